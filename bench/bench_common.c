@@ -0,0 +1,124 @@
+/*
+ * Helpers shared by the benchmarks: timing and a throwaway home directory
+ * with generated global and per-directory configs.
+ */
+
+#include "bench_common.h"
+#include "../src/config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+double bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+void bench_make_dirs(const char* path) {
+    char buffer[PATH_MAX];
+    snprintf(buffer, sizeof(buffer), "%s", path);
+
+    for (char* p = buffer + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(buffer, 0700);
+            *p = '/';
+        }
+    }
+    mkdir(buffer, 0700);
+}
+
+static void remove_tree(const char* path) {
+    char* argv[] = { "rm", "-rf", (char*)path, NULL };
+    pid_t pid;
+    if (posix_spawnp(&pid, "rm", NULL, NULL, argv, environ) == 0) {
+        waitpid(pid, NULL, 0);
+    }
+}
+
+bool bench_home_enter(BenchHome* bench_home) {
+    if (!getcwd(bench_home->start_dir, sizeof(bench_home->start_dir))) {
+        fprintf(stderr, "Error: Failed to get current directory\n");
+        return false;
+    }
+
+    const char* tmpdir = getenv("TMPDIR");
+    snprintf(bench_home->base, sizeof(bench_home->base), "%s/sandbash-bench-XXXXXX",
+             tmpdir && *tmpdir ? tmpdir : "/tmp");
+    if (!mkdtemp(bench_home->base)) {
+        fprintf(stderr, "Error: Failed to create scratch directory: %s\n", strerror(errno));
+        return false;
+    }
+
+    char xdg_config[PATH_MAX];
+    char xdg_cache[PATH_MAX];
+    snprintf(bench_home->home, sizeof(bench_home->home), "%s/home", bench_home->base);
+    snprintf(bench_home->project, sizeof(bench_home->project), "%s/project", bench_home->home);
+    snprintf(bench_home->paths, sizeof(bench_home->paths), "%s/paths", bench_home->home);
+    snprintf(xdg_config, sizeof(xdg_config), "%s/config", bench_home->base);
+    snprintf(xdg_cache, sizeof(xdg_cache), "%s/cache", bench_home->base);
+    bench_make_dirs(bench_home->project);
+    bench_make_dirs(bench_home->paths);
+
+    setenv("HOME", bench_home->home, 1);
+    setenv("XDG_CONFIG_HOME", xdg_config, 1);
+    setenv("XDG_CACHE_HOME", xdg_cache, 1);
+    if (chdir(bench_home->project) != 0) {
+        fprintf(stderr, "Error: Failed to enter %s: %s\n", bench_home->project, strerror(errno));
+        remove_tree(bench_home->base);
+        return false;
+    }
+    return true;
+}
+
+bool bench_home_leave(BenchHome* bench_home) {
+    bool ok = chdir(bench_home->start_dir) == 0;
+    remove_tree(bench_home->base);
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to return to %s\n", bench_home->start_dir);
+    }
+    return ok;
+}
+
+// Write count directory entries, numbered from first, into a config file.
+// The directories are created so that every entry resolves.
+static bool write_config(const char* config_path, const char* paths_dir, int first, int count) {
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", config_path);
+    *strrchr(dir, '/') = '\0';
+    bench_make_dirs(dir);
+
+    FILE* f = fopen(config_path, "w");
+    if (!f) {
+        return false;
+    }
+
+    for (int i = first; i < first + count; i++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/p%04d", paths_dir, i);
+        mkdir(path, 0700);
+        fprintf(f, "%s\n", path);
+    }
+
+    return fclose(f) == 0;
+}
+
+bool bench_write_configs(const BenchHome* bench_home, int global_count, int local_count) {
+    char* global_path = config_get_global_path();
+    char* local_path = config_get_local_path_for_dir(bench_home->project);
+    bool ok = global_path && local_path &&
+              write_config(global_path, bench_home->paths, 0, global_count) &&
+              write_config(local_path, bench_home->paths, global_count, local_count);
+    free(global_path);
+    free(local_path);
+    return ok;
+}
@@ -0,0 +1,36 @@
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include <limits.h>
+#include <stdbool.h>
+
+// Scratch $HOME the benchmarks run in, so the user's config is never touched
+typedef struct {
+    char base[PATH_MAX / 2];
+    char home[PATH_MAX / 2 + 16];
+    // Directory sandbash is run from
+    char project[PATH_MAX];
+    // Parent of the directories listed in the generated configs
+    char paths[PATH_MAX];
+    // Where the process was before bench_home_enter
+    char start_dir[PATH_MAX];
+} BenchHome;
+
+// Get a monotonic timestamp in nanoseconds
+double bench_now_ns(void);
+
+// Create a directory and any missing parents
+void bench_make_dirs(const char* path);
+
+// Create a scratch home under $TMPDIR, point HOME and the XDG directories
+// at it and change into its project directory
+bool bench_home_enter(BenchHome* bench_home);
+
+// Return to the starting directory and remove the scratch home
+bool bench_home_leave(BenchHome* bench_home);
+
+// Write global_count paths to the global config and local_count to the
+// project's config, creating each listed directory
+bool bench_write_configs(const BenchHome* bench_home, int global_count, int local_count);
+
+#endif // BENCH_COMMON_H
@@ -0,0 +1,116 @@
+/*
+ * PathList benchmark: add, lookup, subsumption and removal at 10k entries.
+ *
+ * Half the entries are top-level directories and half are nested one
+ * level below one of them, so dropping subsumed entries should leave
+ * exactly the top-level half.
+ */
+
+#include "bench_common.h"
+#include "../src/config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_ENTRIES 10000
+
+static void report(const char* name, double start_ns, int ops) {
+    double elapsed = bench_now_ns() - start_ns;
+    printf("%-16s %8d ops %12.1f ns/op %10.3f ms total\n", name, ops, elapsed / ops,
+           elapsed / 1e6);
+}
+
+int main(int argc, char* argv[]) {
+    int entries = DEFAULT_ENTRIES;
+    if (argc == 3 && strcmp(argv[1], "--entries") == 0) {
+        entries = atoi(argv[2]);
+    } else if (argc != 1) {
+        printf("Usage: %s [--entries N]\n", argv[0]);
+        return 1;
+    }
+    if (entries < 2) {
+        fprintf(stderr, "Error: Invalid entry count\n");
+        return 1;
+    }
+
+    int top_level = entries / 2;
+    char** paths = malloc(sizeof(char*) * (size_t)entries);
+    if (!paths) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < entries; i++) {
+        char path[PATH_MAX];
+        if (i < top_level) {
+            snprintf(path, sizeof(path), "/home/user/projects/p%05d", i);
+        } else {
+            snprintf(path, sizeof(path), "/home/user/projects/p%05d/build/out%05d",
+                     i % top_level, i);
+        }
+        paths[i] = strdup(path);
+    }
+
+    // Interleave nested and top-level entries, as merged configs would be
+    for (int i = 0; i < entries; i += 2) {
+        char* swap = paths[i / 2];
+        paths[i / 2] = paths[entries - 1 - i / 2];
+        paths[entries - 1 - i / 2] = swap;
+    }
+
+    PathList* list = pathlist_create();
+    if (!list) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 1;
+    }
+
+    printf("PathList with %d entries\n\n", entries);
+
+    double start = bench_now_ns();
+    for (int i = 0; i < entries; i++) {
+        pathlist_add(list, paths[i]);
+    }
+    report("add", start, entries);
+
+    start = bench_now_ns();
+    for (int i = 0; i < entries; i++) {
+        pathlist_add(list, paths[i]);
+    }
+    report("add duplicate", start, entries);
+
+    start = bench_now_ns();
+    int found = 0;
+    for (int i = 0; i < entries; i++) {
+        found += pathlist_contains(list, paths[i]);
+    }
+    report("contains", start, entries);
+
+    PathList* merged = pathlist_create();
+    for (int i = 0; merged && i < entries; i++) {
+        pathlist_add(merged, paths[i]);
+    }
+    start = bench_now_ns();
+    bool dropped = merged && pathlist_drop_subsumed(merged);
+    report("drop subsumed", start, entries);
+
+    start = bench_now_ns();
+    int removed = 0;
+    for (int i = 0; i < entries; i++) {
+        removed += pathlist_remove(list, paths[i]);
+    }
+    report("remove", start, entries);
+
+    bool ok = found == entries && dropped && merged->count == top_level &&
+              removed == entries && list->count == 0;
+    if (!ok) {
+        fprintf(stderr, "Error: Unexpected result (found %d, kept %d, removed %d)\n", found,
+                merged ? merged->count : -1, removed);
+    }
+
+    pathlist_free(list);
+    pathlist_free(merged);
+    for (int i = 0; i < entries; i++) {
+        free(paths[i]);
+    }
+    free(paths);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,379 @@
+/*
+ * Startup-latency benchmark: end-to-end time of `sandbash true` against a
+ * bare `true`.
+ *
+ * Runs in a scratch $HOME so the user's own config is never touched. The
+ * number of configured writable paths is swept from 0 up to
+ * MAX_CONFIG_PATHS, split between the global config, the per-directory
+ * config or both, for every backend that works on this host, with and
+ * without the ruleset cache. Each result goes on one line of the JSON
+ * output so the baseline can be read back without a JSON library.
+ *
+ * With --baseline, a configuration whose p50 overhead exceeds the
+ * baseline's by more than the tolerance fails the run.
+ */
+
+#include "bench_common.h"
+#include "../src/config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define DEFAULT_ITERATIONS 100
+#define DEFAULT_TOLERANCE 0.25
+// Absolute slack so that tiny overheads do not fail on noise
+#define DEFAULT_SLACK_US 200.0
+#define MAX_RESULTS 256
+#define MAX_KEY 128
+
+extern char** environ;
+
+typedef struct {
+    double p50;
+    double p99;
+    double max;
+} Stats;
+
+typedef struct {
+    char key[MAX_KEY];
+    const char* backend;
+    bool cache;
+    int global_paths;
+    int local_paths;
+    Stats stats;
+    double overhead_p50;
+} Result;
+
+typedef struct {
+    char key[MAX_KEY];
+    double overhead_p50;
+} BaselineEntry;
+
+static const char* backends[] = {
+#ifdef __APPLE__
+    "seatbelt",
+#else
+    "landlock",
+    "namespace",
+    "seccomp",
+#endif
+    NULL
+};
+
+// Total configured paths and how they are split between the two configs
+static const int path_counts[] = { 0, 10, 100, 1000 };
+
+typedef enum {
+    SPLIT_GLOBAL,
+    SPLIT_LOCAL,
+    SPLIT_BOTH
+} Split;
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static Stats compute_stats(double* samples, int count) {
+    qsort(samples, (size_t)count, sizeof(double), compare_doubles);
+    Stats stats;
+    stats.p50 = samples[count / 2];
+    stats.p99 = samples[(count * 99) / 100 < count ? (count * 99) / 100 : count - 1];
+    stats.max = samples[count - 1];
+    return stats;
+}
+
+// Run argv once with output discarded; returns elapsed microseconds or -1
+// if it did not exit 0
+static double time_run(char* const argv[], posix_spawn_file_actions_t* actions) {
+    double start = bench_now_ns();
+
+    pid_t pid;
+    if (posix_spawnp(&pid, argv[0], actions, NULL, argv, environ) != 0) {
+        return -1;
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+
+    double elapsed = (bench_now_ns() - start) / 1e3;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? elapsed : -1;
+}
+
+static bool measure(char* const argv[], int iterations, posix_spawn_file_actions_t* actions,
+                    Stats* stats) {
+    double* samples = malloc(sizeof(double) * (size_t)iterations);
+    if (!samples) {
+        return false;
+    }
+
+    // Warm up page cache and the ruleset cache
+    if (time_run(argv, actions) < 0) {
+        free(samples);
+        return false;
+    }
+
+    for (int i = 0; i < iterations; i++) {
+        samples[i] = time_run(argv, actions);
+        if (samples[i] < 0) {
+            free(samples);
+            return false;
+        }
+    }
+
+    *stats = compute_stats(samples, iterations);
+    free(samples);
+    return true;
+}
+
+static int load_baseline(const char* path, BaselineEntry* entries) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+
+    int count = 0;
+    char line[1024];
+    while (count < MAX_RESULTS && fgets(line, sizeof(line), f)) {
+        char* key = strstr(line, "\"key\": \"");
+        char* overhead = strstr(line, "\"overhead_p50_us\": ");
+        if (!key || !overhead) {
+            continue;
+        }
+        key += strlen("\"key\": \"");
+        char* end = strchr(key, '"');
+        if (!end || (size_t)(end - key) >= MAX_KEY) {
+            continue;
+        }
+        memcpy(entries[count].key, key, (size_t)(end - key));
+        entries[count].key[end - key] = '\0';
+        entries[count].overhead_p50 = strtod(overhead + strlen("\"overhead_p50_us\": "), NULL);
+        count++;
+    }
+
+    fclose(f);
+    return count;
+}
+
+static bool write_results(const char* path, int iterations, const Stats* bare,
+                          const Result* results, int count) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        return false;
+    }
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"iterations\": %d,\n", iterations);
+    fprintf(f, "  \"bare\": {\"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f},\n",
+            bare->p50, bare->p99, bare->max);
+    fprintf(f, "  \"results\": [\n");
+    for (int i = 0; i < count; i++) {
+        const Result* r = &results[i];
+        fprintf(f, "    {\"key\": \"%s\", \"backend\": \"%s\", \"cache\": %s, "
+                   "\"global_paths\": %d, \"local_paths\": %d, "
+                   "\"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f, "
+                   "\"overhead_p50_us\": %.1f}%s\n",
+                r->key, r->backend, r->cache ? "true" : "false",
+                r->global_paths, r->local_paths,
+                r->stats.p50, r->stats.p99, r->stats.max, r->overhead_p50,
+                i + 1 < count ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+
+    return fclose(f) == 0;
+}
+
+static void print_usage(const char* program_name) {
+    printf("Usage: %s [OPTIONS]\n", program_name);
+    printf("\nOptions:\n");
+    printf("  --sandbash PATH      sandbash binary to measure (default ./sandbash)\n");
+    printf("  --output FILE        Write results as JSON to FILE\n");
+    printf("  --baseline FILE      Fail if overhead regresses past FILE\n");
+    printf("  --iterations N       Runs per configuration (default %d)\n", DEFAULT_ITERATIONS);
+    printf("  --tolerance F        Allowed relative regression (default %.2f)\n",
+           DEFAULT_TOLERANCE);
+}
+
+int main(int argc, char* argv[]) {
+    const char* sandbash_arg = "./sandbash";
+    const char* output_path = NULL;
+    const char* baseline_path = NULL;
+    int iterations = DEFAULT_ITERATIONS;
+    double tolerance = DEFAULT_TOLERANCE;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--sandbash") == 0 && i + 1 < argc) {
+            sandbash_arg = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else {
+            print_usage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    if (iterations <= 0) {
+        fprintf(stderr, "Error: Invalid iteration count\n");
+        return 1;
+    }
+
+    char sandbash[PATH_MAX];
+    if (!realpath(sandbash_arg, sandbash)) {
+        fprintf(stderr, "Error: Cannot find sandbash binary: %s\n", sandbash_arg);
+        return 1;
+    }
+
+    BenchHome bench_home;
+    if (!bench_home_enter(&bench_home)) {
+        return 1;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    Stats bare;
+    char* bare_argv[] = { "true", NULL };
+    if (!measure(bare_argv, iterations, &actions, &bare)) {
+        fprintf(stderr, "Error: Failed to run true\n");
+        bench_home_leave(&bench_home);
+        return 1;
+    }
+    printf("bare true: p50 %.0fus  p99 %.0fus  max %.0fus\n\n", bare.p50, bare.p99, bare.max);
+    printf("%-10s %-6s %7s %7s %9s %9s %9s %10s\n", "backend", "cache", "global", "local",
+           "p50(us)", "p99(us)", "max(us)", "overhead");
+
+    Result* results = calloc(MAX_RESULTS, sizeof(Result));
+    int result_count = 0;
+
+    for (int b = 0; backends[b] && results; b++) {
+        char backend_arg[64];
+        snprintf(backend_arg, sizeof(backend_arg), "--backend=%s", backends[b]);
+
+        // Skip backends this host cannot use
+        char* probe_argv[] = { sandbash, backend_arg, "true", NULL };
+        if (time_run(probe_argv, &actions) < 0) {
+            printf("%-10s (not available)\n", backends[b]);
+            continue;
+        }
+
+        for (int cache = 1; cache >= 0; cache--) {
+            for (size_t c = 0; c < sizeof(path_counts) / sizeof(path_counts[0]); c++) {
+                for (Split split = SPLIT_GLOBAL; split <= SPLIT_BOTH; split++) {
+                    int total = path_counts[c];
+                    if (total == 0 && split != SPLIT_GLOBAL) {
+                        continue;
+                    }
+
+                    int global_count = split == SPLIT_GLOBAL ? total :
+                                       split == SPLIT_LOCAL ? 0 : total / 2;
+                    int local_count = total - global_count;
+                    if (global_count > MAX_CONFIG_PATHS || local_count > MAX_CONFIG_PATHS ||
+                        result_count >= MAX_RESULTS) {
+                        continue;
+                    }
+
+                    if (!bench_write_configs(&bench_home, global_count, local_count)) {
+                        fprintf(stderr, "Error: Failed to write configs\n");
+                        continue;
+                    }
+
+                    char* run_argv[] = { sandbash, backend_arg, "true", NULL, NULL };
+                    if (!cache) {
+                        run_argv[2] = "--no-cache";
+                        run_argv[3] = "true";
+                    }
+
+                    Result* r = &results[result_count];
+                    if (!measure(run_argv, iterations, &actions, &r->stats)) {
+                        fprintf(stderr, "Error: %s failed\n", backends[b]);
+                        continue;
+                    }
+
+                    r->backend = backends[b];
+                    r->cache = cache;
+                    r->global_paths = global_count;
+                    r->local_paths = local_count;
+                    r->overhead_p50 = r->stats.p50 - bare.p50;
+                    snprintf(r->key, sizeof(r->key), "%s/%s/g%d/l%d", r->backend,
+                             cache ? "cache" : "nocache", global_count, local_count);
+                    result_count++;
+
+                    printf("%-10s %-6s %7d %7d %9.0f %9.0f %9.0f %10.0f\n", r->backend,
+                           cache ? "yes" : "no", global_count, local_count,
+                           r->stats.p50, r->stats.p99, r->stats.max, r->overhead_p50);
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+
+    posix_spawn_file_actions_destroy(&actions);
+    if (!bench_home_leave(&bench_home)) {
+        free(results);
+        return 1;
+    }
+
+    if (!results) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 1;
+    }
+
+    if (output_path) {
+        if (!write_results(output_path, iterations, &bare, results, result_count)) {
+            fprintf(stderr, "Error: Failed to write %s\n", output_path);
+            free(results);
+            return 1;
+        }
+        printf("\nResults written to %s\n", output_path);
+    }
+
+    int regressions = 0;
+    if (baseline_path) {
+        BaselineEntry* baseline = calloc(MAX_RESULTS, sizeof(BaselineEntry));
+        int baseline_count = baseline ? load_baseline(baseline_path, baseline) : -1;
+
+        if (baseline_count < 0) {
+            printf("\nNo baseline at %s; run `make bench-baseline` to record one\n",
+                   baseline_path);
+        } else {
+            for (int i = 0; i < result_count; i++) {
+                for (int j = 0; j < baseline_count; j++) {
+                    if (strcmp(results[i].key, baseline[j].key) != 0) {
+                        continue;
+                    }
+                    double limit = baseline[j].overhead_p50 * (1.0 + tolerance) + DEFAULT_SLACK_US;
+                    if (results[i].overhead_p50 > limit) {
+                        printf("REGRESSION %s: overhead %.0fus, baseline %.0fus (limit %.0fus)\n",
+                               results[i].key, results[i].overhead_p50,
+                               baseline[j].overhead_p50, limit);
+                        regressions++;
+                    }
+                    break;
+                }
+            }
+            printf("\n%d regression(s) against %s\n", regressions, baseline_path);
+        }
+        free(baseline);
+    }
+
+    free(results);
+    return regressions > 0 ? 1 : 0;
+}
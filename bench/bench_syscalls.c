@@ -0,0 +1,342 @@
+/*
+ * Filesystem-syscall benchmark: cost per call of open, stat, write and
+ * rename inside a sandbash sandbox compared with the same calls outside.
+ *
+ * The driver sweeps the number of configured writable paths and the depth
+ * of the directory tree the calls are made in, and re-runs itself as a
+ * worker for each configuration, either directly or under sandbash. The
+ * worker times each syscall in a loop and prints ns/op on one line.
+ *
+ * It lives in bench/ rather than next to test_escape.c at the top level:
+ * it shares the scratch home setup in bench_common.c and the Makefile
+ * rules with the startup benchmark, and test_escape.c is not built.
+ */
+
+#include "bench_common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define DEFAULT_ITERATIONS 20000
+#define MAX_RESULTS 128
+
+extern char** environ;
+
+typedef enum {
+    OP_OPEN,
+    OP_STAT,
+    OP_WRITE,
+    OP_RENAME,
+    OP_COUNT
+} Op;
+
+static const char* op_names[OP_COUNT] = { "open", "stat", "write", "rename" };
+
+typedef struct {
+    const char* backend;
+    int paths;
+    int depth;
+    double ns_per_op[OP_COUNT];
+} Result;
+
+static const char* backends[] = {
+#ifdef __APPLE__
+    "seatbelt",
+#else
+    "landlock",
+    "namespace",
+    "seccomp",
+#endif
+    NULL
+};
+
+static const int path_counts[] = { 0, 10, 100, 1000 };
+static const int depths[] = { 1, 8, 32 };
+
+#define COUNT_OF(array) (sizeof(array) / sizeof((array)[0]))
+
+// Time one syscall mix in the leaf directory; returns ns/op or -1
+static double time_op(Op op, const char* leaf, int iterations) {
+    char file[PATH_MAX];
+    char other[PATH_MAX];
+    snprintf(file, sizeof(file), "%s/f", leaf);
+    snprintf(other, sizeof(other), "%s/g", leaf);
+
+    int fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+
+    char buffer[64] = { 0 };
+    struct stat st;
+    bool ok = true;
+    double start = bench_now_ns();
+
+    for (int i = 0; i < iterations && ok; i++) {
+        switch (op) {
+            case OP_OPEN: {
+                int f = open(file, O_WRONLY | O_CREAT, 0600);
+                ok = f >= 0 && close(f) == 0;
+                break;
+            }
+            case OP_STAT:
+                ok = stat(file, &st) == 0;
+                break;
+            case OP_WRITE:
+                ok = pwrite(fd, buffer, sizeof(buffer), 0) == (ssize_t)sizeof(buffer);
+                break;
+            case OP_RENAME:
+                // Alternate so the source always exists
+                ok = (i % 2 == 0 ? rename(file, other) : rename(other, file)) == 0;
+                break;
+            case OP_COUNT:
+                break;
+        }
+    }
+
+    double elapsed = bench_now_ns() - start;
+    close(fd);
+    unlink(other);
+    return ok ? elapsed / iterations : -1;
+}
+
+// Build a tree depth levels deep under the current directory, run every
+// syscall mix at the bottom and print the results
+static int run_worker(int depth, int iterations) {
+    char leaf[PATH_MAX] = "tree";
+    mkdir(leaf, 0700);
+    for (int level = 1; level < depth; level++) {
+        size_t len = strlen(leaf);
+        snprintf(leaf + len, sizeof(leaf) - len, "/d%02d", level);
+        if (mkdir(leaf, 0700) != 0 && errno != EEXIST) {
+            fprintf(stderr, "Error: Failed to create %s: %s\n", leaf, strerror(errno));
+            return 1;
+        }
+    }
+
+    for (Op op = 0; op < OP_COUNT; op++) {
+        // Warm the dentry cache before timing
+        time_op(op, leaf, iterations / 10 + 1);
+        double ns = time_op(op, leaf, iterations);
+        if (ns < 0) {
+            fprintf(stderr, "Error: %s failed in %s: %s\n", op_names[op], leaf, strerror(errno));
+            return 1;
+        }
+        printf("%s%.1f", op > 0 ? " " : "", ns);
+    }
+    printf("\n");
+    return 0;
+}
+
+// Run argv and parse the worker's line of ns/op figures
+static bool run_measurement(char* const argv[], Result* result) {
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) {
+        return false;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, pipe_fds[0]);
+    posix_spawn_file_actions_addclose(&actions, pipe_fds[1]);
+
+    pid_t pid;
+    int spawn_error = posix_spawnp(&pid, argv[0], &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(pipe_fds[1]);
+    if (spawn_error != 0) {
+        close(pipe_fds[0]);
+        return false;
+    }
+
+    char line[256] = { 0 };
+    FILE* f = fdopen(pipe_fds[0], "r");
+    bool have_line = f && fgets(line, sizeof(line), f);
+    if (f) {
+        fclose(f);
+    } else {
+        close(pipe_fds[0]);
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+
+    return have_line && WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+           sscanf(line, "%lf %lf %lf %lf", &result->ns_per_op[OP_OPEN],
+                  &result->ns_per_op[OP_STAT], &result->ns_per_op[OP_WRITE],
+                  &result->ns_per_op[OP_RENAME]) == OP_COUNT;
+}
+
+static void print_result(const Result* r) {
+    printf("%-10s %6d %6d", r->backend, r->paths, r->depth);
+    for (Op op = 0; op < OP_COUNT; op++) {
+        printf(" %10.0f", r->ns_per_op[op]);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+static bool write_results(const char* path, int iterations, const Result* results, int count) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        return false;
+    }
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"iterations\": %d,\n", iterations);
+    fprintf(f, "  \"results\": [\n");
+    for (int i = 0; i < count; i++) {
+        const Result* r = &results[i];
+        fprintf(f, "    {\"backend\": \"%s\", \"paths\": %d, \"depth\": %d", r->backend,
+                r->paths, r->depth);
+        for (Op op = 0; op < OP_COUNT; op++) {
+            fprintf(f, ", \"%s_ns\": %.1f", op_names[op], r->ns_per_op[op]);
+        }
+        fprintf(f, "}%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+
+    return fclose(f) == 0;
+}
+
+static void print_usage(const char* program_name) {
+    printf("Usage: %s [OPTIONS]\n", program_name);
+    printf("\nOptions:\n");
+    printf("  --sandbash PATH      sandbash binary to measure (default ./sandbash)\n");
+    printf("  --output FILE        Write results as JSON to FILE\n");
+    printf("  --iterations N       Calls per syscall and configuration (default %d)\n",
+           DEFAULT_ITERATIONS);
+}
+
+int main(int argc, char* argv[]) {
+    const char* sandbash_arg = "./sandbash";
+    const char* output_path = NULL;
+    int iterations = DEFAULT_ITERATIONS;
+
+    // Internal: run the syscall mixes in the current directory
+    if (argc == 4 && strcmp(argv[1], "--worker") == 0) {
+        return run_worker(atoi(argv[2]), atoi(argv[3]));
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--sandbash") == 0 && i + 1 < argc) {
+            sandbash_arg = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else {
+            print_usage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    if (iterations <= 0) {
+        fprintf(stderr, "Error: Invalid iteration count\n");
+        return 1;
+    }
+
+    char sandbash[PATH_MAX];
+    char self[PATH_MAX];
+    if (!realpath(sandbash_arg, sandbash)) {
+        fprintf(stderr, "Error: Cannot find sandbash binary: %s\n", sandbash_arg);
+        return 1;
+    }
+    if (!realpath(argv[0], self)) {
+        fprintf(stderr, "Error: Cannot find own binary: %s\n", argv[0]);
+        return 1;
+    }
+
+    BenchHome bench_home;
+    if (!bench_home_enter(&bench_home)) {
+        return 1;
+    }
+
+    char iterations_arg[16];
+    snprintf(iterations_arg, sizeof(iterations_arg), "%d", iterations);
+
+    Result results[MAX_RESULTS];
+    int result_count = 0;
+
+    printf("ns/op by backend, configured paths and tree depth\n\n");
+    printf("%-10s %6s %6s", "backend", "paths", "depth");
+    for (Op op = 0; op < OP_COUNT; op++) {
+        printf(" %10s", op_names[op]);
+    }
+    printf("\n");
+
+    // Outside any sandbox; the configs make no difference here
+    for (size_t d = 0; d < COUNT_OF(depths) && result_count < MAX_RESULTS; d++) {
+        char depth_arg[16];
+        snprintf(depth_arg, sizeof(depth_arg), "%d", depths[d]);
+        char* worker_argv[] = { self, "--worker", depth_arg, iterations_arg, NULL };
+
+        Result* r = &results[result_count];
+        r->backend = "none";
+        r->paths = 0;
+        r->depth = depths[d];
+        if (!run_measurement(worker_argv, r)) {
+            fprintf(stderr, "Error: Unsandboxed run failed at depth %d\n", depths[d]);
+            continue;
+        }
+        print_result(r);
+        result_count++;
+    }
+
+    for (int b = 0; backends[b]; b++) {
+        char backend_arg[64];
+        snprintf(backend_arg, sizeof(backend_arg), "--backend=%s", backends[b]);
+
+        for (size_t c = 0; c < COUNT_OF(path_counts); c++) {
+            if (!bench_write_configs(&bench_home, path_counts[c], 0)) {
+                fprintf(stderr, "Error: Failed to write configs\n");
+                continue;
+            }
+
+            for (size_t d = 0; d < COUNT_OF(depths) && result_count < MAX_RESULTS; d++) {
+                char depth_arg[16];
+                snprintf(depth_arg, sizeof(depth_arg), "%d", depths[d]);
+                char* sandbox_argv[] = { sandbash, backend_arg, self, "--worker", depth_arg,
+                                         iterations_arg, NULL };
+
+                Result* r = &results[result_count];
+                r->backend = backends[b];
+                r->paths = path_counts[c];
+                r->depth = depths[d];
+                if (!run_measurement(sandbox_argv, r)) {
+                    printf("%-10s (not available)\n", backends[b]);
+                    // Skip the rest of this backend
+                    c = COUNT_OF(path_counts);
+                    break;
+                }
+                print_result(r);
+                result_count++;
+            }
+        }
+    }
+
+    if (!bench_home_leave(&bench_home)) {
+        return 1;
+    }
+
+    if (output_path) {
+        if (!write_results(output_path, iterations, results, result_count)) {
+            fprintf(stderr, "Error: Failed to write %s\n", output_path);
+            return 1;
+        }
+        printf("\nResults written to %s\n", output_path);
+    }
+
+    return 0;
+}
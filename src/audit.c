@@ -0,0 +1,296 @@
+/*
+ * Audit log for --audit: writes outside the writable paths are allowed and
+ * recorded instead of denied.
+ *
+ * Supervisor threads push events into a bounded lock-free ring (one
+ * sequence number per slot, claimed with a compare-and-swap on the head),
+ * so recording a write costs a clock read and a path copy while the
+ * sandboxed process waits for its answer. A drainer thread formats the
+ * events as JSON lines in batches and counts them by path prefix for the
+ * summary printed at exit. When the ring is full, producers yield until
+ * the drainer catches up rather than drop events.
+ */
+
+#include "audit.h"
+#include "config.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+// Power of two, so positions map to slots with a mask
+#define RING_SIZE 1024
+#define DRAIN_INTERVAL_NS (2 * 1000 * 1000)
+#define SUMMARY_PREFIXES 10
+// Components kept below $HOME (or / outside it) when grouping paths
+#define PREFIX_DEPTH 2
+
+typedef struct {
+    // pos + 1 once the event at pos is written, pos + RING_SIZE once read
+    atomic_size_t sequence;
+    struct timespec time;
+    pid_t pid;
+    const char* syscall;
+    char path[PATH_MAX];
+} AuditSlot;
+
+struct AuditLog {
+    FILE* file;
+    char* path;
+    AuditSlot* slots;
+    atomic_size_t head;
+    atomic_bool stopping;
+    pthread_t drainer;
+    bool started;
+    // Drainer only
+    size_t tail;
+    unsigned long events;
+    PathList* prefixes;
+    unsigned long* counts;
+    int count_capacity;
+};
+
+AuditLog* audit_log_open(const char* path) {
+    AuditLog* log = calloc(1, sizeof(AuditLog));
+    if (!log) {
+        return NULL;
+    }
+
+    log->path = strdup(path);
+    log->slots = calloc(RING_SIZE, sizeof(AuditSlot));
+    log->prefixes = pathlist_create();
+    log->file = fopen(path, "we");
+    if (!log->path || !log->slots || !log->prefixes || !log->file) {
+        fprintf(stderr, "Error: Failed to open audit log %s: %s\n", path, strerror(errno));
+        if (log->file) {
+            fclose(log->file);
+        }
+        free(log->path);
+        free(log->slots);
+        pathlist_free(log->prefixes);
+        free(log);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < RING_SIZE; i++) {
+        atomic_init(&log->slots[i].sequence, i);
+    }
+    atomic_init(&log->head, 0);
+    atomic_init(&log->stopping, false);
+    return log;
+}
+
+int audit_log_fd(const AuditLog* log) {
+    return log ? fileno(log->file) : -1;
+}
+
+void audit_log_record(AuditLog* log, pid_t pid, const char* syscall, const char* path) {
+    if (!log || atomic_load_explicit(&log->stopping, memory_order_relaxed)) {
+        return;
+    }
+
+    size_t pos = atomic_load_explicit(&log->head, memory_order_relaxed);
+    AuditSlot* slot;
+    for (;;) {
+        slot = &log->slots[pos & (RING_SIZE - 1)];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (sequence == pos) {
+            if (atomic_compare_exchange_weak_explicit(&log->head, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (sequence < pos) {
+            // Full: the slot still holds an event from one lap ago
+            sched_yield();
+            pos = atomic_load_explicit(&log->head, memory_order_relaxed);
+        } else {
+            pos = atomic_load_explicit(&log->head, memory_order_relaxed);
+        }
+    }
+
+    clock_gettime(CLOCK_REALTIME, &slot->time);
+    slot->pid = pid;
+    slot->syscall = syscall;
+    snprintf(slot->path, sizeof(slot->path), "%s", path);
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+}
+
+// Group a path by its directory, cut to PREFIX_DEPTH components below
+// $HOME or the root, so one suggestion covers a whole cache or tool dir
+static void path_prefix(const char* path, char out[PATH_MAX]) {
+    const char* home = getenv("HOME");
+    size_t base = home && path_is_within(path, home) ? strlen(home) : 0;
+
+    snprintf(out, PATH_MAX, "%s", path);
+    char* slash = strrchr(out, '/');
+    // Writes directly into $HOME or / group by the entry itself
+    if (slash && (size_t)(slash - out) > base) {
+        *slash = '\0';
+    }
+
+    int depth = 0;
+    for (char* p = out + base; *p; p++) {
+        if (*p == '/' && ++depth > PREFIX_DEPTH) {
+            *p = '\0';
+            break;
+        }
+    }
+}
+
+static void count_prefix(AuditLog* log, const char* path) {
+    char prefix[PATH_MAX];
+    path_prefix(path, prefix);
+
+    int index = pathlist_find(log->prefixes, prefix);
+    if (index < 0) {
+        if (!pathlist_add(log->prefixes, prefix)) {
+            return;
+        }
+        index = log->prefixes->count - 1;
+        if (index >= log->count_capacity) {
+            int capacity = log->count_capacity ? log->count_capacity * 2 : 64;
+            unsigned long* counts = realloc(log->counts, sizeof(unsigned long) * (size_t)capacity);
+            if (!counts) {
+                return;
+            }
+            log->counts = counts;
+            log->count_capacity = capacity;
+        }
+        log->counts[index] = 0;
+    }
+    log->counts[index]++;
+}
+
+// Write every event recorded so far; returns how many there were
+static size_t drain(AuditLog* log) {
+    size_t drained = 0;
+    for (;;) {
+        AuditSlot* slot = &log->slots[log->tail & (RING_SIZE - 1)];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (sequence != log->tail + 1) {
+            break;
+        }
+
+        fprintf(log->file, "{\"time\":%lld.%06ld,\"pid\":%d,\"syscall\":",
+                (long long)slot->time.tv_sec, slot->time.tv_nsec / 1000, (int)slot->pid);
+        write_json_string(log->file, slot->syscall);
+        fprintf(log->file, ",\"path\":");
+        write_json_string(log->file, slot->path);
+        fprintf(log->file, "}\n");
+        count_prefix(log, slot->path);
+
+        atomic_store_explicit(&slot->sequence, log->tail + RING_SIZE, memory_order_release);
+        log->tail++;
+        log->events++;
+        drained++;
+    }
+    if (drained > 0) {
+        fflush(log->file);
+    }
+    return drained;
+}
+
+static void* drainer_thread(void* arg) {
+    AuditLog* log = arg;
+    while (!atomic_load(&log->stopping)) {
+        if (drain(log) == 0) {
+            struct timespec interval = { 0, DRAIN_INTERVAL_NS };
+            nanosleep(&interval, NULL);
+        }
+    }
+    return NULL;
+}
+
+bool audit_log_start(AuditLog* log) {
+    if (!log || pthread_create(&log->drainer, NULL, drainer_thread, log) != 0) {
+        return false;
+    }
+    log->started = true;
+    return true;
+}
+
+static const AuditLog* sort_log;
+
+static int compare_counts(const void* a, const void* b) {
+    unsigned long count_a = sort_log->counts[*(const int*)a];
+    unsigned long count_b = sort_log->counts[*(const int*)b];
+    if (count_a != count_b) {
+        return count_a < count_b ? 1 : -1;
+    }
+    return strcmp(sort_log->prefixes->paths[*(const int*)a],
+                  sort_log->prefixes->paths[*(const int*)b]);
+}
+
+static void print_summary(AuditLog* log) {
+    fprintf(stderr, "Audit: %lu write(s) outside the writable paths, logged to %s\n",
+            log->events, log->path);
+    if (log->events == 0) {
+        return;
+    }
+
+    int count = log->prefixes->count;
+    int* order = malloc(sizeof(int) * (size_t)count);
+    if (!order) {
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    sort_log = log;
+    qsort(order, (size_t)count, sizeof(int), compare_counts);
+
+    int shown = count < SUMMARY_PREFIXES ? count : SUMMARY_PREFIXES;
+    for (int i = 0; i < shown; i++) {
+        fprintf(stderr, "  %6lu  %s\n", log->counts[order[i]], log->prefixes->paths[order[i]]);
+    }
+    if (count > shown) {
+        fprintf(stderr, "  ... and %d more\n", count - shown);
+    }
+
+    // Suggest the shown prefixes, minus those inside another one and
+    // those, like $HOME itself after a mkdir -p, that would open up $HOME
+    const char* home = getenv("HOME");
+    PathList* suggested = pathlist_create();
+    for (int i = 0; suggested && i < shown; i++) {
+        const char* prefix = log->prefixes->paths[order[i]];
+        if (!home || !path_is_within(home, prefix)) {
+            pathlist_add(suggested, prefix);
+        }
+    }
+    if (suggested && pathlist_drop_subsumed(suggested) && suggested->count > 0) {
+        fprintf(stderr, "To allow these writes:\n");
+        for (int i = 0; i < shown; i++) {
+            const char* prefix = log->prefixes->paths[order[i]];
+            if (pathlist_find(suggested, prefix) >= 0) {
+                fprintf(stderr, "  sandbash --add-path %s\n", prefix);
+            }
+        }
+    }
+    pathlist_free(suggested);
+    free(order);
+}
+
+void audit_log_close(AuditLog* log) {
+    if (!log) {
+        return;
+    }
+
+    atomic_store(&log->stopping, true);
+    if (log->started) {
+        pthread_join(log->drainer, NULL);
+    }
+    drain(log);
+    fclose(log->file);
+    log->file = NULL;
+
+    print_summary(log);
+}
@@ -0,0 +1,27 @@
+#ifndef AUDIT_H
+#define AUDIT_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+typedef struct AuditLog AuditLog;
+
+// Create or truncate the JSON lines file that audited writes go to
+AuditLog* audit_log_open(const char* path);
+
+// Descriptor of the log file, to keep open when closing inherited ones
+int audit_log_fd(const AuditLog* log);
+
+// Start the thread that writes recorded events to the file
+bool audit_log_start(AuditLog* log);
+
+// Record a write the policy would have denied. Lock-free; safe to call
+// from any number of threads.
+void audit_log_record(AuditLog* log, pid_t pid, const char* syscall, const char* path);
+
+// Write out what is left, close the file and print a summary of the most
+// frequent path prefixes to stderr. Threads still recording afterwards
+// are ignored, so the log is not freed; call this just before exiting.
+void audit_log_close(AuditLog* log);
+
+#endif // AUDIT_H
@@ -0,0 +1,399 @@
+/*
+ * On-disk cache of the merged, resolved writable path set.
+ *
+ * Entries live in $XDG_CONFIG_HOME/sandbash/rulesets/<hash> and are keyed by
+ * the working directory, $HOME, the --allow-write arguments and the
+ * identity (device, inode, size, mtime) of the global and per-directory
+ * config files, those of the ancestors included, along with the variables
+ * that move preset directories. A
+ * hit skips config parsing and every realpath() call. Only the resolved
+ * path set is stored: every backend compiles its rules from it in a single
+ * pass, which is cheap next to resolving it.
+ *
+ * Editing a config file invalidates its entries. Retargeting a symlink
+ * named in a config does not, so --no-cache is the escape hatch.
+ *
+ * An entry decides what a sandbox may write, and its key is built from
+ * state any sandbox can read, so whoever can write an entry can widen
+ * another directory's sandbox. Entries are therefore kept next to the
+ * configs, which must already be out of every sandbox's reach, rather
+ * than under $XDG_CACHE_HOME, which sandboxes are often allowed to write.
+ * An entry is still neither stored nor used when the policy it holds
+ * could write to it.
+ */
+
+#include "cache.h"
+#include "pattern.h"
+#include "preset.h"
+#include "trace.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define CACHE_MAGIC "sandbash-cache 1\n"
+#define CACHE_SEPARATOR "--\n"
+
+#ifdef __APPLE__
+#define ST_MTIME_NSEC(st) ((st).st_mtimespec.tv_nsec)
+#else
+#define ST_MTIME_NSEC(st) ((st).st_mtim.tv_nsec)
+#endif
+
+typedef struct {
+    char* data;
+    size_t len;
+    size_t capacity;
+} KeyBuffer;
+
+static bool key_append(KeyBuffer* key, const char* fmt, ...) {
+    va_list args;
+    for (;;) {
+        va_start(args, fmt);
+        int needed = vsnprintf(key->data + key->len, key->capacity - key->len, fmt, args);
+        va_end(args);
+
+        if (needed < 0) {
+            return false;
+        }
+        if ((size_t)needed < key->capacity - key->len) {
+            key->len += (size_t)needed;
+            return true;
+        }
+
+        size_t new_capacity = key->capacity * 2 + (size_t)needed;
+        char* new_data = realloc(key->data, new_capacity);
+        if (!new_data) {
+            return false;
+        }
+        key->data = new_data;
+        key->capacity = new_capacity;
+    }
+}
+
+static bool key_append_file(KeyBuffer* key, const char* label, const char* path) {
+    struct stat st;
+    if (!path || stat(path, &st) != 0) {
+        return key_append(key, "%s %s missing\n", label, path ? path : "");
+    }
+    return key_append(key, "%s %s %llu %llu %lld %lld.%09ld\n", label, path,
+                      (unsigned long long)st.st_dev, (unsigned long long)st.st_ino,
+                      (long long)st.st_size, (long long)st.st_mtime,
+                      (long)ST_MTIME_NSEC(st));
+}
+
+// Build the full cache key. The first slot_len bytes name the invocation
+// (directory, $HOME, CLI paths) and pick the cache file; the rest records
+// config file state, so editing a config overwrites the same entry.
+// Returns NULL if the state cannot be cached.
+static char* build_key(const char* current_dir, const PathList* cli_args, size_t* slot_len) {
+    KeyBuffer key = { malloc(1024), 0, 1024 };
+    if (!key.data) {
+        return NULL;
+    }
+
+    const char* home = getenv("HOME");
+    bool ok = key_append(&key, "dir %s\nhome %s\n", current_dir, home ? home : "");
+
+    for (int i = 0; ok && cli_args && i < cli_args->count; i++) {
+        // The key is line-based
+        if (strchr(cli_args->paths[i], '\n')) {
+            ok = false;
+            break;
+        }
+        ok = key_append(&key, "cli %s\n", cli_args->paths[i]);
+    }
+    *slot_len = key.len;
+
+    // Presets in the config files follow these
+    for (int i = 0; ok && preset_env_vars[i]; i++) {
+        const char* value = getenv(preset_env_vars[i]);
+        if (value && !strchr(value, '\n')) {
+            ok = key_append(&key, "env %s=%s\n", preset_env_vars[i], value);
+        }
+    }
+
+    char* global_path = config_get_global_path();
+    char* local_path = config_get_local_path_for_dir(current_dir);
+
+    ok = ok && key_append_file(&key, "global", global_path) &&
+         key_append_file(&key, "local", local_path);
+
+    free(global_path);
+    free(local_path);
+
+    // A config added above the directory changes this list
+    PathList* inherited = config_inherited_dirs(current_dir);
+    ok = ok && inherited;
+    for (int i = 0; ok && i < inherited->count; i++) {
+        char* path = config_get_local_path_for_dir(inherited->paths[i]);
+        ok = key_append_file(&key, "inherited", path);
+        free(path);
+    }
+    pathlist_free(inherited);
+
+    if (!ok) {
+        free(key.data);
+        return NULL;
+    }
+    return key.data;
+}
+
+static char* get_cache_dir(void) {
+    char* xdg_config = get_xdg_config_dir();
+    if (!xdg_config) {
+        return NULL;
+    }
+
+    char* dir = malloc(PATH_MAX);
+    if (dir) {
+        snprintf(dir, PATH_MAX, "%s/sandbash/rulesets", xdg_config);
+    }
+    free(xdg_config);
+    return dir;
+}
+
+// Check whether a sandbox with these writable paths could write to dir or
+// anything in it
+static bool policy_covers(const PathList* paths, const char* dir) {
+    for (int i = 0; i < paths->count; i++) {
+        if (path_is_within(dir, paths->paths[i]) || path_is_within(paths->paths[i], dir)) {
+            return true;
+        }
+    }
+    PatternSet* patterns = pattern_set_compile(paths);
+    bool covered = !patterns || pattern_set_match(patterns, dir) != PATTERN_NONE;
+    pattern_set_free(patterns);
+    return covered;
+}
+
+static char* get_cache_file(const char* cache_dir, const char* key, size_t slot_len) {
+    char* slot = strndup(key, slot_len);
+    char* hash = slot ? compute_path_hash(slot) : NULL;
+    free(slot);
+    if (!hash) {
+        return NULL;
+    }
+
+    char* filepath = malloc(PATH_MAX);
+    if (filepath) {
+        snprintf(filepath, PATH_MAX, "%s/%s", cache_dir, hash);
+    }
+    free(hash);
+    return filepath;
+}
+
+static char* read_file(const char* filepath, size_t* out_len) {
+    FILE* f = fopen(filepath, "r");
+    if (!f) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0 || st.st_size <= 0) {
+        fclose(f);
+        return NULL;
+    }
+
+    char* data = malloc((size_t)st.st_size + 1);
+    if (!data) {
+        fclose(f);
+        return NULL;
+    }
+
+    size_t len = fread(data, 1, (size_t)st.st_size, f);
+    fclose(f);
+    data[len] = '\0';
+    *out_len = len;
+    return data;
+}
+
+PathList* cache_load(const char* current_dir, const PathList* cli_args) {
+    if (!current_dir) {
+        return NULL;
+    }
+
+    char* cache_dir = get_cache_dir();
+    if (!cache_dir) {
+        return NULL;
+    }
+
+    // A cache the sandboxed command could write to cannot be trusted
+    if (path_is_within(cache_dir, current_dir)) {
+        free(cache_dir);
+        return NULL;
+    }
+
+    size_t slot_len = 0;
+    char* key = build_key(current_dir, cli_args, &slot_len);
+    char* filepath = key ? get_cache_file(cache_dir, key, slot_len) : NULL;
+    if (!filepath) {
+        free(key);
+        free(cache_dir);
+        return NULL;
+    }
+
+    size_t len = 0;
+    char* data = read_file(filepath, &len);
+    free(filepath);
+    if (!data) {
+        free(key);
+        free(cache_dir);
+        return NULL;
+    }
+
+    // Verify the stored key in full; the file name is only a hash of it
+    size_t magic_len = strlen(CACHE_MAGIC);
+    size_t key_len = strlen(key);
+    size_t sep_len = strlen(CACHE_SEPARATOR);
+    if (len < magic_len + key_len + sep_len ||
+        memcmp(data, CACHE_MAGIC, magic_len) != 0 ||
+        memcmp(data + magic_len, key, key_len) != 0 ||
+        memcmp(data + magic_len + key_len, CACHE_SEPARATOR, sep_len) != 0) {
+        free(data);
+        free(key);
+        free(cache_dir);
+        return NULL;
+    }
+    free(key);
+
+    PathList* paths = pathlist_create();
+    bool ok = paths != NULL;
+    char* saveptr = NULL;
+    for (char* line = strtok_r(data + magic_len + key_len + sep_len, "\n", &saveptr);
+         ok && line; line = strtok_r(NULL, "\n", &saveptr)) {
+        ok = line[0] == '/' && pathlist_add(paths, line);
+    }
+    free(data);
+
+    // An entry the sandbox it describes could have written is not trusted
+    if (ok && policy_covers(paths, cache_dir)) {
+        ok = false;
+    }
+    free(cache_dir);
+    if (!ok) {
+        pathlist_free(paths);
+        return NULL;
+    }
+    return paths;
+}
+
+static void make_dirs(const char* path) {
+    char buffer[PATH_MAX];
+    snprintf(buffer, sizeof(buffer), "%s", path);
+
+    for (char* p = buffer + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(buffer, 0700);
+            *p = '/';
+        }
+    }
+    mkdir(buffer, 0700);
+}
+
+bool cache_store(const char* current_dir, const PathList* cli_args,
+                 const PathList* all_paths) {
+    if (!current_dir || !all_paths) {
+        return false;
+    }
+
+    char* cache_dir = get_cache_dir();
+    if (!cache_dir) {
+        return false;
+    }
+
+    // Never store where the sandboxed command could tamper with it
+    if (policy_covers(all_paths, cache_dir)) {
+        free(cache_dir);
+        return false;
+    }
+
+    size_t slot_len = 0;
+    char* key = build_key(current_dir, cli_args, &slot_len);
+    char* filepath = key ? get_cache_file(cache_dir, key, slot_len) : NULL;
+    if (!filepath) {
+        free(key);
+        free(cache_dir);
+        return false;
+    }
+
+    make_dirs(cache_dir);
+    free(cache_dir);
+
+    // Write to a temporary file and rename so readers never see a partial entry
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", filepath, (int)getpid());
+
+    FILE* f = fopen(tmp_path, "w");
+    if (!f) {
+        free(key);
+        free(filepath);
+        return false;
+    }
+
+    fputs(CACHE_MAGIC, f);
+    fputs(key, f);
+    fputs(CACHE_SEPARATOR, f);
+    for (int i = 0; i < all_paths->count; i++) {
+        fprintf(f, "%s\n", all_paths->paths[i]);
+    }
+
+    bool ok = fclose(f) == 0 && rename(tmp_path, filepath) == 0;
+    if (!ok) {
+        unlink(tmp_path);
+    }
+
+    free(key);
+    free(filepath);
+    return ok;
+}
+
+PathList* cache_resolve_paths(Config* config, const PathList* cli_args, bool use_cache) {
+    if (!config) {
+        return NULL;
+    }
+
+    if (use_cache) {
+        TRACE_BEGIN("cache_load");
+        PathList* cached = cache_load(config->current_dir, cli_args);
+        TRACE_END();
+        if (cached) {
+            return cached;
+        }
+    }
+
+    TRACE_BEGIN("config_load_global");
+    config_load_global(config);
+    TRACE_END();
+    TRACE_BEGIN("config_load_local");
+    config_load_local(config);
+    TRACE_END();
+    TRACE_BEGIN("config_load_inherited");
+    config_load_inherited(config);
+    TRACE_END();
+    TRACE_BEGIN("config_add_cli_paths");
+    config_add_cli_paths(config, cli_args);
+    TRACE_END();
+    TRACE_BEGIN("config_resolve_pending");
+    config_resolve_pending(config);
+    TRACE_END();
+
+    TRACE_BEGIN("config_get_all_paths");
+    PathList* all_paths = config_get_all_paths(config);
+    TRACE_END();
+
+    // Entries that failed to resolve may appear later, so a result that
+    // skipped any is not worth caching
+    if (all_paths && use_cache && config->unresolved_paths == 0) {
+        TRACE_BEGIN("cache_store");
+        cache_store(config->current_dir, cli_args, all_paths);
+        TRACE_END();
+    }
+
+    return all_paths;
+}
@@ -0,0 +1,22 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "config.h"
+#include <stdbool.h>
+
+// Look up the merged writable paths cached for this directory and set of
+// --allow-write arguments. Returns NULL on a miss or if either config file
+// changed since the entry was written.
+PathList* cache_load(const char* current_dir, const PathList* cli_args);
+
+// Store the merged writable paths computed for this directory and set of
+// --allow-write arguments
+bool cache_store(const char* current_dir, const PathList* cli_args,
+                 const PathList* all_paths);
+
+// Get the merged writable paths for config and the raw --allow-write
+// arguments. On a cache miss (or when use_cache is false) the config files
+// are loaded into config and resolved, and the result is cached.
+PathList* cache_resolve_paths(Config* config, const PathList* cli_args, bool use_cache);
+
+#endif // CACHE_H
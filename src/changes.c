@@ -0,0 +1,439 @@
+/*
+ * Change tracking for --changes-out.
+ *
+ * Every directory under the writable paths gets an inotify watch before
+ * the command starts, and directories the command creates or moves in are
+ * watched (and their contents recorded) as they appear. Events are folded
+ * into one state per path, so a file that is created and deleted again
+ * leaves no trace and a file that is deleted and recreated is modified.
+ *
+ * The monitor is the subreaper of the command, so processes the command
+ * leaves running in the background are reparented to it, and recording
+ * goes on until the last of them has exited.
+ *
+ * inotify only reports inode events, so mount namespaces (the namespace and
+ * overlay backends) do not hide writes to the real writable paths. A full
+ * event queue or the per-user watch limit can make the record incomplete;
+ * the manifest then says which roots need a full scan.
+ */
+
+#include "changes.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#define WATCH_MASK (IN_CREATE | IN_MODIFY | IN_ATTRIB | IN_DELETE | IN_MOVED_FROM | \
+                    IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+
+struct ChangeMonitor {
+    int fd;
+    const PathList* roots;
+    // Directory of each watch descriptor
+    char** watches;
+    int watch_capacity;
+    // Every path with an event; states[i] and dirs[i] describe paths->paths[i]
+    PathList* paths;
+    char* states;
+    bool* dirs;
+    int state_capacity;
+    // Set when events were lost, so the manifest can't be trusted
+    bool incomplete;
+    // Whether processes the command leaves behind are reparented to us
+    bool subreaper;
+};
+
+static pid_t monitored_child = -1;
+// Set by a termination signal once the command itself has exited, to stop
+// waiting for what it left behind
+static volatile sig_atomic_t stop_waiting;
+
+static void forward_signal(int sig) {
+    if (monitored_child > 0) {
+        kill(monitored_child, sig);
+    } else {
+        stop_waiting = 1;
+    }
+}
+
+// Fold one event into the path's state: 'A' created, 'M' modified,
+// 'D' deleted, or 0 for no net change
+static void record(ChangeMonitor* monitor, const char* path, char change, bool is_dir) {
+    int index = pathlist_find(monitor->paths, path);
+    if (index < 0) {
+        if (!pathlist_add(monitor->paths, path)) {
+            monitor->incomplete = true;
+            return;
+        }
+        index = monitor->paths->count - 1;
+        if (index >= monitor->state_capacity) {
+            int capacity = monitor->state_capacity ? monitor->state_capacity * 2 : 256;
+            char* states = realloc(monitor->states, (size_t)capacity);
+            bool* dirs = states ? realloc(monitor->dirs, sizeof(bool) * (size_t)capacity) : NULL;
+            if (states) {
+                monitor->states = states;
+            }
+            if (!dirs) {
+                monitor->incomplete = true;
+                return;
+            }
+            monitor->dirs = dirs;
+            monitor->state_capacity = capacity;
+        }
+        monitor->states[index] = 0;
+    }
+
+    char* state = &monitor->states[index];
+    monitor->dirs[index] = is_dir;
+    switch (change) {
+        case 'A':
+            *state = *state == 'D' ? 'M' : (*state ? *state : 'A');
+            break;
+        case 'M':
+            *state = *state ? *state : 'M';
+            break;
+        case 'D':
+            *state = *state == 'A' ? 0 : 'D';
+            break;
+    }
+}
+
+static bool set_watch(ChangeMonitor* monitor, int wd, const char* path) {
+    if (wd >= monitor->watch_capacity) {
+        int capacity = monitor->watch_capacity ? monitor->watch_capacity * 2 : 256;
+        while (capacity <= wd) {
+            capacity *= 2;
+        }
+        char** watches = realloc(monitor->watches, sizeof(char*) * (size_t)capacity);
+        if (!watches) {
+            return false;
+        }
+        memset(watches + monitor->watch_capacity, 0,
+               sizeof(char*) * (size_t)(capacity - monitor->watch_capacity));
+        monitor->watches = watches;
+        monitor->watch_capacity = capacity;
+    }
+
+    free(monitor->watches[wd]);
+    monitor->watches[wd] = strdup(path);
+    return monitor->watches[wd] != NULL;
+}
+
+// Watch dir and every directory below it. Directories that appear while the
+// command runs may already have contents, which are recorded as created.
+static void watch_tree(ChangeMonitor* monitor, const char* dir, bool record_contents) {
+    int wd = inotify_add_watch(monitor->fd, dir, WATCH_MASK);
+    if (wd < 0) {
+        if (errno == ENOSPC && !monitor->incomplete) {
+            fprintf(stderr, "Warning: inotify watch limit reached; raise "
+                            "fs.inotify.max_user_watches for complete --changes-out\n");
+        }
+        // A directory that is already gone again has nothing to report
+        if (errno != ENOENT && errno != ENOTDIR) {
+            monitor->incomplete = true;
+        }
+        return;
+    }
+    if (!set_watch(monitor, wd, dir)) {
+        monitor->incomplete = true;
+        return;
+    }
+
+    DIR* handle = opendir(dir);
+    if (!handle) {
+        return;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(handle)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        char path[PATH_MAX];
+        int len = snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if (len < 0 || (size_t)len >= sizeof(path)) {
+            continue;
+        }
+
+        bool is_dir = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat st;
+            is_dir = lstat(path, &st) == 0 && S_ISDIR(st.st_mode);
+        }
+        if (record_contents) {
+            record(monitor, path, 'A', is_dir);
+        }
+        if (is_dir) {
+            watch_tree(monitor, path, record_contents);
+        }
+    }
+    closedir(handle);
+}
+
+// A directory moved away keeps its watches under a stale path; drop them
+static void unwatch_tree(ChangeMonitor* monitor, const char* dir) {
+    for (int wd = 0; wd < monitor->watch_capacity; wd++) {
+        if (monitor->watches[wd] && path_is_within(monitor->watches[wd], dir)) {
+            inotify_rm_watch(monitor->fd, wd);
+            free(monitor->watches[wd]);
+            monitor->watches[wd] = NULL;
+        }
+    }
+}
+
+static void handle_event(ChangeMonitor* monitor, const struct inotify_event* event) {
+    if (event->mask & IN_Q_OVERFLOW) {
+        if (!monitor->incomplete) {
+            fprintf(stderr, "Warning: inotify queue overflowed; --changes-out is incomplete\n");
+        }
+        monitor->incomplete = true;
+        return;
+    }
+    if (event->wd < 0 || event->wd >= monitor->watch_capacity || !monitor->watches[event->wd]) {
+        return;
+    }
+    if (event->mask & IN_IGNORED) {
+        free(monitor->watches[event->wd]);
+        monitor->watches[event->wd] = NULL;
+        return;
+    }
+
+    char path[PATH_MAX];
+    const char* dir = monitor->watches[event->wd];
+    int len = event->len > 0 ? snprintf(path, sizeof(path), "%s/%s", dir, event->name)
+                             : snprintf(path, sizeof(path), "%s", dir);
+    if (len < 0 || (size_t)len >= sizeof(path)) {
+        monitor->incomplete = true;
+        return;
+    }
+
+    bool is_dir = (event->mask & IN_ISDIR) != 0;
+    if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+        record(monitor, path, 'A', is_dir);
+        if (is_dir) {
+            watch_tree(monitor, path, true);
+        }
+    }
+    if (event->mask & (IN_MODIFY | IN_ATTRIB)) {
+        record(monitor, path, 'M', is_dir);
+    }
+    if (event->mask & (IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF)) {
+        record(monitor, path, 'D', is_dir);
+        if (is_dir && (event->mask & IN_MOVED_FROM)) {
+            unwatch_tree(monitor, path);
+        }
+    }
+}
+
+// Handle every queued event; returns false once the queue is empty
+static bool read_events(ChangeMonitor* monitor) {
+    char buffer[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len = read(monitor->fd, buffer, sizeof(buffer));
+    if (len <= 0) {
+        return false;
+    }
+
+    for (char* p = buffer; p < buffer + len;) {
+        const struct inotify_event* event = (const struct inotify_event*)p;
+        handle_event(monitor, event);
+        p += sizeof(struct inotify_event) + event->len;
+    }
+    return true;
+}
+
+ChangeMonitor* changes_watch(const PathList* writable_paths) {
+    ChangeMonitor* monitor = calloc(1, sizeof(ChangeMonitor));
+    if (!monitor) {
+        return NULL;
+    }
+    monitor->roots = writable_paths;
+    monitor->paths = pathlist_create();
+    monitor->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (monitor->fd < 0 || !monitor->paths) {
+        fprintf(stderr, "Error: Failed to start change tracking: %s\n", strerror(errno));
+        changes_free(monitor);
+        return NULL;
+    }
+
+    // Descendants that outlive the command are reparented to us, so their
+    // writes are recorded too
+    monitor->subreaper = prctl(PR_SET_CHILD_SUBREAPER, 1) == 0;
+
+    for (int i = 0; i < writable_paths->count; i++) {
+        const char* path = writable_paths->paths[i];
+        struct stat st;
+        if (lstat(path, &st) != 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            watch_tree(monitor, path, false);
+            continue;
+        }
+
+        // A writable file has no directory to report on it
+        int wd = inotify_add_watch(monitor->fd, path, IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF);
+        if (wd < 0 || !set_watch(monitor, wd, path)) {
+            monitor->incomplete = true;
+        }
+    }
+    return monitor;
+}
+
+int changes_wait(ChangeMonitor* monitor, pid_t pid) {
+    monitored_child = pid;
+    stop_waiting = 0;
+
+    // Terminal signals reach the child through the process group already
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+    signal(SIGTERM, forward_signal);
+    signal(SIGHUP, forward_signal);
+
+    int pidfd = -1;
+#ifdef SYS_pidfd_open
+    pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+#endif
+
+    // Reap the command and, as its subreaper, everything it left running,
+    // until there is nothing left to wait for
+    int status = -1;
+    bool descendants_left = false;
+    for (;;) {
+        int child_status;
+        pid_t done = waitpid(-1, &child_status, WNOHANG);
+        if (done == pid) {
+            status = child_status;
+            monitored_child = -1;
+            if (pidfd >= 0) {
+                close(pidfd);
+                pidfd = -1;
+            }
+            if (!monitor->subreaper) {
+                // Whatever it left behind is out of sight
+                descendants_left = true;
+                break;
+            }
+            continue;
+        }
+        if (done > 0 || (done < 0 && errno == EINTR)) {
+            continue;
+        }
+        if (done < 0) {
+            break;
+        }
+        if (stop_waiting) {
+            descendants_left = true;
+            break;
+        }
+
+        // Without a pidfd, wake up now and then to check on the processes
+        struct pollfd fds[2] = {
+            { .fd = monitor->fd, .events = POLLIN },
+            { .fd = pidfd, .events = POLLIN },
+        };
+        if (poll(fds, pidfd >= 0 ? 2 : 1, pidfd >= 0 ? -1 : 100) > 0 &&
+            (fds[0].revents & POLLIN)) {
+            while (read_events(monitor)) {
+            }
+        }
+    }
+
+    // The last writes are queued before the processes exit
+    while (read_events(monitor)) {
+    }
+
+    if (descendants_left) {
+        monitor->incomplete = true;
+    }
+    if (pidfd >= 0) {
+        close(pidfd);
+    }
+    monitored_child = -1;
+    return status;
+}
+
+static const ChangeMonitor* sort_monitor;
+
+static int compare_changes(const void* a, const void* b) {
+    return strcmp(sort_monitor->paths->paths[*(const int*)a],
+                  sort_monitor->paths->paths[*(const int*)b]);
+}
+
+bool changes_write(ChangeMonitor* monitor, const char* output_path) {
+    int* order = malloc(sizeof(int) * (size_t)(monitor->paths->count + 1));
+    FILE* f = order ? fopen(output_path, "w") : NULL;
+    if (!f) {
+        fprintf(stderr, "Error: Failed to write %s: %s\n", output_path, strerror(errno));
+        free(order);
+        return false;
+    }
+
+    // Settle what the events left ambiguous by looking at the result: a
+    // path moved away along with its directory no longer exists, and one
+    // recreated under a moved-in directory does
+    int count = 0;
+    for (int i = 0; i < monitor->paths->count; i++) {
+        char* state = &monitor->states[i];
+        if (!*state) {
+            continue;
+        }
+        struct stat st;
+        bool exists = lstat(monitor->paths->paths[i], &st) == 0;
+        if (!exists && *state == 'A') {
+            continue;
+        }
+        if (!exists && *state == 'M') {
+            *state = 'D';
+        } else if (exists && *state == 'D') {
+            *state = 'M';
+        }
+        order[count++] = i;
+    }
+
+    sort_monitor = monitor;
+    qsort(order, (size_t)count, sizeof(int), compare_changes);
+
+    if (monitor->incomplete) {
+        for (int i = 0; i < monitor->roots->count; i++) {
+            fprintf(f, "? %s/\n", monitor->roots->paths[i]);
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        fprintf(f, "%c %s%s\n", monitor->states[order[i]], monitor->paths->paths[order[i]],
+                monitor->dirs[order[i]] ? "/" : "");
+    }
+
+    free(order);
+    if (fclose(f) != 0) {
+        fprintf(stderr, "Error: Failed to write %s: %s\n", output_path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void changes_free(ChangeMonitor* monitor) {
+    if (!monitor) {
+        return;
+    }
+    if (monitor->fd >= 0) {
+        close(monitor->fd);
+    }
+    for (int i = 0; i < monitor->watch_capacity; i++) {
+        free(monitor->watches[i]);
+    }
+    free(monitor->watches);
+    pathlist_free(monitor->paths);
+    free(monitor->states);
+    free(monitor->dirs);
+    free(monitor);
+}
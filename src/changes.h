@@ -0,0 +1,26 @@
+#ifndef CHANGES_H
+#define CHANGES_H
+
+#include "config.h"
+#include <stdbool.h>
+#include <sys/types.h>
+
+typedef struct ChangeMonitor ChangeMonitor;
+
+// Start watching the writable paths for creates, writes, renames and
+// deletes. Returns NULL if inotify is unavailable.
+ChangeMonitor* changes_watch(const PathList* writable_paths);
+
+// Record changes until pid and every process it left running have exited;
+// returns the wait status of pid, or -1
+int changes_wait(ChangeMonitor* monitor, pid_t pid);
+
+// Write one "A|M|D path" line per changed path, sorted, directories
+// with a trailing '/'. A "? root/" line means changes under root were
+// missed and it needs a full scan.
+bool changes_write(ChangeMonitor* monitor, const char* output_path);
+
+// Stop watching and free the monitor
+void changes_free(ChangeMonitor* monitor);
+
+#endif // CHANGES_H
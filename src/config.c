@@ -1,14 +1,17 @@
 #include "config.h"
+#include "pattern.h"
+#include "preset.h"
+#include "projects.h"
+#include "resolve.h"
 #include "utils.h"
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <limits.h>
 #include <sys/stat.h>
 
-#define MAX_CONFIG_PATHS 1000
-
 static bool is_valid_config_path(const char* path) {
     if (!path || !*path) {
         return false;
@@ -27,8 +30,95 @@ static bool is_valid_config_path(const char* path) {
     return true;
 }
 
-static bool parse_config_file(const char* filepath, PathList* list) {
-    if (!filepath || !list) {
+// Queue a literal entry of list for config_resolve_pending()
+static bool add_pending(Config* config, PathList* list, const char* entry, int line) {
+    if (config->pending_count == config->pending_capacity) {
+        int capacity = config->pending_capacity ? config->pending_capacity * 2 : 16;
+        PendingPath* pending = realloc(config->pending, (size_t)capacity * sizeof(PendingPath));
+        if (!pending) {
+            return false;
+        }
+        config->pending = pending;
+        config->pending_capacity = capacity;
+    }
+    char* copy = strdup(entry);
+    if (!copy) {
+        return false;
+    }
+    config->pending[config->pending_count++] = (PendingPath){ copy, list, line };
+    return true;
+}
+
+void config_resolve_pending(Config* config) {
+    if (!config || config->pending_count == 0) {
+        return;
+    }
+
+    // The same entry in several files is looked up once
+    int count = config->pending_count;
+    PathList* unique = pathlist_create();
+    int* slots = calloc((size_t)count, sizeof(int));
+    char** results = calloc((size_t)count, sizeof(char*));
+    ResolveStatus* status = calloc((size_t)count, sizeof(ResolveStatus));
+    bool ok = unique && slots && results && status;
+    for (int i = 0; ok && i < count; i++) {
+        ok = pathlist_add(unique, config->pending[i].entry);
+        slots[i] = ok ? pathlist_find(unique, config->pending[i].entry) : -1;
+    }
+    if (ok) {
+        resolve_paths((const char* const*)unique->paths, unique->count, results, status);
+    } else {
+        config->unresolved_paths += count;
+        count = 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+        const PendingPath* pending = &config->pending[i];
+        const char* result = results[slots[i]];
+        if (status[slots[i]] == RESOLVE_TIMED_OUT) {
+            if (pending->line) {
+                fprintf(stderr, "Warning: Timed out resolving path on line %d: %s\n",
+                        pending->line, pending->entry);
+            } else {
+                fprintf(stderr, "Warning: Timed out resolving path: %s\n", pending->entry);
+            }
+            config->unresolved_paths++;
+        } else if (!result) {
+            if (pending->line) {
+                fprintf(stderr, "Warning: Failed to expand path on line %d: %s\n",
+                        pending->line, pending->entry);
+            }
+            config->unresolved_paths++;
+        } else if (!is_valid_config_path(result)) {
+            // Validate the expanded path
+            if (pending->line) {
+                fprintf(stderr, "Warning: Invalid path on line %d: %s\n",
+                        pending->line, result);
+            }
+        } else {
+            pathlist_add(pending->list, result);
+        }
+    }
+
+    for (int i = 0; results && unique && i < unique->count; i++) {
+        free(results[i]);
+    }
+    for (int i = 0; i < config->pending_count; i++) {
+        free(config->pending[i].entry);
+    }
+    config->pending_count = 0;
+    pathlist_free(unique);
+    free(slots);
+    free(results);
+    free(status);
+}
+
+// Relative patterns in the file are anchored at base_dir. Literal paths
+// are queued for config_resolve_pending(), so a slow mount is waited on
+// once for every file rather than once per file.
+static bool parse_config_file(Config* config, const char* filepath, const char* base_dir,
+                              PathList* list) {
+    if (!config || !filepath || !list) {
         return false;
     }
 
@@ -40,12 +130,14 @@ static bool parse_config_file(const char* filepath, PathList* list) {
 
     char line[MAX_PATH_LENGTH];
     int line_num = 0;
+    // The limit is per file; list also holds the entries of other files
+    int entries = 0;
 
     while (fgets(line, sizeof(line), f)) {
         line_num++;
 
         // Check for maximum paths limit
-        if (list->count >= MAX_CONFIG_PATHS) {
+        if (entries >= MAX_CONFIG_PATHS) {
             fprintf(stderr, "Warning: Maximum paths (%d) exceeded, ignoring remaining lines\n",
                     MAX_CONFIG_PATHS);
             break;
@@ -76,43 +168,133 @@ static bool parse_config_file(const char* filepath, PathList* list) {
         if (trimmed[0] == '\0' || trimmed[0] == '#') {
             continue;
         }
+        entries++;
 
-        // Expand and add path
-        char* expanded = expand_path(trimmed);
-        if (!expanded) {
-            fprintf(stderr, "Warning: Failed to expand path on line %d: %s\n",
-                    line_num, trimmed);
+        // "preset NAME[,NAME...]" adds toolchain cache directories
+        if (strncmp(trimmed, "preset", 6) == 0 && (trimmed[6] == ' ' || trimmed[6] == '\t')) {
+            if (!preset_add_paths(list, trimmed + 7, NULL, config->create_presets)) {
+                fprintf(stderr, "Warning: Unknown preset on line %d: %s\n",
+                        line_num, trimmed + 7);
+            }
             continue;
         }
 
-        // Validate the expanded path
-        if (!is_valid_config_path(expanded)) {
-            fprintf(stderr, "Warning: Invalid path on line %d: %s\n",
-                    line_num, expanded);
-            free(expanded);
+        // Patterns are kept as written and matched or expanded at launch
+        if (pattern_is_glob(trimmed)) {
+            char* pattern = pattern_normalize(trimmed, base_dir);
+            if (!pattern) {
+                fprintf(stderr, "Warning: Invalid pattern on line %d: %s\n", line_num, trimmed);
+                continue;
+            }
+            pathlist_add(list, pattern);
+            free(pattern);
             continue;
         }
 
-        pathlist_add(list, expanded);
-        free(expanded);
+        if (!add_pending(config, list, trimmed, line_num)) {
+            config->unresolved_paths++;
+        }
     }
 
     fclose(f);
     return true;
 }
 
+// Strings are carved out of fixed blocks and freed all at once with the list
+#define ARENA_BLOCK_SIZE 16384
+
+struct PathArenaBlock {
+    struct PathArenaBlock* next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+static char* arena_strndup(PathList* list, const char* str, size_t len) {
+    struct PathArenaBlock* block = list->arena;
+    if (!block || block->size - block->used < len + 1) {
+        size_t size = len + 1 > ARENA_BLOCK_SIZE ? len + 1 : ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(struct PathArenaBlock) + size);
+        if (!block) {
+            return NULL;
+        }
+        block->next = list->arena;
+        block->used = 0;
+        block->size = size;
+        list->arena = block;
+    }
+
+    char* copy = block->data + block->used;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    block->used += len + 1;
+    return copy;
+}
+
+// FNV-1a
+static size_t hash_path(const char* path, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)path[i];
+        hash *= 1099511628211ULL;
+    }
+    return (size_t)hash;
+}
+
+// Find the index slot holding path, or the empty slot where it would go
+static size_t find_slot(const PathList* list, const char* path, size_t len, bool* found) {
+    size_t mask = list->index_size - 1;
+    size_t slot = hash_path(path, len) & mask;
+
+    while (list->index[slot] >= 0) {
+        const char* entry = list->paths[list->index[slot]];
+        if (strncmp(entry, path, len) == 0 && entry[len] == '\0') {
+            *found = true;
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    *found = false;
+    return slot;
+}
+
+static bool contains_prefix(const PathList* list, const char* path, size_t len) {
+    bool found;
+    find_slot(list, path, len, &found);
+    return found;
+}
+
+static bool rebuild_index(PathList* list, size_t index_size) {
+    int* index = malloc(index_size * sizeof(int));
+    if (!index) {
+        return false;
+    }
+    memset(index, 0xff, index_size * sizeof(int));
+
+    free(list->index);
+    list->index = index;
+    list->index_size = index_size;
+
+    for (int i = 0; i < list->count; i++) {
+        bool found;
+        size_t slot = find_slot(list, list->paths[i], strlen(list->paths[i]), &found);
+        list->index[slot] = i;
+    }
+    return true;
+}
+
 PathList* pathlist_create(void) {
-    PathList* list = malloc(sizeof(PathList));
+    PathList* list = calloc(1, sizeof(PathList));
     if (!list) {
         return NULL;
     }
 
     list->capacity = 16;
-    list->count = 0;
     list->paths = calloc(list->capacity, sizeof(char*));
 
-    if (!list->paths) {
-        free(list);
+    if (!list->paths || !rebuild_index(list, 32)) {
+        pathlist_free(list);
         return NULL;
     }
 
@@ -125,7 +307,10 @@ bool pathlist_add(PathList* list, const char* path) {
     }
 
     // Check for duplicates
-    if (pathlist_contains(list, path)) {
+    size_t len = strlen(path);
+    bool found;
+    size_t slot = find_slot(list, path, len, &found);
+    if (found) {
         return true;
     }
 
@@ -140,12 +325,19 @@ bool pathlist_add(PathList* list, const char* path) {
         list->capacity = new_capacity;
     }
 
-    list->paths[list->count] = strdup(path);
-    if (!list->paths[list->count]) {
+    char* copy = arena_strndup(list, path, len);
+    if (!copy) {
         return false;
     }
 
+    list->paths[list->count] = copy;
+    list->index[slot] = list->count;
     list->count++;
+
+    // Keep the index at most half full
+    if ((size_t)list->count * 2 > list->index_size) {
+        return rebuild_index(list, list->index_size * 2);
+    }
     return true;
 }
 
@@ -154,13 +346,17 @@ bool pathlist_contains(PathList* list, const char* path) {
         return false;
     }
 
-    for (int i = 0; i < list->count; i++) {
-        if (strcmp(list->paths[i], path) == 0) {
-            return true;
-        }
+    return contains_prefix(list, path, strlen(path));
+}
+
+int pathlist_find(const PathList* list, const char* path) {
+    if (!list || !path) {
+        return -1;
     }
 
-    return false;
+    bool found;
+    size_t slot = find_slot(list, path, strlen(path), &found);
+    return found ? list->index[slot] : -1;
 }
 
 bool pathlist_remove(PathList* list, const char* path) {
@@ -168,19 +364,77 @@ bool pathlist_remove(PathList* list, const char* path) {
         return false;
     }
 
+    bool found;
+    size_t slot = find_slot(list, path, strlen(path), &found);
+    if (!found) {
+        return false;
+    }
+    int removed = list->index[slot];
+
+    // Close the gap in the probe sequence so later lookups still find
+    // entries that collided with this one
+    size_t mask = list->index_size - 1;
+    size_t hole = slot;
+    for (size_t next = (hole + 1) & mask; list->index[next] >= 0; next = (next + 1) & mask) {
+        const char* entry = list->paths[list->index[next]];
+        size_t home = hash_path(entry, strlen(entry)) & mask;
+        // Move the entry back if its home slot is not between the hole
+        // and where it sits now
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            list->index[hole] = list->index[next];
+            hole = next;
+        }
+    }
+    list->index[hole] = -1;
+
+    // Close the gap in the list, keeping the order config files are saved
+    // in. The string stays in the arena until the list is freed.
+    memmove(&list->paths[removed], &list->paths[removed + 1],
+            (size_t)(list->count - removed - 1) * sizeof(char*));
+    list->count--;
+    for (size_t i = 0; i < list->index_size; i++) {
+        if (list->index[i] > removed) {
+            list->index[i]--;
+        }
+    }
+    return true;
+}
+
+bool pathlist_drop_subsumed(PathList* list) {
+    if (!list) {
+        return false;
+    }
+
+    // Check every ancestor of each entry against the index, then compact
+    // in order
+    int kept = 0;
     for (int i = 0; i < list->count; i++) {
-        if (strcmp(list->paths[i], path) == 0) {
-            free(list->paths[i]);
-            // Shift remaining elements
-            for (int j = i; j < list->count - 1; j++) {
-                list->paths[j] = list->paths[j + 1];
+        const char* path = list->paths[i];
+        bool covered = false;
+
+        for (size_t len = strlen(path); len > 1 && !covered; ) {
+            while (len > 0 && path[len - 1] != '/') {
+                len--;
+            }
+            if (len == 0) {
+                break;
             }
-            list->count--;
-            return true;
+            // Check the ancestor without its trailing slash, except "/"
+            size_t ancestor_len = len > 1 ? len - 1 : len;
+            covered = contains_prefix(list, path, ancestor_len);
+            len = ancestor_len;
+        }
+
+        if (!covered) {
+            list->paths[kept++] = list->paths[i];
         }
     }
 
-    return false;
+    if (kept == list->count) {
+        return true;
+    }
+    list->count = kept;
+    return rebuild_index(list, list->index_size);
 }
 
 void pathlist_free(PathList* list) {
@@ -188,36 +442,49 @@ void pathlist_free(PathList* list) {
         return;
     }
 
-    for (int i = 0; i < list->count; i++) {
-        free(list->paths[i]);
+    while (list->arena) {
+        struct PathArenaBlock* next = list->arena->next;
+        free(list->arena);
+        list->arena = next;
     }
+    free(list->index);
     free(list->paths);
     free(list);
 }
 
 Config* config_create(void) {
-    Config* config = malloc(sizeof(Config));
-    if (!config) {
+    // Store current directory
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
         return NULL;
     }
 
-    config->global_paths = pathlist_create();
-    config->local_paths = pathlist_create();
-    config->cli_paths = pathlist_create();
+    return config_create_for_dir(cwd);
+}
 
-    if (!config->global_paths || !config->local_paths || !config->cli_paths) {
-        config_free(config);
+Config* config_create_for_dir(const char* dir) {
+    if (!dir) {
         return NULL;
     }
 
-    // Store current directory
-    char cwd[PATH_MAX];
-    if (!getcwd(cwd, sizeof(cwd))) {
-        config_free(config);
+    Config* config = malloc(sizeof(Config));
+    if (!config) {
         return NULL;
     }
-    config->current_dir = strdup(cwd);
-    if (!config->current_dir) {
+
+    config->global_paths = pathlist_create();
+    config->local_paths = pathlist_create();
+    config->inherited_paths = pathlist_create();
+    config->cli_paths = pathlist_create();
+    config->current_dir = strdup(dir);
+    config->unresolved_paths = 0;
+    config->pending = NULL;
+    config->pending_count = 0;
+    config->pending_capacity = 0;
+    config->create_presets = true;
+
+    if (!config->global_paths || !config->local_paths || !config->inherited_paths ||
+        !config->cli_paths || !config->current_dir) {
         config_free(config);
         return NULL;
     }
@@ -232,7 +499,12 @@ void config_free(Config* config) {
 
     pathlist_free(config->global_paths);
     pathlist_free(config->local_paths);
+    pathlist_free(config->inherited_paths);
     pathlist_free(config->cli_paths);
+    for (int i = 0; i < config->pending_count; i++) {
+        free(config->pending[i].entry);
+    }
+    free(config->pending);
     free(config->current_dir);
     free(config);
 }
@@ -255,7 +527,10 @@ PathList* config_get_all_paths(Config* config) {
         pathlist_add(all, config->global_paths->paths[i]);
     }
 
-    // Merge local paths
+    // Merge inherited and local paths
+    for (int i = 0; i < config->inherited_paths->count; i++) {
+        pathlist_add(all, config->inherited_paths->paths[i]);
+    }
     for (int i = 0; i < config->local_paths->count; i++) {
         pathlist_add(all, config->local_paths->paths[i]);
     }
@@ -265,24 +540,70 @@ PathList* config_get_all_paths(Config* config) {
         pathlist_add(all, config->cli_paths->paths[i]);
     }
 
+    // A writable directory covers everything below it, so nested entries
+    // would only add rules
+    if (!pathlist_drop_subsumed(all)) {
+        pathlist_free(all);
+        return NULL;
+    }
+
     return all;
 }
 
+char* config_get_global_path(void) {
+    char* xdg_config = get_xdg_config_dir();
+    if (!xdg_config) {
+        return NULL;
+    }
+
+    char* filepath = malloc(PATH_MAX);
+    if (!filepath) {
+        free(xdg_config);
+        return NULL;
+    }
+
+    snprintf(filepath, PATH_MAX, "%s/sandbash/config", xdg_config);
+    free(xdg_config);
+
+    return filepath;
+}
+
+void config_add_cli_paths(Config* config, const PathList* raw_paths) {
+    if (!config || !raw_paths) {
+        return;
+    }
+
+    for (int i = 0; i < raw_paths->count; i++) {
+        if (!pattern_is_glob(raw_paths->paths[i])) {
+            if (!add_pending(config, config->cli_paths, raw_paths->paths[i], 0)) {
+                config->unresolved_paths++;
+            }
+            continue;
+        }
+        char* expanded = pattern_normalize(raw_paths->paths[i], config->current_dir);
+        if (expanded) {
+            pathlist_add(config->cli_paths, expanded);
+            free(expanded);
+        } else {
+            config->unresolved_paths++;
+        }
+    }
+}
+
 bool config_load_global(Config* config) {
     if (!config) {
         return false;
     }
 
-    char* xdg_config = get_xdg_config_dir();
-    if (!xdg_config) {
+    char* filepath = config_get_global_path();
+    if (!filepath) {
         return false;
     }
 
-    char filepath[PATH_MAX];
-    snprintf(filepath, sizeof(filepath), "%s/sandbash/config", xdg_config);
-    free(xdg_config);
-
-    return parse_config_file(filepath, config->global_paths);
+    bool result = parse_config_file(config, filepath, config->current_dir,
+                                    config->global_paths);
+    free(filepath);
+    return result;
 }
 
 bool config_load_local(Config* config) {
@@ -290,26 +611,83 @@ bool config_load_local(Config* config) {
         return false;
     }
 
-    // Compute hash of current directory
-    char* hash = compute_path_hash(config->current_dir);
-    if (!hash) {
+    char* filepath = config_get_local_path(config);
+    if (!filepath) {
         return false;
     }
 
-    char* xdg_config = get_xdg_config_dir();
-    if (!xdg_config) {
-        free(hash);
-        return false;
+    bool result = parse_config_file(config, filepath, config->current_dir,
+                                    config->local_paths);
+    free(filepath);
+    return result;
+}
+
+PathList* config_inherited_dirs(const char* dir) {
+    PathList* dirs = pathlist_create();
+    if (!dir || !dirs) {
+        return dirs;
+    }
+
+    // One index lookup per level. Without an index, or while it leaves out
+    // configs that have no header line, each level's config is looked for
+    // on disk instead.
+    ProjectIndex* index = projects_open();
+    if (index && projects_unattributed(index) > 0) {
+        projects_close(index);
+        index = NULL;
+    }
+    char ancestor[PATH_MAX];
+    snprintf(ancestor, sizeof(ancestor), "%s", dir);
+    char* slash;
+    PathList* found = pathlist_create();
+    while (found && (slash = strrchr(ancestor, '/')) != NULL && strcmp(ancestor, "/") != 0) {
+        slash[slash == ancestor ? 1 : 0] = '\0';
+        bool has_config;
+        if (index) {
+            has_config = projects_contains(index, ancestor);
+        } else {
+            char* filepath = config_get_local_path_for_dir(ancestor);
+            has_config = filepath && access(filepath, F_OK) == 0;
+            free(filepath);
+        }
+        if (has_config && !pathlist_add(found, ancestor)) {
+            pathlist_free(found);
+            found = NULL;
+        }
     }
+    projects_close(index);
 
-    char filepath[PATH_MAX];
-    snprintf(filepath, sizeof(filepath), "%s/sandbash/projects/%s",
-             xdg_config, hash);
+    for (int i = found ? found->count - 1 : -1; i >= 0; i--) {
+        pathlist_add(dirs, found->paths[i]);
+    }
+    if (!found) {
+        pathlist_free(dirs);
+        dirs = NULL;
+    }
+    pathlist_free(found);
+    return dirs;
+}
 
-    free(xdg_config);
-    free(hash);
+bool config_load_inherited(Config* config) {
+    if (!config) {
+        return false;
+    }
 
-    return parse_config_file(filepath, config->local_paths);
+    PathList* dirs = config_inherited_dirs(config->current_dir);
+    if (!dirs) {
+        return false;
+    }
+
+    // Relative patterns belong to the project that wrote them
+    bool result = true;
+    for (int i = 0; result && i < dirs->count; i++) {
+        char* filepath = config_get_local_path_for_dir(dirs->paths[i]);
+        result = parse_config_file(config, filepath, dirs->paths[i],
+                                   config->inherited_paths);
+        free(filepath);
+    }
+    pathlist_free(dirs);
+    return result;
 }
 
 char* config_get_local_path(Config* config) {
@@ -317,7 +695,16 @@ char* config_get_local_path(Config* config) {
         return NULL;
     }
 
-    char* hash = compute_path_hash(config->current_dir);
+    return config_get_local_path_for_dir(config->current_dir);
+}
+
+char* config_get_local_path_for_dir(const char* dir) {
+    if (!dir) {
+        return NULL;
+    }
+
+    // Per-directory configs are keyed by a hash of the directory path
+    char* hash = compute_path_hash(dir);
     if (!hash) {
         return NULL;
     }
@@ -344,11 +731,129 @@ char* config_get_local_path(Config* config) {
     return filepath;
 }
 
-bool config_save_local(Config* config) {
-    if (!config) {
+// The lines of a config file as written, so updates keep presets,
+// comments and entries that do not resolve right now
+typedef struct {
+    char** lines;
+    int count;
+    int capacity;
+} RawLines;
+
+static void raw_lines_free(RawLines* raw) {
+    for (int i = 0; i < raw->count; i++) {
+        free(raw->lines[i]);
+    }
+    free(raw->lines);
+}
+
+static bool raw_lines_add(RawLines* raw, const char* line) {
+    if (raw->count == raw->capacity) {
+        int capacity = raw->capacity ? raw->capacity * 2 : 32;
+        char** lines = realloc(raw->lines, capacity * sizeof(char*));
+        if (!lines) {
+            return false;
+        }
+        raw->lines = lines;
+        raw->capacity = capacity;
+    }
+    char* copy = strdup(line);
+    if (!copy) {
         return false;
     }
+    raw->lines[raw->count++] = copy;
+    return true;
+}
 
+// A missing file reads as no lines
+static bool read_raw_lines(const char* filepath, RawLines* raw) {
+    FILE* f = fopen(filepath, "r");
+    if (!f) {
+        return true;
+    }
+    char* line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    bool ok = true;
+    while (ok && (len = getline(&line, &size, f)) >= 0) {
+        if (len > 0 && line[len - 1] == '\n') {
+            line[len - 1] = '\0';
+        }
+        ok = raw_lines_add(raw, line);
+    }
+    free(line);
+    fclose(f);
+    return ok;
+}
+
+// The entry on a config line with surrounding blanks removed, or NULL for
+// blank lines, comments and presets
+static char* raw_entry(const char* line) {
+    while (*line == ' ' || *line == '\t') {
+        line++;
+    }
+    size_t len = strlen(line);
+    while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t')) {
+        len--;
+    }
+    if (len == 0 || line[0] == '#' ||
+        (len > 6 && strncmp(line, "preset", 6) == 0 && (line[6] == ' ' || line[6] == '\t'))) {
+        return NULL;
+    }
+    return strndup(line, len);
+}
+
+// Mark the lines whose entry stands for path: written that way, the same
+// pattern once normalized, or a literal that resolves to it. Lines that
+// fail or time out resolving match nothing and stay as they are.
+static void match_raw_lines(const RawLines* raw, const char* base_dir, const char* path,
+                            bool* matches) {
+    PathList* literals = pathlist_create();
+    for (int i = 0; i < raw->count; i++) {
+        matches[i] = false;
+        char* entry = raw_entry(raw->lines[i]);
+        if (!entry) {
+            continue;
+        }
+        if (strcmp(entry, path) == 0) {
+            matches[i] = true;
+        } else if (pattern_is_glob(entry)) {
+            char* pattern = pattern_normalize(entry, base_dir);
+            matches[i] = pattern && strcmp(pattern, path) == 0;
+            free(pattern);
+        } else if (literals) {
+            pathlist_add(literals, entry);
+        }
+        free(entry);
+    }
+
+    int count = literals ? literals->count : 0;
+    char** results = calloc(count ? count : 1, sizeof(char*));
+    ResolveStatus* status = calloc(count ? count : 1, sizeof(ResolveStatus));
+    if (results && status) {
+        resolve_paths((const char* const*)literals->paths, count, results, status);
+        for (int i = 0; i < count; i++) {
+            for (int j = 0; status[i] == RESOLVE_OK && j < raw->count; j++) {
+                // The same entry may be written on several lines
+                char* entry = raw_entry(raw->lines[j]);
+                if (entry && strcmp(entry, literals->paths[i]) == 0 &&
+                    strcmp(results[i], path) == 0) {
+                    matches[j] = true;
+                }
+                free(entry);
+            }
+            free(results[i]);
+        }
+    }
+    free(results);
+    free(status);
+    pathlist_free(literals);
+}
+
+// Write the per-directory config to a temporary file and rename it into
+// place, so readers never see half of it, and add it to the index. Lines
+// marked in skip are left out. The caller holds the update lock.
+static bool write_local_locked(Config* config, const RawLines* raw, const bool* skip,
+                               const char* append) {
     char* filepath = config_get_local_path(config);
     if (!filepath) {
         return false;
@@ -369,20 +874,107 @@ bool config_save_local(Config* config) {
         free(xdg_config);
     }
 
-    FILE* f = fopen(filepath, "w");
+    char temp[PATH_MAX + 16];
+    snprintf(temp, sizeof(temp), "%s.tmp", filepath);
+    FILE* f = fopen(temp, "w");
     if (!f) {
         free(filepath);
         return false;
     }
 
-    fprintf(f, "# Per-directory config for: %s\n", config->current_dir);
-    fprintf(f, "# One path per line\n\n");
+    // --reindex finds the directory from the header, so it always leads
+    bool migrated = false;
+    if (raw->count == 0) {
+        fprintf(f, PROJECTS_CONFIG_HEADER "%s\n", config->current_dir);
+        fprintf(f, "# One path per line\n\n");
+    } else if (strncmp(raw->lines[0], PROJECTS_CONFIG_HEADER,
+                       strlen(PROJECTS_CONFIG_HEADER)) != 0) {
+        fprintf(f, PROJECTS_CONFIG_HEADER "%s\n", config->current_dir);
+        migrated = true;
+    }
 
-    for (int i = 0; i < config->local_paths->count; i++) {
-        fprintf(f, "%s\n", config->local_paths->paths[i]);
+    for (int i = 0; i < raw->count; i++) {
+        if (!skip || !skip[i]) {
+            fprintf(f, "%s\n", raw->lines[i]);
+        }
+    }
+    if (append) {
+        fprintf(f, "%s\n", append);
     }
 
-    fclose(f);
+    bool ok = fclose(f) == 0 && rename(temp, filepath) == 0;
+    if (!ok) {
+        unlink(temp);
+    }
     free(filepath);
-    return true;
+
+    if (ok && !projects_add(config->current_dir, migrated)) {
+        fprintf(stderr, "Warning: Failed to update the project index; run sandbash "
+                        "--reindex\n");
+    }
+    return ok;
+}
+
+bool config_create_local(Config* config) {
+    if (!config) {
+        return false;
+    }
+
+    int lock_fd = projects_lock();
+    if (lock_fd < 0) {
+        return false;
+    }
+    char* filepath = config_get_local_path(config);
+    bool ok = filepath != NULL;
+    if (ok && access(filepath, F_OK) != 0) {
+        RawLines raw = { NULL, 0, 0 };
+        ok = write_local_locked(config, &raw, NULL, NULL);
+    }
+    free(filepath);
+    projects_unlock(lock_fd);
+    return ok;
+}
+
+bool config_update_local(Config* config, const char* path, bool add, bool* changed) {
+    if (!config || !path || !changed) {
+        return false;
+    }
+
+    int lock_fd = projects_lock();
+    if (lock_fd < 0) {
+        return false;
+    }
+
+    // Edit the file as it is now, which another process may have changed
+    // since it was loaded. Only the lines for path are touched.
+    RawLines raw = { NULL, 0, 0 };
+    char* filepath = config_get_local_path(config);
+    bool ok = filepath && read_raw_lines(filepath, &raw);
+    free(filepath);
+    bool* matches = ok ? calloc(raw.count ? raw.count : 1, sizeof(bool)) : NULL;
+    ok = ok && matches;
+    if (ok) {
+        match_raw_lines(&raw, config->current_dir, path, matches);
+        bool found = false;
+        for (int i = 0; i < raw.count; i++) {
+            found = found || matches[i];
+        }
+
+        *changed = add ? !found : found;
+        if (*changed) {
+            ok = add ? write_local_locked(config, &raw, NULL, path)
+                     : write_local_locked(config, &raw, matches, NULL);
+        }
+        if (ok && *changed) {
+            if (add) {
+                pathlist_add(config->local_paths, path);
+            } else {
+                pathlist_remove(config->local_paths, path);
+            }
+        }
+    }
+    free(matches);
+    raw_lines_free(&raw);
+    projects_unlock(lock_fd);
+    return ok;
 }
@@ -2,21 +2,51 @@
 #define CONFIG_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #define MAX_PATHS 256
 #define MAX_PATH_LENGTH 4096
+#define MAX_CONFIG_PATHS 1000  // entries read from one config file
 
+struct PathArenaBlock;
+
+// Set of paths in insertion order. Lookups go through a hash index and
+// the strings live in an arena owned by the list.
 typedef struct {
     char** paths;
     int count;
     int capacity;
+    // Open-addressing index into paths; -1 marks an empty slot
+    int* index;
+    size_t index_size;
+    struct PathArenaBlock* arena;
 } PathList;
 
+// A literal entry waiting to be resolved together with the others
+typedef struct {
+    char* entry;
+    // The list the resolved path goes to
+    PathList* list;
+    // The config file line it came from, or 0 for --allow-write
+    int line;
+} PendingPath;
+
 typedef struct {
     PathList* global_paths;
     PathList* local_paths;
+    // From the per-directory configs of ancestors of current_dir
+    PathList* inherited_paths;
     PathList* cli_paths;
     char* current_dir;
+    int unresolved_paths;  // entries skipped because they could not be resolved
+    // Literal entries collected by the load functions and
+    // config_add_cli_paths() for config_resolve_pending()
+    PendingPath* pending;
+    int pending_count;
+    int pending_capacity;
+    // Create missing preset directories while loading, as a launch needs
+    // them; set by default
+    bool create_presets;
 } Config;
 
 // Create new PathList
@@ -28,15 +58,24 @@ bool pathlist_add(PathList* list, const char* path);
 // Check if path exists in PathList
 bool pathlist_contains(PathList* list, const char* path);
 
-// Remove path from PathList
+// Get the position of path in PathList, or -1
+int pathlist_find(const PathList* list, const char* path);
+
+// Remove path from PathList, keeping the order of the others
 bool pathlist_remove(PathList* list, const char* path);
 
+// Drop entries that lie under another entry in the list
+bool pathlist_drop_subsumed(PathList* list);
+
 // Free PathList
 void pathlist_free(PathList* list);
 
-// Create new Config
+// Create new Config for the current directory
 Config* config_create(void);
 
+// Create new Config for an arbitrary directory
+Config* config_create_for_dir(const char* dir);
+
 // Free Config
 void config_free(Config* config);
 
@@ -46,13 +85,40 @@ bool config_load_global(Config* config);
 // Load per-directory config file
 bool config_load_local(Config* config);
 
+// Get the ancestors of dir that have a per-directory config, outermost
+// first
+PathList* config_inherited_dirs(const char* dir);
+
+// Load the per-directory configs of the ancestors of the current directory
+bool config_load_inherited(Config* config);
+
+// Add --allow-write arguments to the command-line path list; literal paths
+// are resolved by config_resolve_pending()
+void config_add_cli_paths(Config* config, const PathList* raw_paths);
+
+// Resolve the literal entries collected so far, all in one batch, into
+// their lists. The lists are complete once this has run.
+void config_resolve_pending(Config* config);
+
 // Get merged list of all writable paths
 PathList* config_get_all_paths(Config* config);
 
-// Save per-directory config
-bool config_save_local(Config* config);
+// Create an empty per-directory config if there is none yet
+bool config_create_local(Config* config);
+
+// Add path to the per-directory config, or remove it, and save. The lines
+// of the file are edited under the update lock, so concurrent updates are
+// not lost and the other entries are kept as written. changed is set to
+// whether the config had to change.
+bool config_update_local(Config* config, const char* path, bool add, bool* changed);
 
 // Get per-directory config path
 char* config_get_local_path(Config* config);
 
+// Get per-directory config path for an arbitrary directory
+char* config_get_local_path_for_dir(const char* dir);
+
+// Get global config path
+char* config_get_global_path(void);
+
 #endif // CONFIG_H
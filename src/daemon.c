@@ -0,0 +1,1036 @@
+/*
+ * sandbashd: a per-user daemon that launches commands in sandboxes that
+ * were set up ahead of time.
+ *
+ * The daemon listens on a Unix socket in the runtime directory. A client
+ * sends its working directory, --allow-write arguments, argv, environment
+ * and umask together with its stdin, stdout and stderr. The daemon resolves
+ * the writable path set exactly as sandbash does (ruleset cache included)
+ * and hands the request to a zygote: a process forked from the daemon that
+ * applied the sandbox for that backend and path set once and then waits for
+ * work. For each request the zygote vforks and execs the command, reports
+ * its pid and exit status straight to the client and delivers the signals
+ * the client forwards.
+ *
+ * Zygotes live in a small LRU pool keyed by backend and path set and are
+ * shut down after an idle timeout. Requests are only served for peers
+ * running as the same user in the same user and mount namespace and without
+ * no_new_privs, which every Linux backend sets, so a sandboxed process
+ * cannot use the daemon to reach a less restricted sandbox. The client runs
+ * the command itself if anything goes wrong before the command starts.
+ */
+
+#include "daemon.h"
+#include "cache.h"
+#include "sandbox.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define DAEMON_MAGIC 0x53424431u
+#define DAEMON_MAX_PAYLOAD (4 * 1024 * 1024)
+#define DAEMON_FLAG_NO_CACHE 1u
+
+// stdin, stdout and stderr travel with every request; the daemon adds the
+// client connection when forwarding to a zygote
+#define REQUEST_FDS 3
+#define MAX_PASSED_FDS (REQUEST_FDS + 1)
+
+#define MAX_SELECTED_BACKENDS 8
+
+extern char** environ;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t flags;
+    uint32_t umask;
+    uint32_t cli_count;
+    uint32_t argv_count;
+    uint32_t env_count;
+    uint32_t payload_len;
+} RequestHeader;
+
+// The payload holds NUL-terminated strings: backend name (empty for the
+// default), working directory, then the CLI paths, argv and environment
+typedef struct {
+    RequestHeader header;
+    char* payload;
+    const char* backend;
+    const char* cwd;
+    PathList* cli_args;
+    char** argv;
+    char** env;
+} Request;
+
+typedef enum {
+    MSG_STARTED = 1,
+    MSG_EXITED,
+    MSG_SIGNAL
+} MessageType;
+
+typedef struct {
+    uint32_t type;
+    int32_t value;
+} Message;
+
+typedef struct {
+    char* key;
+    pid_t pid;
+    int sock;
+    time_t last_used;
+} Zygote;
+
+static int listen_fd = -1;
+static Zygote* zygotes = NULL;
+static int zygote_count = 0;
+
+static bool write_all(int fd, const void* data, size_t len) {
+    const char* p = data;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static bool read_all(int fd, void* data, size_t len) {
+    char* p = data;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static bool send_message(int sock, MessageType type, int value) {
+    Message msg = { (uint32_t)type, value };
+    return write_all(sock, &msg, sizeof(msg));
+}
+
+// Send data with fds attached to the first byte
+static bool send_with_fds(int sock, const void* data, size_t len, const int* fds, int nfds) {
+    struct iovec iov = { .iov_base = (void*)data, .iov_len = len };
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * MAX_PASSED_FDS)];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)nfds),
+    };
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)nfds);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * (size_t)nfds);
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+
+    if (sent <= 0) {
+        return false;
+    }
+    return write_all(sock, (const char*)data + sent, len - (size_t)sent);
+}
+
+static void close_fds(int* fds, int nfds) {
+    for (int i = 0; i < nfds; i++) {
+        close(fds[i]);
+    }
+}
+
+static void free_request(Request* req) {
+    free(req->payload);
+    pathlist_free(req->cli_args);
+    free(req->argv);
+    free(req->env);
+    memset(req, 0, sizeof(*req));
+}
+
+// Receive a request and the fds that came with it. Returns false on EOF or
+// a malformed request.
+static bool recv_request(int sock, Request* req, int* fds, int* nfds) {
+    memset(req, 0, sizeof(*req));
+    *nfds = 0;
+
+    struct iovec iov = { .iov_base = &req->header, .iov_len = sizeof(req->header) };
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * MAX_PASSED_FDS)];
+        struct cmsghdr align;
+    } control;
+
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+
+    if (n <= 0) {
+        return false;
+    }
+
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        int count = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        for (int i = 0; i < count; i++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg) + sizeof(int) * (size_t)i, sizeof(int));
+            if (*nfds < MAX_PASSED_FDS) {
+                fds[(*nfds)++] = fd;
+            } else {
+                close(fd);
+            }
+        }
+    }
+
+    bool ok = !(msg.msg_flags & MSG_CTRUNC) &&
+              read_all(sock, (char*)&req->header + n, sizeof(req->header) - (size_t)n) &&
+              req->header.magic == DAEMON_MAGIC &&
+              req->header.payload_len <= DAEMON_MAX_PAYLOAD;
+
+    if (ok) {
+        req->payload = malloc(req->header.payload_len + 1);
+        ok = req->payload && read_all(sock, req->payload, req->header.payload_len);
+    }
+
+    if (!ok) {
+        close_fds(fds, *nfds);
+        *nfds = 0;
+        free_request(req);
+        return false;
+    }
+
+    req->payload[req->header.payload_len] = '\0';
+    return true;
+}
+
+// Point the string table entries into the payload
+static bool parse_strings(char** cursor, const char* end, char** out, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (*cursor >= end) {
+            return false;
+        }
+        out[i] = *cursor;
+        *cursor += strlen(*cursor) + 1;
+    }
+    return true;
+}
+
+static bool parse_request(Request* req) {
+    const RequestHeader* h = &req->header;
+    char* cursor = req->payload;
+    const char* end = req->payload + h->payload_len;
+
+    // Every string takes at least one byte, which bounds the counts
+    if (h->argv_count == 0 || h->cli_count > h->payload_len ||
+        h->argv_count > h->payload_len || h->env_count > h->payload_len) {
+        return false;
+    }
+
+    char* fixed[2];
+    char** cli = malloc(sizeof(char*) * (h->cli_count + 1));
+    req->argv = malloc(sizeof(char*) * (h->argv_count + 1));
+    req->env = malloc(sizeof(char*) * (h->env_count + 1));
+    req->cli_args = pathlist_create();
+
+    bool ok = cli && req->argv && req->env && req->cli_args &&
+              parse_strings(&cursor, end, fixed, 2) &&
+              parse_strings(&cursor, end, cli, h->cli_count) &&
+              parse_strings(&cursor, end, req->argv, h->argv_count) &&
+              parse_strings(&cursor, end, req->env, h->env_count);
+
+    for (uint32_t i = 0; ok && i < h->cli_count; i++) {
+        ok = pathlist_add(req->cli_args, cli[i]);
+    }
+    free(cli);
+
+    if (!ok) {
+        return false;
+    }
+
+    req->backend = fixed[0];
+    req->cwd = fixed[1];
+    req->argv[h->argv_count] = NULL;
+    req->env[h->env_count] = NULL;
+    return true;
+}
+
+static bool same_namespace(pid_t pid, const char* ns) {
+    char path[64];
+    struct stat self_st;
+    struct stat peer_st;
+
+    snprintf(path, sizeof(path), "/proc/self/ns/%s", ns);
+    if (stat(path, &self_st) != 0) {
+        return false;
+    }
+    snprintf(path, sizeof(path), "/proc/%d/ns/%s", (int)pid, ns);
+    if (stat(path, &peer_st) != 0) {
+        return false;
+    }
+    return self_st.st_dev == peer_st.st_dev && self_st.st_ino == peer_st.st_ino;
+}
+
+static bool peer_credentials(int sock, struct ucred* cred) {
+    socklen_t len = sizeof(*cred);
+    return getsockopt(sock, SOL_SOCKET, SO_PEERCRED, cred, &len) == 0;
+}
+
+// Check that the other end of sock is an unsandboxed process of this user
+// that sees the same filesystem
+static bool peer_is_trusted(int sock) {
+    struct ucred cred;
+    return peer_credentials(sock, &cred) && cred.uid == getuid() &&
+           !process_has_no_new_privs(cred.pid) && same_namespace(cred.pid, "user") &&
+           same_namespace(cred.pid, "mnt");
+}
+
+char* daemon_get_socket_path(void) {
+    char* runtime_dir = get_xdg_runtime_dir();
+    if (!runtime_dir) {
+        return NULL;
+    }
+
+    char* path = malloc(PATH_MAX);
+    if (path) {
+        snprintf(path, PATH_MAX, "%s/sandbash/sandbashd.sock", runtime_dir);
+    }
+    free(runtime_dir);
+    return path;
+}
+
+static bool fill_socket_address(struct sockaddr_un* addr, const char* path) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        return false;
+    }
+    strcpy(addr->sun_path, path);
+    return true;
+}
+
+/* Client */
+
+static int client_sock = -1;
+
+static void client_forward_signal(int sig) {
+    int saved_errno = errno;
+    Message msg = { MSG_SIGNAL, sig };
+    (void)!send(client_sock, &msg, sizeof(msg), MSG_NOSIGNAL);
+    errno = saved_errno;
+}
+
+typedef struct {
+    char* data;
+    size_t len;
+    size_t capacity;
+} Payload;
+
+static bool payload_add(Payload* p, const char* str) {
+    size_t n = strlen(str) + 1;
+    if (p->len + n > p->capacity) {
+        size_t capacity = (p->capacity + n) * 2;
+        char* data = realloc(p->data, capacity);
+        if (!data) {
+            return false;
+        }
+        p->data = data;
+        p->capacity = capacity;
+    }
+    memcpy(p->data + p->len, str, n);
+    p->len += n;
+    return true;
+}
+
+// Build header and payload as one buffer
+static char* build_request(const char* backend_name, const PathList* cli_args, bool use_cache,
+                           int argc, char** argv, size_t* out_len) {
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        return NULL;
+    }
+
+    RequestHeader header = { 0 };
+    Payload p = { malloc(4096), sizeof(header), 4096 };
+    if (!p.data) {
+        return NULL;
+    }
+
+    bool ok = payload_add(&p, backend_name ? backend_name : "") && payload_add(&p, cwd);
+    for (int i = 0; ok && cli_args && i < cli_args->count; i++) {
+        ok = payload_add(&p, cli_args->paths[i]);
+    }
+    for (int i = 0; ok && i < argc; i++) {
+        ok = payload_add(&p, argv[i]);
+    }
+
+    uint32_t env_count = 0;
+    for (char** env = environ; ok && env && *env; env++, env_count++) {
+        ok = payload_add(&p, *env);
+    }
+
+    if (!ok || p.len - sizeof(header) > DAEMON_MAX_PAYLOAD) {
+        free(p.data);
+        return NULL;
+    }
+
+    mode_t mask = umask(0);
+    umask(mask);
+
+    header.magic = DAEMON_MAGIC;
+    header.flags = use_cache ? 0 : DAEMON_FLAG_NO_CACHE;
+    header.umask = (uint32_t)mask;
+    header.cli_count = cli_args ? (uint32_t)cli_args->count : 0;
+    header.argv_count = (uint32_t)argc;
+    header.env_count = env_count;
+    header.payload_len = (uint32_t)(p.len - sizeof(header));
+    memcpy(p.data, &header, sizeof(header));
+
+    *out_len = p.len;
+    return p.data;
+}
+
+int daemon_client_run(const char* backend_name, const PathList* cli_args,
+                      bool use_cache, int argc, char** argv) {
+    if (argc <= 0) {
+        return -1;
+    }
+
+    char* socket_path = daemon_get_socket_path();
+    struct sockaddr_un addr;
+    bool have_addr = socket_path && fill_socket_address(&addr, socket_path);
+    free(socket_path);
+    if (!have_addr) {
+        return -1;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return -1;
+    }
+
+    // The socket directory is private, so checking the owner is enough here.
+    // An impostor could only fake results, not run anything unsandboxed.
+    struct ucred cred;
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        !peer_credentials(sock, &cred) || cred.uid != getuid()) {
+        close(sock);
+        return -1;
+    }
+
+    size_t len = 0;
+    char* request = build_request(backend_name, cli_args, use_cache, argc, argv, &len);
+    int stdio_fds[REQUEST_FDS] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    bool sent = request && send_with_fds(sock, request, len, stdio_fds, REQUEST_FDS);
+    free(request);
+
+    // Without a start notice the command never ran and can run locally
+    Message msg;
+    if (!sent || !read_all(sock, &msg, sizeof(msg)) || msg.type != MSG_STARTED) {
+        close(sock);
+        return -1;
+    }
+
+    // The command is not in our process group, so terminal signals have
+    // to be passed on
+    client_sock = sock;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = client_forward_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGQUIT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+
+    for (;;) {
+        if (!read_all(sock, &msg, sizeof(msg))) {
+            fprintf(stderr, "Error: Lost connection to sandbashd\n");
+            return 1;
+        }
+        if (msg.type == MSG_EXITED) {
+            break;
+        }
+    }
+
+    int status = msg.value;
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
+
+/* Zygote */
+
+typedef struct {
+    pid_t pid;
+    int conn;
+} Command;
+
+static int child_exit_pipe[2] = { -1, -1 };
+
+static void notify_child_exit(int sig) {
+    (void)sig;
+    int saved_errno = errno;
+    char byte = 0;
+    (void)!write(child_exit_pipe[1], &byte, 1);
+    errno = saved_errno;
+}
+
+static void close_from(int lowest) {
+#ifdef SYS_close_range
+    if (syscall(SYS_close_range, (unsigned)lowest, ~0u, 0) == 0) {
+        return;
+    }
+#endif
+    long max_fd = sysconf(_SC_OPEN_MAX);
+    for (int fd = lowest; fd < max_fd; fd++) {
+        close(fd);
+    }
+}
+
+static void write_error(const char* what, const char* name, int err) {
+    char buf[PATH_MAX + 128];
+    int len = snprintf(buf, sizeof(buf), "Error: Failed to %s '%s': %s\n", what, name,
+                       strerror(err));
+    if (len > 0) {
+        (void)!write(STDERR_FILENO, buf, (size_t)len < sizeof(buf) ? (size_t)len : sizeof(buf));
+    }
+}
+
+// Runs in the vforked command process; never returns. It shares the
+// zygote's memory, so it only writes to its own stack and the kernel.
+static void exec_command(const Request* req, const int* fds) {
+    for (int i = 0; i < REQUEST_FDS; i++) {
+        if (dup2(fds[i], i) < 0) {
+            _exit(1);
+        }
+    }
+    close_from(REQUEST_FDS);
+
+    umask((mode_t)req->header.umask);
+
+    if (chdir(req->cwd) != 0) {
+        write_error("change to directory", req->cwd, errno);
+        _exit(1);
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_DFL;
+    for (int sig = 1; sig < NSIG; sig++) {
+        sigaction(sig, &sa, NULL);
+    }
+    sigset_t empty;
+    sigemptyset(&empty);
+    sigprocmask(SIG_SETMASK, &empty, NULL);
+
+    setpgid(0, 0);
+
+    exec_with_env(req->argv, req->env);
+
+    write_error("execute", req->argv[0], errno);
+    _exit(1);
+}
+
+// Start the command for a request. Returns its pid, or -1.
+static pid_t start_command(const Request* req, const int* fds) {
+    // Nothing may run a handler in the child before it resets them
+    sigset_t all;
+    sigset_t saved;
+    sigfillset(&all);
+    sigprocmask(SIG_SETMASK, &all, &saved);
+
+    pid_t pid = vfork();
+    if (pid == 0) {
+        exec_command(req, fds);
+    }
+
+    sigprocmask(SIG_SETMASK, &saved, NULL);
+
+    if (pid > 0) {
+        // Also set here so signals cannot reach the wrong group
+        setpgid(pid, pid);
+    }
+    return pid;
+}
+
+// Runs in the sandboxed zygote; never returns. Starts a command for every
+// request the daemon passes on, relays the client's signals to it and
+// reports how it exited. Once the daemon closes the socket, the zygote
+// waits for running commands and exits.
+static void zygote_main(int sock) {
+    if (pipe2(child_exit_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        _exit(1);
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = notify_child_exit;
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGCHLD, &sa, NULL);
+
+    Command* commands = NULL;
+    int command_count = 0;
+    int command_capacity = 0;
+    struct pollfd* pfds = NULL;
+    bool daemon_open = true;
+
+    while (daemon_open || command_count > 0) {
+        struct pollfd* new_pfds = realloc(pfds, sizeof(struct pollfd) * (size_t)(command_count + 2));
+        if (!new_pfds) {
+            _exit(1);
+        }
+        pfds = new_pfds;
+
+        pfds[0] = (struct pollfd){ .fd = child_exit_pipe[0], .events = POLLIN };
+        pfds[1] = (struct pollfd){ .fd = daemon_open ? sock : -1, .events = POLLIN };
+        for (int i = 0; i < command_count; i++) {
+            pfds[i + 2] = (struct pollfd){ .fd = commands[i].conn, .events = POLLIN };
+        }
+
+        if (poll(pfds, (nfds_t)(command_count + 2), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            _exit(1);
+        }
+
+        // Signals for running commands; an EOF means the client is gone,
+        // as when its terminal closes
+        for (int i = 0; i < command_count; i++) {
+            if (!pfds[i + 2].revents) {
+                continue;
+            }
+            Message msg;
+            if (!read_all(commands[i].conn, &msg, sizeof(msg))) {
+                kill(-commands[i].pid, SIGHUP);
+                close(commands[i].conn);
+                commands[i].conn = -1;
+            } else if (msg.type == MSG_SIGNAL && msg.value > 0 && msg.value < NSIG) {
+                kill(-commands[i].pid, msg.value);
+            }
+        }
+
+        if (pfds[0].revents) {
+            char drain[16];
+            while (read(child_exit_pipe[0], drain, sizeof(drain)) > 0) {
+            }
+
+            int status;
+            pid_t pid;
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+                for (int i = 0; i < command_count; i++) {
+                    if (commands[i].pid != pid) {
+                        continue;
+                    }
+                    if (commands[i].conn >= 0) {
+                        send_message(commands[i].conn, MSG_EXITED, status);
+                        close(commands[i].conn);
+                    }
+                    commands[i] = commands[--command_count];
+                    break;
+                }
+            }
+        }
+
+        if (pfds[1].revents) {
+            Request req;
+            int fds[MAX_PASSED_FDS];
+            int nfds;
+            if (!recv_request(sock, &req, fds, &nfds)) {
+                daemon_open = false;
+                continue;
+            }
+
+            if (command_count == command_capacity) {
+                command_capacity = command_capacity ? command_capacity * 2 : 8;
+                Command* grown = realloc(commands, sizeof(Command) * (size_t)command_capacity);
+                if (!grown) {
+                    _exit(1);
+                }
+                commands = grown;
+            }
+
+            pid_t pid = -1;
+            if (nfds == MAX_PASSED_FDS && parse_request(&req)) {
+                pid = start_command(&req, fds);
+            }
+
+            if (pid > 0) {
+                commands[command_count].pid = pid;
+                commands[command_count].conn = fds[REQUEST_FDS];
+                command_count++;
+                nfds = REQUEST_FDS;
+
+                if (!send_message(fds[REQUEST_FDS], MSG_STARTED, (int)pid)) {
+                    kill(-pid, SIGHUP);
+                }
+            }
+
+            close_fds(fds, nfds);
+            free_request(&req);
+        }
+    }
+
+    _exit(0);
+}
+
+/* Daemon */
+
+static void remove_zygote(int index) {
+    close(zygotes[index].sock);
+    free(zygotes[index].key);
+    zygotes[index] = zygotes[--zygote_count];
+}
+
+static Zygote* spawn_zygote(const char* key, const SandboxBackend* backend,
+                            const PathList* paths, const DaemonOptions* options) {
+    if (zygote_count >= options->max_zygotes) {
+        int oldest = 0;
+        for (int i = 1; i < zygote_count; i++) {
+            if (zygotes[i].last_used < zygotes[oldest].last_used) {
+                oldest = i;
+            }
+        }
+        remove_zygote(oldest);
+    }
+
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0) {
+        fprintf(stderr, "Error: Failed to create socket pair: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    char* key_copy = strdup(key);
+    if (!key_copy) {
+        close(sockets[0]);
+        close(sockets[1]);
+        return NULL;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Error: Failed to fork: %s\n", strerror(errno));
+        free(key_copy);
+        close(sockets[0]);
+        close(sockets[1]);
+        return NULL;
+    }
+
+    if (pid == 0) {
+        close(sockets[0]);
+        close(listen_fd);
+        for (int i = 0; i < zygote_count; i++) {
+            close(zygotes[i].sock);
+        }
+
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+
+        // Commands must not share the daemon's controlling terminal
+        setsid();
+
+        // The working directory is already the requesting client's
+        if (!sandbox_apply(backend, paths)) {
+            _exit(1);
+        }
+        zygote_main(sockets[1]);
+    }
+
+    close(sockets[1]);
+
+    Zygote* zygote = &zygotes[zygote_count++];
+    zygote->key = key_copy;
+    zygote->pid = pid;
+    zygote->sock = sockets[0];
+    zygote->last_used = time(NULL);
+    return zygote;
+}
+
+// Backend name and path set identify the sandbox a zygote applied
+static char* build_ruleset_key(const SandboxBackend* backend, const PathList* paths) {
+    size_t len = strlen(backend->name) + 2;
+    for (int i = 0; i < paths->count; i++) {
+        len += strlen(paths->paths[i]) + 1;
+    }
+
+    char* key = malloc(len);
+    if (!key) {
+        return NULL;
+    }
+
+    char* p = stpcpy(key, backend->name);
+    *p++ = '\n';
+    for (int i = 0; i < paths->count; i++) {
+        p = stpcpy(p, paths->paths[i]);
+        *p++ = '\n';
+    }
+    *p = '\0';
+    return key;
+}
+
+// Probing a backend can mean forking a test process, so results are kept
+// for the lifetime of the daemon. An empty name selects the default.
+static const SandboxBackend* select_backend(const char* name) {
+    static struct {
+        char* name;
+        const SandboxBackend* backend;
+    } selected[MAX_SELECTED_BACKENDS];
+    static int selected_count = 0;
+
+    for (int i = 0; i < selected_count; i++) {
+        if (strcmp(selected[i].name, name) == 0) {
+            return selected[i].backend;
+        }
+    }
+
+    const SandboxBackend* backend = sandbox_select_backend(name[0] ? name : NULL);
+    if (backend && selected_count < MAX_SELECTED_BACKENDS) {
+        selected[selected_count].name = strdup(name);
+        if (selected[selected_count].name) {
+            selected[selected_count++].backend = backend;
+        }
+    }
+    return backend;
+}
+
+// Resolve the ruleset for a request and pass it to the matching zygote
+static void dispatch_request(Request* req, int* fds, int conn, const DaemonOptions* options) {
+    // Relative --allow-write paths resolve against the client's directory
+    if (chdir(req->cwd) != 0) {
+        return;
+    }
+
+    const SandboxBackend* backend = select_backend(req->backend);
+    Config* config = config_create_for_dir(req->cwd);
+    PathList* paths = NULL;
+    if (backend && config) {
+        paths = cache_resolve_paths(config, req->cli_args,
+                                    !(req->header.flags & DAEMON_FLAG_NO_CACHE));
+    }
+    config_free(config);
+
+    char* key = paths ? build_ruleset_key(backend, paths) : NULL;
+    if (!key) {
+        pathlist_free(paths);
+        return;
+    }
+
+    int forward_fds[MAX_PASSED_FDS];
+    memcpy(forward_fds, fds, sizeof(int) * REQUEST_FDS);
+    forward_fds[REQUEST_FDS] = conn;
+    size_t len = sizeof(req->header) + req->header.payload_len;
+    char* message = malloc(len);
+    if (message) {
+        memcpy(message, &req->header, sizeof(req->header));
+        memcpy(message + sizeof(req->header), req->payload, req->header.payload_len);
+    }
+
+    // A zygote that died since its last use gets replaced once
+    for (int attempt = 0; message && attempt < 2; attempt++) {
+        Zygote* zygote = NULL;
+        for (int i = 0; i < zygote_count; i++) {
+            if (strcmp(zygotes[i].key, key) == 0) {
+                zygote = &zygotes[i];
+                break;
+            }
+        }
+        if (!zygote) {
+            zygote = spawn_zygote(key, backend, paths, options);
+        }
+        if (!zygote) {
+            break;
+        }
+
+        zygote->last_used = time(NULL);
+        if (send_with_fds(zygote->sock, message, len, forward_fds, MAX_PASSED_FDS)) {
+            break;
+        }
+        remove_zygote((int)(zygote - zygotes));
+    }
+
+    free(message);
+    free(key);
+    pathlist_free(paths);
+}
+
+static void handle_client(int conn, const DaemonOptions* options) {
+    if (!peer_is_trusted(conn)) {
+        return;
+    }
+
+    // A client that stalls mid-request must not block everyone else
+    struct timeval timeout = { 1, 0 };
+    setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    Request req;
+    int fds[MAX_PASSED_FDS];
+    int nfds;
+    if (!recv_request(conn, &req, fds, &nfds)) {
+        return;
+    }
+
+    if (nfds == REQUEST_FDS && parse_request(&req)) {
+        // The runner reads signals from this socket with no deadline
+        timeout.tv_sec = 0;
+        setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        dispatch_request(&req, fds, conn, options);
+    }
+
+    close_fds(fds, nfds);
+    free_request(&req);
+}
+
+static void expire_idle_zygotes(const DaemonOptions* options) {
+    time_t now = time(NULL);
+    for (int i = zygote_count - 1; i >= 0; i--) {
+        if (now - zygotes[i].last_used >= options->idle_timeout) {
+            remove_zygote(i);
+        }
+    }
+}
+
+static bool create_listener(const char* socket_path) {
+    struct sockaddr_un addr;
+    if (!fill_socket_address(&addr, socket_path)) {
+        fprintf(stderr, "Error: Socket path too long: %s\n", socket_path);
+        return false;
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        fprintf(stderr, "Error: Failed to create socket: %s\n", strerror(errno));
+        return false;
+    }
+
+    // Refuse to take over from a daemon that is still answering
+    if (connect(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+        fprintf(stderr, "Error: sandbashd is already running (%s)\n", socket_path);
+        return false;
+    }
+    close(listen_fd);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        fprintf(stderr, "Error: Failed to create socket: %s\n", strerror(errno));
+        return false;
+    }
+
+    unlink(socket_path);
+    mode_t mask = umask(077);
+    int bound = bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(mask);
+
+    if (bound != 0 || listen(listen_fd, 64) != 0) {
+        fprintf(stderr, "Error: Failed to listen on %s: %s\n", socket_path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+int daemon_serve(const DaemonOptions* options) {
+    // Received fds must never land on 0-2, which commands dup2 over
+    int fd;
+    while ((fd = open("/dev/null", O_RDWR)) >= 0 && fd <= STDERR_FILENO) {
+    }
+    if (fd > STDERR_FILENO) {
+        close(fd);
+    }
+
+    zygotes = calloc((size_t)options->max_zygotes, sizeof(Zygote));
+    char* socket_path = daemon_get_socket_path();
+    if (!zygotes || !socket_path) {
+        fprintf(stderr, "Error: Failed to determine socket path\n");
+        free(zygotes);
+        free(socket_path);
+        return 1;
+    }
+
+    char* socket_dir = strdup(socket_path);
+    *strrchr(socket_dir, '/') = '\0';
+    mkdir(socket_dir, 0700);
+    free(socket_dir);
+
+    if (!create_listener(socket_path)) {
+        free(socket_path);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    for (;;) {
+        struct pollfd pfd = { .fd = listen_fd, .events = POLLIN };
+        int ready = poll(&pfd, 1, 1000);
+        if (ready < 0 && errno != EINTR) {
+            fprintf(stderr, "Error: poll failed: %s\n", strerror(errno));
+            break;
+        }
+
+        if (ready > 0) {
+            int conn = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            if (conn >= 0) {
+                handle_client(conn, options);
+                close(conn);
+            }
+        }
+
+        expire_idle_zygotes(options);
+
+        // Collect zygotes that have exited
+        while (waitpid(-1, NULL, WNOHANG) > 0) {
+        }
+    }
+
+    unlink(socket_path);
+    free(socket_path);
+    return 1;
+}
@@ -0,0 +1,26 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "config.h"
+#include <stdbool.h>
+
+typedef struct {
+    // Seconds an unused zygote is kept before it is shut down
+    int idle_timeout;
+    // Maximum number of zygotes; the least recently used is evicted
+    int max_zygotes;
+} DaemonOptions;
+
+// Get the path of the per-user sandbashd socket
+char* daemon_get_socket_path(void);
+
+// Run a command through sandbashd. Returns the command's exit status, or -1
+// if no trusted daemon could take the request and the caller should run the
+// command itself. Nothing has been executed when -1 is returned.
+int daemon_client_run(const char* backend_name, const PathList* cli_args,
+                      bool use_cache, int argc, char** argv);
+
+// Listen on the daemon socket and serve requests; returns only on error
+int daemon_serve(const DaemonOptions* options);
+
+#endif // DAEMON_H
@@ -0,0 +1,593 @@
+/*
+ * Fan-out mode: run one command in many directories, each in its own
+ * sandbox built from that directory's config.
+ *
+ * Directories are dealt round-robin onto per-worker queues. A worker takes
+ * jobs from the front of its own queue and, once that is empty, steals from
+ * the back of the others', so one slow directory holds up only the worker
+ * running it. No jobs are added after start, so a worker that finds every
+ * queue empty is done.
+ *
+ * Every line a command writes is prefixed with its directory and written
+ * whole, so output from concurrent runs interleaves only between lines.
+ *
+ * Workers never fork themselves: a child forked while another thread holds
+ * the malloc or stdio lock would deadlock on its way to exec. A launcher
+ * process is forked before the workers start, and each worker hands it
+ * jobs, with the pipes for their output, over a socket of its own. The
+ * launcher forks one process per job that loads the config, spawns the
+ * command and reports how it ended. Both stay single-threaded.
+ */
+
+#include "fanout.h"
+#include "sandbash.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#define MAX_JOBS 256
+#define READ_CHUNK 4096
+
+typedef struct {
+    const char* dir;
+    SandbashError error;
+    int error_errno;
+    int status;
+    double seconds;
+} Job;
+
+// What a job process sends back to its worker
+typedef struct {
+    SandbashError error;
+    int error_errno;
+    int status;
+} JobResult;
+
+typedef struct {
+    pthread_mutex_t lock;
+    int* jobs;
+    int head;
+    int tail;
+} WorkQueue;
+
+typedef struct {
+    const FanoutOptions* options;
+    Job* jobs;
+    WorkQueue* queues;
+    int worker_count;
+    int devnull;
+    pthread_mutex_t output_lock;
+} Fanout;
+
+typedef struct {
+    Fanout* fanout;
+    int index;
+    // This worker's end of its socket to the launcher
+    int launcher_fd;
+} Worker;
+
+// Partial line carried between reads of one output stream
+typedef struct {
+    int fd;
+    FILE* out;
+    char* data;
+    size_t len;
+    size_t capacity;
+} LineBuffer;
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Owner end: directories in the order they were given
+static int queue_pop(WorkQueue* queue) {
+    int job = -1;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail) {
+        job = queue->jobs[queue->head++];
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return job;
+}
+
+// Thief end: the job the owner would get to last
+static int queue_steal(WorkQueue* queue) {
+    int job = -1;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail) {
+        job = queue->jobs[--queue->tail];
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return job;
+}
+
+static int next_job(Fanout* fanout, int self) {
+    int job = queue_pop(&fanout->queues[self]);
+    for (int i = 1; job < 0 && i < fanout->worker_count; i++) {
+        job = queue_steal(&fanout->queues[(self + i) % fanout->worker_count]);
+    }
+    return job;
+}
+
+static void write_prefixed(Fanout* fanout, FILE* out, const char* dir,
+                           const char* line, size_t len) {
+    pthread_mutex_lock(&fanout->output_lock);
+    fprintf(out, "[%s] ", dir);
+    fwrite(line, 1, len, out);
+    if (len == 0 || line[len - 1] != '\n') {
+        fputc('\n', out);
+    }
+    fflush(out);
+    pthread_mutex_unlock(&fanout->output_lock);
+}
+
+// Read what is available and write out every complete line. Returns false
+// at EOF, after flushing any unterminated last line.
+static bool relay_lines(Fanout* fanout, const char* dir, LineBuffer* buffer) {
+    if (buffer->capacity - buffer->len < READ_CHUNK) {
+        size_t capacity = buffer->capacity * 2 + READ_CHUNK;
+        char* data = realloc(buffer->data, capacity);
+        if (!data) {
+            return false;
+        }
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+
+    ssize_t n = read(buffer->fd, buffer->data + buffer->len, READ_CHUNK);
+    if (n < 0 && errno == EINTR) {
+        return true;
+    }
+    if (n <= 0) {
+        if (buffer->len > 0) {
+            write_prefixed(fanout, buffer->out, dir, buffer->data, buffer->len);
+            buffer->len = 0;
+        }
+        return false;
+    }
+    buffer->len += (size_t)n;
+
+    size_t start = 0;
+    for (size_t i = buffer->len - (size_t)n; i < buffer->len; i++) {
+        if (buffer->data[i] == '\n') {
+            write_prefixed(fanout, buffer->out, dir, buffer->data + start, i - start + 1);
+            start = i + 1;
+        }
+    }
+    memmove(buffer->data, buffer->data + start, buffer->len - start);
+    buffer->len -= start;
+    return true;
+}
+
+static void relay_output(Fanout* fanout, const char* dir, int out_fd, int err_fd) {
+    LineBuffer buffers[2] = {
+        { .fd = out_fd, .out = stdout },
+        { .fd = err_fd, .out = stderr },
+    };
+    bool active[2] = { true, true };
+
+    while (active[0] || active[1]) {
+        struct pollfd pfds[2] = {
+            { .fd = active[0] ? out_fd : -1, .events = POLLIN },
+            { .fd = active[1] ? err_fd : -1, .events = POLLIN },
+        };
+        if (poll(pfds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (int i = 0; i < 2; i++) {
+            if (pfds[i].revents) {
+                active[i] = relay_lines(fanout, dir, &buffers[i]);
+            }
+        }
+    }
+
+    free(buffers[0].data);
+    free(buffers[1].data);
+}
+
+// Send a job index with the write ends of its output pipes
+static bool send_job(int sock, int index, int out_fd, int err_fd) {
+    int fds[2] = { out_fd, err_fd };
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = { &index, sizeof(index) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control,
+        .msg_controllen = sizeof(control),
+    };
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t n;
+    do {
+        n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    return n == (ssize_t)sizeof(index);
+}
+
+// Receive a job from send_job(). Returns 0 at EOF, -1 on error.
+static int receive_job(int sock, int* index, int fds[2]) {
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    struct iovec iov = { index, sizeof(*index) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control,
+        .msg_controllen = sizeof(control),
+    };
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        return n == 0 ? 0 : -1;
+    }
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (n != (ssize_t)sizeof(*index) || !cmsg || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int))) {
+        if (cmsg && cmsg->cmsg_type == SCM_RIGHTS) {
+            int count = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            for (int i = 0; i < count; i++) {
+                int fd;
+                memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(fd));
+                close(fd);
+            }
+        }
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), 2 * sizeof(int));
+    return 1;
+}
+
+// Runs in a process of its own, forked by the launcher; never returns
+static void run_job_process(Fanout* fanout, int sock, int index, const int pipes[2]) {
+    // The launcher ignores SIGCHLD; this process waits for its command
+    signal(SIGCHLD, SIG_DFL);
+
+    const FanoutOptions* options = fanout->options;
+    SandbashOptions sandbox_options = {
+        .directory = fanout->jobs[index].dir,
+        .allow_write = options->allow_write,
+        .allow_write_count = options->allow_write_count,
+        .backend = options->backend,
+        .use_cache = options->use_cache,
+    };
+
+    JobResult result = { SANDBASH_OK, 0, 0 };
+    SandbashConfig* config = NULL;
+    result.error = sandbash_config_load(&sandbox_options, &config);
+    if (result.error == SANDBASH_OK) {
+        int fds[3] = { fanout->devnull, pipes[0], pipes[1] };
+        SandbashProcess process;
+        result.error = sandbash_spawn(config, options->argv, NULL, fds, &process);
+        result.error_errno = process.error_errno;
+        sandbash_config_free(config);
+        close(pipes[0]);
+        close(pipes[1]);
+        if (result.error == SANDBASH_OK) {
+            while (waitpid(process.pid, &result.status, 0) < 0 && errno == EINTR) {
+            }
+        }
+    }
+    (void)!send(sock, &result, sizeof(result), MSG_NOSIGNAL);
+    _exit(0);
+}
+
+// The launcher: fork a process for each job the workers send, until every
+// worker has closed its socket. Never returns.
+static void run_launcher(Fanout* fanout, const int* socks) {
+    // Job processes report over the socket; nobody needs their status
+    signal(SIGCHLD, SIG_IGN);
+
+    int count = fanout->worker_count;
+    struct pollfd* pfds = calloc((size_t)count, sizeof(struct pollfd));
+    if (!pfds) {
+        _exit(1);
+    }
+    int open_count = count;
+    for (int i = 0; i < count; i++) {
+        pfds[i].fd = socks[i];
+        pfds[i].events = POLLIN;
+    }
+
+    while (open_count > 0) {
+        if (poll(pfds, (nfds_t)count, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            _exit(1);
+        }
+        for (int i = 0; i < count; i++) {
+            if (pfds[i].fd < 0 || !pfds[i].revents) {
+                continue;
+            }
+            int index;
+            int pipes[2];
+            int received = receive_job(pfds[i].fd, &index, pipes);
+            if (received <= 0) {
+                close(pfds[i].fd);
+                pfds[i].fd = -1;
+                open_count--;
+                continue;
+            }
+
+            // A job process that cannot be started, or an index that is
+            // out of range, closes the pipes unanswered; the worker sees
+            // a failed fork
+            if (index >= 0 && index < fanout->options->dir_count && fork() == 0) {
+                run_job_process(fanout, pfds[i].fd, index, pipes);
+            }
+            close(pipes[0]);
+            close(pipes[1]);
+        }
+    }
+    _exit(0);
+}
+
+static void run_job(Worker* worker, Job* job) {
+    Fanout* fanout = worker->fanout;
+    double start = monotonic_seconds();
+
+    int out_pipe[2];
+    int err_pipe[2];
+    if (!create_cloexec_pipe(out_pipe)) {
+        job->error = SANDBASH_ERR_FORK;
+        job->error_errno = errno;
+        return;
+    }
+    if (!create_cloexec_pipe(err_pipe)) {
+        job->error = SANDBASH_ERR_FORK;
+        job->error_errno = errno;
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        return;
+    }
+
+    bool sent = send_job(worker->launcher_fd, (int)(job - fanout->jobs), out_pipe[1],
+                         err_pipe[1]);
+    int send_errno = errno;
+    close(out_pipe[1]);
+    close(err_pipe[1]);
+
+    JobResult result = { SANDBASH_ERR_FORK, sent ? 0 : send_errno, 0 };
+    if (sent) {
+        // Output ends once the command and the job process are done with
+        // it, then the result follows
+        relay_output(fanout, job->dir, out_pipe[0], err_pipe[0]);
+        ssize_t n;
+        do {
+            n = recv(worker->launcher_fd, &result, sizeof(result), 0);
+        } while (n < 0 && errno == EINTR);
+        if (n != (ssize_t)sizeof(result)) {
+            result.error = SANDBASH_ERR_FORK;
+            result.error_errno = n < 0 ? errno : 0;
+        }
+    }
+    job->error = result.error;
+    job->error_errno = result.error_errno;
+    job->status = result.status;
+
+    close(out_pipe[0]);
+    close(err_pipe[0]);
+    job->seconds = monotonic_seconds() - start;
+}
+
+static void* worker_main(void* arg) {
+    Worker* worker = arg;
+    Fanout* fanout = worker->fanout;
+
+    int index;
+    while ((index = next_job(fanout, worker->index)) >= 0) {
+        Job* job = &fanout->jobs[index];
+        run_job(worker, job);
+
+        if (job->error != SANDBASH_OK) {
+            char message[512];
+            if (job->error_errno != 0) {
+                snprintf(message, sizeof(message), "Error: %s: %s", sandbash_strerror(job->error),
+                         strerror(job->error_errno));
+            } else {
+                snprintf(message, sizeof(message), "Error: %s", sandbash_strerror(job->error));
+            }
+            write_prefixed(fanout, stderr, job->dir, message, strlen(message));
+        }
+    }
+    return NULL;
+}
+
+static bool job_succeeded(const Job* job) {
+    return job->error == SANDBASH_OK && WIFEXITED(job->status) && WEXITSTATUS(job->status) == 0;
+}
+
+static void print_summary(const Fanout* fanout, double seconds) {
+    const FanoutOptions* options = fanout->options;
+    int failed = 0;
+    for (int i = 0; i < options->dir_count; i++) {
+        if (!job_succeeded(&fanout->jobs[i])) {
+            failed++;
+        }
+    }
+
+    printf("\nSummary: %d directories, %d succeeded, %d failed (%.1fs)\n",
+           options->dir_count, options->dir_count - failed, failed, seconds);
+
+    for (int i = 0; i < options->dir_count; i++) {
+        const Job* job = &fanout->jobs[i];
+        if (job_succeeded(job)) {
+            continue;
+        }
+        if (job->error != SANDBASH_OK) {
+            printf("  FAIL %s: %s\n", job->dir, sandbash_strerror(job->error));
+        } else if (WIFSIGNALED(job->status)) {
+            printf("  FAIL %s: killed by signal %d (%.1fs)\n", job->dir,
+                   WTERMSIG(job->status), job->seconds);
+        } else {
+            printf("  FAIL %s: exit %d (%.1fs)\n", job->dir,
+                   WEXITSTATUS(job->status), job->seconds);
+        }
+    }
+}
+
+int fanout_run(const FanoutOptions* options) {
+    if (!options || options->dir_count <= 0 || !options->argv || !options->argv[0]) {
+        return 1;
+    }
+
+    int workers = options->jobs;
+    if (workers <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (int)cpus : 1;
+    }
+    if (workers > MAX_JOBS) {
+        workers = MAX_JOBS;
+    }
+    if (workers > options->dir_count) {
+        workers = options->dir_count;
+    }
+
+    Fanout fanout = {
+        .options = options,
+        .jobs = calloc((size_t)options->dir_count, sizeof(Job)),
+        .queues = calloc((size_t)workers, sizeof(WorkQueue)),
+        .worker_count = workers,
+        .devnull = open("/dev/null", O_RDONLY | O_CLOEXEC),
+    };
+    Worker* worker_args = calloc((size_t)workers, sizeof(Worker));
+    pthread_t* threads = calloc((size_t)workers, sizeof(pthread_t));
+    bool* joinable = calloc((size_t)workers, sizeof(bool));
+
+    if (!fanout.jobs || !fanout.queues || !worker_args || !threads || !joinable ||
+        fanout.devnull < 0) {
+        fprintf(stderr, "Error: Failed to set up workers\n");
+        free(fanout.jobs);
+        free(fanout.queues);
+        free(worker_args);
+        free(threads);
+        free(joinable);
+        if (fanout.devnull >= 0) {
+            close(fanout.devnull);
+        }
+        return 1;
+    }
+
+    pthread_mutex_init(&fanout.output_lock, NULL);
+
+    // Deal directories out round-robin; each queue holds at most this many
+    int per_queue = (options->dir_count + workers - 1) / workers;
+    for (int w = 0; w < workers; w++) {
+        pthread_mutex_init(&fanout.queues[w].lock, NULL);
+        fanout.queues[w].jobs = malloc(sizeof(int) * (size_t)per_queue);
+        if (!fanout.queues[w].jobs) {
+            fprintf(stderr, "Error: Failed to set up workers\n");
+            exit(1);
+        }
+    }
+    for (int i = 0; i < options->dir_count; i++) {
+        fanout.jobs[i].dir = options->dirs[i];
+        WorkQueue* queue = &fanout.queues[i % workers];
+        queue->jobs[queue->tail++] = i;
+    }
+
+    // Buffered output would otherwise be copied into every child
+    fflush(stdout);
+    fflush(stderr);
+
+    // One socket per worker, so results go back to the worker that asked
+    int* launcher_socks = calloc((size_t)workers, sizeof(int));
+    for (int w = 0; w < workers; w++) {
+        int pair[2];
+        if (!launcher_socks ||
+            socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair) != 0) {
+            fprintf(stderr, "Error: Failed to set up workers\n");
+            exit(1);
+        }
+        worker_args[w].launcher_fd = pair[0];
+        launcher_socks[w] = pair[1];
+    }
+    pid_t launcher = fork();
+    if (launcher == 0) {
+        for (int w = 0; w < workers; w++) {
+            close(worker_args[w].launcher_fd);
+        }
+        run_launcher(&fanout, launcher_socks);
+    }
+    for (int w = 0; w < workers; w++) {
+        close(launcher_socks[w]);
+    }
+    free(launcher_socks);
+    if (launcher < 0) {
+        fprintf(stderr, "Error: Failed to start the launcher: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    double start = monotonic_seconds();
+    int started = 0;
+    for (int w = 0; w < workers; w++) {
+        worker_args[w].fanout = &fanout;
+        worker_args[w].index = w;
+        if (pthread_create(&threads[w], NULL, worker_main, &worker_args[w]) == 0) {
+            joinable[w] = true;
+            started++;
+        }
+    }
+
+    // Workers steal, so any one that started drains every queue
+    if (started == 0) {
+        worker_main(&worker_args[0]);
+    }
+    for (int w = 0; w < workers; w++) {
+        if (joinable[w]) {
+            pthread_join(threads[w], NULL);
+        }
+    }
+
+    // The launcher exits once every socket is closed
+    for (int w = 0; w < workers; w++) {
+        close(worker_args[w].launcher_fd);
+    }
+    while (waitpid(launcher, NULL, 0) < 0 && errno == EINTR) {
+    }
+
+    print_summary(&fanout, monotonic_seconds() - start);
+
+    int result = 0;
+    for (int i = 0; i < options->dir_count; i++) {
+        if (!job_succeeded(&fanout.jobs[i])) {
+            result = 1;
+        }
+    }
+
+    for (int w = 0; w < workers; w++) {
+        free(fanout.queues[w].jobs);
+        pthread_mutex_destroy(&fanout.queues[w].lock);
+    }
+    pthread_mutex_destroy(&fanout.output_lock);
+    close(fanout.devnull);
+    free(fanout.jobs);
+    free(fanout.queues);
+    free(worker_args);
+    free(threads);
+    free(joinable);
+    return result;
+}
@@ -0,0 +1,27 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+    // Directories to run the command in, each with its own config and sandbox
+    char** dirs;
+    int dir_count;
+    // Command to run
+    char** argv;
+    // Extra writable paths for every directory, as with --allow-write
+    const char* const* allow_write;
+    size_t allow_write_count;
+    // Backend name, or NULL for the best available
+    const char* backend;
+    bool use_cache;
+    // Number of directories to run at once; 0 for one per CPU
+    int jobs;
+} FanoutOptions;
+
+// Run the command in every directory, prefixing its output with the
+// directory, then print a summary. Returns 0 if every run exited 0.
+int fanout_run(const FanoutOptions* options);
+
+#endif // FANOUT_H
@@ -5,20 +5,36 @@
 #include <getopt.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
 #include <signal.h>
 #include <sys/wait.h>
 #include "config.h"
-#include "sandbox.h"
+#include "sandbash.h"
+#include "fanout.h"
+#include "trace.h"
 #include "utils.h"
+#include "snapshot.h"
+#include "resources.h"
+#include "report.h"
+#include "preset.h"
+#include "pattern.h"
+#include "projects.h"
+#include "resolve.h"
+#ifdef __linux__
+#include "daemon.h"
+#include "overlay.h"
+#include "changes.h"
+#include "profile.h"
+#include "supervisor.h"
+#endif
 
 #define VERSION "0.1.0"
 
 extern char** environ;
 
 static void signal_handler(int sig) {
-    (void)sig;  // Unused parameter
-    // Just exit cleanly
-    exit(0);
+    // Exit the way a process killed by sig would appear to a shell
+    exit(128 + sig);
 }
 
 typedef enum {
@@ -26,28 +42,131 @@ typedef enum {
     MODE_ADD_PATH,
     MODE_REMOVE_PATH,
     MODE_EDIT,
-    MODE_LIST_PATHS
+    MODE_LIST_PATHS,
+    MODE_EACH_DIR,
+    MODE_OVERLAY_DIFF,
+    MODE_OVERLAY_COMMIT,
+    MODE_OVERLAY_DISCARD,
+    MODE_ROLLBACK,
+    MODE_DROP_SNAPSHOT,
+    MODE_LIST_SANDBOXES,
+    MODE_KILL_SANDBOX,
+    MODE_GRANT,
+    MODE_REINDEX,
+    MODE_LIST_PROJECTS
 } OperationMode;
 
 typedef struct {
     OperationMode mode;
     PathList* allow_write_paths;
+    // --preset values, each a comma-separated list of preset names
+    PathList* presets;
+    const char* backend_name;
+    bool use_cache;
+    bool use_daemon;
+    int jobs;
+    // Overlay session for --overlay and the --overlay-* commands
+    bool use_overlay;
+    const char* overlay_id;
+    // Snapshot for --snapshot, --rollback and --drop-snapshot
+    bool use_snapshot;
+    const char* snapshot_id;
+    // Manifest of changed paths for --changes-out
+    const char* changes_out;
+    // JSON lines log for --audit
+    const char* audit_log;
+    // Per-directory report for --profile-io
+    const char* profile_io;
+    // --cpu-max, --memory-max, --pids-max, --io-weight, --cpuset, --priority
+    ResourceLimits limits;
+    // JSON resource usage for --report
+    const char* report;
+    // Size-capped tmpfs on /tmp for --private-tmp; zero size for the
+    // kernel default
+    bool private_tmp;
+    unsigned long long private_tmp_size;
+    // Supervised run for --supervise, --timeout and --session, and the
+    // sandbox --kill-sandbox targets
+    bool supervise;
+    const char* session_id;
+    // Control socket for --allow-grants, and the path --grant adds to the
+    // --session sandbox
+    bool allow_grants;
+    const char* grant_path;
+    double timeout;
+    double kill_after;
     int bash_argc;
     char** bash_argv;
 } Arguments;
 
 static void print_usage(const char* program_name) {
-    printf("sandbash v%s - Sandboxed bash launcher for macOS\n\n", VERSION);
+    printf("sandbash v%s - Sandboxed bash launcher\n\n", VERSION);
     printf("Usage: %s [OPTIONS] [BASH_ARGS...]\n", program_name);
     printf("\nSandbox execution:\n");
     printf("  %s [--allow-write=PATH]... [BASH_ARGS...]\n", program_name);
+    printf("\nFan-out execution:\n");
+    printf("  %s [--jobs=N] --each-dir DIR... -- COMMAND [ARGS...]\n", program_name);
     printf("\nConfiguration management:\n");
     printf("  --add-path PATH      Add path to per-directory config\n");
     printf("  --remove-path PATH   Remove path from per-directory config\n");
     printf("  --edit               Edit per-directory config\n");
     printf("  --list-paths         List all writable paths\n");
+    printf("  --list-projects      List directories with a per-directory config\n");
+    printf("  --reindex            Rebuild the index of per-directory configs\n");
+    printf("\nOverlay sessions (Linux):\n");
+    printf("  --overlay-diff ID    List what a session changed\n");
+    printf("  --overlay-commit ID  Apply a session's changes and delete it\n");
+    printf("  --overlay-discard ID Delete a session without applying it\n");
+    printf("\nSupervised sandboxes (Linux):\n");
+    printf("  --list-sandboxes     List running supervised sandboxes\n");
+    printf("  --kill-sandbox ID    Terminate a supervised sandbox and its processes\n");
+    printf("  --grant PATH --session ID\n");
+    printf("                       Make PATH writable in a running sandbox started\n");
+    printf("                       with --allow-grants\n");
+    printf("\nSnapshots:\n");
+    printf("  --rollback ID        Restore the writable paths saved by a snapshot\n");
+    printf("  --drop-snapshot ID   Delete a snapshot\n");
     printf("\nOptions:\n");
     printf("  --allow-write=PATH   Add temporary writable path\n");
+    printf("  --preset=NAMES       Make toolchain caches writable: node, rust, python,\n");
+    printf("                       go, ccache, or auto to pick by command name\n");
+    printf("  --backend=NAME       Use a specific sandbox backend\n");
+    printf("  --no-cache           Ignore the cached writable path set\n");
+    printf("  --resolve-timeout=DURATION\n");
+    printf("                       Skip paths that take longer to resolve, e.g. on a\n");
+    printf("                       hung network mount (default 2s, 0 for no limit)\n");
+    printf("  --use-daemon         Start commands through sandbashd if it is running\n");
+    printf("  -j, --jobs=N         Run N directories at once with --each-dir\n");
+    printf("  --overlay[=ID]       Capture writes outside the policy in an overlay\n");
+    printf("                       session instead of failing them (Linux)\n");
+    printf("  --snapshot[=ID]      Save the writable paths before running. Without\n");
+    printf("                       reflinks (Btrfs, XFS, APFS) every file is copied\n");
+    printf("  --changes-out=FILE   List the paths the command changed in FILE (Linux)\n");
+    printf("  --audit=FILE         Allow writes outside the writable paths but log\n");
+    printf("                       them to FILE as JSON lines (Linux, seccomp)\n");
+    printf("  --profile-io=FILE    Count and time file syscalls per directory into\n");
+    printf("                       FILE (Linux)\n");
+    printf("  --private-tmp[=SIZE] Mount a private tmpfs of up to SIZE, e.g. 2G, on\n");
+    printf("                       /tmp, freed when the command exits (Linux)\n");
+    printf("  --supervise          Stay as the command's supervisor and terminate\n");
+    printf("                       whatever it leaves running when it exits (Linux)\n");
+    printf("  --session=ID         Name the supervised sandbox (implies --supervise)\n");
+    printf("  --timeout=DURATION   Terminate the command after DURATION, e.g. 90s or\n");
+    printf("                       10m; exits with 124 (implies --supervise)\n");
+    printf("  --kill-after=DURATION  Send SIGKILL if the command is still running\n");
+    printf("                       DURATION after SIGTERM (default 5s)\n");
+    printf("  --allow-grants       Accept --grant from outside the sandbox while it\n");
+    printf("                       runs (Linux, seccomp; implies --supervise)\n");
+    printf("  --report=FILE        Write the command's wall time, CPU, memory and I/O\n");
+    printf("                       to FILE as JSON\n");
+    printf("\nResource limits (cgroup v2 on Linux, setrlimit otherwise):\n");
+    printf("  --cpu-max=CPUS       Limit CPU time to CPUS processors, e.g. 1.5\n");
+    printf("  --memory-max=SIZE    Limit memory, e.g. 2G\n");
+    printf("  --pids-max=N         Limit the number of processes\n");
+    printf("  --io-weight=N        Set the I/O weight, 1-10000 (default 100)\n");
+    printf("  --cpuset=CPUS        Run only on CPUS, e.g. 0-3,6\n");
+    printf("  --priority=PRESET    background (nice, low I/O priority) or idle\n");
+    printf("                       (SCHED_IDLE, idle I/O class)\n");
     printf("  -h, --help           Show this help message\n");
 }
 
@@ -59,15 +178,72 @@ static Arguments* parse_arguments(int argc, char* argv[]) {
 
     args->mode = MODE_SANDBOX;
     args->allow_write_paths = pathlist_create();
+    args->presets = pathlist_create();
+    args->backend_name = NULL;
+    args->use_cache = true;
+    args->use_daemon = false;
+    args->jobs = 0;
+    args->use_overlay = false;
+    args->overlay_id = NULL;
+    args->use_snapshot = false;
+    args->snapshot_id = NULL;
+    args->changes_out = NULL;
+    args->audit_log = NULL;
+    args->profile_io = NULL;
+    memset(&args->limits, 0, sizeof(args->limits));
+    args->report = NULL;
+    args->private_tmp = false;
+    args->private_tmp_size = 0;
+    args->supervise = false;
+    args->session_id = NULL;
+    args->allow_grants = false;
+    args->grant_path = NULL;
+    args->timeout = 0;
+    args->kill_after = 5;
     args->bash_argc = 0;
     args->bash_argv = NULL;
 
     static struct option long_options[] = {
         {"allow-write", required_argument, 0, 'w'},
+        {"preset", required_argument, 0, 'f'},
         {"add-path", required_argument, 0, 'a'},
         {"remove-path", required_argument, 0, 'r'},
         {"edit", no_argument, 0, 'e'},
         {"list-paths", no_argument, 0, 'l'},
+        {"backend", required_argument, 0, 'b'},
+        {"no-cache", no_argument, 0, 'C'},
+        {"resolve-timeout", required_argument, 0, 'd'},
+        {"use-daemon", no_argument, 0, 'D'},
+        {"each-dir", no_argument, 0, 'E'},
+        {"jobs", required_argument, 0, 'j'},
+        {"overlay", optional_argument, 0, 'O'},
+        {"overlay-diff", required_argument, 0, 'V'},
+        {"overlay-commit", required_argument, 0, 'M'},
+        {"overlay-discard", required_argument, 0, 'X'},
+        {"snapshot", optional_argument, 0, 'S'},
+        {"rollback", required_argument, 0, 'R'},
+        {"drop-snapshot", required_argument, 0, 'K'},
+        {"changes-out", required_argument, 0, 'c'},
+        {"audit", required_argument, 0, 'U'},
+        {"profile-io", required_argument, 0, 'P'},
+        {"cpu-max", required_argument, 0, 'Q'},
+        {"memory-max", required_argument, 0, 'm'},
+        {"pids-max", required_argument, 0, 'p'},
+        {"io-weight", required_argument, 0, 'i'},
+        {"cpuset", required_argument, 0, 's'},
+        {"priority", required_argument, 0, 'N'},
+        {"report", required_argument, 0, 'T'},
+        {"private-tmp", optional_argument, 0, 'y'},
+        {"supervise", no_argument, 0, 'G'},
+        {"session", required_argument, 0, 'n'},
+        {"timeout", required_argument, 0, 't'},
+        {"kill-after", required_argument, 0, 'k'},
+        {"list-sandboxes", no_argument, 0, 'L'},
+        {"kill-sandbox", required_argument, 0, 'Z'},
+        {"allow-grants", no_argument, 0, 'W'},
+        {"grant", required_argument, 0, 'g'},
+        {"reindex", no_argument, 0, 'I'},
+        {"list-projects", no_argument, 0, 'J'},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}
     };
@@ -75,12 +251,15 @@ static Arguments* parse_arguments(int argc, char* argv[]) {
     int opt;
     int option_index = 0;
 
-    while ((opt = getopt_long(argc, argv, "+w:a:r:elh",
+    while ((opt = getopt_long(argc, argv, "+w:f:a:r:elb:Cd:DEj:O::V:M:X:S::R:K:c:U:P:Q:m:p:i:s:N:T:y::Gn:t:k:LZ:Wg:IJh",
                               long_options, &option_index)) != -1) {
         switch (opt) {
             case 'w':
                 pathlist_add(args->allow_write_paths, optarg);
                 break;
+            case 'f':
+                pathlist_add(args->presets, optarg);
+                break;
             case 'a':
                 args->mode = MODE_ADD_PATH;
                 pathlist_add(args->allow_write_paths, optarg);
@@ -95,6 +274,150 @@ static Arguments* parse_arguments(int argc, char* argv[]) {
             case 'l':
                 args->mode = MODE_LIST_PATHS;
                 break;
+            case 'I':
+                args->mode = MODE_REINDEX;
+                break;
+            case 'J':
+                args->mode = MODE_LIST_PROJECTS;
+                break;
+            case 'b':
+                args->backend_name = optarg;
+                break;
+            case 'C':
+                args->use_cache = false;
+                break;
+            case 'd': {
+                double seconds;
+                if (!parse_duration(optarg, &seconds)) {
+                    fprintf(stderr, "Error: Invalid duration: %s\n", optarg);
+                    exit(1);
+                }
+                resolve_set_timeout(seconds);
+                break;
+            }
+            case 'D':
+                args->use_daemon = true;
+                break;
+            case 'E':
+                args->mode = MODE_EACH_DIR;
+                break;
+            case 'j': {
+                char* end;
+                long jobs = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || jobs <= 0 || jobs > 1024) {
+                    fprintf(stderr, "Error: Invalid job count: %s\n", optarg);
+                    exit(1);
+                }
+                args->jobs = (int)jobs;
+                break;
+            }
+            case 'O':
+                args->use_overlay = true;
+                args->overlay_id = optarg;
+                break;
+            case 'V':
+                args->mode = MODE_OVERLAY_DIFF;
+                args->overlay_id = optarg;
+                break;
+            case 'M':
+                args->mode = MODE_OVERLAY_COMMIT;
+                args->overlay_id = optarg;
+                break;
+            case 'X':
+                args->mode = MODE_OVERLAY_DISCARD;
+                args->overlay_id = optarg;
+                break;
+            case 'S':
+                args->use_snapshot = true;
+                args->snapshot_id = optarg;
+                break;
+            case 'R':
+                args->mode = MODE_ROLLBACK;
+                args->snapshot_id = optarg;
+                break;
+            case 'K':
+                args->mode = MODE_DROP_SNAPSHOT;
+                args->snapshot_id = optarg;
+                break;
+            case 'c':
+                args->changes_out = optarg;
+                break;
+            case 'U':
+                args->audit_log = optarg;
+                break;
+            case 'P':
+                args->profile_io = optarg;
+                break;
+            case 'Q':
+                if (!resources_parse_option(&args->limits, "cpu-max", optarg)) {
+                    exit(1);
+                }
+                break;
+            case 'm':
+                if (!resources_parse_option(&args->limits, "memory-max", optarg)) {
+                    exit(1);
+                }
+                break;
+            case 'p':
+                if (!resources_parse_option(&args->limits, "pids-max", optarg)) {
+                    exit(1);
+                }
+                break;
+            case 'i':
+                if (!resources_parse_option(&args->limits, "io-weight", optarg)) {
+                    exit(1);
+                }
+                break;
+            case 's':
+                if (!resources_parse_option(&args->limits, "cpuset", optarg)) {
+                    exit(1);
+                }
+                break;
+            case 'N':
+                if (!resources_parse_option(&args->limits, "priority", optarg)) {
+                    exit(1);
+                }
+                break;
+            case 'T':
+                args->report = optarg;
+                break;
+            case 'y':
+                args->private_tmp = true;
+                if (optarg && !parse_size(optarg, &args->private_tmp_size)) {
+                    fprintf(stderr, "Error: Invalid size for --private-tmp: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'G':
+                args->supervise = true;
+                break;
+            case 'n':
+                args->supervise = true;
+                args->session_id = optarg;
+                break;
+            case 't':
+            case 'k':
+                if (!parse_duration(optarg, opt == 't' ? &args->timeout : &args->kill_after)) {
+                    fprintf(stderr, "Error: Invalid duration: %s\n", optarg);
+                    exit(1);
+                }
+                args->supervise = true;
+                break;
+            case 'L':
+                args->mode = MODE_LIST_SANDBOXES;
+                break;
+            case 'Z':
+                args->mode = MODE_KILL_SANDBOX;
+                args->session_id = optarg;
+                break;
+            case 'W':
+                args->allow_grants = true;
+                args->supervise = true;
+                break;
+            case 'g':
+                args->mode = MODE_GRANT;
+                args->grant_path = optarg;
+                break;
             case 'h':
                 print_usage(argv[0]);
                 exit(0);
@@ -116,31 +439,48 @@ static void free_arguments(Arguments* args) {
         return;
     }
     pathlist_free(args->allow_write_paths);
+    pathlist_free(args->presets);
     free(args);
 }
 
+// The command sandbash is asked to run, for --preset=auto
+static const char* command_name(const Arguments* args) {
+    int start = 0;
+    if (args->mode == MODE_EACH_DIR) {
+        while (start < args->bash_argc && strcmp(args->bash_argv[start], "--") != 0) {
+            start++;
+        }
+        start++;
+    }
+    return start < args->bash_argc ? args->bash_argv[start] : NULL;
+}
+
+// A path or pattern as it is stored in the config file
+static char* config_entry(const Config* config, const char* path) {
+    return pattern_is_glob(path) ? pattern_normalize(path, config->current_dir)
+                                 : expand_path(path);
+}
+
 static int handle_add_path(Config* config, const char* path) {
-    char* expanded = expand_path(path);
+    char* expanded = config_entry(config, path);
     if (!expanded) {
         fprintf(stderr, "Error: Invalid path: %s\n", path);
         return 1;
     }
 
-    // Check if already exists
-    if (pathlist_contains(config->local_paths, expanded)) {
+    bool changed;
+    if (!config_update_local(config, expanded, true, &changed)) {
+        fprintf(stderr, "Error: Failed to save configuration\n");
+        free(expanded);
+        return 1;
+    }
+    if (!changed) {
         printf("Path already in config: %s\n", expanded);
         free(expanded);
         return 0;
     }
-
-    pathlist_add(config->local_paths, expanded);
     free(expanded);
 
-    if (!config_save_local(config)) {
-        fprintf(stderr, "Error: Failed to save configuration\n");
-        return 1;
-    }
-
     char* config_path = config_get_local_path(config);
     printf("Added path to config: %s\n", config_path);
     printf("Path: %s\n", path);
@@ -150,21 +490,27 @@ static int handle_add_path(Config* config, const char* path) {
 }
 
 static int handle_remove_path(Config* config, const char* path) {
-    char* expanded = expand_path(path);
+    // An entry that is gone, or on a mount that hangs, is matched as
+    // written
+    char* expanded = config_entry(config, path);
+    if (!expanded && !pattern_is_glob(path)) {
+        expanded = strdup(path);
+    }
     if (!expanded) {
         fprintf(stderr, "Error: Invalid path: %s\n", path);
         return 1;
     }
 
-    if (!pathlist_remove(config->local_paths, expanded)) {
-        fprintf(stderr, "Warning: Path not found in config: %s\n", path);
-    }
+    bool changed;
+    bool saved = config_update_local(config, expanded, false, &changed);
     free(expanded);
-
-    if (!config_save_local(config)) {
+    if (!saved) {
         fprintf(stderr, "Error: Failed to save configuration\n");
         return 1;
     }
+    if (!changed) {
+        fprintf(stderr, "Warning: Path not found in config: %s\n", path);
+    }
 
     char* config_path = config_get_local_path(config);
     printf("Removed path from config: %s\n", config_path);
@@ -181,10 +527,11 @@ static int handle_edit(Config* config) {
         return 1;
     }
 
-    // Ensure file exists
-    FILE* f = fopen(config_path, "a");
-    if (f) {
-        fclose(f);
+    // Create it like --add-path would, so it is indexed
+    if (access(config_path, F_OK) != 0 && !config_create_local(config)) {
+        fprintf(stderr, "Error: Failed to create %s\n", config_path);
+        free(config_path);
+        return 1;
     }
 
     const char* editor = getenv("EDITOR");
@@ -241,6 +588,26 @@ static int handle_list_paths(Config* config) {
     }
     printf("\n");
 
+    PathList* inherited = config_inherited_dirs(config->current_dir);
+    if (inherited && inherited->count > 0) {
+        printf("Inherited paths (from the configs of");
+        for (int i = 0; i < inherited->count; i++) {
+            printf("%s %s", i > 0 ? "," : "", inherited->paths[i]);
+        }
+        printf("):\n");
+    } else {
+        printf("Inherited paths (from the configs of parent directories):\n");
+    }
+    pathlist_free(inherited);
+    if (config->inherited_paths->count == 0) {
+        printf("  (none)\n");
+    } else {
+        for (int i = 0; i < config->inherited_paths->count; i++) {
+            printf("  %s\n", config->inherited_paths->paths[i]);
+        }
+    }
+    printf("\n");
+
     char* local_config_path = config_get_local_path(config);
     printf("Per-directory paths (from %s):\n", local_config_path);
     free(local_config_path);
@@ -267,6 +634,356 @@ static int handle_list_paths(Config* config) {
     return 0;
 }
 
+// Configs without a header line still apply, but are not indexed or listed
+static void warn_unattributed(size_t count) {
+    if (count > 0) {
+        fprintf(stderr, "Warning: %zu config file%s do%s not name a directory and cannot be "
+                        "indexed; --add-path or --remove-path in the directory adds the name\n",
+                count, count == 1 ? "" : "s", count == 1 ? "es" : "");
+    }
+}
+
+static int handle_reindex(void) {
+    int skipped;
+    int count = projects_reindex(&skipped);
+    if (count < 0) {
+        fprintf(stderr, "Error: Failed to rebuild the project index\n");
+        return 1;
+    }
+    warn_unattributed((size_t)skipped);
+    printf("Indexed %d project config%s\n", count, count == 1 ? "" : "s");
+    return 0;
+}
+
+static int compare_strings(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+static int handle_list_projects(void) {
+    ProjectIndex* index = projects_open();
+    if (!index && projects_reindex(NULL) >= 0) {
+        index = projects_open();
+    }
+    if (!index) {
+        fprintf(stderr, "Error: Failed to read the project index\n");
+        return 1;
+    }
+    warn_unattributed(projects_unattributed(index));
+
+    size_t count = projects_count(index);
+    const char** dirs = calloc(count ? count : 1, sizeof(char*));
+    if (!dirs) {
+        projects_close(index);
+        return 1;
+    }
+    size_t found = 0;
+    for (const char* dir = projects_next(index, NULL); dir && found < count;
+         dir = projects_next(index, dir)) {
+        // Configs deleted by hand stay indexed until --reindex
+        char* config_path = config_get_local_path_for_dir(dir);
+        if (config_path && access(config_path, F_OK) == 0) {
+            dirs[found++] = dir;
+        }
+        free(config_path);
+    }
+    qsort(dirs, found, sizeof(char*), compare_strings);
+    for (size_t i = 0; i < found; i++) {
+        printf("%s\n", dirs[i]);
+    }
+
+    free(dirs);
+    projects_close(index);
+    return 0;
+}
+
+// Directories come before "--" and the command after it
+static int handle_each_dir(Arguments* args) {
+    int separator = -1;
+    for (int i = 0; i < args->bash_argc; i++) {
+        if (strcmp(args->bash_argv[i], "--") == 0) {
+            separator = i;
+            break;
+        }
+    }
+
+    if (separator <= 0 || separator == args->bash_argc - 1) {
+        fprintf(stderr, "Error: Usage: sandbash --each-dir DIR... -- COMMAND [ARGS...]\n");
+        return 1;
+    }
+
+    // The command is run with argv as given, so it needs its own
+    // terminating NULL
+    int command_argc = args->bash_argc - separator - 1;
+    char** command_argv = malloc(sizeof(char*) * (size_t)(command_argc + 1));
+    if (!command_argv) {
+        fprintf(stderr, "Error: Failed to allocate memory\n");
+        return 1;
+    }
+    for (int i = 0; i < command_argc; i++) {
+        command_argv[i] = args->bash_argv[separator + 1 + i];
+    }
+    command_argv[command_argc] = NULL;
+
+    FanoutOptions options = {
+        .dirs = args->bash_argv,
+        .dir_count = separator,
+        .argv = command_argv,
+        .allow_write = (const char* const*)args->allow_write_paths->paths,
+        .allow_write_count = (size_t)args->allow_write_paths->count,
+        .backend = args->backend_name,
+        .use_cache = args->use_cache,
+        .jobs = args->jobs,
+    };
+
+    int result = fanout_run(&options);
+    free(command_argv);
+    return result;
+}
+
+static int handle_overlay_command(Arguments* args) {
+#ifdef __linux__
+    bool ok = false;
+    switch (args->mode) {
+        case MODE_OVERLAY_DIFF:
+            ok = overlay_diff(args->overlay_id);
+            break;
+        case MODE_OVERLAY_COMMIT:
+            ok = overlay_commit(args->overlay_id);
+            break;
+        case MODE_OVERLAY_DISCARD:
+            ok = overlay_discard(args->overlay_id);
+            break;
+        default:
+            break;
+    }
+    return ok ? 0 : 1;
+#else
+    (void)args;
+    fprintf(stderr, "Error: Overlay sessions are only supported on Linux\n");
+    return 1;
+#endif
+}
+
+static int handle_grant(const Arguments* args) {
+#ifdef __linux__
+    if (!args->session_id) {
+        fprintf(stderr, "Error: --grant needs --session ID to pick the sandbox\n");
+        return 1;
+    }
+    char* path = expand_path(args->grant_path);
+    if (!path) {
+        fprintf(stderr, "Error: Invalid path: %s\n", args->grant_path);
+        return 1;
+    }
+    bool ok = supervisor_grant(args->session_id, path);
+    free(path);
+    return ok ? 0 : 1;
+#else
+    (void)args;
+    fprintf(stderr, "Error: Supervised sandboxes are only supported on Linux\n");
+    return 1;
+#endif
+}
+
+// The writable paths minus internal, which holds sandbash's own results
+// rather than anything the user would save or want listed. Patterns are
+// expanded to what they match at launch.
+static PathList* writable_paths_of(const SandbashConfig* sandbox_config, const char* internal) {
+    PathList* paths = pathlist_create();
+    size_t count = sandbash_config_path_count(sandbox_config);
+    for (size_t i = 0; paths && i < count; i++) {
+        const char* path = sandbash_config_path(sandbox_config, i);
+        if (internal && strcmp(path, internal) == 0) {
+            continue;
+        }
+        if (!pathlist_add(paths, path)) {
+            pathlist_free(paths);
+            return NULL;
+        }
+    }
+    PathList* expanded = paths ? pattern_expand(paths) : NULL;
+    pathlist_free(paths);
+    return expanded;
+}
+
+static bool take_snapshot(const char* id, const SandbashConfig* sandbox_config,
+                          const char* internal) {
+    char* snapshot_id = id ? strdup(id) : generate_session_id();
+    PathList* paths = writable_paths_of(sandbox_config, internal);
+    bool ok = snapshot_id && paths && snapshot_create(snapshot_id, paths);
+
+    pathlist_free(paths);
+    free(snapshot_id);
+    return ok;
+}
+
+// Fork a parent that records what the command changes under the writable
+// paths and writes the manifest when it exits. Returns in the child, which
+// goes on to run the command; the parent exits with the command's status.
+static bool track_changes(const char* output_path, const SandbashConfig* sandbox_config,
+                          const char* internal) {
+#ifdef __linux__
+    PathList* paths = writable_paths_of(sandbox_config, internal);
+    ChangeMonitor* monitor = paths ? changes_watch(paths) : NULL;
+    if (!monitor) {
+        pathlist_free(paths);
+        return false;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Error: Failed to fork: %s\n", strerror(errno));
+        changes_free(monitor);
+        pathlist_free(paths);
+        return false;
+    }
+    if (pid == 0) {
+        changes_free(monitor);
+        pathlist_free(paths);
+        return true;
+    }
+
+    // The child writes the trace before it execs
+    trace_disable();
+    int status = changes_wait(monitor, pid);
+    bool written = changes_write(monitor, output_path);
+    changes_free(monitor);
+    pathlist_free(paths);
+
+    if (status < 0) {
+        exit(1);
+    }
+    if (WIFSIGNALED(status)) {
+        exit(128 + WTERMSIG(status));
+    }
+    exit(WEXITSTATUS(status) == 0 && !written ? 1 : WEXITSTATUS(status));
+#else
+    (void)output_path;
+    (void)sandbox_config;
+    (void)internal;
+    fprintf(stderr, "Error: --changes-out is only supported on Linux\n");
+    return false;
+#endif
+}
+
+// Register the sandbox and fork a supervisor that enforces the timeout
+// and tears down the whole tree. Returns in the child, which goes on to
+// run the command; the supervisor exits with the command's status.
+static bool supervise_command(const Arguments* args) {
+#ifdef __linux__
+    char* id = args->session_id ? strdup(args->session_id) : generate_session_id();
+    if (!id || !supervisor_register(id, args->bash_argc, args->bash_argv)) {
+        free(id);
+        return false;
+    }
+    if (!args->session_id) {
+        fprintf(stderr, "Sandbox session: %s\n", id);
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Error: Failed to fork: %s\n", strerror(errno));
+        supervisor_unregister(id);
+        free(id);
+        return false;
+    }
+    if (pid == 0) {
+        free(id);
+        return true;
+    }
+
+    // The child writes the trace before it execs
+    trace_disable();
+    SupervisorLimits limits = { args->timeout, args->kill_after };
+    int status = supervisor_wait(pid, &limits);
+    supervisor_unregister(id);
+    free(id);
+    exit(status);
+#else
+    (void)args;
+    fprintf(stderr, "Error: Supervised sandboxes are only supported on Linux\n");
+    return false;
+#endif
+}
+
+// Fork a parent that measures the command and writes the report once the
+// tree is done. Returns in the child, which goes on to run the command;
+// the parent exits with the command's status.
+static bool report_command(const Arguments* args) {
+    RunReport* report = report_start();
+    if (!report) {
+        return false;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Error: Failed to fork: %s\n", strerror(errno));
+        report_free(report);
+        return false;
+    }
+    if (pid == 0) {
+        report_free(report);
+        return true;
+    }
+
+    // The child writes the trace before it execs
+    trace_disable();
+    int status = report_wait(report, pid);
+    bool written = report_write(report, status, args->report, args->bash_argc,
+                                args->bash_argv);
+    report_free(report);
+
+    if (status < 0) {
+        exit(1);
+    }
+    if (WIFSIGNALED(status)) {
+        exit(128 + WTERMSIG(status));
+    }
+    exit(WEXITSTATUS(status) == 0 && !written ? 1 : WEXITSTATUS(status));
+}
+
+#ifdef __linux__
+// Fork a parent that waits for the command and merges what its processes
+// recorded into the report. Returns in the child, which runs the command
+// with the profiler preloaded; the parent exits with the command's status.
+static bool profile_command(ProfileRun* profile, const char* output_path) {
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Error: Failed to fork: %s\n", strerror(errno));
+        return false;
+    }
+    if (pid == 0) {
+        if (!profile_export(profile)) {
+            fprintf(stderr, "Error: Failed to set up the I/O profiler\n");
+            _exit(1);
+        }
+        return true;
+    }
+
+    // The child writes the trace before it execs
+    trace_disable();
+    int status = profile_wait(pid);
+    bool written = profile_report(profile, output_path);
+    profile_free(profile);
+
+    if (status < 0) {
+        exit(1);
+    }
+    if (WIFSIGNALED(status)) {
+        exit(128 + WTERMSIG(status));
+    }
+    exit(WEXITSTATUS(status) == 0 && !written ? 1 : WEXITSTATUS(status));
+}
+#endif
+
 // Get shell path from $SHELL with fallback to /bin/bash
 static const char* get_shell_path(void) {
     const char* shell = getenv("SHELL");
@@ -286,18 +1003,25 @@ static const char* get_shell_path(void) {
 }
 
 int main(int argc, char* argv[]) {
+    trace_init();
+
     // Set up signal handlers
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
 
+    TRACE_BEGIN("parse_arguments");
     Arguments* args = parse_arguments(argc, argv);
+    TRACE_END();
     if (!args) {
         fprintf(stderr, "Error: Failed to parse arguments\n");
         return 1;
     }
 
     // Check home directory constraint
-    if (!is_under_home_directory()) {
+    TRACE_BEGIN("home_check");
+    bool under_home = is_under_home_directory();
+    TRACE_END();
+    if (!under_home) {
         fprintf(stderr, "Error: sandbash must be invoked from within your home directory\n");
         char cwd[4096];
         getcwd(cwd, sizeof(cwd));
@@ -308,28 +1032,46 @@ int main(int argc, char* argv[]) {
     }
 
     // Create config
+    TRACE_BEGIN("config_create");
     Config* config = config_create();
+    TRACE_END();
     if (!config) {
         fprintf(stderr, "Error: Failed to create configuration\n");
         free_arguments(args);
         return 1;
     }
 
-    // Load configs
-    config_load_global(config);
-    config_load_local(config);
+    // Only a launch creates missing preset directories; the config
+    // operations leave the file system alone
+    bool launch = args->mode == MODE_SANDBOX || args->mode == MODE_EACH_DIR;
+    config->create_presets = launch;
 
-    // Add CLI paths
-    for (int i = 0; i < args->allow_write_paths->count; i++) {
-        char* expanded = expand_path(args->allow_write_paths->paths[i]);
-        if (expanded) {
-            pathlist_add(config->cli_paths, expanded);
-            free(expanded);
+    // Presets become --allow-write paths, so every mode and the daemon
+    // treat them like any other
+    for (int i = 0; i < args->presets->count; i++) {
+        if (!preset_add_paths(args->allow_write_paths, args->presets->paths[i],
+                              command_name(args), launch)) {
+            fprintf(stderr, "Error: Unknown preset in %s (available: node, rust, python, go, "
+                            "ccache, auto)\n", args->presets->paths[i]);
+            config_free(config);
+            free_arguments(args);
+            return 1;
         }
     }
 
+    if (!launch) {
+        // Load configs
+        config_load_global(config);
+        config_load_local(config);
+        config_load_inherited(config);
+
+        // Add CLI paths
+        config_add_cli_paths(config, args->allow_write_paths);
+        config_resolve_pending(config);
+    }
+
     // Check for invalid combination: config operation + command
-    if (args->mode != MODE_SANDBOX && args->bash_argc > 0) {
+    if (!launch && args->bash_argc > 0) {
         fprintf(stderr, "Error: Cannot combine configuration operations with command execution\n");
         fprintf(stderr, "Use config operations alone or execute commands separately.\n");
         config_free(config);
@@ -356,29 +1098,311 @@ int main(int argc, char* argv[]) {
         case MODE_LIST_PATHS:
             result = handle_list_paths(config);
             break;
+        case MODE_REINDEX:
+            result = handle_reindex();
+            break;
+        case MODE_LIST_PROJECTS:
+            result = handle_list_projects();
+            break;
+        case MODE_OVERLAY_DIFF:
+        case MODE_OVERLAY_COMMIT:
+        case MODE_OVERLAY_DISCARD:
+            result = handle_overlay_command(args);
+            break;
+        case MODE_ROLLBACK:
+            result = snapshot_rollback(args->snapshot_id) ? 0 : 1;
+            break;
+        case MODE_DROP_SNAPSHOT:
+            result = snapshot_drop(args->snapshot_id) ? 0 : 1;
+            break;
+        case MODE_LIST_SANDBOXES:
+        case MODE_KILL_SANDBOX:
+#ifdef __linux__
+            result = (args->mode == MODE_LIST_SANDBOXES ? supervisor_list()
+                                                        : supervisor_kill(args->session_id))
+                         ? 0
+                         : 1;
+#else
+            fprintf(stderr, "Error: Supervised sandboxes are only supported on Linux\n");
+            result = 1;
+#endif
+            break;
+        case MODE_GRANT:
+            result = handle_grant(args);
+            break;
+        case MODE_EACH_DIR:
+            // Recording is single-threaded; keep what led up to the fan-out
+            TRACE_FLUSH();
+            trace_disable();
+            result = handle_each_dir(args);
+            break;
         case MODE_SANDBOX: {
-            // Generate sandbox profile
-            char* profile = sandbox_generate_profile(config);
-            if (!profile) {
-                fprintf(stderr, "Error: Failed to generate sandbox profile\n");
+            if (args->audit_log) {
+#ifdef __linux__
+                if (args->use_overlay) {
+                    fprintf(stderr, "Error: --audit cannot be combined with --overlay\n");
+                    result = 1;
+                    break;
+                }
+                if (args->backend_name && strcmp(args->backend_name, "seccomp") != 0) {
+                    fprintf(stderr, "Error: --audit requires the seccomp backend\n");
+                    result = 1;
+                    break;
+                }
+#else
+                fprintf(stderr, "Error: --audit is only supported on Linux\n");
                 result = 1;
                 break;
+#endif
             }
 
-            // Initialize sandbox
-            if (!sandbox_init_with_profile(profile)) {
-                fprintf(stderr, "Error: Failed to initialize sandbox\n");
-                free(profile);
+            // Grants are addressed by session id, so it is settled here
+            char grant_socket[PATH_MAX] = "";
+            char generated_id[128] = "";
+            if (args->allow_grants) {
+#ifdef __linux__
+                if (args->use_overlay) {
+                    fprintf(stderr, "Error: --allow-grants cannot be combined with --overlay\n");
+                    result = 1;
+                    break;
+                }
+                if (args->backend_name && strcmp(args->backend_name, "seccomp") != 0) {
+                    fprintf(stderr, "Error: --allow-grants requires the seccomp backend\n");
+                    result = 1;
+                    break;
+                }
+                if (!args->session_id) {
+                    char* id = generate_session_id();
+                    snprintf(generated_id, sizeof(generated_id), "%s", id ? id : "");
+                    free(id);
+                    args->session_id = generated_id;
+                    fprintf(stderr, "Sandbox session: %s\n", generated_id);
+                }
+                if (!supervisor_grant_socket(args->session_id, grant_socket,
+                                             sizeof(grant_socket))) {
+                    fprintf(stderr, "Error: Invalid sandbox id: %s\n", args->session_id);
+                    result = 1;
+                    break;
+                }
+#else
+                fprintf(stderr, "Error: --allow-grants is only supported on Linux\n");
+                result = 1;
+                break;
+#endif
+            }
+
+            char* overlay_id = NULL;
+            if (args->use_overlay) {
+#ifdef __linux__
+                if (args->backend_name && strcmp(args->backend_name, "namespace") != 0) {
+                    fprintf(stderr, "Error: --overlay requires the namespace backend\n");
+                    result = 1;
+                    break;
+                }
+                overlay_id = args->overlay_id ? strdup(args->overlay_id) : generate_session_id();
+                if (!overlay_id || !is_valid_session_id(overlay_id)) {
+                    fprintf(stderr, "Error: Invalid overlay session id\n");
+                    free(overlay_id);
+                    result = 1;
+                    break;
+                }
+                fprintf(stderr, "Overlay session: %s\n", overlay_id);
+#else
+                fprintf(stderr, "Error: --overlay is only supported on Linux\n");
+                result = 1;
+                break;
+#endif
+            }
+
+#ifndef __linux__
+            if (args->private_tmp) {
+                fprintf(stderr, "Error: --private-tmp is only supported on Linux\n");
+                free(overlay_id);
                 result = 1;
                 break;
             }
+#endif
 
-            free(profile);
+            // The profiler's processes write their results under a
+            // directory of ours, so it joins the writable paths
+            const char* internal = NULL;
+#ifdef __linux__
+            ProfileRun* profile = NULL;
+            if (args->profile_io) {
+                profile = profile_start();
+                if (!profile ||
+                    !pathlist_add(args->allow_write_paths, profile_writable_path(profile))) {
+                    profile_free(profile);
+                    free(overlay_id);
+                    result = 1;
+                    break;
+                }
+                internal = profile_writable_path(profile);
+            }
+#else
+            if (args->profile_io) {
+                fprintf(stderr, "Error: --profile-io is only supported on Linux\n");
+                free(overlay_id);
+                result = 1;
+                break;
+            }
+#endif
+
+            // Interactive shells need our terminal, so only commands are
+            // handed to the daemon. Zygotes have no overlay or audit log,
+            // neither snapshot nor watch the writable paths, are not
+            // profiled, measured, limited or supervised and share /tmp.
+            if (args->use_daemon && args->bash_argc > 0 && !overlay_id &&
+                !args->use_snapshot && !args->changes_out && !args->audit_log &&
+                !args->profile_io && !resources_requested(&args->limits) && !args->report &&
+                !args->supervise && !args->private_tmp) {
+#ifdef __linux__
+                TRACE_BEGIN("daemon_client_run");
+                int status = daemon_client_run(args->backend_name, args->allow_write_paths,
+                                               args->use_cache, args->bash_argc,
+                                               args->bash_argv);
+                TRACE_END();
+                if (status >= 0) {
+                    result = status;
+                    break;
+                }
+#else
+                fprintf(stderr, "Warning: --use-daemon is not supported on this platform\n");
+#endif
+            }
+
+            // Load the writable paths and pick the sandbox backend
+            SandbashOptions options = {
+                .directory = config->current_dir,
+                .allow_write = (const char* const*)args->allow_write_paths->paths,
+                .allow_write_count = (size_t)args->allow_write_paths->count,
+                .backend = args->backend_name,
+                .use_cache = args->use_cache,
+                .overlay = overlay_id,
+                .audit = args->audit_log,
+                .private_tmp = args->private_tmp,
+                .private_tmp_size = args->private_tmp_size,
+                .grant_socket = *grant_socket ? grant_socket : NULL,
+            };
+            SandbashConfig* sandbox_config = NULL;
+            TRACE_BEGIN("sandbash_config_load");
+            SandbashError error = sandbash_config_load(&options, &sandbox_config);
+            TRACE_END();
+            free(overlay_id);
+            if (error != SANDBASH_OK) {
+                // Backend selection already explained what is missing
+                if (error != SANDBASH_ERR_NO_BACKEND) {
+                    fprintf(stderr, "Error: %s\n", sandbash_strerror(error));
+                }
+#ifdef __linux__
+                profile_free(profile);
+#endif
+                result = 1;
+                break;
+            }
+
+            // Save the writable paths while they are still ours alone
+            if (args->use_snapshot) {
+                TRACE_BEGIN("snapshot_create");
+                bool saved = take_snapshot(args->snapshot_id, sandbox_config, internal);
+                TRACE_END();
+                if (!saved) {
+#ifdef __linux__
+                    profile_free(profile);
+#endif
+                    sandbash_config_free(sandbox_config);
+                    result = 1;
+                    break;
+                }
+            }
+
+            // Apply limits while cgroupfs is still in reach. The processes
+            // forked below to watch the command share them, at a cost of
+            // a few pids and little memory.
+            if (resources_requested(&args->limits)) {
+                TRACE_BEGIN("resources_apply");
+                bool limited = resources_apply(&args->limits);
+                TRACE_END();
+                if (!limited) {
+#ifdef __linux__
+                    profile_free(profile);
+#endif
+                    sandbash_config_free(sandbox_config);
+                    result = 1;
+                    break;
+                }
+            }
+
+            // The outermost parent, so a timeout or --kill-sandbox reaches
+            // every process below it, watchers included
+            if (args->supervise) {
+                TRACE_BEGIN("supervise");
+                bool supervising = supervise_command(args);
+                TRACE_END();
+                if (!supervising) {
+#ifdef __linux__
+                    profile_free(profile);
+#endif
+                    sandbash_config_free(sandbox_config);
+                    result = 1;
+                    break;
+                }
+            }
+
+            // Forked before the other watchers, so its report comes last,
+            // and after the limits, so it shares the command's cgroup leaf
+            if (args->report) {
+                TRACE_BEGIN("report_start");
+                bool measuring = report_command(args);
+                TRACE_END();
+                if (!measuring) {
+#ifdef __linux__
+                    profile_free(profile);
+#endif
+                    sandbash_config_free(sandbox_config);
+                    result = 1;
+                    break;
+                }
+            }
+
+#ifdef __linux__
+            // Forked before the change tracker, so the report is written
+            // after the manifest and stays out of it
+            if (profile && !profile_command(profile, args->profile_io)) {
+                profile_free(profile);
+                sandbash_config_free(sandbox_config);
+                result = 1;
+                break;
+            }
+#endif
+
+            // From here on only the command's own writes are recorded
+            if (args->changes_out) {
+                TRACE_BEGIN("changes_watch");
+                bool tracking = track_changes(args->changes_out, sandbox_config, internal);
+                TRACE_END();
+                if (!tracking) {
+                    sandbash_config_free(sandbox_config);
+                    result = 1;
+                    break;
+                }
+            }
+
+            // Initialize sandbox
+            error = sandbash_apply(sandbox_config);
+            sandbash_config_free(sandbox_config);
+            if (error != SANDBASH_OK) {
+                fprintf(stderr, "Error: %s\n", sandbash_strerror(error));
+                result = 1;
+                break;
+            }
 
             // If no command specified, launch interactive shell
             if (args->bash_argc == 0) {
                 const char* shell_path = get_shell_path();
                 char* shell_argv[] = {(char*)shell_path, NULL};
+                TRACE_INSTANT_DETAIL("execve", shell_path);
+                TRACE_FLUSH();
                 execve(shell_path, shell_argv, environ);
 
                 // If we get here, execve failed
@@ -395,7 +1419,10 @@ int main(int argc, char* argv[]) {
             }
             cmd_argv[args->bash_argc] = NULL;
 
-            // Execute command using execvp (searches PATH)
+            // Execute command using execvp (searches PATH). Nothing of ours
+            // runs after it, so the trace is written first.
+            TRACE_INSTANT_DETAIL("execvp", cmd_argv[0]);
+            TRACE_FLUSH();
             execvp(cmd_argv[0], cmd_argv);
 
             // If we get here, execvp failed
@@ -409,5 +1436,6 @@ int main(int argc, char* argv[]) {
 
     config_free(config);
     free_arguments(args);
+    TRACE_FLUSH();
     return result;
 }
@@ -0,0 +1,323 @@
+#include "namespace.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/syscall.h>
+#include <linux/capability.h>
+
+static bool write_file(const char* path, const char* contents) {
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    size_t len = strlen(contents);
+    bool ok = write(fd, contents, len) == (ssize_t)len;
+    close(fd);
+    return ok;
+}
+
+bool ns_enter(void) {
+    uid_t uid = getuid();
+    gid_t gid = getgid();
+
+    if (unshare(CLONE_NEWUSER | CLONE_NEWNS) != 0) {
+        fprintf(stderr, "Error: Failed to create user namespace: %s\n", strerror(errno));
+        return false;
+    }
+
+    char map[64];
+
+    // setgroups must be denied before an unprivileged gid_map write
+    if (!write_file("/proc/self/setgroups", "deny")) {
+        fprintf(stderr, "Error: Failed to deny setgroups: %s\n", strerror(errno));
+        return false;
+    }
+
+    snprintf(map, sizeof(map), "%u %u 1", (unsigned)uid, (unsigned)uid);
+    if (!write_file("/proc/self/uid_map", map)) {
+        fprintf(stderr, "Error: Failed to write uid_map: %s\n", strerror(errno));
+        return false;
+    }
+
+    snprintf(map, sizeof(map), "%u %u 1", (unsigned)gid, (unsigned)gid);
+    if (!write_file("/proc/self/gid_map", map)) {
+        fprintf(stderr, "Error: Failed to write gid_map: %s\n", strerror(errno));
+        return false;
+    }
+
+    // Keep every mount change inside the new namespace
+    if (mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) != 0) {
+        fprintf(stderr, "Error: Failed to make mounts private: %s\n", strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+bool ns_drop_privileges(void) {
+    // Empty the bounding set so exec cannot grant anything back, even when
+    // the mapped uid is 0
+    for (int cap = 0; cap <= CAP_LAST_CAP; cap++) {
+        if (prctl(PR_CAPBSET_DROP, cap, 0, 0, 0) != 0 && errno != EINVAL) {
+            fprintf(stderr, "Error: Failed to drop capability %d: %s\n",
+                    cap, strerror(errno));
+            return false;
+        }
+    }
+
+    prctl(PR_CAP_AMBIENT, PR_CAP_AMBIENT_CLEAR_ALL, 0, 0, 0);
+
+    struct __user_cap_header_struct header = {
+        .version = _LINUX_CAPABILITY_VERSION_3,
+        .pid = 0,
+    };
+    struct __user_cap_data_struct data[2];
+    memset(data, 0, sizeof(data));
+    if (syscall(SYS_capset, &header, data) != 0) {
+        fprintf(stderr, "Error: Failed to clear capabilities: %s\n", strerror(errno));
+        return false;
+    }
+
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0) {
+        fprintf(stderr, "Error: Failed to set no_new_privs: %s\n", strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+// Create path as a directory or an empty file, with the directories
+// leading to it, inside a freshly mounted tmpfs
+static bool make_mount_point(const char* path, bool directory) {
+    if (directory) {
+        return make_directories(path, 0755);
+    }
+    char parent[PATH_MAX];
+    snprintf(parent, sizeof(parent), "%s", path);
+    char* slash = strrchr(parent, '/');
+    if (slash && slash != parent) {
+        *slash = '\0';
+        if (!make_directories(parent, 0755)) {
+            return false;
+        }
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    close(fd);
+    return true;
+}
+
+// Open the paths below target, so they can be found again once a mount
+// covers target; -1 for the others
+static int* open_below(const char* target, const PathList* paths) {
+    int* fds = malloc(sizeof(int) * (size_t)(paths->count > 0 ? paths->count : 1));
+    for (int i = 0; fds && i < paths->count; i++) {
+        const char* path = paths->paths[i];
+        fds[i] = path_is_within(path, target) && strcmp(path, target) != 0
+                     ? open(path, O_PATH | O_CLOEXEC)
+                     : -1;
+    }
+    return fds;
+}
+
+// Bind the paths opened by open_below back to where they were
+static void bind_back(const char* target, const PathList* paths, int* fds, bool mounted,
+                      bool readonly) {
+    for (int i = 0; i < paths->count; i++) {
+        if (fds[i] < 0) {
+            continue;
+        }
+        const char* path = paths->paths[i];
+        struct stat st;
+        char source[64];
+        snprintf(source, sizeof(source), "/proc/self/fd/%d", fds[i]);
+        if (mounted && (fstat(fds[i], &st) != 0 || !make_mount_point(path, S_ISDIR(st.st_mode)) ||
+                        mount(source, path, NULL, MS_BIND | MS_REC, NULL) != 0 ||
+                        (readonly && !ns_remount_readonly(path)))) {
+            fprintf(stderr, "Warning: Cannot keep %s below %s: %s\n", path, target,
+                    strerror(errno));
+        }
+        close(fds[i]);
+    }
+    free(fds);
+}
+
+bool ns_mount_tmpfs(const char* target, unsigned long long size,
+                    const PathList* keep_readonly, const PathList* keep) {
+    // Hold on to what the tmpfs is about to hide
+    int* readonly_fds = open_below(target, keep_readonly);
+    int* fds = open_below(target, keep);
+    if (!readonly_fds || !fds) {
+        free(readonly_fds);
+        free(fds);
+        return false;
+    }
+
+    char options[64] = "mode=1777";
+    if (size > 0) {
+        snprintf(options, sizeof(options), "mode=1777,size=%llu", size);
+    }
+    bool ok = mount("tmpfs", target, "tmpfs", MS_NOSUID | MS_NODEV, options) == 0;
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to mount tmpfs on %s: %s\n", target, strerror(errno));
+    }
+
+    // Read-only ones first, so writable paths inside them stay writable
+    bind_back(target, keep_readonly, readonly_fds, ok, true);
+    bind_back(target, keep, fds, ok, false);
+    return ok;
+}
+
+// Decode the octal escapes (\040 etc.) used in /proc/self/mountinfo
+static void unescape_mount_path(char* path) {
+    char* out = path;
+    for (char* p = path; *p; p++) {
+        if (p[0] == '\\' && p[1] >= '0' && p[1] <= '3' &&
+            p[2] >= '0' && p[2] <= '7' && p[3] >= '0' && p[3] <= '7') {
+            *out++ = (char)(((p[1] - '0') << 6) | ((p[2] - '0') << 3) | (p[3] - '0'));
+            p += 3;
+        } else {
+            *out++ = *p;
+        }
+    }
+    *out = '\0';
+}
+
+PathList* ns_list_mounts(void) {
+    FILE* f = fopen("/proc/self/mountinfo", "r");
+    if (!f) {
+        fprintf(stderr, "Error: Failed to read mount table: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    PathList* mounts = pathlist_create();
+    if (!mounts) {
+        fclose(f);
+        return NULL;
+    }
+
+    // Lines look like: 36 35 98:0 /mnt1 /mnt2 rw,noatime master:1 - ext3 ...
+    // and are listed in mount order, so parents come before children.
+    char line[MAX_PATH_LENGTH + 256];
+    while (fgets(line, sizeof(line), f)) {
+        char* saveptr = NULL;
+        char* field = strtok_r(line, " ", &saveptr);
+        for (int i = 1; field && i < 5; i++) {
+            field = strtok_r(NULL, " ", &saveptr);
+        }
+        if (!field) {
+            continue;
+        }
+
+        unescape_mount_path(field);
+        pathlist_add(mounts, field);
+    }
+
+    fclose(f);
+    return mounts;
+}
+
+bool ns_remount_readonly(const char* mount_point) {
+    struct statvfs st;
+    if (statvfs(mount_point, &st) != 0) {
+        return false;
+    }
+
+    // Flags locked by the kernel must be repeated on remount or it fails
+    unsigned long flags = MS_REMOUNT | MS_BIND | MS_RDONLY;
+    if (st.f_flag & ST_NOSUID) {
+        flags |= MS_NOSUID;
+    }
+    if (st.f_flag & ST_NODEV) {
+        flags |= MS_NODEV;
+    }
+    if (st.f_flag & ST_NOEXEC) {
+        flags |= MS_NOEXEC;
+    }
+    if (st.f_flag & ST_NOATIME) {
+        flags |= MS_NOATIME;
+    }
+    if (st.f_flag & ST_NODIRATIME) {
+        flags |= MS_NODIRATIME;
+    }
+    if (st.f_flag & ST_RELATIME) {
+        flags |= MS_RELATIME;
+    }
+
+    return mount(NULL, mount_point, NULL, flags, NULL) == 0;
+}
+
+// Pseudo filesystems whose writability is governed by the kernel rather
+// than by mount flags. /dev stays as is so device nodes and shared memory
+// keep working.
+static const char* const skipped_mounts[] = {
+    "/proc",
+    "/sys",
+    "/dev",
+    NULL
+};
+
+static bool is_writable_mount(const char* mount_point, const PathList* writable_paths) {
+    for (int i = 0; i < writable_paths->count; i++) {
+        if (path_is_within(mount_point, writable_paths->paths[i])) {
+            return true;
+        }
+    }
+    for (int i = 0; skipped_mounts[i]; i++) {
+        if (path_is_within(mount_point, skipped_mounts[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ns_restrict_writes(const PathList* writable_paths) {
+    // Give each writable path its own mount so it keeps its flags when
+    // the mount it lives on becomes read-only
+    for (int i = 0; i < writable_paths->count; i++) {
+        const char* path = writable_paths->paths[i];
+        if (mount(path, path, NULL, MS_BIND | MS_REC, NULL) != 0) {
+            fprintf(stderr, "Warning: Cannot bind writable path %s: %s\n",
+                    path, strerror(errno));
+        }
+    }
+
+    PathList* mounts = ns_list_mounts();
+    if (!mounts) {
+        return false;
+    }
+
+    for (int i = 0; i < mounts->count; i++) {
+        const char* mount_point = mounts->paths[i];
+        if (is_writable_mount(mount_point, writable_paths)) {
+            continue;
+        }
+
+        if (!ns_remount_readonly(mount_point)) {
+            // Mount points we cannot reach cannot be written through either
+            if (errno == ENOENT || errno == EACCES) {
+                continue;
+            }
+            fprintf(stderr, "Error: Failed to remount %s read-only: %s\n",
+                    mount_point, strerror(errno));
+            pathlist_free(mounts);
+            return false;
+        }
+    }
+
+    pathlist_free(mounts);
+    return true;
+}
@@ -0,0 +1,32 @@
+#ifndef NAMESPACE_H
+#define NAMESPACE_H
+
+#include "config.h"
+#include <stdbool.h>
+
+// Enter new user and mount namespaces, mapping the caller's uid and gid
+// to themselves and making all mounts private
+bool ns_enter(void);
+
+// Drop every capability held in the user namespace so neither this
+// process nor anything it executes can change mounts again
+bool ns_drop_privileges(void);
+
+// Mount a fresh tmpfs of at most size bytes (0 for the kernel default,
+// half of RAM) over target, writable by everyone like /tmp. Paths in
+// keep_readonly and keep that lie below target are bound back in from the
+// filesystem underneath, the former read-only.
+bool ns_mount_tmpfs(const char* target, unsigned long long size,
+                    const PathList* keep_readonly, const PathList* keep);
+
+// List mount points visible in the current mount namespace, parents first
+PathList* ns_list_mounts(void);
+
+// Remount an existing mount point read-only, preserving its other flags
+bool ns_remount_readonly(const char* mount_point);
+
+// Keep each writable path writable and remount every other mount
+// read-only, apart from kernel pseudo filesystems
+bool ns_restrict_writes(const PathList* writable_paths);
+
+#endif // NAMESPACE_H
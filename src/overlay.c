@@ -0,0 +1,450 @@
+/*
+ * Copy-on-write overlay sessions (Linux).
+ *
+ * $HOME is covered with an overlayfs whose lower layer is the real home
+ * and whose upper layer belongs to the session, so writes the policy would
+ * refuse are captured instead of failing. The writable paths are bound
+ * back over the overlay from the real home and keep writing through.
+ * Outside $HOME everything is read-only, as with the namespace backend.
+ *
+ * Sessions live in <runtime>/sandbash/overlays/<id>:
+ *   home   the $HOME the session was created for
+ *   upper  overlayfs upper layer, mirroring paths below $HOME
+ *   work   overlayfs work directory
+ *   lower  where the real $HOME is mounted while the overlay is built
+ *
+ * The runtime directory is used because overlayfs refuses an upper layer
+ * inside its lower layer. Unprivileged overlays need the userxattr option,
+ * which marks opaque directories with user.overlay.opaque; deletions are
+ * 0/0 character devices as usual. Diff and commit read both back.
+ */
+
+#include "overlay.h"
+#include "namespace.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/xattr.h>
+
+typedef struct {
+    char dir[PATH_MAX];
+    char home[PATH_MAX];
+    char upper[PATH_MAX];
+    char work[PATH_MAX];
+    char lower[PATH_MAX];
+} Session;
+
+// Called for each change found in the upper layer, parents first
+typedef bool (*ChangeVisitor)(const Session* session, const char* rel, char change,
+                              const struct stat* st, void* context);
+
+static bool join_path(char out[PATH_MAX], const char* dir, const char* rel) {
+    int len = rel && *rel ? snprintf(out, PATH_MAX, "%s/%s", dir, rel)
+                          : snprintf(out, PATH_MAX, "%s", dir);
+    return len >= 0 && len < PATH_MAX;
+}
+
+static bool write_home_file(const char* path, const char* home) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "%s\n", home);
+    return fclose(f) == 0;
+}
+
+static bool read_home_file(const char* path, char home[PATH_MAX]) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    bool ok = fgets(home, PATH_MAX, f) != NULL;
+    fclose(f);
+    if (ok) {
+        home[strcspn(home, "\n")] = '\0';
+    }
+    return ok && home[0] == '/';
+}
+
+static bool session_open(const char* id, bool create, Session* session) {
+    if (!is_valid_session_id(id)) {
+        fprintf(stderr, "Error: Invalid overlay session id: %s\n", id ? id : "");
+        return false;
+    }
+
+    char* runtime_dir = get_xdg_runtime_dir();
+    if (!runtime_dir) {
+        fprintf(stderr, "Error: Failed to determine runtime directory\n");
+        return false;
+    }
+
+    char overlays[PATH_MAX];
+    snprintf(overlays, sizeof(overlays), "%s/sandbash", runtime_dir);
+    mkdir(overlays, 0700);
+    snprintf(overlays, sizeof(overlays), "%s/sandbash/overlays", runtime_dir);
+    mkdir(overlays, 0700);
+    free(runtime_dir);
+
+    char home_file[PATH_MAX];
+    if (!join_path(session->dir, overlays, id) ||
+        !join_path(session->upper, session->dir, "upper") ||
+        !join_path(session->work, session->dir, "work") ||
+        !join_path(session->lower, session->dir, "lower") ||
+        !join_path(home_file, session->dir, "home")) {
+        fprintf(stderr, "Error: Overlay session path too long\n");
+        return false;
+    }
+
+    if (create && mkdir(session->dir, 0700) == 0) {
+        const char* home_env = getenv("HOME");
+        char home[PATH_MAX];
+        if (!home_env || !realpath(home_env, home) ||
+            mkdir(session->upper, 0700) != 0 || mkdir(session->work, 0700) != 0 ||
+            mkdir(session->lower, 0700) != 0 || !write_home_file(home_file, home)) {
+            fprintf(stderr, "Error: Failed to create overlay session %s: %s\n",
+                    id, strerror(errno));
+            remove_tree(session->dir);
+            return false;
+        }
+    }
+
+    if (!read_home_file(home_file, session->home)) {
+        fprintf(stderr, "Error: No overlay session %s\n", id);
+        return false;
+    }
+    return true;
+}
+
+bool overlay_session_dir(const char* id, char* out, size_t size) {
+    Session session;
+    if (!session_open(id, true, &session)) {
+        return false;
+    }
+    int len = snprintf(out, size, "%s", session.dir);
+    return len >= 0 && (size_t)len < size;
+}
+
+bool overlay_apply(const char* id, const PathList* writable_paths) {
+    if (!writable_paths) {
+        return false;
+    }
+
+    Session session;
+    if (!session_open(id, true, &session)) {
+        return false;
+    }
+
+    // The mount options are comma and colon separated with no escaping
+    if (strpbrk(session.dir, ",:\\") || strpbrk(session.home, ",:\\")) {
+        fprintf(stderr, "Error: Overlay paths may not contain ',', ':' or '\\'\n");
+        return false;
+    }
+    if (path_is_within(session.dir, session.home)) {
+        fprintf(stderr, "Error: Overlay sessions must live outside %s\n", session.home);
+        return false;
+    }
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        fprintf(stderr, "Error: Failed to get current directory: %s\n", strerror(errno));
+        return false;
+    }
+
+    if (!ns_enter()) {
+        return false;
+    }
+
+    // Keep the real home reachable once the overlay covers it
+    if (mount(session.home, session.lower, NULL, MS_BIND | MS_REC, NULL) != 0) {
+        fprintf(stderr, "Error: Failed to bind %s: %s\n", session.home, strerror(errno));
+        return false;
+    }
+
+    char options[3 * PATH_MAX + 64];
+    snprintf(options, sizeof(options), "lowerdir=%s,upperdir=%s,workdir=%s,userxattr",
+             session.lower, session.upper, session.work);
+    if (mount("overlay", session.home, "overlay", 0, options) != 0) {
+        fprintf(stderr, "Error: Failed to mount overlay on %s: %s\n",
+                session.home, strerror(errno));
+        return false;
+    }
+
+    // Writable paths under $HOME write to the real home, not the overlay
+    size_t home_len = strlen(session.home);
+    for (int i = 0; i < writable_paths->count; i++) {
+        const char* path = writable_paths->paths[i];
+        char source[PATH_MAX];
+        if (!path_is_within(path, session.home) ||
+            !join_path(source, session.lower, path[home_len] ? path + home_len + 1 : "")) {
+            continue;
+        }
+        if (mount(source, path, NULL, MS_BIND | MS_REC, NULL) != 0) {
+            fprintf(stderr, "Warning: Cannot bind writable path %s: %s\n",
+                    path, strerror(errno));
+        }
+    }
+
+    if (umount2(session.lower, MNT_DETACH) != 0) {
+        fprintf(stderr, "Error: Failed to unmount %s: %s\n", session.lower, strerror(errno));
+        return false;
+    }
+
+    // The overlay itself stays writable; everything else outside the
+    // policy becomes read-only
+    PathList* writable = pathlist_create();
+    bool ok = writable != NULL;
+    for (int i = 0; ok && i < writable_paths->count; i++) {
+        ok = pathlist_add(writable, writable_paths->paths[i]);
+    }
+    ok = ok && pathlist_add(writable, session.home) && ns_restrict_writes(writable);
+    pathlist_free(writable);
+    if (!ok) {
+        return false;
+    }
+
+    if (chdir(cwd) != 0) {
+        fprintf(stderr, "Error: Failed to re-enter %s: %s\n", cwd, strerror(errno));
+        return false;
+    }
+
+    return ns_drop_privileges();
+}
+
+static bool is_whiteout(const struct stat* st) {
+    return S_ISCHR(st->st_mode) && st->st_rdev == makedev(0, 0);
+}
+
+static bool is_opaque(const char* path) {
+    char value = 0;
+    return lgetxattr(path, "user.overlay.opaque", &value, 1) == 1 && value == 'y';
+}
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// List a directory's entries in name order
+static char** read_names(const char* path, int* count) {
+    DIR* dir = opendir(path);
+    if (!dir) {
+        return NULL;
+    }
+
+    char** names = NULL;
+    int capacity = 0;
+    *count = 0;
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            char** grown = realloc(names, sizeof(char*) * (size_t)capacity);
+            if (!grown) {
+                break;
+            }
+            names = grown;
+        }
+        names[*count] = strdup(entry->d_name);
+        if (names[*count]) {
+            (*count)++;
+        }
+    }
+    closedir(dir);
+
+    if (!names) {
+        // Empty directories still succeed
+        names = malloc(sizeof(char*));
+    }
+    if (names) {
+        qsort(names, (size_t)*count, sizeof(char*), compare_names);
+    }
+    return names;
+}
+
+// Walk the upper layer below rel. Below a new or replaced directory
+// nothing exists in the real home, so every entry is an addition.
+static bool walk_changes(const Session* session, const char* rel, bool below_new,
+                         ChangeVisitor visit, void* context) {
+    char upper_dir[PATH_MAX];
+    if (!join_path(upper_dir, session->upper, rel)) {
+        return false;
+    }
+
+    int count = 0;
+    char** names = read_names(upper_dir, &count);
+    if (!names) {
+        fprintf(stderr, "Error: Failed to read %s: %s\n", upper_dir, strerror(errno));
+        return false;
+    }
+
+    bool ok = true;
+    for (int i = 0; i < count && ok; i++) {
+        char entry_rel[PATH_MAX];
+        char upper_path[PATH_MAX];
+        char real_path[PATH_MAX];
+        if (!(*rel ? join_path(entry_rel, rel, names[i]) : join_path(entry_rel, names[i], NULL)) ||
+            !join_path(upper_path, session->upper, entry_rel) ||
+            !join_path(real_path, session->home, entry_rel)) {
+            ok = false;
+            break;
+        }
+
+        struct stat st;
+        struct stat real;
+        if (lstat(upper_path, &st) != 0) {
+            continue;
+        }
+        bool exists = !below_new && lstat(real_path, &real) == 0;
+
+        if (is_whiteout(&st)) {
+            if (exists) {
+                ok = visit(session, entry_rel, 'D', &st, context);
+            }
+            continue;
+        }
+
+        if (!S_ISDIR(st.st_mode)) {
+            ok = visit(session, entry_rel, exists ? 'M' : 'A', &st, context);
+            continue;
+        }
+
+        char change = 0;
+        if (!exists) {
+            change = 'A';
+        } else if (!S_ISDIR(real.st_mode) || is_opaque(upper_path)) {
+            change = 'R';
+        } else if ((st.st_mode & 07777) != (real.st_mode & 07777)) {
+            change = 'M';
+        }
+
+        if (change) {
+            ok = visit(session, entry_rel, change, &st, context);
+        }
+        if (ok) {
+            ok = walk_changes(session, entry_rel, below_new || change == 'A' || change == 'R',
+                              visit, context);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+    return ok;
+}
+
+static bool print_change(const Session* session, const char* rel, char change,
+                         const struct stat* st, void* context) {
+    int* changes = context;
+    (*changes)++;
+    printf("%c %s/%s%s\n", change, session->home, rel,
+           S_ISDIR(st->st_mode) && change != 'D' ? "/" : "");
+    return true;
+}
+
+bool overlay_diff(const char* id) {
+    Session session;
+    if (!session_open(id, false, &session)) {
+        return false;
+    }
+
+    int changes = 0;
+    if (!walk_changes(&session, "", false, print_change, &changes)) {
+        return false;
+    }
+    if (changes == 0) {
+        printf("No changes in overlay session %s\n", id);
+    }
+    return true;
+}
+
+static bool apply_change(const Session* session, const char* rel, char change,
+                         const struct stat* st, void* context) {
+    int* changes = context;
+    char upper_path[PATH_MAX];
+    char real_path[PATH_MAX];
+    join_path(upper_path, session->upper, rel);
+    join_path(real_path, session->home, rel);
+
+    struct stat real;
+    bool exists = lstat(real_path, &real) == 0;
+    bool ok = true;
+
+    if (change == 'D') {
+        ok = remove_tree(real_path);
+    } else if (S_ISDIR(st->st_mode)) {
+        if (change == 'M') {
+            ok = chmod(real_path, st->st_mode & 07777) == 0;
+        } else {
+            ok = (!exists || remove_tree(real_path)) &&
+                 mkdir(real_path, st->st_mode & 07777) == 0;
+        }
+    } else {
+        // A directory in the way has to go; files are replaced atomically
+        if (exists && S_ISDIR(real.st_mode)) {
+            ok = remove_tree(real_path);
+        }
+        if (ok && S_ISREG(st->st_mode)) {
+            ok = copy_file_atomic(upper_path, real_path);
+        } else if (ok && S_ISLNK(st->st_mode)) {
+            ok = copy_symlink_atomic(upper_path, real_path);
+        } else if (ok) {
+            fprintf(stderr, "Warning: Skipping special file %s\n", real_path);
+            return true;
+        }
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to apply %c %s: %s\n", change, real_path,
+                strerror(errno));
+        return false;
+    }
+    (*changes)++;
+    return true;
+}
+
+bool overlay_commit(const char* id) {
+    Session session;
+    if (!session_open(id, false, &session)) {
+        return false;
+    }
+
+    int changes = 0;
+    if (!walk_changes(&session, "", false, apply_change, &changes)) {
+        fprintf(stderr, "Error: Commit stopped after %d change(s); session %s kept\n",
+                changes, id);
+        return false;
+    }
+
+    if (!remove_tree(session.dir)) {
+        fprintf(stderr, "Warning: Failed to remove overlay session %s\n", session.dir);
+    }
+    printf("Committed %d change(s) from overlay session %s\n", changes, id);
+    return true;
+}
+
+bool overlay_discard(const char* id) {
+    Session session;
+    if (!session_open(id, false, &session)) {
+        return false;
+    }
+
+    if (!remove_tree(session.dir)) {
+        fprintf(stderr, "Error: Failed to remove overlay session %s: %s\n",
+                session.dir, strerror(errno));
+        return false;
+    }
+    printf("Discarded overlay session %s\n", id);
+    return true;
+}
@@ -0,0 +1,25 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include "config.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Sandbox the current process like the namespace backend, except that
+// writes under $HOME outside the writable paths go to the session's upper
+// layer instead of failing. The session is created if it does not exist.
+bool overlay_apply(const char* id, const PathList* writable_paths);
+
+// Create the session if it does not exist and store its directory in out
+bool overlay_session_dir(const char* id, char* out, size_t size);
+
+// Print what the session changed under $HOME, one path per line
+bool overlay_diff(const char* id);
+
+// Apply the session's changes to the real $HOME and delete the session
+bool overlay_commit(const char* id);
+
+// Delete the session and everything it captured
+bool overlay_discard(const char* id);
+
+#endif // OVERLAY_H
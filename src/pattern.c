@@ -0,0 +1,598 @@
+/*
+ * Glob patterns in the writable paths, compiled into a trie.
+ *
+ * Each pattern is split into path components and inserted into a trie
+ * shared by all patterns, so common prefixes such as $HOME are stored and
+ * walked once. A node's literal edges are sorted and found by binary
+ * search; only wildcard edges need fnmatch. A ** component becomes a node
+ * that loops on every component, entered without consuming one.
+ *
+ * Matching runs the trie as an NFA over the components of a path, keeping
+ * the set of nodes reached so far. Expansion walks the trie and the
+ * filesystem together: literal edges are a single lstat, and a directory
+ * is only read where a wildcard or ** has to be matched against its
+ * entries. Symlinks are never followed or matched, as a sandbox that can
+ * write one match could otherwise redirect it.
+ *
+ * After compiling, nodes and edges live in two flat arrays, which keeps
+ * the matcher's working set small when the seccomp supervisor consults it
+ * on every write.
+ */
+
+#include "pattern.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+// Directories expansion may visit before it gives up, so a ** over a huge
+// tree cannot stall the launch
+#define MAX_EXPAND_VISITS 200000
+
+// Active node sets up to this size live on the stack while matching
+#define STACK_NODES 64
+
+typedef struct {
+    // edges[first_edge, first_edge + edge_count), literal ones first
+    int first_edge;
+    int literal_count;
+    int edge_count;
+    // Node entered through a ** component, or -1
+    int any_child;
+    // Reached through **, so it also consumes any component and stays
+    bool loop;
+    // A pattern ends here
+    bool accept;
+} PatternNode;
+
+typedef struct {
+    char* segment;
+    int target;
+} PatternEdge;
+
+struct PatternSet {
+    PatternNode* nodes;
+    int node_count;
+    PatternEdge* edges;
+    int edge_count;
+    int pattern_count;
+};
+
+// Trie as built, before it is flattened
+typedef struct BuildNode {
+    char* segment;
+    bool glob;
+    bool loop;
+    bool accept;
+    struct BuildNode* first_child;
+    struct BuildNode* next_sibling;
+    struct BuildNode* any;
+    int index;
+} BuildNode;
+
+static bool is_glob_segment(const char* segment) {
+    return strpbrk(segment, "*?[") != NULL;
+}
+
+bool pattern_is_glob(const char* entry) {
+    return entry && is_glob_segment(entry);
+}
+
+char* pattern_normalize(const char* pattern, const char* base_dir) {
+    if (!pattern || !*pattern || strpbrk(pattern, "\"\n\r")) {
+        return NULL;
+    }
+
+    char joined[PATH_MAX];
+    int len;
+    if (pattern[0] == '~') {
+        const char* home = getenv("HOME");
+        if (pattern[1] != '/' || !home || home[0] != '/') {
+            return NULL;
+        }
+        len = snprintf(joined, sizeof(joined), "%s%s", home, pattern + 1);
+    } else if (pattern[0] != '/') {
+        if (!base_dir) {
+            return NULL;
+        }
+        len = snprintf(joined, sizeof(joined), "%s/%s", base_dir, pattern);
+    } else {
+        len = snprintf(joined, sizeof(joined), "%s", pattern);
+    }
+    if (len < 0 || (size_t)len >= sizeof(joined)) {
+        return NULL;
+    }
+
+    // Rebuild component by component, resolving the literal prefix once
+    // and dropping empty and "." components
+    char out[PATH_MAX] = "";
+    size_t out_len = 0;
+    bool in_literal_prefix = true;
+    char* save;
+    for (char* part = strtok_r(joined, "/", &save); part; part = strtok_r(NULL, "/", &save)) {
+        if (strcmp(part, ".") == 0) {
+            continue;
+        }
+        if (strcmp(part, "..") == 0) {
+            return NULL;
+        }
+        if (in_literal_prefix && is_glob_segment(part)) {
+            in_literal_prefix = false;
+            char* resolved = out_len > 0 ? realpath(out, NULL) : NULL;
+            if (resolved) {
+                out_len = (size_t)snprintf(out, sizeof(out), "%s",
+                                           strcmp(resolved, "/") == 0 ? "" : resolved);
+                free(resolved);
+            }
+        }
+        int written = snprintf(out + out_len, sizeof(out) - out_len, "/%s", part);
+        if (written < 0 || (size_t)written >= sizeof(out) - out_len) {
+            return NULL;
+        }
+        out_len += (size_t)written;
+    }
+    return out_len > 0 ? strdup(out) : NULL;
+}
+
+static BuildNode* build_node(const char* segment) {
+    BuildNode* node = calloc(1, sizeof(BuildNode));
+    if (node && segment) {
+        node->segment = strdup(segment);
+        node->glob = is_glob_segment(segment);
+        if (!node->segment) {
+            free(node);
+            return NULL;
+        }
+    }
+    return node;
+}
+
+static void build_free(BuildNode* node) {
+    while (node) {
+        BuildNode* next = node->next_sibling;
+        build_free(node->first_child);
+        build_free(node->any);
+        free(node->segment);
+        free(node);
+        node = next;
+    }
+}
+
+static bool build_insert(BuildNode* root, const char* pattern) {
+    char copy[PATH_MAX];
+    int len = snprintf(copy, sizeof(copy), "%s", pattern);
+    if (len < 0 || (size_t)len >= sizeof(copy)) {
+        return false;
+    }
+
+    BuildNode* node = root;
+    char* save;
+    for (char* part = strtok_r(copy, "/", &save); part; part = strtok_r(NULL, "/", &save)) {
+        if (strcmp(part, "**") == 0) {
+            // Consecutive ** are one
+            if (!node->loop) {
+                if (!node->any && !(node->any = build_node(NULL))) {
+                    return false;
+                }
+                node->any->loop = true;
+                node = node->any;
+            }
+            continue;
+        }
+
+        BuildNode* child = node->first_child;
+        while (child && strcmp(child->segment, part) != 0) {
+            child = child->next_sibling;
+        }
+        if (!child) {
+            if (!(child = build_node(part))) {
+                return false;
+            }
+            child->next_sibling = node->first_child;
+            node->first_child = child;
+        }
+        node = child;
+    }
+    node->accept = true;
+    return true;
+}
+
+static int count_nodes(const BuildNode* node, int* edges) {
+    int count = 1;
+    for (const BuildNode* child = node->first_child; child; child = child->next_sibling) {
+        (*edges)++;
+        count += count_nodes(child, edges);
+    }
+    if (node->any) {
+        count += count_nodes(node->any, edges);
+    }
+    return count;
+}
+
+static int compare_edges(const void* a, const void* b) {
+    const PatternEdge* x = a;
+    const PatternEdge* y = b;
+    return strcmp(x->segment, y->segment);
+}
+
+// Lay the nodes out breadth-first, so the nodes a match step visits
+// together sit together
+static bool flatten(PatternSet* set, BuildNode* root) {
+    BuildNode** queue = malloc(sizeof(BuildNode*) * (size_t)set->node_count);
+    if (!queue) {
+        return false;
+    }
+    int head = 0;
+    int tail = 0;
+    queue[tail++] = root;
+    root->index = 0;
+    while (head < tail) {
+        BuildNode* node = queue[head++];
+        for (BuildNode* child = node->first_child; child; child = child->next_sibling) {
+            child->index = tail;
+            queue[tail++] = child;
+        }
+        if (node->any) {
+            node->any->index = tail;
+            queue[tail++] = node->any;
+        }
+    }
+
+    int edge = 0;
+    for (int i = 0; i < tail; i++) {
+        BuildNode* node = queue[i];
+        PatternNode* flat = &set->nodes[i];
+        flat->first_edge = edge;
+        flat->any_child = node->any ? node->any->index : -1;
+        flat->loop = node->loop;
+        flat->accept = node->accept;
+
+        // Literal edges first and sorted, then the wildcards
+        for (int pass = 0; pass < 2; pass++) {
+            for (BuildNode* child = node->first_child; child; child = child->next_sibling) {
+                if (child->glob == (pass == 1)) {
+                    set->edges[edge].segment = child->segment;
+                    set->edges[edge].target = child->index;
+                    child->segment = NULL;
+                    edge++;
+                }
+            }
+            if (pass == 0) {
+                flat->literal_count = edge - flat->first_edge;
+                qsort(&set->edges[flat->first_edge], (size_t)flat->literal_count,
+                      sizeof(PatternEdge), compare_edges);
+            }
+        }
+        flat->edge_count = edge - flat->first_edge;
+    }
+    free(queue);
+    return true;
+}
+
+PatternSet* pattern_set_compile(const PathList* paths) {
+    PatternSet* set = calloc(1, sizeof(PatternSet));
+    BuildNode* root = build_node(NULL);
+    bool ok = set && root;
+
+    for (int i = 0; ok && paths && i < paths->count; i++) {
+        if (pattern_is_glob(paths->paths[i])) {
+            ok = build_insert(root, paths->paths[i]);
+            set->pattern_count++;
+        }
+    }
+
+    if (ok) {
+        set->node_count = count_nodes(root, &set->edge_count);
+        set->nodes = calloc((size_t)set->node_count, sizeof(PatternNode));
+        set->edges = calloc((size_t)(set->edge_count > 0 ? set->edge_count : 1),
+                            sizeof(PatternEdge));
+        ok = set->nodes && set->edges && flatten(set, root);
+    }
+
+    build_free(root);
+    if (!ok) {
+        pattern_set_free(set);
+        return NULL;
+    }
+    return set;
+}
+
+int pattern_set_count(const PatternSet* set) {
+    return set ? set->pattern_count : 0;
+}
+
+void pattern_set_free(PatternSet* set) {
+    if (!set) {
+        return;
+    }
+    for (int i = 0; set->edges && i < set->edge_count; i++) {
+        free(set->edges[i].segment);
+    }
+    free(set->edges);
+    free(set->nodes);
+    free(set);
+}
+
+// Add node to the active set, with the ** nodes it can enter for free
+static void activate(const PatternSet* set, int* active, int* count, int node) {
+    while (node >= 0) {
+        for (int i = 0; i < *count; i++) {
+            if (active[i] == node) {
+                return;
+            }
+        }
+        active[(*count)++] = node;
+        node = set->nodes[node].any_child;
+    }
+}
+
+static int find_literal(const PatternSet* set, const PatternNode* node, const char* name) {
+    int low = node->first_edge;
+    int high = node->first_edge + node->literal_count - 1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        int cmp = strcmp(set->edges[mid].segment, name);
+        if (cmp == 0) {
+            return set->edges[mid].target;
+        }
+        if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return -1;
+}
+
+static bool any_accepts(const PatternSet* set, const int* active, int count) {
+    for (int i = 0; i < count; i++) {
+        if (set->nodes[active[i]].accept) {
+            return true;
+        }
+    }
+    return false;
+}
+
+PatternMatch pattern_set_match(const PatternSet* set, const char* path) {
+    if (!set || set->pattern_count == 0 || !path || path[0] != '/') {
+        return PATTERN_NONE;
+    }
+
+    int stack[2 * STACK_NODES];
+    int* buffer = stack;
+    if (set->node_count > STACK_NODES) {
+        buffer = malloc(sizeof(int) * 2 * (size_t)set->node_count);
+        if (!buffer) {
+            return PATTERN_NONE;
+        }
+    }
+    int* active = buffer;
+    int* next = buffer + (set->node_count > STACK_NODES ? set->node_count : STACK_NODES);
+    int count = 0;
+    activate(set, active, &count, 0);
+
+    PatternMatch result = any_accepts(set, active, count) ? PATTERN_MATCH : PATTERN_PREFIX;
+    char name[NAME_MAX + 1];
+    for (const char* p = path; result == PATTERN_PREFIX && *p; ) {
+        p += strspn(p, "/");
+        size_t len = strcspn(p, "/");
+        if (len == 0) {
+            break;
+        }
+        bool fits = len < sizeof(name);
+        if (fits) {
+            memcpy(name, p, len);
+            name[len] = '\0';
+        }
+        p += len;
+
+        int next_count = 0;
+        for (int i = 0; i < count; i++) {
+            const PatternNode* node = &set->nodes[active[i]];
+            if (node->loop) {
+                activate(set, next, &next_count, active[i]);
+            }
+            if (!fits) {
+                continue;
+            }
+            int target = find_literal(set, node, name);
+            if (target >= 0) {
+                activate(set, next, &next_count, target);
+            }
+            for (int e = node->first_edge + node->literal_count;
+                 e < node->first_edge + node->edge_count; e++) {
+                if (fnmatch(set->edges[e].segment, name, 0) == 0) {
+                    activate(set, next, &next_count, set->edges[e].target);
+                }
+            }
+        }
+
+        int* swap = active;
+        active = next;
+        next = swap;
+        count = next_count;
+        if (count == 0) {
+            result = PATTERN_NONE;
+        } else if (any_accepts(set, active, count)) {
+            result = PATTERN_MATCH;
+        }
+    }
+
+    if (buffer != stack) {
+        free(buffer);
+    }
+    return result;
+}
+
+typedef struct {
+    const PatternSet* set;
+    PathList* out;
+    int visits;
+    bool ok;
+} Expansion;
+
+static void expand_node(Expansion* x, int index, char* path, size_t len);
+
+// Continue the walk at path/name, restoring path afterwards
+static void expand_child(Expansion* x, int index, char* path, size_t len, const char* name) {
+    int written = snprintf(path + len, PATH_MAX - len, "%s%s", len > 1 ? "/" : "", name);
+    if (written > 0 && (size_t)written < PATH_MAX - len) {
+        expand_node(x, index, path, len + (size_t)written);
+    }
+    path[len] = '\0';
+}
+
+static void expand_node(Expansion* x, int index, char* path, size_t len) {
+    const PatternNode* node = &x->set->nodes[index];
+    struct stat st;
+    // Symlinks are not followed. The leading literal components were
+    // resolved when the pattern was normalized, so the rest is made of
+    // entries a sandbox may have written; a link there would point the
+    // match anywhere.
+    if (!x->ok || lstat(path, &st) != 0 || S_ISLNK(st.st_mode)) {
+        return;
+    }
+    if (node->accept) {
+        x->ok = pathlist_add(x->out, path);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        return;
+    }
+    if (++x->visits > MAX_EXPAND_VISITS) {
+        if (x->visits == MAX_EXPAND_VISITS + 1) {
+            fprintf(stderr, "Warning: Stopped expanding writable path patterns after %d "
+                            "directories\n", MAX_EXPAND_VISITS);
+        }
+        return;
+    }
+
+    for (int e = node->first_edge; e < node->first_edge + node->literal_count; e++) {
+        expand_child(x, x->set->edges[e].target, path, len, x->set->edges[e].segment);
+    }
+    if (node->any_child >= 0) {
+        expand_node(x, node->any_child, path, len);
+    }
+    if (!node->loop && node->edge_count == node->literal_count) {
+        return;
+    }
+
+    DIR* dir = opendir(path);
+    if (!dir) {
+        return;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char* name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        for (int e = node->first_edge + node->literal_count;
+             e < node->first_edge + node->edge_count; e++) {
+            if (fnmatch(x->set->edges[e].segment, name, 0) == 0) {
+                expand_child(x, x->set->edges[e].target, path, len, name);
+            }
+        }
+        // ** descends into real directories only
+        if (!node->loop) {
+            continue;
+        }
+        bool is_dir = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat entry_st;
+            int written = snprintf(path + len, PATH_MAX - len, "%s%s", len > 1 ? "/" : "",
+                                   name);
+            is_dir = written > 0 && (size_t)written < PATH_MAX - len &&
+                     lstat(path, &entry_st) == 0 && S_ISDIR(entry_st.st_mode);
+            path[len] = '\0';
+        }
+        if (is_dir) {
+            expand_child(x, index, path, len, name);
+        }
+    }
+    closedir(dir);
+}
+
+PathList* pattern_expand(const PathList* paths) {
+    PathList* out = pathlist_create();
+    PatternSet* set = NULL;
+    bool ok = out != NULL;
+    for (int i = 0; ok && i < paths->count; i++) {
+        if (!pattern_is_glob(paths->paths[i])) {
+            ok = pathlist_add(out, paths->paths[i]);
+        } else if (!set) {
+            ok = (set = pattern_set_compile(paths)) != NULL;
+        }
+    }
+
+    if (ok && set) {
+        char path[PATH_MAX] = "/";
+        Expansion x = { set, out, 0, true };
+        expand_node(&x, 0, path, 1);
+        ok = x.ok;
+    }
+    pattern_set_free(set);
+
+    // Matches below a literal entry add nothing
+    if (!ok || !pathlist_drop_subsumed(out)) {
+        pathlist_free(out);
+        return NULL;
+    }
+    return out;
+}
+
+char* pattern_to_regex(const char* pattern) {
+    // Seatbelt regex literals have no escapes, so metacharacters are put
+    // in brackets, and the few that cannot be are refused
+    if (!pattern || strpbrk(pattern, "^\\\"")) {
+        return NULL;
+    }
+
+    size_t size = strlen(pattern) * 6 + 32;
+    char* regex = malloc(size);
+    if (!regex) {
+        return NULL;
+    }
+    char* out = regex;
+    *out++ = '^';
+    for (const char* p = pattern; *p; ) {
+        if (p[0] == '/' && p[1] == '*' && p[2] == '*' && (p[3] == '/' || p[3] == '\0')) {
+            out = stpcpy(out, "(/.*)?");
+            p += 3;
+        } else if (*p == '*') {
+            out = stpcpy(out, "[^/]*");
+            p++;
+        } else if (*p == '?') {
+            out = stpcpy(out, "[^/]");
+            p++;
+        } else if (*p == '[') {
+            const char* end = strchr(p + 2, ']');
+            if (!end) {
+                free(regex);
+                return NULL;
+            }
+            *out++ = '[';
+            p++;
+            if (*p == '!') {
+                *out++ = '^';
+                p++;
+            }
+            while (p <= end) {
+                *out++ = *p++;
+            }
+        } else if (strchr(".+(){}|$", *p)) {
+            *out++ = '[';
+            *out++ = *p++;
+            *out++ = ']';
+        } else {
+            *out++ = *p++;
+        }
+    }
+    out = stpcpy(out, "(/.*)?$");
+    return regex;
+}
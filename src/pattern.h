@@ -0,0 +1,55 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include "config.h"
+#include <stdbool.h>
+
+// Glob patterns among the writable paths.
+//
+// A pattern is an absolute path whose components may use *, ? and [...]
+// as in the shell, or be ** to match any number of directories. The
+// writable paths are then whatever the patterns match, and everything
+// below those.
+
+typedef struct PatternSet PatternSet;
+
+typedef enum {
+    // Neither path nor anything below it can match
+    PATTERN_NONE,
+    // Something below path could match
+    PATTERN_PREFIX,
+    // Path or one of its ancestors matches
+    PATTERN_MATCH,
+} PatternMatch;
+
+// Check whether a writable path entry is a pattern rather than a literal
+// path
+bool pattern_is_glob(const char* entry);
+
+// Turn a pattern from a config file or the command line into an absolute
+// one: ~ is expanded, relative patterns are anchored at base_dir, and the
+// leading components without wildcards are resolved like literal paths.
+// Returns NULL for a pattern that cannot be used.
+char* pattern_normalize(const char* pattern, const char* base_dir);
+
+// Compile the patterns among paths; literal entries are skipped
+PatternSet* pattern_set_compile(const PathList* paths);
+
+// Match a canonical absolute path against the compiled patterns
+PatternMatch pattern_set_match(const PatternSet* set, const char* path);
+
+// Number of patterns compiled into the set
+int pattern_set_count(const PatternSet* set);
+
+void pattern_set_free(PatternSet* set);
+
+// A copy of paths with every pattern replaced by the existing files and
+// directories it matches, for backends that need concrete paths. Matches
+// that are symlinks, or lie below one, are left out.
+PathList* pattern_expand(const PathList* paths);
+
+// Convert a pattern to an anchored extended regular expression matching
+// what it matches and everything below, for seatbelt profiles
+char* pattern_to_regex(const char* pattern);
+
+#endif // PATTERN_H
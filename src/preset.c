@@ -0,0 +1,243 @@
+/*
+ * Toolchain cache presets.
+ *
+ * Package managers and compiler caches keep their downloads and build
+ * results under $HOME, which is read-only in the sandbox, so without these
+ * directories they start cold on every run. A preset names the cache
+ * directories of one toolchain. They follow the variables the toolchain
+ * itself reads to move them (CARGO_HOME, PIP_CACHE_DIR, ...), so a preset
+ * is overridden the same way the cache is.
+ *
+ * Only caches are included, never directories of installed programs such
+ * as ~/.cargo/bin, which a sandboxed command could use to plant something
+ * that later runs outside the sandbox.
+ */
+
+#include "preset.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+
+#define MAX_PRESET_DIRS 5
+
+typedef enum {
+    BASE_HOME,
+    // The per-user cache directory the toolchains default to
+    BASE_CACHE,
+} PresetBase;
+
+typedef enum {
+    // Only used if it exists
+    PRESET_EXISTING,
+    // The toolchain's main cache, created if missing so the first run
+    // can fill it
+    PRESET_CREATE_DIR,
+    // A lock file next to the cache, created empty if missing
+    PRESET_CREATE_FILE,
+} PresetCreate;
+
+typedef struct {
+    // Variables that move the directory, tried in order, with what to
+    // append to their value
+    const char* env;
+    const char* env_suffix;
+    const char* alt_env;
+    const char* alt_suffix;
+    // Where it is when neither is set
+    PresetBase base;
+    const char* path;
+    PresetCreate create;
+} PresetDir;
+
+typedef struct {
+    const char* name;
+    // Space-separated command names that "auto" picks the preset for
+    const char* commands;
+    PresetDir dirs[MAX_PRESET_DIRS];
+} Preset;
+
+static const Preset presets[] = {
+    { "node", "node npm npx yarn pnpm corepack", {
+        { "npm_config_cache", "", NULL, NULL, BASE_HOME, ".npm", PRESET_CREATE_DIR },
+        { "YARN_CACHE_FOLDER", "", NULL, NULL, BASE_CACHE, "yarn", PRESET_EXISTING },
+        { NULL, NULL, NULL, NULL, BASE_HOME, ".local/share/pnpm/store", PRESET_EXISTING },
+        { NULL, NULL, NULL, NULL, BASE_CACHE, "node-gyp", PRESET_EXISTING },
+    } },
+    { "rust", "cargo rustc", {
+        { "CARGO_HOME", "/registry", NULL, NULL, BASE_HOME, ".cargo/registry", PRESET_CREATE_DIR },
+        { "CARGO_HOME", "/git", NULL, NULL, BASE_HOME, ".cargo/git", PRESET_CREATE_DIR },
+        { "CARGO_HOME", "/.package-cache", NULL, NULL, BASE_HOME, ".cargo/.package-cache",
+          PRESET_CREATE_FILE },
+        { "CARGO_HOME", "/.package-cache-mutate", NULL, NULL, BASE_HOME,
+          ".cargo/.package-cache-mutate", PRESET_CREATE_FILE },
+        { "CARGO_HOME", "/.global-cache", NULL, NULL, BASE_HOME, ".cargo/.global-cache",
+          PRESET_EXISTING },
+    } },
+    { "python", "pip pip3 python python3 uv poetry", {
+        { "PIP_CACHE_DIR", "", NULL, NULL, BASE_CACHE, "pip", PRESET_CREATE_DIR },
+        { "UV_CACHE_DIR", "", NULL, NULL, BASE_CACHE, "uv", PRESET_EXISTING },
+        { "POETRY_CACHE_DIR", "", NULL, NULL, BASE_CACHE, "pypoetry", PRESET_EXISTING },
+    } },
+    { "go", "go", {
+        { "GOMODCACHE", "", "GOPATH", "/pkg/mod", BASE_HOME, "go/pkg/mod", PRESET_CREATE_DIR },
+        { "GOCACHE", "", NULL, NULL, BASE_CACHE, "go-build", PRESET_CREATE_DIR },
+    } },
+    { "ccache", "ccache make ninja cmake cc c++ gcc g++ clang clang++", {
+        { "CCACHE_DIR", "", NULL, NULL, BASE_CACHE, "ccache", PRESET_CREATE_DIR },
+        { NULL, NULL, NULL, NULL, BASE_HOME, ".ccache", PRESET_EXISTING },
+    } },
+};
+
+#define PRESET_COUNT (sizeof(presets) / sizeof(presets[0]))
+
+const char* const preset_env_vars[] = {
+    "npm_config_cache", "YARN_CACHE_FOLDER", "CARGO_HOME", "PIP_CACHE_DIR", "UV_CACHE_DIR",
+    "POETRY_CACHE_DIR", "GOMODCACHE", "GOPATH", "GOCACHE", "CCACHE_DIR", "XDG_CACHE_HOME",
+    NULL
+};
+
+static const Preset* find_preset(const char* name) {
+    for (size_t i = 0; i < PRESET_COUNT; i++) {
+        if (strcmp(presets[i].name, name) == 0) {
+            return &presets[i];
+        }
+    }
+    return NULL;
+}
+
+static bool has_word(const char* words, const char* word) {
+    size_t len = strlen(word);
+    for (const char* p = words; *p; p += strcspn(p, " "), p += strspn(p, " ")) {
+        if (strncmp(p, word, len) == 0 && (p[len] == ' ' || p[len] == '\0')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The first directory of an absolute, colon-separated variable such as
+// GOPATH
+static bool env_dir(char out[PATH_MAX], const char* name, const char* suffix) {
+    const char* value = name ? getenv(name) : NULL;
+    if (!value || value[0] != '/') {
+        return false;
+    }
+    int len = snprintf(out, PATH_MAX, "%.*s%s", (int)strcspn(value, ":"), value, suffix);
+    return len >= 0 && len < PATH_MAX;
+}
+
+static bool base_dir(char out[PATH_MAX], PresetBase base, const char* path) {
+    const char* home = getenv("HOME");
+    if (!home || home[0] != '/') {
+        return false;
+    }
+    int len;
+    if (base == BASE_HOME) {
+        len = snprintf(out, PATH_MAX, "%s/%s", home, path);
+    } else {
+#ifdef __APPLE__
+        len = snprintf(out, PATH_MAX, "%s/Library/Caches/%s", home, path);
+#else
+        char* cache = get_xdg_cache_dir();
+        if (!cache) {
+            return false;
+        }
+        len = snprintf(out, PATH_MAX, "%s/%s", cache, path);
+        free(cache);
+#endif
+    }
+    return len >= 0 && len < PATH_MAX;
+}
+
+static bool create_entry(const char* path, PresetCreate create) {
+    if (create == PRESET_CREATE_DIR) {
+        return make_directories(path, 0700);
+    }
+    char parent[PATH_MAX];
+    snprintf(parent, sizeof(parent), "%s", path);
+    char* slash = strrchr(parent, '/');
+    if (slash && slash != parent) {
+        *slash = '\0';
+        if (!make_directories(parent, 0700)) {
+            return false;
+        }
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    close(fd);
+    return true;
+}
+
+static void add_preset(PathList* paths, const Preset* preset, bool create) {
+    for (int i = 0; i < MAX_PRESET_DIRS && preset->dirs[i].path; i++) {
+        const PresetDir* dir = &preset->dirs[i];
+        char path[PATH_MAX];
+        if (!env_dir(path, dir->env, dir->env_suffix) &&
+            !env_dir(path, dir->alt_env, dir->alt_suffix) &&
+            !base_dir(path, dir->base, dir->path)) {
+            continue;
+        }
+
+        if (create && dir->create != PRESET_EXISTING && access(path, F_OK) != 0 &&
+            !create_entry(path, dir->create)) {
+            fprintf(stderr, "Warning: Cannot create %s for preset %s: %s\n",
+                    path, preset->name, strerror(errno));
+            continue;
+        }
+
+        // Checked like config file paths, as they end up in the same rules
+        char* resolved = realpath(path, NULL);
+        if (resolved && !strpbrk(resolved, "\"\n\r")) {
+            pathlist_add(paths, resolved);
+            free(resolved);
+        }
+    }
+}
+
+bool preset_add_paths(PathList* paths, const char* names, const char* command, bool create) {
+    char* list = strdup(names);
+    if (!list) {
+        return false;
+    }
+
+    // Check every name before adding anything
+    bool ok = true;
+    char* save;
+    for (char* name = strtok_r(list, ", \t", &save); ok && name;
+         name = strtok_r(NULL, ", \t", &save)) {
+        ok = strcmp(name, "auto") == 0 || find_preset(name);
+    }
+    free(list);
+    list = ok ? strdup(names) : NULL;
+    if (!list) {
+        return false;
+    }
+
+    const char* base = command ? strrchr(command, '/') : NULL;
+    base = base ? base + 1 : command;
+    for (char* name = strtok_r(list, ", \t", &save); name;
+         name = strtok_r(NULL, ", \t", &save)) {
+        if (strcmp(name, "auto") != 0) {
+            add_preset(paths, find_preset(name), create);
+            continue;
+        }
+        if (!base) {
+            fprintf(stderr, "Warning: Preset auto picks presets by command name and "
+                            "does nothing without a command\n");
+        }
+        for (size_t i = 0; base && *base && i < PRESET_COUNT; i++) {
+            if (has_word(presets[i].commands, base)) {
+                add_preset(paths, &presets[i], create);
+            }
+        }
+    }
+    free(list);
+    return true;
+}
@@ -0,0 +1,17 @@
+#ifndef PRESET_H
+#define PRESET_H
+
+#include "config.h"
+#include <stdbool.h>
+
+// Environment variables that move preset directories, NULL-terminated
+extern const char* const preset_env_vars[];
+
+// Add the cache directories of the comma-separated presets in names to
+// paths. With create, each toolchain's main cache is created first if it
+// is missing; without, missing directories are left out. "auto" picks the
+// presets for command's name; command may be NULL where there is none.
+// Returns false, adding nothing, if a name is unknown.
+bool preset_add_paths(PathList* paths, const char* names, const char* command, bool create);
+
+#endif // PRESET_H
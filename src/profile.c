@@ -0,0 +1,306 @@
+/*
+ * --profile-io: per-directory counts and time of file syscalls.
+ *
+ * The command runs with libsandbash-profile.so (profile_preload.c)
+ * preloaded. Every process it starts writes its own totals to a file in
+ * <runtime>/sandbash/profile/<run>/ before it execs or exits; once the
+ * command is done, sandbash merges them into one tab-separated report.
+ */
+
+#include "profile.h"
+#include "config.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define PROFILE_LIBRARY "libsandbash-profile.so"
+#define SUMMARY_DIRECTORIES 5
+
+enum { OP_OPEN, OP_STAT, OP_READ, OP_WRITE, OP_RENAME, OP_COUNT };
+
+typedef struct {
+    unsigned long calls[OP_COUNT];
+    unsigned long long ns;
+} ProfileRow;
+
+struct ProfileRun {
+    char root[PATH_MAX / 2];
+    char dir[PATH_MAX];
+    char library[PATH_MAX];
+};
+
+static pid_t profiled_child = -1;
+
+static void forward_signal(int sig) {
+    if (profiled_child > 0) {
+        kill(profiled_child, sig);
+    }
+}
+
+// $SANDBASH_PROFILE_LIB, next to the executable (a build tree), or in
+// ../lib/sandbash (an install)
+static bool find_library(char out[PATH_MAX]) {
+    const char* env = getenv("SANDBASH_PROFILE_LIB");
+    if (env && *env) {
+        snprintf(out, PATH_MAX, "%s", env);
+        return access(out, R_OK) == 0;
+    }
+
+    char exe[PATH_MAX / 2];
+    ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (len <= 0) {
+        return false;
+    }
+    exe[len] = '\0';
+    *strrchr(exe, '/') = '\0';
+
+    snprintf(out, PATH_MAX, "%s/" PROFILE_LIBRARY, exe);
+    if (access(out, R_OK) == 0) {
+        return true;
+    }
+    snprintf(out, PATH_MAX, "%s/../lib/sandbash/" PROFILE_LIBRARY, exe);
+    return access(out, R_OK) == 0;
+}
+
+// Remove results left by runs that died before writing their report
+static void remove_stale_runs(const char* root) {
+    DIR* handle = opendir(root);
+    if (!handle) {
+        return;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(handle)) != NULL) {
+        char* end;
+        long pid = strtol(entry->d_name, &end, 10);
+        if (entry->d_name[0] == '.' || *end != '\0' || pid <= 0 ||
+            kill((pid_t)pid, 0) == 0 || errno != ESRCH) {
+            continue;
+        }
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", root, entry->d_name);
+        remove_tree(path);
+    }
+    closedir(handle);
+}
+
+ProfileRun* profile_start(void) {
+    ProfileRun* run = calloc(1, sizeof(ProfileRun));
+    if (!run) {
+        return NULL;
+    }
+
+    if (!find_library(run->library)) {
+        fprintf(stderr, "Error: Cannot find " PROFILE_LIBRARY "; set SANDBASH_PROFILE_LIB "
+                        "to its path\n");
+        free(run);
+        return NULL;
+    }
+
+    char* runtime_dir = get_xdg_runtime_dir();
+    if (!runtime_dir) {
+        fprintf(stderr, "Error: Failed to determine runtime directory\n");
+        free(run);
+        return NULL;
+    }
+    snprintf(run->root, sizeof(run->root), "%s/sandbash", runtime_dir);
+    free(runtime_dir);
+    mkdir(run->root, 0700);
+    strncat(run->root, "/profile", sizeof(run->root) - strlen(run->root) - 1);
+    mkdir(run->root, 0700);
+
+    remove_stale_runs(run->root);
+
+    snprintf(run->dir, sizeof(run->dir), "%s/%d", run->root, (int)getpid());
+    remove_tree(run->dir);
+    if (mkdir(run->dir, 0700) != 0) {
+        fprintf(stderr, "Error: Failed to create %s: %s\n", run->dir, strerror(errno));
+        free(run);
+        return NULL;
+    }
+    return run;
+}
+
+const char* profile_writable_path(const ProfileRun* run) {
+    return run->root;
+}
+
+bool profile_export(const ProfileRun* run) {
+    // Keep whatever else is preloaded, after the shim
+    const char* existing = getenv("LD_PRELOAD");
+    char preload[PATH_MAX * 2];
+    int len = existing && *existing
+                  ? snprintf(preload, sizeof(preload), "%s:%s", run->library, existing)
+                  : snprintf(preload, sizeof(preload), "%s", run->library);
+    if (len < 0 || (size_t)len >= sizeof(preload)) {
+        return false;
+    }
+    return setenv("LD_PRELOAD", preload, 1) == 0 &&
+           setenv("SANDBASH_PROFILE_DIR", run->dir, 1) == 0;
+}
+
+int profile_wait(pid_t pid) {
+    profiled_child = pid;
+
+    // Terminal signals reach the child through the process group already
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+    signal(SIGTERM, forward_signal);
+    signal(SIGHUP, forward_signal);
+
+    int status = -1;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            status = -1;
+            break;
+        }
+    }
+    profiled_child = -1;
+    return status;
+}
+
+// Add one process's lines to the per-directory totals
+static void merge_file(const char* path, PathList* dirs, ProfileRow** rows, int* capacity) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return;
+    }
+
+    char* line = NULL;
+    size_t line_size = 0;
+    while (getline(&line, &line_size, f) > 0) {
+        line[strcspn(line, "\n")] = '\0';
+        ProfileRow row = { { 0 }, 0 };
+        int dir_start = 0;
+        if (sscanf(line, "%lu\t%lu\t%lu\t%lu\t%lu\t%llu\t%n", &row.calls[OP_OPEN],
+                   &row.calls[OP_STAT], &row.calls[OP_READ], &row.calls[OP_WRITE],
+                   &row.calls[OP_RENAME], &row.ns, &dir_start) != 6 || dir_start == 0) {
+            continue;
+        }
+
+        const char* dir = line + dir_start;
+        int index = pathlist_find(dirs, dir);
+        if (index < 0) {
+            if (!pathlist_add(dirs, dir)) {
+                continue;
+            }
+            index = dirs->count - 1;
+            if (index >= *capacity) {
+                int grown_capacity = *capacity ? *capacity * 2 : 256;
+                ProfileRow* grown = realloc(*rows, sizeof(ProfileRow) * (size_t)grown_capacity);
+                if (!grown) {
+                    continue;
+                }
+                *rows = grown;
+                *capacity = grown_capacity;
+            }
+            memset(&(*rows)[index], 0, sizeof(ProfileRow));
+        }
+
+        ProfileRow* total = &(*rows)[index];
+        for (int op = 0; op < OP_COUNT; op++) {
+            total->calls[op] += row.calls[op];
+        }
+        total->ns += row.ns;
+    }
+
+    free(line);
+    fclose(f);
+}
+
+static const ProfileRow* sort_rows;
+static const PathList* sort_dirs;
+
+static int compare_rows(const void* a, const void* b) {
+    unsigned long long ns_a = sort_rows[*(const int*)a].ns;
+    unsigned long long ns_b = sort_rows[*(const int*)b].ns;
+    if (ns_a != ns_b) {
+        return ns_a < ns_b ? 1 : -1;
+    }
+    return strcmp(sort_dirs->paths[*(const int*)a], sort_dirs->paths[*(const int*)b]);
+}
+
+bool profile_report(const ProfileRun* run, const char* output_path) {
+    PathList* dirs = pathlist_create();
+    ProfileRow* rows = NULL;
+    int capacity = 0;
+
+    DIR* handle = opendir(run->dir);
+    if (!dirs || !handle) {
+        fprintf(stderr, "Error: Failed to read I/O profile results: %s\n", strerror(errno));
+        pathlist_free(dirs);
+        if (handle) {
+            closedir(handle);
+        }
+        return false;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(handle)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        char path[PATH_MAX * 2];
+        snprintf(path, sizeof(path), "%s/%s", run->dir, entry->d_name);
+        merge_file(path, dirs, &rows, &capacity);
+    }
+    closedir(handle);
+
+    int count = dirs->count;
+    int* order = malloc(sizeof(int) * (size_t)(count + 1));
+    FILE* f = order ? fopen(output_path, "w") : NULL;
+    if (!f) {
+        fprintf(stderr, "Error: Failed to write %s: %s\n", output_path, strerror(errno));
+        free(order);
+        free(rows);
+        pathlist_free(dirs);
+        return false;
+    }
+
+    unsigned long calls = 0;
+    unsigned long long ns = 0;
+    for (int i = 0; i < count; i++) {
+        order[i] = i;
+        for (int op = 0; op < OP_COUNT; op++) {
+            calls += rows[i].calls[op];
+        }
+        ns += rows[i].ns;
+    }
+    sort_rows = rows;
+    sort_dirs = dirs;
+    qsort(order, (size_t)count, sizeof(int), compare_rows);
+
+    fprintf(f, "time_ms\topens\tstats\treads\twrites\trenames\tdirectory\n");
+    for (int i = 0; i < count; i++) {
+        const ProfileRow* row = &rows[order[i]];
+        fprintf(f, "%.3f\t%lu\t%lu\t%lu\t%lu\t%lu\t%s\n", row->ns / 1e6, row->calls[OP_OPEN],
+                row->calls[OP_STAT], row->calls[OP_READ], row->calls[OP_WRITE],
+                row->calls[OP_RENAME], dirs->paths[order[i]]);
+    }
+    bool ok = fclose(f) == 0;
+
+    fprintf(stderr, "I/O profile: %lu call(s) in %d director%s, %.1f ms, written to %s\n",
+            calls, count, count == 1 ? "y" : "ies", ns / 1e6, output_path);
+    for (int i = 0; i < count && i < SUMMARY_DIRECTORIES; i++) {
+        fprintf(stderr, "  %10.1f ms  %s\n", rows[order[i]].ns / 1e6, dirs->paths[order[i]]);
+    }
+
+    free(order);
+    free(rows);
+    pathlist_free(dirs);
+    return ok;
+}
+
+void profile_free(ProfileRun* run) {
+    if (!run) {
+        return;
+    }
+    remove_tree(run->dir);
+    free(run);
+}
@@ -0,0 +1,31 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+typedef struct ProfileRun ProfileRun;
+
+// Locate libsandbash-profile.so and create a directory for this run's
+// per-process results
+ProfileRun* profile_start(void);
+
+// Directory the preload library writes to, which must be writable inside
+// the sandbox. The same for every run, so the ruleset cache still hits.
+const char* profile_writable_path(const ProfileRun* run);
+
+// Set LD_PRELOAD and SANDBASH_PROFILE_DIR for the command about to run
+bool profile_export(const ProfileRun* run);
+
+// Wait for the profiled command, forwarding termination signals to it.
+// Returns its wait status, or -1.
+int profile_wait(pid_t pid);
+
+// Merge the per-process results into a report at output_path, sorted by
+// time spent, and print the busiest directories to stderr
+bool profile_report(const ProfileRun* run, const char* output_path);
+
+// Delete the run's results and free it
+void profile_free(ProfileRun* run);
+
+#endif // PROFILE_H
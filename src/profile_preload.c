@@ -0,0 +1,722 @@
+/*
+ * LD_PRELOAD shim for --profile-io, built as libsandbash-profile.so.
+ *
+ * Wraps the libc entry points for opens, stats, reads, writes and renames,
+ * times each call and adds it to a per-directory bucket. Reads and writes
+ * are charged to the directory the descriptor was opened in. Each process
+ * writes its buckets to $SANDBASH_PROFILE_DIR/<pid>.<n> before it execs or
+ * exits, and a forked child starts from zero, so every call is counted
+ * exactly once; sandbash merges the files into the report.
+ *
+ * Statically linked programs and anything that makes raw syscalls (Go
+ * binaries, for one) bypass the shim and are not profiled.
+ */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+// Power of two; slot 0 collects whatever does not fit
+#define MAX_BUCKETS 4096
+#define MAX_TRACKED_FDS 4096
+
+enum { OP_OPEN, OP_STAT, OP_READ, OP_WRITE, OP_RENAME, OP_COUNT };
+
+typedef struct {
+    char* dir;
+    unsigned long calls[OP_COUNT];
+    unsigned long long ns;
+} Bucket;
+
+static Bucket buckets[MAX_BUCKETS];
+static int bucket_count;
+// Bucket of each open descriptor, or 0 for none
+static int fd_buckets[MAX_TRACKED_FDS];
+static char cwd[PATH_MAX];
+static unsigned flush_count;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static const char* output_dir;
+static char output_dir_buffer[PATH_MAX];
+
+#define REAL_TYPED(name, type) \
+    static type* real_##name; \
+    if (!real_##name) { \
+        real_##name = (type*)dlsym(RTLD_NEXT, #name); \
+    }
+#define REAL(name) REAL_TYPED(name, __typeof__(name))
+
+// Entry points that _FORTIFY_SOURCE and older glibc versions route calls
+// through; the headers do not declare them
+typedef int open2_fn(const char* path, int flags);
+typedef int openat2_fn(int dirfd, const char* path, int flags);
+typedef ssize_t read_chk_fn(int fd, void* buf, size_t count, size_t buflen);
+typedef ssize_t pread_chk_fn(int fd, void* buf, size_t count, off_t offset, size_t buflen);
+typedef int xstat_fn(int version, const char* path, struct stat* st);
+typedef int fxstatat_fn(int version, int dirfd, const char* path, struct stat* st, int flags);
+int __open_2(const char* path, int flags);
+int __open64_2(const char* path, int flags);
+int __openat_2(int dirfd, const char* path, int flags);
+int __openat64_2(int dirfd, const char* path, int flags);
+ssize_t __read_chk(int fd, void* buf, size_t count, size_t buflen);
+ssize_t __pread_chk(int fd, void* buf, size_t count, off_t offset, size_t buflen);
+int __xstat(int version, const char* path, struct stat* st);
+int __lxstat(int version, const char* path, struct stat* st);
+int __fxstatat(int version, int dirfd, const char* path, struct stat* st, int flags);
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
+
+// A forked child reports only its own calls
+static void reset_in_child(void) {
+    for (int i = 0; i < MAX_BUCKETS; i++) {
+        memset(buckets[i].calls, 0, sizeof(buckets[i].calls));
+        buckets[i].ns = 0;
+    }
+    flush_count = 0;
+    pthread_mutex_init(&lock, NULL);
+}
+
+static void init(void) {
+    const char* dir = getenv("SANDBASH_PROFILE_DIR");
+    if (dir && *dir && strlen(dir) < sizeof(output_dir_buffer)) {
+        strcpy(output_dir_buffer, dir);
+        output_dir = output_dir_buffer;
+    }
+    pthread_atfork(NULL, NULL, reset_in_child);
+}
+
+static unsigned long hash_dir(const char* dir, size_t len) {
+    unsigned long hash = 14695981039346656037ul;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)dir[i]) * 1099511628211ul;
+    }
+    return hash;
+}
+
+// Find or create the bucket for a directory, or return 0 when the table
+// is full; called with the lock held
+static int find_bucket(const char* dir, size_t len) {
+    unsigned long slot = hash_dir(dir, len) & (MAX_BUCKETS - 1);
+    for (int probes = 0; probes < MAX_BUCKETS; probes++) {
+        if (slot != 0) {
+            Bucket* bucket = &buckets[slot];
+            if (!bucket->dir) {
+                // Keep slot 0 and some headroom so probing stays short
+                if (bucket_count >= MAX_BUCKETS / 2) {
+                    return 0;
+                }
+                bucket->dir = strndup(dir, len);
+                if (!bucket->dir) {
+                    break;
+                }
+                bucket_count++;
+                return (int)slot;
+            }
+            if (strncmp(bucket->dir, dir, len) == 0 && bucket->dir[len] == '\0') {
+                return (int)slot;
+            }
+        }
+        slot = (slot + 1) & (MAX_BUCKETS - 1);
+    }
+    return 0;
+}
+
+static int other_bucket(void) {
+    if (!buckets[0].dir) {
+        buckets[0].dir = "(other)";
+    }
+    return 0;
+}
+
+// Once the table is full, a directory is charged to its closest ancestor
+// that has a bucket, and only what has none goes to slot 0
+static int bucket_for_dir(const char* dir, size_t len) {
+    int bucket = find_bucket(dir, len);
+    while (bucket == 0 && len > 1) {
+        while (len > 1 && dir[len - 1] != '/') {
+            len--;
+        }
+        len = len > 1 ? len - 1 : 1;
+        bucket = find_bucket(dir, len);
+    }
+    return bucket != 0 ? bucket : other_bucket();
+}
+
+// The bucket for the directory a path argument lives in; lock held
+static int bucket_for_path(int dirfd, const char* path) {
+    char full[PATH_MAX];
+    const char* base = NULL;
+    char dir_path[PATH_MAX];
+
+    if (!path || path[0] != '/') {
+        if (dirfd == AT_FDCWD) {
+            if (!cwd[0] && !getcwd(cwd, sizeof(cwd))) {
+                cwd[0] = '\0';
+            }
+            base = cwd;
+        } else {
+            char link[64];
+            snprintf(link, sizeof(link), "/proc/self/fd/%d", dirfd);
+            ssize_t len = readlink(link, dir_path, sizeof(dir_path) - 1);
+            dir_path[len > 0 ? len : 0] = '\0';
+            base = dir_path;
+        }
+    }
+
+    while (path && path[0] == '.' && path[1] == '/') {
+        path += 2;
+    }
+    int len = base ? snprintf(full, sizeof(full), "%s/%s", base, path ? path : "")
+                   : snprintf(full, sizeof(full), "%s", path);
+    if (len < 0 || (size_t)len >= sizeof(full)) {
+        return other_bucket();
+    }
+
+    char* slash = strrchr(full, '/');
+    size_t dir_len = slash ? (size_t)(slash - full) : 0;
+    return dir_len > 0 ? bucket_for_dir(full, dir_len) : bucket_for_dir("/", 1);
+}
+
+static void charge(int bucket, int op, unsigned long long start) {
+    unsigned long long elapsed = now_ns() - start;
+    buckets[bucket].calls[op]++;
+    buckets[bucket].ns += elapsed;
+}
+
+static void record_path(int op, int dirfd, const char* path, unsigned long long start, int fd) {
+    pthread_once(&once, init);
+    if (!output_dir) {
+        return;
+    }
+    pthread_mutex_lock(&lock);
+    int bucket = bucket_for_path(dirfd, path);
+    charge(bucket, op, start);
+    if (fd >= 0 && fd < MAX_TRACKED_FDS) {
+        fd_buckets[fd] = bucket;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+static void record_fd(int op, int fd, unsigned long long start) {
+    pthread_once(&once, init);
+    if (!output_dir || fd < 0 || fd >= MAX_TRACKED_FDS || fd_buckets[fd] == 0) {
+        return;
+    }
+    pthread_mutex_lock(&lock);
+    charge(fd_buckets[fd], op, start);
+    pthread_mutex_unlock(&lock);
+}
+
+// Write this process's buckets out and start over
+static void flush(void) {
+    pthread_once(&once, init);
+    if (!output_dir) {
+        return;
+    }
+    REAL(open);
+    REAL(write);
+
+    pthread_mutex_lock(&lock);
+    int fd = -1;
+
+    for (int i = 0; i < MAX_BUCKETS; i++) {
+        Bucket* bucket = &buckets[i];
+        if (!bucket->dir || bucket->ns == 0) {
+            continue;
+        }
+        // The image before an exec wrote under the same pid, so skip
+        // the names it used
+        while (fd < 0) {
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%d.%u", output_dir, (int)getpid(), flush_count++);
+            fd = real_open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+            if (fd < 0 && errno != EEXIST) {
+                break;
+            }
+        }
+        if (fd < 0) {
+            break;
+        }
+
+        char line[PATH_MAX + 128];
+        int len = snprintf(line, sizeof(line), "%lu\t%lu\t%lu\t%lu\t%lu\t%llu\t%s\n",
+                           bucket->calls[OP_OPEN], bucket->calls[OP_STAT],
+                           bucket->calls[OP_READ], bucket->calls[OP_WRITE],
+                           bucket->calls[OP_RENAME], bucket->ns, bucket->dir);
+        if (len > 0 && (size_t)len < sizeof(line)) {
+            real_write(fd, line, (size_t)len);
+        }
+        memset(bucket->calls, 0, sizeof(bucket->calls));
+        bucket->ns = 0;
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+__attribute__((destructor)) static void flush_at_exit(void) {
+    flush();
+}
+
+// Opens
+
+static int mode_arg(int flags, va_list args) {
+    return (flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE ? va_arg(args, int) : 0;
+}
+
+#define WRAP_OPEN(name) \
+    int name(const char* path, int flags, ...) { \
+        REAL(name); \
+        va_list args; \
+        va_start(args, flags); \
+        int mode = mode_arg(flags, args); \
+        va_end(args); \
+        unsigned long long start = now_ns(); \
+        int fd = real_##name(path, flags, mode); \
+        int saved = errno; \
+        record_path(OP_OPEN, AT_FDCWD, path, start, fd); \
+        errno = saved; \
+        return fd; \
+    }
+
+#define WRAP_OPENAT(name) \
+    int name(int dirfd, const char* path, int flags, ...) { \
+        REAL(name); \
+        va_list args; \
+        va_start(args, flags); \
+        int mode = mode_arg(flags, args); \
+        va_end(args); \
+        unsigned long long start = now_ns(); \
+        int fd = real_##name(dirfd, path, flags, mode); \
+        int saved = errno; \
+        record_path(OP_OPEN, dirfd, path, start, fd); \
+        errno = saved; \
+        return fd; \
+    }
+
+WRAP_OPEN(open)
+WRAP_OPEN(open64)
+WRAP_OPENAT(openat)
+WRAP_OPENAT(openat64)
+
+#define WRAP_OPEN2(name) \
+    int name(const char* path, int flags) { \
+        REAL_TYPED(name, open2_fn); \
+        unsigned long long start = now_ns(); \
+        int fd = real_##name(path, flags); \
+        int saved = errno; \
+        record_path(OP_OPEN, AT_FDCWD, path, start, fd); \
+        errno = saved; \
+        return fd; \
+    }
+
+#define WRAP_OPENAT2(name) \
+    int name(int dirfd, const char* path, int flags) { \
+        REAL_TYPED(name, openat2_fn); \
+        unsigned long long start = now_ns(); \
+        int fd = real_##name(dirfd, path, flags); \
+        int saved = errno; \
+        record_path(OP_OPEN, dirfd, path, start, fd); \
+        errno = saved; \
+        return fd; \
+    }
+
+WRAP_OPEN2(__open_2)
+WRAP_OPEN2(__open64_2)
+WRAP_OPENAT2(__openat_2)
+WRAP_OPENAT2(__openat64_2)
+
+int creat(const char* path, mode_t mode) {
+    return open(path, O_WRONLY | O_CREAT | O_TRUNC, mode);
+}
+
+#define WRAP_FOPEN(name) \
+    FILE* name(const char* path, const char* mode) { \
+        REAL(name); \
+        unsigned long long start = now_ns(); \
+        FILE* stream = real_##name(path, mode); \
+        int saved = errno; \
+        record_path(OP_OPEN, AT_FDCWD, path, start, stream ? fileno(stream) : -1); \
+        errno = saved; \
+        return stream; \
+    }
+
+WRAP_FOPEN(fopen)
+WRAP_FOPEN(fopen64)
+
+int close(int fd) {
+    REAL(close);
+    if (fd >= 0 && fd < MAX_TRACKED_FDS) {
+        fd_buckets[fd] = 0;
+    }
+    return real_close(fd);
+}
+
+// Shell redirections dup a file onto stdout, which should still be
+// charged to the file's directory
+static int copy_fd_bucket(int from, int to) {
+    if (from >= 0 && from < MAX_TRACKED_FDS && to >= 0 && to < MAX_TRACKED_FDS) {
+        fd_buckets[to] = fd_buckets[from];
+    }
+    return to;
+}
+
+int dup(int fd) {
+    REAL(dup);
+    return copy_fd_bucket(fd, real_dup(fd));
+}
+
+int dup2(int fd, int target) {
+    REAL(dup2);
+    return copy_fd_bucket(fd, real_dup2(fd, target));
+}
+
+int dup3(int fd, int target, int flags) {
+    REAL(dup3);
+    return copy_fd_bucket(fd, real_dup3(fd, target, flags));
+}
+
+// Stats
+
+#define WRAP_STAT(name, type) \
+    int name(const char* path, type* st) { \
+        REAL(name); \
+        unsigned long long start = now_ns(); \
+        int result = real_##name(path, st); \
+        int saved = errno; \
+        record_path(OP_STAT, AT_FDCWD, path, start, -1); \
+        errno = saved; \
+        return result; \
+    }
+
+#define WRAP_FSTATAT(name, type) \
+    int name(int dirfd, const char* path, type* st, int flags) { \
+        REAL(name); \
+        unsigned long long start = now_ns(); \
+        int result = real_##name(dirfd, path, st, flags); \
+        int saved = errno; \
+        record_path(OP_STAT, dirfd, path, start, -1); \
+        errno = saved; \
+        return result; \
+    }
+
+WRAP_STAT(stat, struct stat)
+WRAP_STAT(lstat, struct stat)
+WRAP_STAT(stat64, struct stat64)
+WRAP_STAT(lstat64, struct stat64)
+WRAP_FSTATAT(fstatat, struct stat)
+WRAP_FSTATAT(fstatat64, struct stat64)
+
+#define WRAP_XSTAT(name) \
+    int name(int version, const char* path, struct stat* st) { \
+        REAL_TYPED(name, xstat_fn); \
+        unsigned long long start = now_ns(); \
+        int result = real_##name(version, path, st); \
+        int saved = errno; \
+        record_path(OP_STAT, AT_FDCWD, path, start, -1); \
+        errno = saved; \
+        return result; \
+    }
+
+WRAP_XSTAT(__xstat)
+WRAP_XSTAT(__lxstat)
+
+int __fxstatat(int version, int dirfd, const char* path, struct stat* st, int flags) {
+    REAL_TYPED(__fxstatat, fxstatat_fn);
+    unsigned long long start = now_ns();
+    int result = real___fxstatat(version, dirfd, path, st, flags);
+    int saved = errno;
+    record_path(OP_STAT, dirfd, path, start, -1);
+    errno = saved;
+    return result;
+}
+
+int statx(int dirfd, const char* path, int flags, unsigned mask, struct statx* st) {
+    REAL(statx);
+    unsigned long long start = now_ns();
+    int result = real_statx(dirfd, path, flags, mask, st);
+    int saved = errno;
+    record_path(OP_STAT, dirfd, path, start, -1);
+    errno = saved;
+    return result;
+}
+
+int access(const char* path, int mode) {
+    REAL(access);
+    unsigned long long start = now_ns();
+    int result = real_access(path, mode);
+    int saved = errno;
+    record_path(OP_STAT, AT_FDCWD, path, start, -1);
+    errno = saved;
+    return result;
+}
+
+int faccessat(int dirfd, const char* path, int mode, int flags) {
+    REAL(faccessat);
+    unsigned long long start = now_ns();
+    int result = real_faccessat(dirfd, path, mode, flags);
+    int saved = errno;
+    record_path(OP_STAT, dirfd, path, start, -1);
+    errno = saved;
+    return result;
+}
+
+// Reads and writes
+
+#define WRAP_IO(name, op, ...) \
+    do { \
+        REAL(name); \
+        unsigned long long start = now_ns(); \
+        ssize_t result = real_##name(__VA_ARGS__); \
+        int saved = errno; \
+        record_fd(op, fd, start); \
+        errno = saved; \
+        return result; \
+    } while (0)
+
+ssize_t read(int fd, void* buf, size_t count) {
+    WRAP_IO(read, OP_READ, fd, buf, count);
+}
+
+ssize_t pread(int fd, void* buf, size_t count, off_t offset) {
+    WRAP_IO(pread, OP_READ, fd, buf, count, offset);
+}
+
+ssize_t pread64(int fd, void* buf, size_t count, off64_t offset) {
+    WRAP_IO(pread64, OP_READ, fd, buf, count, offset);
+}
+
+ssize_t __read_chk(int fd, void* buf, size_t count, size_t buflen) {
+    REAL_TYPED(__read_chk, read_chk_fn);
+    unsigned long long start = now_ns();
+    ssize_t result = real___read_chk(fd, buf, count, buflen);
+    int saved = errno;
+    record_fd(OP_READ, fd, start);
+    errno = saved;
+    return result;
+}
+
+ssize_t __pread_chk(int fd, void* buf, size_t count, off_t offset, size_t buflen) {
+    REAL_TYPED(__pread_chk, pread_chk_fn);
+    unsigned long long start = now_ns();
+    ssize_t result = real___pread_chk(fd, buf, count, offset, buflen);
+    int saved = errno;
+    record_fd(OP_READ, fd, start);
+    errno = saved;
+    return result;
+}
+
+ssize_t readv(int fd, const struct iovec* iov, int iovcnt) {
+    WRAP_IO(readv, OP_READ, fd, iov, iovcnt);
+}
+
+ssize_t write(int fd, const void* buf, size_t count) {
+    WRAP_IO(write, OP_WRITE, fd, buf, count);
+}
+
+ssize_t pwrite(int fd, const void* buf, size_t count, off_t offset) {
+    WRAP_IO(pwrite, OP_WRITE, fd, buf, count, offset);
+}
+
+ssize_t pwrite64(int fd, const void* buf, size_t count, off64_t offset) {
+    WRAP_IO(pwrite64, OP_WRITE, fd, buf, count, offset);
+}
+
+ssize_t writev(int fd, const struct iovec* iov, int iovcnt) {
+    WRAP_IO(writev, OP_WRITE, fd, iov, iovcnt);
+}
+
+// stdio reads and writes go to the kernel without passing through read()
+// and write() above
+size_t fread(void* buf, size_t size, size_t count, FILE* stream) {
+    int fd = fileno(stream);
+    WRAP_IO(fread, OP_READ, buf, size, count, stream);
+}
+
+size_t fwrite(const void* buf, size_t size, size_t count, FILE* stream) {
+    int fd = fileno(stream);
+    WRAP_IO(fwrite, OP_WRITE, buf, size, count, stream);
+}
+
+// Renames, charged to the source directory
+
+int rename(const char* from, const char* to) {
+    REAL(rename);
+    unsigned long long start = now_ns();
+    int result = real_rename(from, to);
+    int saved = errno;
+    record_path(OP_RENAME, AT_FDCWD, from, start, -1);
+    errno = saved;
+    return result;
+}
+
+int renameat(int from_dirfd, const char* from, int to_dirfd, const char* to) {
+    REAL(renameat);
+    unsigned long long start = now_ns();
+    int result = real_renameat(from_dirfd, from, to_dirfd, to);
+    int saved = errno;
+    record_path(OP_RENAME, from_dirfd, from, start, -1);
+    errno = saved;
+    return result;
+}
+
+int renameat2(int from_dirfd, const char* from, int to_dirfd, const char* to,
+              unsigned flags) {
+    REAL(renameat2);
+    unsigned long long start = now_ns();
+    int result = real_renameat2(from_dirfd, from, to_dirfd, to, flags);
+    int saved = errno;
+    record_path(OP_RENAME, from_dirfd, from, start, -1);
+    errno = saved;
+    return result;
+}
+
+// Relative paths are charged against the cached working directory
+
+int chdir(const char* path) {
+    REAL(chdir);
+    int result = real_chdir(path);
+    pthread_mutex_lock(&lock);
+    cwd[0] = '\0';
+    pthread_mutex_unlock(&lock);
+    return result;
+}
+
+int fchdir(int fd) {
+    REAL(fchdir);
+    int result = real_fchdir(fd);
+    pthread_mutex_lock(&lock);
+    cwd[0] = '\0';
+    pthread_mutex_unlock(&lock);
+    return result;
+}
+
+// exec replaces the process without running destructors, so flush first
+
+int execve(const char* path, char* const argv[], char* const envp[]) {
+    REAL(execve);
+    flush();
+    return real_execve(path, argv, envp);
+}
+
+int execv(const char* path, char* const argv[]) {
+    REAL(execv);
+    flush();
+    return real_execv(path, argv);
+}
+
+int execvp(const char* file, char* const argv[]) {
+    REAL(execvp);
+    flush();
+    return real_execvp(file, argv);
+}
+
+int execvpe(const char* file, char* const argv[], char* const envp[]) {
+    REAL(execvpe);
+    flush();
+    return real_execvpe(file, argv, envp);
+}
+
+int fexecve(int fd, char* const argv[], char* const envp[]) {
+    REAL(fexecve);
+    flush();
+    return real_fexecve(fd, argv, envp);
+}
+
+// The execl family builds an argv and calls into libc's own execve, which
+// the wrappers above never see
+static char** collect_args(const char* arg, va_list args, char* const** envp) {
+    va_list counting;
+    va_copy(counting, args);
+    size_t count = 1;
+    while (arg && va_arg(counting, const char*)) {
+        count++;
+    }
+    va_end(counting);
+
+    char** argv = malloc(sizeof(char*) * (count + 1));
+    if (!argv) {
+        return NULL;
+    }
+    argv[0] = (char*)arg;
+    for (size_t i = 1; i <= count; i++) {
+        argv[i] = arg ? va_arg(args, char*) : NULL;
+    }
+    if (envp) {
+        *envp = va_arg(args, char* const*);
+    }
+    return argv;
+}
+
+int execl(const char* path, const char* arg, ...) {
+    va_list args;
+    va_start(args, arg);
+    char** argv = collect_args(arg, args, NULL);
+    va_end(args);
+    if (!argv) {
+        errno = ENOMEM;
+        return -1;
+    }
+    execv(path, argv);
+    free(argv);
+    return -1;
+}
+
+int execlp(const char* file, const char* arg, ...) {
+    va_list args;
+    va_start(args, arg);
+    char** argv = collect_args(arg, args, NULL);
+    va_end(args);
+    if (!argv) {
+        errno = ENOMEM;
+        return -1;
+    }
+    execvp(file, argv);
+    free(argv);
+    return -1;
+}
+
+int execle(const char* path, const char* arg, ...) {
+    char* const* envp;
+    va_list args;
+    va_start(args, arg);
+    char** argv = collect_args(arg, args, &envp);
+    va_end(args);
+    if (!argv) {
+        errno = ENOMEM;
+        return -1;
+    }
+    execve(path, argv, envp);
+    free(argv);
+    return -1;
+}
+
+void _Exit(int status) {
+    REAL(_Exit);
+    flush();
+    real__Exit(status);
+    __builtin_unreachable();
+}
+
+void _exit(int status) {
+    REAL(_exit);
+    flush();
+    real__exit(status);
+    __builtin_unreachable();
+}
@@ -0,0 +1,400 @@
+/*
+ * Index of the directories that have a per-directory config.
+ *
+ * Per-directory configs are named by a hash of their directory, which
+ * cannot be reversed, so listing them or finding the ones above the
+ * working directory would mean opening every file. projects.index, next
+ * to the projects directory, records the directories in an open-addressing
+ * hash table keyed by FNV-1a of the path. It is memory-mapped, so a lookup
+ * is a hash and a probe or two without a syscall, and walking every
+ * ancestor of the working directory stays cheap.
+ *
+ * The file is never changed in place. Updates write a new one and rename
+ * it over the old with projects.lock held, so readers see one version or
+ * the other and concurrent writers do not lose each other's entries.
+ * Entries whose config was deleted stay until --reindex; looking one up
+ * finds no file and loads nothing.
+ *
+ * Only commands that change configs build the index, so a launch never
+ * writes here. Configs written before the header line existed cannot be
+ * attributed to a directory; the index counts them, and while any remain
+ * lookups walk the ancestors on disk instead, as they do with no index.
+ */
+
+#include "projects.h"
+#include "config.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define INDEX_MAGIC "SBPIDX01"
+
+typedef struct {
+    char magic[8];
+    // A power of two, at least twice the entry count
+    uint32_t slot_count;
+    uint32_t entry_count;
+    uint32_t strings_size;
+    // Configs without a header line, which are not in the table
+    uint32_t unattributed;
+} IndexHeader;
+
+typedef struct {
+    uint64_t hash;
+    // The directory's NUL-terminated path in the string table; length 0
+    // marks an empty slot
+    uint32_t offset;
+    uint32_t length;
+} IndexSlot;
+
+struct ProjectIndex {
+    void* map;
+    size_t size;
+    const IndexHeader* header;
+    const IndexSlot* slots;
+    const char* strings;
+};
+
+static uint64_t hash_dir(const char* dir) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char* p = (const unsigned char*)dir; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// <config>/sandbash/name
+static bool sandbash_file(const char* name, char* out, size_t size) {
+    char* xdg_config = get_xdg_config_dir();
+    if (!xdg_config) {
+        return false;
+    }
+    int len = snprintf(out, size, "%s/sandbash/%s", xdg_config, name);
+    free(xdg_config);
+    return len > 0 && (size_t)len < size;
+}
+
+static ProjectIndex* map_index(void) {
+    char path[PATH_MAX];
+    if (!sandbash_file("projects.index", path, sizeof(path))) {
+        return NULL;
+    }
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(IndexHeader)) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    // Nothing past the header is trusted until it adds up
+    const IndexHeader* header = map;
+    uint64_t expected = sizeof(IndexHeader) +
+                        (uint64_t)header->slot_count * sizeof(IndexSlot) +
+                        header->strings_size;
+    const char* strings = (const char*)map + sizeof(IndexHeader) +
+                          (size_t)header->slot_count * sizeof(IndexSlot);
+    ProjectIndex* index = NULL;
+    if (memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) == 0 &&
+        header->slot_count > 0 && (header->slot_count & (header->slot_count - 1)) == 0 &&
+        expected == size &&
+        (header->strings_size == 0 || strings[header->strings_size - 1] == '\0')) {
+        index = malloc(sizeof(ProjectIndex));
+    }
+    if (!index) {
+        munmap(map, size);
+        return NULL;
+    }
+    index->map = map;
+    index->size = size;
+    index->header = header;
+    index->slots = (const IndexSlot*)(header + 1);
+    index->strings = strings;
+    return index;
+}
+
+// Write dirs as the new index, replacing the old one atomically
+static bool write_index(const PathList* dirs, uint32_t unattributed) {
+    uint32_t slot_count = 8;
+    while (slot_count < (uint32_t)dirs->count * 2) {
+        slot_count *= 2;
+    }
+    size_t strings_size = 0;
+    for (int i = 0; i < dirs->count; i++) {
+        strings_size += strlen(dirs->paths[i]) + 1;
+    }
+    if (strings_size > UINT32_MAX) {
+        return false;
+    }
+
+    size_t size = sizeof(IndexHeader) + slot_count * sizeof(IndexSlot) + strings_size;
+    char* buffer = calloc(1, size);
+    if (!buffer) {
+        return false;
+    }
+    IndexHeader* header = (IndexHeader*)buffer;
+    memcpy(header->magic, INDEX_MAGIC, sizeof(header->magic));
+    header->slot_count = slot_count;
+    header->entry_count = (uint32_t)dirs->count;
+    header->strings_size = (uint32_t)strings_size;
+    header->unattributed = unattributed;
+    IndexSlot* slots = (IndexSlot*)(header + 1);
+    char* strings = (char*)(slots + slot_count);
+
+    uint32_t offset = 0;
+    for (int i = 0; i < dirs->count; i++) {
+        const char* dir = dirs->paths[i];
+        uint64_t hash = hash_dir(dir);
+        uint32_t slot = (uint32_t)hash & (slot_count - 1);
+        while (slots[slot].length != 0) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        size_t len = strlen(dir);
+        slots[slot] = (IndexSlot){ hash, offset, (uint32_t)len };
+        memcpy(strings + offset, dir, len + 1);
+        offset += (uint32_t)len + 1;
+    }
+
+    char path[PATH_MAX];
+    char temp[PATH_MAX + 32];
+    bool ok = sandbash_file("projects.index", path, sizeof(path));
+    if (ok) {
+        snprintf(temp, sizeof(temp), "%s.%d.tmp", path, (int)getpid());
+        int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        size_t written = 0;
+        while (fd >= 0 && written < size) {
+            ssize_t n = write(fd, buffer + written, size - written);
+            if (n <= 0) {
+                break;
+            }
+            written += (size_t)n;
+        }
+        ok = fd >= 0 && written == size;
+        if (fd >= 0) {
+            ok = close(fd) == 0 && ok;
+        }
+        ok = ok && rename(temp, path) == 0;
+        if (!ok) {
+            unlink(temp);
+        }
+    }
+    free(buffer);
+    return ok;
+}
+
+// Read the directory a config file was saved for from its first line.
+// The file must be named like that directory's config, so a copied file
+// is not attributed to the wrong directory.
+static bool config_dir_of(const char* file, const char* name, char* dir, size_t size) {
+    FILE* f = fopen(file, "re");
+    if (!f) {
+        return false;
+    }
+    char line[PATH_MAX + 64];
+    bool read = fgets(line, sizeof(line), f) != NULL;
+    fclose(f);
+
+    size_t prefix = strlen(PROJECTS_CONFIG_HEADER);
+    if (!read || strncmp(line, PROJECTS_CONFIG_HEADER, prefix) != 0) {
+        return false;
+    }
+    line[strcspn(line, "\n")] = '\0';
+    int len = snprintf(dir, size, "%s", line + prefix);
+    if (len <= 0 || (size_t)len >= size || dir[0] != '/') {
+        return false;
+    }
+    char* hash = compute_path_hash(dir);
+    bool matches = hash && strcmp(hash, name) == 0;
+    free(hash);
+    return matches;
+}
+
+// Add the directory of every config in the projects directory to dirs
+static bool scan_configs(PathList* dirs, int* skipped) {
+    char projects_dir[PATH_MAX];
+    if (!sandbash_file("projects", projects_dir, sizeof(projects_dir))) {
+        return false;
+    }
+    DIR* handle = opendir(projects_dir);
+    if (!handle) {
+        // No configs yet
+        return errno == ENOENT;
+    }
+
+    bool ok = true;
+    struct dirent* entry;
+    while (ok && (entry = readdir(handle)) != NULL) {
+        if (entry->d_name[0] == '.' || strchr(entry->d_name, '.')) {
+            continue;
+        }
+        char file[PATH_MAX + 256];
+        char dir[PATH_MAX];
+        snprintf(file, sizeof(file), "%s/%s", projects_dir, entry->d_name);
+        if (config_dir_of(file, entry->d_name, dir, sizeof(dir))) {
+            ok = pathlist_add(dirs, dir);
+        } else if (skipped) {
+            (*skipped)++;
+        }
+    }
+    closedir(handle);
+    return ok;
+}
+
+ProjectIndex* projects_open(void) {
+    return map_index();
+}
+
+size_t projects_unattributed(const ProjectIndex* index) {
+    return index ? index->header->unattributed : 0;
+}
+
+bool projects_contains(const ProjectIndex* index, const char* dir) {
+    if (!index || !dir) {
+        return false;
+    }
+    uint64_t hash = hash_dir(dir);
+    size_t len = strlen(dir);
+    uint32_t mask = index->header->slot_count - 1;
+    uint32_t strings_size = index->header->strings_size;
+
+    uint32_t slot = (uint32_t)hash & mask;
+    for (uint32_t probes = 0; probes <= mask; probes++, slot = (slot + 1) & mask) {
+        const IndexSlot* entry = &index->slots[slot];
+        if (entry->length == 0) {
+            return false;
+        }
+        if (entry->hash == hash && entry->length == len && entry->offset < strings_size &&
+            len < strings_size - entry->offset &&
+            memcmp(index->strings + entry->offset, dir, len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t projects_count(const ProjectIndex* index) {
+    return index ? index->header->entry_count : 0;
+}
+
+const char* projects_next(const ProjectIndex* index, const char* previous) {
+    if (!index || index->header->strings_size == 0) {
+        return NULL;
+    }
+    const char* next = previous ? previous + strlen(previous) + 1 : index->strings;
+    return next < index->strings + index->header->strings_size ? next : NULL;
+}
+
+void projects_close(ProjectIndex* index) {
+    if (!index) {
+        return;
+    }
+    munmap(index->map, index->size);
+    free(index);
+}
+
+int projects_lock(void) {
+    char path[PATH_MAX];
+    if (!sandbash_file("projects.lock", path, sizeof(path))) {
+        return -1;
+    }
+    char* slash = strrchr(path, '/');
+    *slash = '\0';
+    make_directories(path, 0755);
+    *slash = '/';
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    while (flock(fd, LOCK_EX) != 0) {
+        if (errno != EINTR) {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+void projects_unlock(int lock_fd) {
+    if (lock_fd >= 0) {
+        // Closing releases the lock
+        close(lock_fd);
+    }
+}
+
+bool projects_add(const char* dir, bool migrated) {
+    PathList* dirs = pathlist_create();
+    if (!dirs) {
+        return false;
+    }
+
+    // Without an index to extend, start from what is on disk
+    ProjectIndex* index = map_index();
+    bool ok = true;
+    int unattributed = 0;
+    if (index) {
+        unattributed = (int)index->header->unattributed;
+        if (migrated && unattributed > 0) {
+            unattributed--;
+        }
+        if (projects_contains(index, dir) && unattributed == (int)index->header->unattributed) {
+            projects_close(index);
+            pathlist_free(dirs);
+            return true;
+        }
+        for (const char* d = projects_next(index, NULL); ok && d; d = projects_next(index, d)) {
+            ok = pathlist_add(dirs, d);
+        }
+        projects_close(index);
+    } else {
+        // This finds the config just written for dir as well
+        ok = scan_configs(dirs, &unattributed);
+    }
+
+    if (ok && pathlist_find(dirs, dir) < 0) {
+        ok = pathlist_add(dirs, dir);
+    }
+    ok = ok && write_index(dirs, (uint32_t)unattributed);
+    pathlist_free(dirs);
+    return ok;
+}
+
+int projects_reindex(int* skipped) {
+    if (skipped) {
+        *skipped = 0;
+    }
+    int lock_fd = projects_lock();
+    if (lock_fd < 0) {
+        return -1;
+    }
+    PathList* dirs = pathlist_create();
+    int unattributed = 0;
+    bool ok = dirs && scan_configs(dirs, &unattributed) &&
+              write_index(dirs, (uint32_t)unattributed);
+    int count = ok ? dirs->count : -1;
+    if (skipped) {
+        *skipped = unattributed;
+    }
+    pathlist_free(dirs);
+    projects_unlock(lock_fd);
+    return count;
+}
@@ -0,0 +1,51 @@
+#ifndef PROJECTS_H
+#define PROJECTS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// First line of every per-directory config, followed by its directory
+#define PROJECTS_CONFIG_HEADER "# Per-directory config for: "
+
+// Index of the directories that have a per-directory config, kept next to
+// the configs as a hash table that is memory-mapped for lookups
+typedef struct ProjectIndex ProjectIndex;
+
+// Map the index. Returns NULL if there is none or it cannot be read; only
+// commands that change configs and --reindex build it.
+ProjectIndex* projects_open(void);
+
+// Number of configs left out of the index because they have no header
+// line. While it is not 0, a lookup that misses may still have a config.
+size_t projects_unattributed(const ProjectIndex* index);
+
+// Check whether dir, a canonical path, is in the index
+bool projects_contains(const ProjectIndex* index, const char* dir);
+
+// Number of directories in the index
+size_t projects_count(const ProjectIndex* index);
+
+// Iterate over the directories in the index, in no particular order: pass
+// NULL for the first and the previous result after that. Returns NULL
+// after the last.
+const char* projects_next(const ProjectIndex* index, const char* previous);
+
+void projects_close(ProjectIndex* index);
+
+// Take the lock that serializes updates to per-directory configs and the
+// index. Returns the lock's fd, or -1.
+int projects_lock(void);
+
+void projects_unlock(int lock_fd);
+
+// Add dir to the index, building it if there is none. migrated says that
+// dir's config just gained its header line and no longer counts as
+// unattributed. The caller holds the lock.
+bool projects_add(const char* dir, bool migrated);
+
+// Rebuild the index from the first lines of the per-directory configs.
+// Returns the number of configs indexed, or -1; skipped, if not NULL, is
+// set to the number of files that could not be attributed to a directory.
+int projects_reindex(int* skipped);
+
+#endif // PROJECTS_H
@@ -0,0 +1,279 @@
+/*
+ * --report: what a sandboxed command cost.
+ *
+ * sandbash forks the command and stays behind as its parent. It becomes
+ * a subreaper first, so grandchildren orphaned inside the tree are
+ * reparented to it, reaped and included in RUSAGE_CHILDREN. When the
+ * command ran in a cgroup leaf of its own (--cpu-max and friends), CPU,
+ * memory and I/O come from the cgroup instead, which also covers
+ * processes still running in the background.
+ */
+
+#include "report.h"
+#include "resources.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+// Cumulative I/O of this process and the children it has reaped, from
+// /proc/self/io
+typedef struct {
+    unsigned long long read_chars;
+    unsigned long long write_chars;
+    unsigned long long read_bytes;
+    unsigned long long write_bytes;
+} IoCounters;
+
+struct RunReport {
+    struct timespec started;
+    struct timespec finished;
+    IoCounters io_before;
+    bool have_io;
+};
+
+static pid_t reported_child = -1;
+
+static void forward_signal(int sig) {
+    if (reported_child > 0) {
+        kill(reported_child, sig);
+    }
+}
+
+static bool read_io(IoCounters* io) {
+#ifdef __linux__
+    FILE* f = fopen("/proc/self/io", "re");
+    if (!f) {
+        return false;
+    }
+    char name[32];
+    unsigned long long value;
+    while (fscanf(f, "%31[^:]: %llu\n", name, &value) == 2) {
+        if (strcmp(name, "rchar") == 0) {
+            io->read_chars = value;
+        } else if (strcmp(name, "wchar") == 0) {
+            io->write_chars = value;
+        } else if (strcmp(name, "read_bytes") == 0) {
+            io->read_bytes = value;
+        } else if (strcmp(name, "write_bytes") == 0) {
+            io->write_bytes = value;
+        }
+    }
+    fclose(f);
+    return true;
+#else
+    (void)io;
+    return false;
+#endif
+}
+
+RunReport* report_start(void) {
+    RunReport* report = calloc(1, sizeof(RunReport));
+    if (!report) {
+        return NULL;
+    }
+
+#ifdef __linux__
+    if (prctl(PR_SET_CHILD_SUBREAPER, 1) != 0) {
+        fprintf(stderr, "Warning: Failed to become a subreaper; orphaned processes will "
+                        "not be counted: %s\n", strerror(errno));
+    }
+#endif
+    report->have_io = read_io(&report->io_before);
+    clock_gettime(CLOCK_MONOTONIC, &report->started);
+    return report;
+}
+
+int report_wait(RunReport* report, pid_t pid) {
+    reported_child = pid;
+
+    // Terminal signals reach the child through the process group already
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+    signal(SIGTERM, forward_signal);
+    signal(SIGHUP, forward_signal);
+
+    int status = -1;
+    for (;;) {
+        int child_status;
+        pid_t done = waitpid(-1, &child_status, 0);
+        if (done == pid) {
+            status = child_status;
+            break;
+        }
+        if (done < 0 && errno != EINTR) {
+            break;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &report->finished);
+
+    // Orphans that already exited count too; ones still running in the
+    // background are not waited for
+    while (waitpid(-1, NULL, WNOHANG) > 0) {
+    }
+
+    reported_child = -1;
+    return status;
+}
+
+#ifdef __linux__
+// Look up "key value" in a cgroup stat file such as cpu.stat
+static bool read_cgroup_stat(const char* cgroup, const char* file, const char* key,
+                             unsigned long long* out) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", cgroup, file);
+    FILE* f = fopen(path, "re");
+    if (!f) {
+        return false;
+    }
+    char name[64];
+    unsigned long long value;
+    bool found = false;
+    while (!found && fscanf(f, "%63s %llu\n", name, &value) == 2) {
+        if (strcmp(name, key) == 0) {
+            *out = value;
+            found = true;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+// Sum rbytes= and wbytes= over the devices in io.stat
+static bool read_cgroup_io(const char* cgroup, IoCounters* io) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/io.stat", cgroup);
+    FILE* f = fopen(path, "re");
+    if (!f) {
+        return false;
+    }
+    char line[512];
+    io->read_bytes = io->write_bytes = 0;
+    while (fgets(line, sizeof(line), f)) {
+        const char* field = strstr(line, "rbytes=");
+        if (field) {
+            io->read_bytes += strtoull(field + 7, NULL, 10);
+        }
+        field = strstr(line, "wbytes=");
+        if (field) {
+            io->write_bytes += strtoull(field + 7, NULL, 10);
+        }
+    }
+    fclose(f);
+    return true;
+}
+#endif
+
+bool report_write(const RunReport* report, int status, const char* output_path,
+                  int argc, char* const argv[]) {
+    struct rusage usage;
+    getrusage(RUSAGE_CHILDREN, &usage);
+
+    double wall = (double)(report->finished.tv_sec - report->started.tv_sec) +
+                  (double)(report->finished.tv_nsec - report->started.tv_nsec) / 1e9;
+    double user = (double)usage.ru_utime.tv_sec + (double)usage.ru_utime.tv_usec / 1e6;
+    double sys = (double)usage.ru_stime.tv_sec + (double)usage.ru_stime.tv_usec / 1e6;
+#ifdef __APPLE__
+    // Bytes on macOS, kilobytes elsewhere
+    unsigned long long peak_rss = (unsigned long long)usage.ru_maxrss;
+#else
+    unsigned long long peak_rss = (unsigned long long)usage.ru_maxrss * 1024;
+#endif
+
+    IoCounters io = { 0, 0, 0, 0 };
+    bool have_io = false;
+    if (report->have_io && read_io(&io)) {
+        io.read_chars -= report->io_before.read_chars;
+        io.write_chars -= report->io_before.write_chars;
+        io.read_bytes -= report->io_before.read_bytes;
+        io.write_bytes -= report->io_before.write_bytes;
+        have_io = true;
+    }
+
+    // Prefer the cgroup's figures: they add up the whole tree, where
+    // ru_maxrss is only the largest single process
+    char cgroup[PATH_MAX / 2];
+    bool in_cgroup = resources_cgroup(cgroup, sizeof(cgroup));
+#ifdef __linux__
+    if (in_cgroup) {
+        unsigned long long value;
+        if (read_cgroup_stat(cgroup, "cpu.stat", "user_usec", &value)) {
+            user = (double)value / 1e6;
+        }
+        if (read_cgroup_stat(cgroup, "cpu.stat", "system_usec", &value)) {
+            sys = (double)value / 1e6;
+        }
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/memory.peak", cgroup);
+        FILE* f = fopen(path, "re");
+        if (f) {
+            if (fscanf(f, "%llu", &value) == 1) {
+                peak_rss = value;
+            }
+            fclose(f);
+        }
+        have_io = read_cgroup_io(cgroup, &io) || have_io;
+    }
+#endif
+
+    FILE* f = fopen(output_path, "w");
+    if (!f) {
+        fprintf(stderr, "Error: Failed to write %s: %s\n", output_path, strerror(errno));
+        return false;
+    }
+
+    fprintf(f, "{\n  \"command\": [");
+    for (int i = 0; i < argc; i++) {
+        if (i > 0) {
+            fprintf(f, ", ");
+        }
+        write_json_string(f, argv[i]);
+    }
+    fprintf(f, "],\n");
+    if (status >= 0 && WIFSIGNALED(status)) {
+        fprintf(f, "  \"exit_status\": %d,\n  \"signal\": %d,\n", 128 + WTERMSIG(status),
+                WTERMSIG(status));
+    } else {
+        fprintf(f, "  \"exit_status\": %d,\n  \"signal\": null,\n",
+                status >= 0 ? WEXITSTATUS(status) : -1);
+    }
+    fprintf(f, "  \"wall_time_s\": %.6f,\n", wall);
+    fprintf(f, "  \"user_cpu_s\": %.6f,\n", user);
+    fprintf(f, "  \"sys_cpu_s\": %.6f,\n", sys);
+    fprintf(f, "  \"peak_rss_bytes\": %llu,\n", peak_rss);
+    fprintf(f, "  \"voluntary_context_switches\": %ld,\n", (long)usage.ru_nvcsw);
+    fprintf(f, "  \"involuntary_context_switches\": %ld,\n", (long)usage.ru_nivcsw);
+    if (have_io) {
+        fprintf(f, "  \"read_bytes\": %llu,\n  \"write_bytes\": %llu,\n", io.read_bytes,
+                io.write_bytes);
+    } else {
+        fprintf(f, "  \"read_bytes\": null,\n  \"write_bytes\": null,\n");
+    }
+    // Bytes through read() and write(), including pipes and page cache hits
+    if (report->have_io) {
+        fprintf(f, "  \"read_chars\": %llu,\n  \"write_chars\": %llu,\n", io.read_chars,
+                io.write_chars);
+    }
+    fprintf(f, "  \"cgroup\": ");
+    if (in_cgroup) {
+        write_json_string(f, cgroup);
+    } else {
+        fprintf(f, "null");
+    }
+    fprintf(f, "\n}\n");
+    return fclose(f) == 0;
+}
+
+void report_free(RunReport* report) {
+    free(report);
+}
@@ -0,0 +1,26 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+typedef struct RunReport RunReport;
+
+// Start measuring a command about to be forked off. The caller becomes
+// a subreaper, so processes orphaned inside the tree are still reaped
+// and counted.
+RunReport* report_start(void);
+
+// Wait for pid, reaping orphans along the way and forwarding termination
+// signals. Returns its wait status, or -1.
+int report_wait(RunReport* report, pid_t pid);
+
+// Write what the tree used as JSON: wall time, CPU, peak RSS, context
+// switches, I/O bytes and the exit status. Figures come from the cgroup
+// resources_apply created when there is one, otherwise from rusage.
+bool report_write(const RunReport* report, int status, const char* output_path,
+                  int argc, char* const argv[]);
+
+void report_free(RunReport* report);
+
+#endif // REPORT_H
@@ -0,0 +1,403 @@
+/*
+ * Bounded resolution of writable path entries.
+ *
+ * Every literal entry is resolved with realpath() when a config is loaded,
+ * and a lookup on a hung NFS or sshfs mount blocks until the mount comes
+ * back, which stalls every launch. When no network or FUSE filesystem is
+ * mounted, nothing can hang that way and entries are resolved in the
+ * calling process. Otherwise they are resolved by a small pool of threads
+ * in a helper process, which reports when it starts each entry and each
+ * result over a pipe. An entry that has not resolved within the timeout of
+ * being started is reported as timed out, and once nothing else can finish
+ * the helper is killed. A thread cannot be abandoned like that: it would
+ * keep the process multithreaded, and creating a user namespace then fails.
+ *
+ * The helper is forked from a short-lived intermediate child, so a helper
+ * that was killed while stuck in the kernel is reaped by init rather than
+ * left as a zombie child of the command sandbash execs.
+ *
+ * A hung entry occupies one worker, so the others carry on with the rest.
+ */
+
+#include "resolve.h"
+#include "trace.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <mntent.h>
+#endif
+#ifdef __APPLE__
+#include <sys/mount.h>
+#endif
+
+#define MAX_WORKERS 8
+
+// Lengths that mark a record without a path: an entry that did not
+// resolve, and one a worker has started on
+#define FAILED_LENGTH UINT32_MAX
+#define STARTED_LENGTH (UINT32_MAX - 1)
+
+// A record on the pipe: this, followed by the resolved path. The helper's
+// pid comes before the first record.
+typedef struct {
+    uint32_t index;
+    uint32_t length;
+} ResultHeader;
+
+typedef struct {
+    const char* const* paths;
+    int count;
+    int next;
+    int fd;
+    pthread_mutex_t lock;
+} HelperState;
+
+static double resolve_timeout = RESOLVE_DEFAULT_TIMEOUT;
+
+void resolve_set_timeout(double seconds) {
+    resolve_timeout = seconds;
+}
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+#ifdef __linux__
+static bool is_remote_type(const char* type) {
+    static const char* const remote[] = {
+        "nfs", "nfs4", "cifs", "smb3", "smbfs", "ncpfs", "9p", "ceph", "afs",
+        "lustre", "glusterfs", "gfs2", "ocfs2", "davfs", NULL,
+    };
+    if (strncmp(type, "fuse", 4) == 0) {
+        return true;
+    }
+    for (int i = 0; remote[i]; i++) {
+        if (strcmp(type, remote[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+// Whether every mounted filesystem is local, so a lookup cannot hang on
+// an unreachable server. Only the mount table is read, which never blocks
+// on the mounts themselves. Checked once per process.
+static bool only_local_mounts(void) {
+    static int local = -1;
+    if (local >= 0) {
+        return local;
+    }
+    local = 0;
+#if defined(__linux__)
+    FILE* mounts = setmntent("/proc/self/mounts", "re");
+    if (mounts) {
+        local = 1;
+        struct mntent* entry;
+        while ((entry = getmntent(mounts)) != NULL) {
+            if (is_remote_type(entry->mnt_type)) {
+                local = 0;
+            }
+        }
+        endmntent(mounts);
+    }
+#elif defined(__APPLE__)
+    int count = getfsstat(NULL, 0, MNT_NOWAIT);
+    struct statfs* stats = count > 0 ? calloc((size_t)count, sizeof(struct statfs)) : NULL;
+    if (stats) {
+        count = getfsstat(stats, count * (int)sizeof(struct statfs), MNT_NOWAIT);
+        local = count > 0;
+        for (int i = 0; i < count; i++) {
+            if (!(stats[i].f_flags & MNT_LOCAL)) {
+                local = 0;
+            }
+        }
+        free(stats);
+    }
+#endif
+    return local;
+}
+
+static bool write_all(int fd, const void* data, size_t size) {
+    const char* p = data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+static bool read_all(int fd, void* data, size_t size) {
+    char* p = data;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+static void* helper_worker(void* arg) {
+    HelperState* state = arg;
+    for (;;) {
+        // Whole records, so records from different workers do not mix
+        pthread_mutex_lock(&state->lock);
+        int index = state->next < state->count ? state->next++ : -1;
+        ResultHeader started = { (uint32_t)index, STARTED_LENGTH };
+        bool ok = index >= 0 && write_all(state->fd, &started, sizeof(started));
+        pthread_mutex_unlock(&state->lock);
+        if (!ok) {
+            return NULL;
+        }
+
+        char* resolved = expand_path(state->paths[index]);
+        ResultHeader header = { (uint32_t)index,
+                                resolved ? (uint32_t)strlen(resolved) : FAILED_LENGTH };
+        pthread_mutex_lock(&state->lock);
+        ok = write_all(state->fd, &header, sizeof(header)) &&
+             (!resolved || write_all(state->fd, resolved, header.length));
+        pthread_mutex_unlock(&state->lock);
+        free(resolved);
+        if (!ok) {
+            return NULL;
+        }
+    }
+}
+
+static void run_helper(const char* const paths[], int count, int fd) {
+    // The recorder is not thread-safe, and the parent keeps the trace
+    trace_enabled = false;
+
+    // The parent kills the helper by this pid, as it is not its child
+    pid_t self = getpid();
+    if (!write_all(fd, &self, sizeof(self))) {
+        _exit(1);
+    }
+
+    HelperState state = { paths, count, 0, fd, PTHREAD_MUTEX_INITIALIZER };
+    pthread_t workers[MAX_WORKERS];
+    int started = 0;
+    while (started < MAX_WORKERS - 1 && started < count - 1 &&
+           pthread_create(&workers[started], NULL, helper_worker, &state) == 0) {
+        started++;
+    }
+    helper_worker(&state);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    _exit(0);
+}
+
+// Take the complete records at the start of buffer; returns the bytes used.
+// started_at[i] is set to now when a worker starts entry i.
+static size_t take_results(const char* buffer, size_t len, int count, char* results[],
+                           ResolveStatus status[], double started_at[], double now,
+                           int* done) {
+    size_t used = 0;
+    while (len - used >= sizeof(ResultHeader)) {
+        ResultHeader header;
+        memcpy(&header, buffer + used, sizeof(header));
+        bool has_path = header.length != FAILED_LENGTH && header.length != STARTED_LENGTH;
+        size_t length = has_path ? header.length : 0;
+        if (len - used - sizeof(header) < length) {
+            break;
+        }
+        const char* path = buffer + used + sizeof(header);
+        used += sizeof(header) + length;
+
+        int index = (int)header.index;
+        if (index >= count || status[index] != RESOLVE_TIMED_OUT) {
+            continue;
+        }
+        if (header.length == STARTED_LENGTH) {
+            started_at[index] = now;
+            continue;
+        }
+        if (has_path) {
+            results[index] = strndup(path, length);
+        }
+        status[index] = results[index] ? RESOLVE_OK : RESOLVE_FAILED;
+        (*done)++;
+    }
+    return used;
+}
+
+static void resolve_inline(const char* const paths[], int count, char* results[],
+                           ResolveStatus status[]) {
+    for (int i = 0; i < count; i++) {
+        results[i] = expand_path(paths[i]);
+        status[i] = results[i] ? RESOLVE_OK : RESOLVE_FAILED;
+    }
+}
+
+// Fork the helper through an intermediate child that exits at once.
+// Returns the helper's pid, or -1 if it could not be started.
+static pid_t start_helper(const char* const paths[], int count, int pipe_fds[2]) {
+    // The helper's stdio buffers are copies of ours
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        return -1;
+    }
+    if (pid == 0) {
+        close(pipe_fds[0]);
+        if (fork() == 0) {
+            run_helper(paths, count, pipe_fds[1]);
+        }
+        _exit(0);
+    }
+    close(pipe_fds[1]);
+    while (waitpid(pid, NULL, 0) < 0 && errno == EINTR) {
+    }
+
+    // Written before any lookup, so this does not wait on one; if the
+    // helper was never forked, the pipe is already closed
+    pid_t helper;
+    return read_all(pipe_fds[0], &helper, sizeof(helper)) ? helper : -1;
+}
+
+void resolve_paths(const char* const paths[], int count, char* results[],
+                   ResolveStatus status[]) {
+    if (count <= 0) {
+        return;
+    }
+    if (resolve_timeout <= 0 || only_local_mounts()) {
+        resolve_inline(paths, count, results, status);
+        return;
+    }
+
+    TRACE_BEGIN("resolve_paths");
+    size_t capacity = 2 * (sizeof(ResultHeader) + PATH_MAX);
+    char* buffer = malloc(capacity);
+    double* started_at = calloc((size_t)count, sizeof(double));
+    int pipe_fds[2];
+    if (!buffer || !started_at || !create_cloexec_pipe(pipe_fds)) {
+        free(buffer);
+        free(started_at);
+        resolve_inline(paths, count, results, status);
+        TRACE_END();
+        return;
+    }
+    pid_t pid = start_helper(paths, count, pipe_fds);
+    if (pid < 0) {
+        close(pipe_fds[0]);
+        free(buffer);
+        free(started_at);
+        resolve_inline(paths, count, results, status);
+        TRACE_END();
+        return;
+    }
+
+    // Until a result arrives, everything counts as timed out
+    for (int i = 0; i < count; i++) {
+        results[i] = NULL;
+        status[i] = RESOLVE_TIMED_OUT;
+    }
+
+    size_t len = 0;
+    int done = 0;
+    int workers = count < MAX_WORKERS ? count : MAX_WORKERS;
+    bool helper_exited = false;
+    bool waited_for_worker = false;
+    while (done < count && !helper_exited) {
+        // Each entry has the timeout from when a worker started it. Queued
+        // entries wait for a worker, unless every worker is stuck on an
+        // entry that has timed out.
+        double now = monotonic_seconds();
+        double wake = now + resolve_timeout;
+        int running = 0;
+        int expired = 0;
+        int queued = 0;
+        for (int i = 0; i < count; i++) {
+            if (status[i] != RESOLVE_TIMED_OUT) {
+                continue;
+            }
+            if (started_at[i] == 0) {
+                queued++;
+            } else if (now >= started_at[i] + resolve_timeout) {
+                expired++;
+            } else {
+                running++;
+                if (started_at[i] + resolve_timeout < wake) {
+                    wake = started_at[i] + resolve_timeout;
+                }
+            }
+        }
+        if (running == 0 && (queued == 0 || expired >= workers || waited_for_worker)) {
+            break;
+        }
+
+        struct pollfd pfd = { pipe_fds[0], POLLIN, 0 };
+        int ready = poll(&pfd, 1, (int)((wake - now) * 1000) + 1);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready < 0) {
+            break;
+        }
+        if (ready == 0) {
+            // No worker came free for a queued entry in a whole timeout
+            waited_for_worker = running == 0;
+            continue;
+        }
+        ssize_t n = read(pipe_fds[0], buffer + len, capacity - len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            helper_exited = true;
+            break;
+        }
+        len += (size_t)n;
+
+        size_t used = take_results(buffer, len, count, results, status, started_at,
+                                   monotonic_seconds(), &done);
+        memmove(buffer, buffer + used, len - used);
+        len -= used;
+    }
+
+    // A helper stuck in a lookup dies once the kernel lets go of it, and
+    // init reaps it. It still holds the pipe, so its pid is not reused yet.
+    if (done < count && !helper_exited) {
+        kill(pid, SIGKILL);
+    }
+    close(pipe_fds[0]);
+
+    // Entries a helper that died did not report failed rather than timed
+    // out
+    for (int i = 0; i < count && helper_exited; i++) {
+        if (status[i] == RESOLVE_TIMED_OUT) {
+            status[i] = RESOLVE_FAILED;
+        }
+    }
+    free(buffer);
+    free(started_at);
+    TRACE_END();
+}
@@ -0,0 +1,34 @@
+#ifndef RESOLVE_H
+#define RESOLVE_H
+
+#include <stdbool.h>
+
+// Seconds an entry may take to resolve before resolve_paths() gives up on
+// it
+#define RESOLVE_DEFAULT_TIMEOUT 2.0
+
+typedef enum {
+    RESOLVE_OK,
+    // The path does not exist or could not be expanded
+    RESOLVE_FAILED,
+    // The lookup did not finish in time, e.g. on a hung network mount
+    RESOLVE_TIMED_OUT,
+} ResolveStatus;
+
+// Set the timeout for the rest of the process. 0 resolves in the calling
+// process, one entry at a time and without a limit.
+void resolve_set_timeout(double seconds);
+
+// Expand each of paths like expand_path(). With no network or FUSE
+// filesystem mounted this happens in the calling process; otherwise it
+// happens several at a time in a helper process, and an entry that takes
+// longer than the timeout is given up on. results[i] is set to the
+// resolved path, to be freed by the caller, or NULL; status[i] says why.
+// If the helper cannot be started, the entries are resolved in the calling
+// process instead. Results only hold for now: configs are never rewritten
+// from them, so an entry that times out or does not exist yet is kept for
+// later launches.
+void resolve_paths(const char* const paths[], int count, char* results[],
+                   ResolveStatus status[]);
+
+#endif // RESOLVE_H
@@ -0,0 +1,458 @@
+/*
+ * Resource limits and scheduling presets for the sandboxed process tree.
+ *
+ * With cgroup v2 the process moves into a new leaf, sandbash-<pid>, below
+ * its own cgroup, then enables the controllers it needs on that cgroup and
+ * writes the limits to the leaf. Moving first matters: cgroup v2 refuses
+ * to hand controllers to the children of a cgroup that still has processes,
+ * so this works whenever sandbash runs alone in a delegated cgroup, such
+ * as one from systemd-run --user --scope -p Delegate=yes. Leaves of
+ * finished runs are removed by the next run.
+ *
+ * Without delegation, the limits that have a per-process equivalent fall
+ * back to setrlimit, CPU affinity and I/O priority.
+ */
+
+#include "resources.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+#define CPU_PERIOD_US 100000
+#define LEAF_PREFIX "sandbash-"
+
+#ifdef __linux__
+// Set once join_cgroup succeeds
+static char joined_leaf[PATH_MAX / 2 + 32];
+
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+#endif
+
+bool resources_parse_option(ResourceLimits* limits, const char* option, const char* value) {
+    char* end;
+    bool valid = false;
+
+    if (strcmp(option, "cpu-max") == 0) {
+        double cpus = strtod(value, &end);
+        valid = end != value && *end == '\0' && cpus >= 0.01 && cpus <= 4096;
+        limits->cpu_max = cpus;
+    } else if (strcmp(option, "memory-max") == 0) {
+        valid = parse_size(value, &limits->memory_max);
+    } else if (strcmp(option, "pids-max") == 0) {
+        long pids = strtol(value, &end, 10);
+        valid = *value != '\0' && *end == '\0' && pids > 0 && pids <= 4194304;
+        limits->pids_max = pids;
+    } else if (strcmp(option, "io-weight") == 0) {
+        long weight = strtol(value, &end, 10);
+        valid = *value != '\0' && *end == '\0' && weight >= 1 && weight <= 10000;
+        limits->io_weight = (int)weight;
+    } else if (strcmp(option, "cpuset") == 0) {
+        valid = isdigit((unsigned char)value[0]) &&
+                strspn(value, "0123456789,-") == strlen(value);
+        limits->cpuset = value;
+    } else if (strcmp(option, "priority") == 0) {
+        valid = true;
+        if (strcmp(value, "background") == 0) {
+            limits->priority = PRIORITY_BACKGROUND;
+        } else if (strcmp(value, "idle") == 0) {
+            limits->priority = PRIORITY_IDLE;
+        } else if (strcmp(value, "normal") == 0) {
+            limits->priority = PRIORITY_NORMAL;
+        } else {
+            valid = false;
+        }
+    }
+
+    if (!valid) {
+        fprintf(stderr, "Error: Invalid --%s value: %s\n", option, value);
+    }
+    return valid;
+}
+
+static bool limits_set(const ResourceLimits* limits) {
+    return limits->cpu_max > 0 || limits->memory_max > 0 || limits->pids_max > 0 ||
+           limits->io_weight > 0 || limits->cpuset;
+}
+
+bool resources_requested(const ResourceLimits* limits) {
+    return limits_set(limits) || limits->priority != PRIORITY_NORMAL;
+}
+
+#ifdef __linux__
+static bool write_file(const char* dir, const char* name, const char* value) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    size_t len = strlen(value);
+    bool ok = write(fd, value, len) == (ssize_t)len;
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return ok;
+}
+
+static bool read_file(const char* dir, const char* name, char* out, size_t size) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t len = read(fd, out, size - 1);
+    close(fd);
+    out[len > 0 ? len : 0] = '\0';
+    return len >= 0;
+}
+
+// Whether a space-separated list such as cgroup.controllers holds word
+static bool has_word(const char* list, const char* word) {
+    size_t len = strlen(word);
+    for (const char* p = strstr(list, word); p; p = strstr(p + 1, word)) {
+        if ((p == list || isspace((unsigned char)p[-1])) &&
+            (p[len] == '\0' || isspace((unsigned char)p[len]))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The directory of this process's cgroup in the cgroup v2 hierarchy
+static bool own_cgroup(char* out, size_t size) {
+    char mount[PATH_MAX / 2] = "";
+    char line[PATH_MAX];
+    FILE* f = fopen("/proc/self/mountinfo", "re");
+    if (!f) {
+        return false;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        char point[PATH_MAX / 2];
+        if (strstr(line, " - cgroup2 ") &&
+            sscanf(line, "%*s %*s %*s %*s %2047s", point) == 1) {
+            snprintf(mount, sizeof(mount), "%s", point);
+            break;
+        }
+    }
+    fclose(f);
+
+    f = fopen("/proc/self/cgroup", "re");
+    if (!mount[0] || !f) {
+        if (f) {
+            fclose(f);
+        }
+        return false;
+    }
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            const char* path = strcmp(line + 3, "/") == 0 ? "" : line + 3;
+            int len = snprintf(out, size, "%s%s", mount, path);
+            found = len > 0 && (size_t)len < size;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+// Remove the leaves of runs whose processes have all exited
+static void remove_stale_leaves(const char* base) {
+    DIR* handle = opendir(base);
+    if (!handle) {
+        return;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(handle)) != NULL) {
+        if (strncmp(entry->d_name, LEAF_PREFIX, strlen(LEAF_PREFIX)) != 0) {
+            continue;
+        }
+        char leaf[PATH_MAX];
+        char events[256];
+        snprintf(leaf, sizeof(leaf), "%s/%s", base, entry->d_name);
+        if (read_file(leaf, "cgroup.events", events, sizeof(events)) &&
+            strstr(events, "populated 0")) {
+            rmdir(leaf);
+        }
+    }
+    closedir(handle);
+}
+
+// Write the limits to the leaf; on failure names the file in failed
+static bool write_limits(const char* leaf, const ResourceLimits* limits, const char** failed) {
+    char value[64];
+    if (limits->cpu_max > 0) {
+        long long quota = (long long)(limits->cpu_max * CPU_PERIOD_US + 0.5);
+        snprintf(value, sizeof(value), "%lld %d", quota, CPU_PERIOD_US);
+        if (!write_file(leaf, *failed = "cpu.max", value)) {
+            return false;
+        }
+    }
+    if (limits->memory_max > 0) {
+        snprintf(value, sizeof(value), "%llu", limits->memory_max);
+        if (!write_file(leaf, *failed = "memory.max", value)) {
+            return false;
+        }
+    }
+    if (limits->pids_max > 0) {
+        snprintf(value, sizeof(value), "%ld", limits->pids_max);
+        if (!write_file(leaf, *failed = "pids.max", value)) {
+            return false;
+        }
+    }
+    if (limits->io_weight > 0) {
+        snprintf(value, sizeof(value), "default %d", limits->io_weight);
+        if (!write_file(leaf, *failed = "io.weight", value)) {
+            return false;
+        }
+    }
+    if (limits->cpuset && !write_file(leaf, *failed = "cpuset.cpus", limits->cpuset)) {
+        return false;
+    }
+    return true;
+}
+
+// Move into a new leaf cgroup with the limits; explains a failure in reason
+static bool join_cgroup(const ResourceLimits* limits, char* reason, size_t reason_size) {
+    char base[PATH_MAX / 2];
+    if (!own_cgroup(base, sizeof(base))) {
+        snprintf(reason, reason_size, "no cgroup v2 hierarchy");
+        return false;
+    }
+
+    const char* needed[5];
+    int needed_count = 0;
+    if (limits->cpu_max > 0) {
+        needed[needed_count++] = "cpu";
+    }
+    if (limits->memory_max > 0) {
+        needed[needed_count++] = "memory";
+    }
+    if (limits->pids_max > 0) {
+        needed[needed_count++] = "pids";
+    }
+    if (limits->io_weight > 0) {
+        needed[needed_count++] = "io";
+    }
+    if (limits->cpuset) {
+        needed[needed_count++] = "cpuset";
+    }
+
+    char available[512];
+    char enable[64] = "";
+    if (!read_file(base, "cgroup.controllers", available, sizeof(available))) {
+        snprintf(reason, reason_size, "cannot read %s/cgroup.controllers", base);
+        return false;
+    }
+    for (int i = 0; i < needed_count; i++) {
+        if (!has_word(available, needed[i])) {
+            snprintf(reason, reason_size, "the %s controller is not available in %s",
+                     needed[i], base);
+            return false;
+        }
+        strcat(enable, i > 0 ? " +" : "+");
+        strcat(enable, needed[i]);
+    }
+
+    remove_stale_leaves(base);
+    char leaf[PATH_MAX / 2 + 32];
+    snprintf(leaf, sizeof(leaf), "%s/" LEAF_PREFIX "%d", base, (int)getpid());
+    if (mkdir(leaf, 0755) != 0) {
+        snprintf(reason, reason_size, "cannot create %s: %s", leaf, strerror(errno));
+        return false;
+    }
+    if (!write_file(leaf, "cgroup.procs", "0")) {
+        snprintf(reason, reason_size, "cannot move into %s: %s", leaf, strerror(errno));
+        rmdir(leaf);
+        return false;
+    }
+
+    const char* failed = "cgroup.subtree_control";
+    if (!write_file(base, "cgroup.subtree_control", enable) ||
+        !write_limits(leaf, limits, &failed)) {
+        if (errno == EBUSY && strcmp(failed, "cgroup.subtree_control") == 0) {
+            snprintf(reason, reason_size, "%s has other processes; run sandbash in a "
+                     "cgroup of its own", base);
+        } else {
+            snprintf(reason, reason_size, "cannot write %s: %s", failed, strerror(errno));
+        }
+        write_file(base, "cgroup.procs", "0");
+        rmdir(leaf);
+        return false;
+    }
+    snprintf(joined_leaf, sizeof(joined_leaf), "%s", leaf);
+    return true;
+}
+
+static bool parse_cpu_list(const char* list, cpu_set_t* set) {
+    CPU_ZERO(set);
+    const char* p = list;
+    while (*p) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p) {
+            return false;
+        }
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p) {
+                return false;
+            }
+        }
+        if (first < 0 || last < first || last >= CPU_SETSIZE) {
+            return false;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            CPU_SET(cpu, set);
+        }
+        p = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool set_io_priority(int io_class, int level) {
+    return syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+                   (io_class << IOPRIO_CLASS_SHIFT) | level) == 0;
+}
+#endif
+
+// Per-process stand-ins for the cgroup limits
+static bool apply_rlimits(const ResourceLimits* limits) {
+    if (limits->memory_max > 0) {
+        struct rlimit limit = { (rlim_t)limits->memory_max, (rlim_t)limits->memory_max };
+        if (setrlimit(RLIMIT_AS, &limit) != 0) {
+            fprintf(stderr, "Error: Failed to limit memory: %s\n", strerror(errno));
+            return false;
+        }
+    }
+    if (limits->pids_max > 0) {
+        // Counts all of the user's processes, not just the sandbox's
+        struct rlimit limit = { (rlim_t)limits->pids_max, (rlim_t)limits->pids_max };
+        if (setrlimit(RLIMIT_NPROC, &limit) != 0) {
+            fprintf(stderr, "Error: Failed to limit processes: %s\n", strerror(errno));
+            return false;
+        }
+    }
+    if (limits->cpu_max > 0) {
+        fprintf(stderr, "Warning: --cpu-max needs cgroup v2 and is not enforced\n");
+    }
+
+#ifdef __linux__
+    if (limits->io_weight > 0) {
+        // Map the weight onto best-effort levels 7 (lowest) to 0, with
+        // the default weight of 100 at the default level of 4
+        int weight = limits->io_weight;
+        int level = weight < 100 ? 4 + (100 - weight) * 3 / 99
+                                 : 4 - (weight - 100) * 4 / 9900;
+        if (!set_io_priority(IOPRIO_CLASS_BE, level)) {
+            fprintf(stderr, "Error: Failed to set I/O priority: %s\n", strerror(errno));
+            return false;
+        }
+    }
+    if (limits->cpuset) {
+        cpu_set_t set;
+        if (!parse_cpu_list(limits->cpuset, &set)) {
+            fprintf(stderr, "Error: Invalid --cpuset value: %s\n", limits->cpuset);
+            return false;
+        }
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            fprintf(stderr, "Error: Failed to set CPU affinity: %s\n", strerror(errno));
+            return false;
+        }
+    }
+#else
+    if (limits->io_weight > 0 || limits->cpuset) {
+        fprintf(stderr, "Warning: --io-weight and --cpuset are not supported on this "
+                        "platform\n");
+    }
+#endif
+    return true;
+}
+
+static bool apply_priority(Priority priority) {
+    if (priority == PRIORITY_NORMAL) {
+        return true;
+    }
+
+    // Only ever lower the priority; raising it back needs privileges
+    int nice_value = priority == PRIORITY_IDLE ? 19 : 10;
+    errno = 0;
+    int current = getpriority(PRIO_PROCESS, 0);
+    if ((errno != 0 || current < nice_value) &&
+        setpriority(PRIO_PROCESS, 0, nice_value) != 0) {
+        fprintf(stderr, "Error: Failed to set nice value: %s\n", strerror(errno));
+        return false;
+    }
+
+#ifdef __linux__
+    if (priority == PRIORITY_IDLE) {
+        struct sched_param param = { 0 };
+        if (sched_setscheduler(0, SCHED_IDLE, &param) != 0) {
+            fprintf(stderr, "Error: Failed to set SCHED_IDLE: %s\n", strerror(errno));
+            return false;
+        }
+    }
+    bool io_set = priority == PRIORITY_IDLE ? set_io_priority(IOPRIO_CLASS_IDLE, 7)
+                                            : set_io_priority(IOPRIO_CLASS_BE, 7);
+    if (!io_set) {
+        fprintf(stderr, "Warning: Failed to lower I/O priority: %s\n", strerror(errno));
+    }
+#endif
+    return true;
+}
+
+bool resources_apply(const ResourceLimits* limits) {
+    if (limits_set(limits)) {
+#ifdef __linux__
+        char reason[PATH_MAX];
+        bool joined = join_cgroup(limits, reason, sizeof(reason));
+        if (!joined) {
+            fprintf(stderr, "Warning: cgroup v2 limits unavailable (%s); falling back to "
+                            "setrlimit\n", reason);
+        }
+        if (!joined && !apply_rlimits(limits)) {
+            return false;
+        }
+#else
+        if (!apply_rlimits(limits)) {
+            return false;
+        }
+#endif
+    }
+    return apply_priority(limits->priority);
+}
+
+bool resources_cgroup(char* out, size_t size) {
+#ifdef __linux__
+    if (joined_leaf[0]) {
+        snprintf(out, size, "%s", joined_leaf);
+        return true;
+    }
+#else
+    (void)out;
+    (void)size;
+#endif
+    return false;
+}
@@ -0,0 +1,47 @@
+#ifndef RESOURCES_H
+#define RESOURCES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Scheduling presets for background work
+typedef enum {
+    PRIORITY_NORMAL,
+    // nice 10 and the lowest best-effort I/O priority
+    PRIORITY_BACKGROUND,
+    // SCHED_IDLE, nice 19 and the idle I/O class: runs only when nothing
+    // else wants the CPU or the disk
+    PRIORITY_IDLE,
+} Priority;
+
+// Resource limits for the sandboxed process tree; zero fields are unset
+typedef struct {
+    // CPUs' worth of time per period, e.g. 1.5
+    double cpu_max;
+    unsigned long long memory_max;
+    long pids_max;
+    // 1-10000, relative to other cgroups
+    int io_weight;
+    // CPU list such as "0-3,6"
+    const char* cpuset;
+    Priority priority;
+} ResourceLimits;
+
+// Set the limit named by option ("cpu-max", "memory-max", "pids-max",
+// "io-weight", "cpuset" or "priority") from its command-line value.
+// Prints an error and returns false if the value is invalid.
+bool resources_parse_option(ResourceLimits* limits, const char* option, const char* value);
+
+// Whether any limit or preset is set
+bool resources_requested(const ResourceLimits* limits);
+
+// Move the calling process into a new cgroup v2 leaf with the limits, or
+// fall back to setrlimit and CPU affinity when cgroups are not delegated,
+// then apply the priority preset. Limits are inherited by everything the
+// process starts.
+bool resources_apply(const ResourceLimits* limits);
+
+// The cgroup leaf resources_apply moved this process into, if any
+bool resources_cgroup(char* out, size_t size);
+
+#endif // RESOURCES_H
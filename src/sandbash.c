@@ -0,0 +1,436 @@
+#include "sandbash.h"
+#include "cache.h"
+#include "pattern.h"
+#include "sandbox.h"
+#include "trace.h"
+#include "utils.h"
+#ifdef __linux__
+#include "namespace.h"
+#include "overlay.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+struct SandbashConfig {
+    char* directory;
+    char* overlay;
+    // Absolute audit log path for audit mode, or NULL
+    char* audit;
+    bool private_tmp;
+    unsigned long long private_tmp_size;
+    char* grant_socket;
+    const SandboxBackend* backend;
+    PathList* paths;
+};
+
+// What a child that failed before exec writes to the status pipe
+typedef struct {
+    int error;
+    int error_errno;
+} SpawnFailure;
+
+// Make relative --allow-write paths relative to the sandbox directory
+// rather than to wherever the caller happens to be
+static PathList* anchor_paths(const SandbashOptions* options, const char* directory) {
+    PathList* paths = pathlist_create();
+    if (!paths) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < options->allow_write_count; i++) {
+        const char* path = options->allow_write[i];
+        char anchored[PATH_MAX];
+
+        if (!path) {
+            continue;
+        }
+        if (path[0] != '/' && path[0] != '~') {
+            int len = snprintf(anchored, sizeof(anchored), "%s/%s", directory, path);
+            if (len < 0 || (size_t)len >= sizeof(anchored)) {
+                // Too long to resolve; treat like any other bad path
+                continue;
+            }
+            path = anchored;
+        }
+        if (!pathlist_add(paths, path)) {
+            pathlist_free(paths);
+            return NULL;
+        }
+    }
+
+    return paths;
+}
+
+SandbashError sandbash_config_load(const SandbashOptions* options, SandbashConfig** config) {
+    if (!options || !config || (options->allow_write_count > 0 && !options->allow_write)) {
+        return SANDBASH_ERR_INVALID_ARGUMENT;
+    }
+    *config = NULL;
+
+    char directory[PATH_MAX];
+    if (options->directory) {
+        if (!realpath(options->directory, directory)) {
+            return SANDBASH_ERR_INVALID_ARGUMENT;
+        }
+    } else if (!getcwd(directory, sizeof(directory))) {
+        return SANDBASH_ERR_INVALID_ARGUMENT;
+    }
+
+    if (!is_directory_under_home(directory)) {
+        return SANDBASH_ERR_OUTSIDE_HOME;
+    }
+
+    // Overlays are built from the same namespaces as that backend
+    const char* backend_name = options->backend;
+    if (options->overlay) {
+#ifdef __linux__
+        if (!is_valid_session_id(options->overlay) ||
+            (backend_name && strcmp(backend_name, "namespace") != 0)) {
+            return SANDBASH_ERR_INVALID_ARGUMENT;
+        }
+        backend_name = "namespace";
+#else
+        return SANDBASH_ERR_NO_BACKEND;
+#endif
+    }
+
+    // Audit mode needs a supervisor that sees every write
+    char audit[PATH_MAX] = "";
+    if (options->audit) {
+#ifdef __linux__
+        if (options->overlay || !*options->audit ||
+            (backend_name && strcmp(backend_name, "seccomp") != 0)) {
+            return SANDBASH_ERR_INVALID_ARGUMENT;
+        }
+        int len = options->audit[0] == '/'
+                      ? snprintf(audit, sizeof(audit), "%s", options->audit)
+                      : snprintf(audit, sizeof(audit), "%s/%s", directory, options->audit);
+        if (len < 0 || (size_t)len >= sizeof(audit)) {
+            return SANDBASH_ERR_INVALID_ARGUMENT;
+        }
+        backend_name = "seccomp";
+#else
+        return SANDBASH_ERR_NO_BACKEND;
+#endif
+    }
+
+    // Only the seccomp supervisor can widen a policy in force
+    if (options->grant_socket) {
+#ifdef __linux__
+        if (options->overlay || !*options->grant_socket ||
+            (backend_name && strcmp(backend_name, "seccomp") != 0)) {
+            return SANDBASH_ERR_INVALID_ARGUMENT;
+        }
+        backend_name = "seccomp";
+#else
+        return SANDBASH_ERR_NO_BACKEND;
+#endif
+    }
+
+#ifndef __linux__
+    if (options->private_tmp) {
+        return SANDBASH_ERR_NO_BACKEND;
+    }
+#endif
+
+    TRACE_BEGIN("select_backend");
+    const SandboxBackend* backend = sandbox_select_backend(backend_name);
+    TRACE_END();
+    if (!backend) {
+        return SANDBASH_ERR_NO_BACKEND;
+    }
+
+    SandbashConfig* result = calloc(1, sizeof(SandbashConfig));
+    PathList* cli_args = anchor_paths(options, directory);
+    Config* loaded = config_create_for_dir(directory);
+    if (result) {
+        result->directory = strdup(directory);
+        result->overlay = options->overlay ? strdup(options->overlay) : NULL;
+        result->audit = *audit ? strdup(audit) : NULL;
+        result->private_tmp = options->private_tmp;
+        result->private_tmp_size = options->private_tmp_size;
+        result->grant_socket = options->grant_socket ? strdup(options->grant_socket) : NULL;
+        result->backend = backend;
+    }
+
+    if (!result || !result->directory || (options->overlay && !result->overlay) ||
+        (*audit && !result->audit) || (options->grant_socket && !result->grant_socket) ||
+        !cli_args || !loaded) {
+        sandbash_config_free(result);
+        pathlist_free(cli_args);
+        config_free(loaded);
+        return SANDBASH_ERR_NO_MEMORY;
+    }
+
+    result->paths = cache_resolve_paths(loaded, cli_args, options->use_cache);
+    pathlist_free(cli_args);
+    config_free(loaded);
+
+    if (!result->paths) {
+        sandbash_config_free(result);
+        return SANDBASH_ERR_PATHS;
+    }
+
+    *config = result;
+    return SANDBASH_OK;
+}
+
+void sandbash_config_free(SandbashConfig* config) {
+    if (!config) {
+        return;
+    }
+    free(config->directory);
+    free(config->overlay);
+    free(config->audit);
+    free(config->grant_socket);
+    pathlist_free(config->paths);
+    free(config);
+}
+
+const char* sandbash_config_backend(const SandbashConfig* config) {
+    return config ? config->backend->name : NULL;
+}
+
+size_t sandbash_config_path_count(const SandbashConfig* config) {
+    return config ? (size_t)config->paths->count : 0;
+}
+
+const char* sandbash_config_path(const SandbashConfig* config, size_t index) {
+    if (!config || index >= (size_t)config->paths->count) {
+        return NULL;
+    }
+    return config->paths->paths[index];
+}
+
+#ifdef __linux__
+// A copy of paths with extra added, if not NULL
+static PathList* paths_with(const PathList* paths, const char* extra) {
+    PathList* result = pathlist_create();
+    bool ok = result != NULL;
+    for (int i = 0; ok && i < paths->count; i++) {
+        ok = pathlist_add(result, paths->paths[i]);
+    }
+    if (!ok || (extra && !pathlist_add(result, extra))) {
+        pathlist_free(result);
+        return NULL;
+    }
+    return result;
+}
+
+// Mount a tmpfs over /tmp in a mount namespace of our own, so it is freed
+// once the last process in the sandbox exits, and return the writable
+// paths with /tmp added
+static PathList* private_tmp_apply(const SandbashConfig* config) {
+    // Writable paths under /tmp keep pointing at the real ones. So does
+    // the runtime directory, read-only apart from the overlay session
+    // being built there, as it would be without --private-tmp. Patterns
+    // keep what they match now.
+    char session_dir[PATH_MAX] = "";
+    if (config->overlay &&
+        !overlay_session_dir(config->overlay, session_dir, sizeof(session_dir))) {
+        return NULL;
+    }
+    char* runtime_dir = get_xdg_runtime_dir();
+    PathList* keep_readonly = pathlist_create();
+    PathList* expanded = pattern_expand(config->paths);
+    PathList* keep = expanded ? paths_with(expanded, *session_dir ? session_dir : NULL) : NULL;
+    pathlist_free(expanded);
+    bool ok = keep_readonly && keep &&
+              (!runtime_dir || pathlist_add(keep_readonly, runtime_dir)) && ns_enter() &&
+              ns_mount_tmpfs("/tmp", config->private_tmp_size, keep_readonly, keep);
+    free(runtime_dir);
+    pathlist_free(keep_readonly);
+    pathlist_free(keep);
+    if (!ok) {
+        return NULL;
+    }
+
+    // Namespace sandboxes nest their own namespaces inside this one and
+    // drop the capabilities themselves once done; that needs them still
+    bool nests = config->overlay || strcmp(config->backend->name, "namespace") == 0;
+    if (!nests && !ns_drop_privileges()) {
+        return NULL;
+    }
+    return paths_with(config->paths, "/tmp");
+}
+#endif
+
+SandbashError sandbash_apply(const SandbashConfig* config) {
+    if (!config) {
+        return SANDBASH_ERR_INVALID_ARGUMENT;
+    }
+    TRACE_BEGIN("chdir");
+    int chdir_result = chdir(config->directory);
+    TRACE_END();
+    if (chdir_result != 0) {
+        return SANDBASH_ERR_CHDIR;
+    }
+
+    const PathList* paths = config->paths;
+    PathList* with_tmp = NULL;
+#ifdef __linux__
+    // Bound before a private /tmp can hide the runtime directory
+    if (config->grant_socket && !sandbox_seccomp_accept_grants(config->grant_socket)) {
+        return SANDBASH_ERR_SANDBOX;
+    }
+    if (config->private_tmp) {
+        TRACE_BEGIN("private_tmp");
+        with_tmp = private_tmp_apply(config);
+        TRACE_END();
+        if (!with_tmp) {
+            return SANDBASH_ERR_SANDBOX;
+        }
+        paths = with_tmp;
+    }
+#endif
+
+    bool applied;
+#ifdef __linux__
+    if (config->overlay) {
+        // Overlays are mounted per directory, so patterns must be
+        // expanded first
+        PathList* expanded = pattern_expand(paths);
+        applied = expanded && overlay_apply(config->overlay, expanded);
+        pathlist_free(expanded);
+    } else if (config->audit) {
+        applied = sandbox_apply_seccomp_audit(paths, config->audit);
+    } else
+#endif
+    {
+        applied = sandbox_apply(config->backend, paths);
+    }
+    pathlist_free(with_tmp);
+    return applied ? SANDBASH_OK : SANDBASH_ERR_SANDBOX;
+}
+
+// Runs in the child; never returns
+static void spawn_child(const SandbashConfig* config, char* const argv[], char* const envp[],
+                        const int fds[3], int status_fd) {
+    SpawnFailure failure = { SANDBASH_OK, 0 };
+
+    // Move the new stdio out of the way first, in case the caller passed
+    // them in a different order than 0, 1, 2
+    int moved[3] = { -1, -1, -1 };
+    for (int i = 0; fds && i < 3; i++) {
+        if (fds[i] >= 0) {
+            moved[i] = fcntl(fds[i], F_DUPFD_CLOEXEC, 3);
+            if (moved[i] < 0) {
+                failure.error = SANDBASH_ERR_INVALID_ARGUMENT;
+                goto fail;
+            }
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        if (moved[i] >= 0 && dup2(moved[i], i) < 0) {
+            failure.error = SANDBASH_ERR_INVALID_ARGUMENT;
+            goto fail;
+        }
+    }
+
+    failure.error = sandbash_apply(config);
+    if (failure.error != SANDBASH_OK) {
+        goto fail;
+    }
+
+    exec_with_env(argv, envp ? envp : environ);
+    failure.error = SANDBASH_ERR_EXEC;
+
+fail:
+    failure.error_errno = errno;
+    (void)!write(status_fd, &failure, sizeof(failure));
+    _exit(127);
+}
+
+SandbashError sandbash_spawn(const SandbashConfig* config, char* const argv[],
+                             char* const envp[], const int fds[3],
+                             SandbashProcess* process) {
+    if (!config || !argv || !argv[0] || !process) {
+        return SANDBASH_ERR_INVALID_ARGUMENT;
+    }
+    process->pid = -1;
+    process->pidfd = -1;
+    process->error_errno = 0;
+
+    // Closed by a successful exec; a failing child writes to it first
+    int status_pipe[2];
+    if (!create_cloexec_pipe(status_pipe)) {
+        process->error_errno = errno;
+        return SANDBASH_ERR_FORK;
+    }
+
+    // Backends that fork flush stdio in the child, which would repeat
+    // whatever the caller has buffered
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        process->error_errno = errno;
+        close(status_pipe[0]);
+        close(status_pipe[1]);
+        return SANDBASH_ERR_FORK;
+    }
+
+    if (pid == 0) {
+        close(status_pipe[0]);
+        spawn_child(config, argv, envp, fds, status_pipe[1]);
+    }
+
+    close(status_pipe[1]);
+
+    SpawnFailure failure;
+    ssize_t n;
+    do {
+        n = read(status_pipe[0], &failure, sizeof(failure));
+    } while (n < 0 && errno == EINTR);
+    close(status_pipe[0]);
+
+    if (n == (ssize_t)sizeof(failure)) {
+        while (waitpid(pid, NULL, 0) < 0 && errno == EINTR) {
+        }
+        process->error_errno = failure.error_errno;
+        return (SandbashError)failure.error;
+    }
+
+    process->pid = pid;
+#ifdef SYS_pidfd_open
+    // pidfds are always close-on-exec
+    process->pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+#endif
+    return SANDBASH_OK;
+}
+
+const char* sandbash_strerror(SandbashError error) {
+    switch (error) {
+        case SANDBASH_OK:
+            return "Success";
+        case SANDBASH_ERR_INVALID_ARGUMENT:
+            return "Invalid argument";
+        case SANDBASH_ERR_NO_MEMORY:
+            return "Out of memory";
+        case SANDBASH_ERR_OUTSIDE_HOME:
+            return "Directory is not within the home directory";
+        case SANDBASH_ERR_NO_BACKEND:
+            return "No usable sandbox backend";
+        case SANDBASH_ERR_PATHS:
+            return "Failed to merge writable paths";
+        case SANDBASH_ERR_FORK:
+            return "Failed to fork";
+        case SANDBASH_ERR_CHDIR:
+            return "Failed to change to the sandbox directory";
+        case SANDBASH_ERR_SANDBOX:
+            return "Failed to initialize sandbox";
+        case SANDBASH_ERR_EXEC:
+            return "Failed to execute command";
+    }
+    return "Unknown error";
+}
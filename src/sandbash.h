@@ -0,0 +1,132 @@
+#ifndef SANDBASH_H
+#define SANDBASH_H
+
+/*
+ * libsandbash: spawn sandboxed processes from a long-lived program.
+ *
+ * Load a SandbashConfig once; that parses the config files, resolves the
+ * writable paths and picks a backend. Then pass it to sandbash_spawn() as
+ * often as needed. A loaded config is read-only and may be shared between
+ * threads, but see sandbash_spawn() before spawning from more than one.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define SANDBASH_API __attribute__((visibility("default")))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    SANDBASH_OK = 0,
+    SANDBASH_ERR_INVALID_ARGUMENT,
+    SANDBASH_ERR_NO_MEMORY,
+    // The sandbox directory is not within $HOME
+    SANDBASH_ERR_OUTSIDE_HOME,
+    // The requested backend, or any backend, is not available
+    SANDBASH_ERR_NO_BACKEND,
+    // The writable paths could not be loaded and merged
+    SANDBASH_ERR_PATHS,
+    SANDBASH_ERR_FORK,
+    // The child could not change to the sandbox directory
+    SANDBASH_ERR_CHDIR,
+    // The child could not apply the sandbox
+    SANDBASH_ERR_SANDBOX,
+    // The command could not be executed
+    SANDBASH_ERR_EXEC
+} SandbashError;
+
+typedef struct SandbashConfig SandbashConfig;
+
+typedef struct {
+    // Directory the sandbox is built for and commands start in; NULL for
+    // the current directory
+    const char* directory;
+    // Extra writable paths, as with --allow-write. Relative paths are
+    // relative to directory.
+    const char* const* allow_write;
+    size_t allow_write_count;
+    // Backend name, or NULL for the best available
+    const char* backend;
+    // Use the on-disk ruleset cache
+    bool use_cache;
+    // Overlay session id, or NULL. Writes under $HOME outside the
+    // writable paths then go to the session instead of failing. Linux
+    // only; implies the namespace backend.
+    const char* overlay;
+    // Audit log path, or NULL. Writes outside the writable paths are then
+    // allowed and logged to this file as JSON lines instead of failing.
+    // Relative paths are relative to directory. Linux only; implies the
+    // seccomp backend and cannot be combined with overlay.
+    const char* audit;
+    // Mount a private tmpfs over /tmp that is writable whatever the
+    // writable paths say and goes away with the sandboxed processes.
+    // Linux only.
+    bool private_tmp;
+    // Size limit of the private /tmp in bytes, or 0 for the kernel
+    // default of half the RAM
+    unsigned long long private_tmp_size;
+    // Unix socket to create, or NULL. While the sandbox runs, processes
+    // of this user outside it can grant it further writable paths there.
+    // Each process the config starts binds it, so start one at a time.
+    // Linux only; implies the seccomp backend, the only one whose policy
+    // can be widened after launch.
+    const char* grant_socket;
+} SandbashOptions;
+
+typedef struct {
+    pid_t pid;
+    // pidfd for the child, or -1 where the kernel has none. Owned by the
+    // caller.
+    int pidfd;
+    // errno of the step that failed, or 0
+    int error_errno;
+} SandbashProcess;
+
+// Load global, per-directory and extra writable paths and select a backend
+SANDBASH_API SandbashError sandbash_config_load(const SandbashOptions* options,
+                                                SandbashConfig** config);
+
+// Free a loaded config
+SANDBASH_API void sandbash_config_free(SandbashConfig* config);
+
+// Get the name of the backend a config uses
+SANDBASH_API const char* sandbash_config_backend(const SandbashConfig* config);
+
+// Get the number of merged writable paths
+SANDBASH_API size_t sandbash_config_path_count(const SandbashConfig* config);
+
+// Get a merged writable path by index
+SANDBASH_API const char* sandbash_config_path(const SandbashConfig* config, size_t index);
+
+// Start argv[0] (searched in the PATH of envp) in the sandbox. envp may be
+// NULL for the current environment. fds gives the child's stdin, stdout
+// and stderr; NULL or -1 entries are inherited. On success the child has
+// exec'd. On failure nothing is left running and error_errno says why.
+// With the seccomp backend, pid is a supervisor that exits with the
+// command's status.
+//
+// Not safe to call while the process has other threads: the child
+// allocates and writes files before exec, and would deadlock on a malloc
+// or stdio lock another thread held at the fork. A threaded program should
+// fork a launcher before it starts threads and spawn from there, as
+// sandbash --each-dir does.
+SANDBASH_API SandbashError sandbash_spawn(const SandbashConfig* config, char* const argv[],
+                                          char* const envp[], const int fds[3],
+                                          SandbashProcess* process);
+
+// Restrict the calling process itself, as sandbash does before it execs.
+// The seccomp backend forks here and only the child returns.
+SANDBASH_API SandbashError sandbash_apply(const SandbashConfig* config);
+
+// Get a description of an error code
+SANDBASH_API const char* sandbash_strerror(SandbashError error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SANDBASH_H
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include "daemon.h"
+
+#define VERSION "0.1.0"
+
+#define DEFAULT_IDLE_TIMEOUT 300
+#define DEFAULT_MAX_ZYGOTES 16
+
+static void print_usage(const char* program_name) {
+    printf("sandbashd v%s - Launch daemon for sandbash\n\n", VERSION);
+    printf("Usage: %s [OPTIONS]\n", program_name);
+    printf("\nKeeps sandboxed processes ready so that `sandbash --use-daemon`\n");
+    printf("can start commands without setting up a sandbox each time.\n");
+    printf("\nOptions:\n");
+    printf("  --idle-timeout=SECS  Shut down sandboxes unused for SECS (default %d)\n",
+           DEFAULT_IDLE_TIMEOUT);
+    printf("  --max-zygotes=N      Keep at most N sandboxes ready (default %d)\n",
+           DEFAULT_MAX_ZYGOTES);
+    printf("  -h, --help           Show this help message\n");
+}
+
+static bool parse_positive(const char* value, int* out) {
+    char* end;
+    long parsed = strtol(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || parsed <= 0 || parsed > 1000000) {
+        return false;
+    }
+    *out = (int)parsed;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    DaemonOptions options = { DEFAULT_IDLE_TIMEOUT, DEFAULT_MAX_ZYGOTES };
+
+    static struct option long_options[] = {
+        {"idle-timeout", required_argument, 0, 't'},
+        {"max-zygotes", required_argument, 0, 'n'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:n:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 't':
+                if (!parse_positive(optarg, &options.idle_timeout)) {
+                    fprintf(stderr, "Error: Invalid idle timeout: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'n':
+                if (!parse_positive(optarg, &options.max_zygotes)) {
+                    fprintf(stderr, "Error: Invalid zygote count: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind < argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    return daemon_serve(&options);
+}
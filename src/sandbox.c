@@ -1,17 +1,31 @@
-/*
- * Note: macOS sandbox_init_with_parameters is a private API.
- * For production use, this tool may need to be signed with proper
- * entitlements or use alternative sandboxing approaches.
- *
- * Alternative: Use sandbox_init(kSBXProfileNoWrite, SANDBOX_NAMED, &error)
- * and manage write permissions differently.
- */
-
 #include "sandbox.h"
+#include "pattern.h"
+#include "trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sandbox.h>
+
+#ifdef __APPLE__
+extern const SandboxBackend sandbox_backend_seatbelt;
+#endif
+#ifdef __linux__
+extern const SandboxBackend sandbox_backend_landlock;
+extern const SandboxBackend sandbox_backend_namespace;
+extern const SandboxBackend sandbox_backend_seccomp;
+#endif
+
+// Backends in order of preference
+static const SandboxBackend* const backends[] = {
+#ifdef __APPLE__
+    &sandbox_backend_seatbelt,
+#endif
+#ifdef __linux__
+    &sandbox_backend_landlock,
+    &sandbox_backend_namespace,
+    &sandbox_backend_seccomp,
+#endif
+    NULL
+};
 
 char* escape_sandbox_string(const char* str) {
     if (!str) {
@@ -55,11 +69,20 @@ char* sandbox_generate_profile(Config* config) {
         return NULL;
     }
 
+    char* profile = sandbox_generate_profile_for_paths(all_paths);
+    pathlist_free(all_paths);
+    return profile;
+}
+
+char* sandbox_generate_profile_for_paths(const PathList* all_paths) {
+    if (!all_paths) {
+        return NULL;
+    }
+
     // Build profile string
     size_t buffer_size = 8192;
     char* profile = malloc(buffer_size);
     if (!profile) {
-        pathlist_free(all_paths);
         return NULL;
     }
 
@@ -81,17 +104,42 @@ char* sandbox_generate_profile(Config* config) {
 
     // Add write permissions for each path
     for (int i = 0; i < all_paths->count; i++) {
-        char* escaped = escape_sandbox_string(all_paths->paths[i]);
-        if (!escaped) {
-            free(profile);
-            pathlist_free(all_paths);
-            return NULL;
-        }
+        // Patterns become regexes, which also cover directories created
+        // after launch
+        if (pattern_is_glob(all_paths->paths[i])) {
+            char* regex = pattern_to_regex(all_paths->paths[i]);
+            if (!regex) {
+                fprintf(stderr, "Warning: Skipping pattern seatbelt cannot express: %s\n",
+                        all_paths->paths[i]);
+                continue;
+            }
+            // Regexes can be several times as long as the pattern
+            while (buffer_size - offset < strlen(regex) + 512) {
+                buffer_size *= 2;
+                char* new_profile = realloc(profile, buffer_size);
+                if (!new_profile) {
+                    free(regex);
+                    free(profile);
+                    return NULL;
+                }
+                profile = new_profile;
+            }
+            offset += snprintf(profile + offset, buffer_size - offset,
+                "(allow file-write* (regex #\"%s\"))\n",
+                regex);
+            free(regex);
+        } else {
+            char* escaped = escape_sandbox_string(all_paths->paths[i]);
+            if (!escaped) {
+                free(profile);
+                return NULL;
+            }
 
-        offset += snprintf(profile + offset, buffer_size - offset,
-            "(allow file-write* (subpath \"%s\"))\n",
-            escaped);
-        free(escaped);
+            offset += snprintf(profile + offset, buffer_size - offset,
+                "(allow file-write* (subpath \"%s\"))\n",
+                escaped);
+            free(escaped);
+        }
 
         if (offset >= buffer_size - 512) {
             // Need more space
@@ -99,39 +147,59 @@ char* sandbox_generate_profile(Config* config) {
             char* new_profile = realloc(profile, buffer_size);
             if (!new_profile) {
                 free(profile);
-                pathlist_free(all_paths);
                 return NULL;
             }
             profile = new_profile;
         }
     }
 
-    pathlist_free(all_paths);
     return profile;
 }
 
-// Private API declaration (may require code signing)
-extern int sandbox_init_with_parameters(const char *profile, uint64_t flags,
-                                       const char *const parameters[],
-                                       char **errorbuf);
+const SandboxBackend* sandbox_select_backend(const char* name) {
+    for (int i = 0; backends[i]; i++) {
+        if (name && strcmp(backends[i]->name, name) != 0) {
+            continue;
+        }
+        if (backends[i]->probe()) {
+            return backends[i];
+        }
+        if (name) {
+            fprintf(stderr, "Error: Sandbox backend '%s' is not available on this host\n",
+                    name);
+            return NULL;
+        }
+    }
+
+    if (name) {
+        fprintf(stderr, "Error: Unknown sandbox backend: %s\n", name);
+    } else {
+        fprintf(stderr, "Error: No sandbox backend available on this host\n");
+    }
+    return NULL;
+}
 
-bool sandbox_init_with_profile(const char* profile) {
-    if (!profile) {
+bool sandbox_apply(const SandboxBackend* backend, const PathList* writable_paths) {
+    if (!backend || !writable_paths) {
         return false;
     }
 
-    char* error = NULL;
-    int result = sandbox_init_with_parameters(profile, 0, NULL, &error);
-
-    if (result != 0) {
-        if (error) {
-            fprintf(stderr, "Error: Failed to initialize sandbox: %s\n", error);
-            free(error);
-        } else {
-            fprintf(stderr, "Error: Failed to initialize sandbox\n");
+    PathList* expanded = NULL;
+    for (int i = 0; !backend->matches_patterns && i < writable_paths->count; i++) {
+        if (pattern_is_glob(writable_paths->paths[i])) {
+            expanded = pattern_expand(writable_paths);
+            if (!expanded) {
+                fprintf(stderr, "Error: Failed to expand writable path patterns\n");
+                return false;
+            }
+            break;
         }
-        return false;
     }
 
-    return true;
+    // With seccomp only the child returns, so it records the end
+    TRACE_BEGIN_DETAIL("sandbox_apply", backend->name);
+    bool result = backend->apply(expanded ? expanded : writable_paths);
+    TRACE_END();
+    pathlist_free(expanded);
+    return result;
 }
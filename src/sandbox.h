@@ -4,10 +4,44 @@
 #include "config.h"
 #include <stdbool.h>
 
+// A sandbox backend restricts filesystem writes for the current process
+// and everything it executes. Backends are tried in order of preference
+// and the first one whose probe succeeds is used.
+typedef struct {
+    const char* name;
+    // Check whether this backend can be used on this host
+    bool (*probe)(void);
+    // Restrict the current process to the given writable paths. A backend
+    // may fork a supervisor; apply only returns in the process that goes
+    // on to run the command.
+    bool (*apply)(const PathList* writable_paths);
+    // Whether apply matches glob patterns among the paths itself; other
+    // backends get the patterns expanded to existing paths first
+    bool matches_patterns;
+} SandboxBackend;
+
+// Select backend by name, or the best available backend if name is NULL
+const SandboxBackend* sandbox_select_backend(const char* name);
+
+// Restrict the current process to the merged writable paths
+bool sandbox_apply(const SandboxBackend* backend, const PathList* writable_paths);
+
+// Like the seccomp backend, but writes outside writable_paths are allowed
+// and logged to log_path as JSON lines (Linux only)
+bool sandbox_apply_seccomp_audit(const PathList* writable_paths, const char* log_path);
+
+// Listen on socket_path for grants of further writable paths from
+// processes of this user outside the sandbox, for the seccomp backend
+// applied next (Linux only)
+bool sandbox_seccomp_accept_grants(const char* socket_path);
+
 // Generate sandbox profile from config
 char* sandbox_generate_profile(Config* config);
 
-// Initialize sandbox with profile
+// Generate sandbox profile from an already merged path list
+char* sandbox_generate_profile_for_paths(const PathList* paths);
+
+// Initialize sandbox with profile (macOS only)
 bool sandbox_init_with_profile(const char* profile);
 
 // Escape special characters in strings for sandbox profile
@@ -0,0 +1,185 @@
+/*
+ * Linux Landlock backend.
+ *
+ * The merged writable path list is turned into a Landlock ruleset that
+ * handles every write-class filesystem right. Reads and execution are left
+ * unhandled, so they stay unrestricted just like the Seatbelt profile. Once
+ * the ruleset is enforced the kernel does all checking during path walks;
+ * no user-space code runs per syscall.
+ */
+
+#include "sandbox.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/landlock.h>
+
+#ifndef LANDLOCK_ACCESS_FS_REFER
+#define LANDLOCK_ACCESS_FS_REFER (1ULL << 13)
+#endif
+#ifndef LANDLOCK_ACCESS_FS_TRUNCATE
+#define LANDLOCK_ACCESS_FS_TRUNCATE (1ULL << 14)
+#endif
+
+// Rights available in every ABI version
+#define LANDLOCK_WRITE_ACCESS_V1 \
+    (LANDLOCK_ACCESS_FS_WRITE_FILE | \
+     LANDLOCK_ACCESS_FS_REMOVE_DIR | \
+     LANDLOCK_ACCESS_FS_REMOVE_FILE | \
+     LANDLOCK_ACCESS_FS_MAKE_CHAR | \
+     LANDLOCK_ACCESS_FS_MAKE_DIR | \
+     LANDLOCK_ACCESS_FS_MAKE_REG | \
+     LANDLOCK_ACCESS_FS_MAKE_SOCK | \
+     LANDLOCK_ACCESS_FS_MAKE_FIFO | \
+     LANDLOCK_ACCESS_FS_MAKE_BLOCK | \
+     LANDLOCK_ACCESS_FS_MAKE_SYM)
+
+// Rights that may be granted on a rule for a non-directory
+#define LANDLOCK_FILE_ACCESS \
+    (LANDLOCK_ACCESS_FS_WRITE_FILE | LANDLOCK_ACCESS_FS_TRUNCATE)
+
+// Device nodes that must stay writable for shells to work (redirects to
+// /dev/null, the controlling terminal, pseudo-terminals)
+static const char* const device_paths[] = {
+    "/dev/null",
+    "/dev/zero",
+    "/dev/full",
+    "/dev/random",
+    "/dev/urandom",
+    "/dev/tty",
+    "/dev/ptmx",
+    "/dev/pts",
+    NULL
+};
+
+static int landlock_abi = -1;
+
+static bool landlock_probe(void) {
+    if (landlock_abi < 0) {
+        long abi = syscall(SYS_landlock_create_ruleset, NULL, 0,
+                           LANDLOCK_CREATE_RULESET_VERSION);
+        landlock_abi = abi < 0 ? 0 : (int)abi;
+    }
+    return landlock_abi >= 1;
+}
+
+// Write rights handled by the ruleset for the probed ABI version
+static __u64 handled_write_access(void) {
+    __u64 access = LANDLOCK_WRITE_ACCESS_V1;
+
+    // ABI 1 cannot express REFER, so renames and links across directories
+    // always fail with EXDEV there. ABI 2 lets us allow them between
+    // writable paths.
+    if (landlock_abi >= 2) {
+        access |= LANDLOCK_ACCESS_FS_REFER;
+    }
+    if (landlock_abi >= 3) {
+        access |= LANDLOCK_ACCESS_FS_TRUNCATE;
+    }
+
+    return access;
+}
+
+static bool add_path_rule(int ruleset_fd, const char* path, __u64 access,
+                          bool warn_missing) {
+    int fd = open(path, O_PATH | O_CLOEXEC);
+    if (fd < 0) {
+        if (warn_missing || errno != ENOENT) {
+            fprintf(stderr, "Warning: Cannot open writable path %s: %s\n",
+                    path, strerror(errno));
+        }
+        return true;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "Warning: Cannot stat writable path %s: %s\n",
+                path, strerror(errno));
+        close(fd);
+        return true;
+    }
+
+    struct landlock_path_beneath_attr rule = {
+        .allowed_access = access,
+        .parent_fd = fd,
+    };
+    if (!S_ISDIR(st.st_mode)) {
+        rule.allowed_access &= LANDLOCK_FILE_ACCESS;
+    }
+
+    long result = syscall(SYS_landlock_add_rule, ruleset_fd,
+                          LANDLOCK_RULE_PATH_BENEATH, &rule, 0);
+    close(fd);
+
+    if (result != 0) {
+        fprintf(stderr, "Error: Failed to add Landlock rule for %s: %s\n",
+                path, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+static bool landlock_apply(const PathList* writable_paths) {
+    if (!writable_paths || !landlock_probe()) {
+        return false;
+    }
+
+    __u64 handled = handled_write_access();
+    struct landlock_ruleset_attr attr = {
+        .handled_access_fs = handled,
+    };
+
+    int ruleset_fd = (int)syscall(SYS_landlock_create_ruleset, &attr,
+                                  sizeof(attr), 0);
+    if (ruleset_fd < 0) {
+        fprintf(stderr, "Error: Failed to create Landlock ruleset: %s\n",
+                strerror(errno));
+        return false;
+    }
+
+    for (int i = 0; i < writable_paths->count; i++) {
+        if (!add_path_rule(ruleset_fd, writable_paths->paths[i], handled, true)) {
+            close(ruleset_fd);
+            return false;
+        }
+    }
+
+    for (int i = 0; device_paths[i]; i++) {
+        if (!add_path_rule(ruleset_fd, device_paths[i],
+                           LANDLOCK_FILE_ACCESS & handled, false)) {
+            close(ruleset_fd);
+            return false;
+        }
+    }
+
+    // Required to enforce a ruleset without CAP_SYS_ADMIN. This also means
+    // setuid binaries cannot gain privileges inside the sandbox.
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0) {
+        fprintf(stderr, "Error: Failed to set no_new_privs: %s\n", strerror(errno));
+        close(ruleset_fd);
+        return false;
+    }
+
+    if (syscall(SYS_landlock_restrict_self, ruleset_fd, 0) != 0) {
+        fprintf(stderr, "Error: Failed to enforce Landlock ruleset: %s\n",
+                strerror(errno));
+        close(ruleset_fd);
+        return false;
+    }
+
+    close(ruleset_fd);
+    return true;
+}
+
+const SandboxBackend sandbox_backend_landlock = {
+    .name = "landlock",
+    .probe = landlock_probe,
+    .apply = landlock_apply,
+};
@@ -0,0 +1,74 @@
+/*
+ * Linux mount-namespace backend, for kernels without Landlock.
+ *
+ * The process enters an unprivileged user and mount namespace, binds every
+ * writable path onto itself so it becomes its own mount, and then remounts
+ * every other mount read-only. Capabilities are dropped before returning,
+ * so the command cannot undo the mounts. Once set up, filesystem syscalls
+ * run at native speed: the read-only flag is checked by the VFS like any
+ * other mount flag.
+ */
+
+#include "sandbox.h"
+#include "namespace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static bool namespace_probe(void) {
+    // Unprivileged user namespaces can be disabled by sysctl or LSM policy,
+    // so try creating one in a throwaway child
+    pid_t pid = fork();
+    if (pid < 0) {
+        return false;
+    }
+    if (pid == 0) {
+        _exit(unshare(CLONE_NEWUSER | CLONE_NEWNS) == 0 ? 0 : 1);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0) {
+        return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static bool namespace_apply(const PathList* writable_paths) {
+    if (!writable_paths) {
+        return false;
+    }
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        fprintf(stderr, "Error: Failed to get current directory: %s\n", strerror(errno));
+        return false;
+    }
+
+    if (!ns_enter()) {
+        return false;
+    }
+
+    if (!ns_restrict_writes(writable_paths)) {
+        return false;
+    }
+
+    // The working directory still refers to the mount that was there when
+    // we started; re-resolve it so relative writes go through the bind
+    if (chdir(cwd) != 0) {
+        fprintf(stderr, "Error: Failed to re-enter %s: %s\n", cwd, strerror(errno));
+        return false;
+    }
+
+    return ns_drop_privileges();
+}
+
+const SandboxBackend sandbox_backend_namespace = {
+    .name = "namespace",
+    .probe = namespace_probe,
+    .apply = namespace_apply,
+};
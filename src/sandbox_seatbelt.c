@@ -0,0 +1,68 @@
+/*
+ * Note: macOS sandbox_init_with_parameters is a private API.
+ * For production use, this tool may need to be signed with proper
+ * entitlements or use alternative sandboxing approaches.
+ *
+ * Alternative: Use sandbox_init(kSBXProfileNoWrite, SANDBOX_NAMED, &error)
+ * and manage write permissions differently.
+ */
+
+#include "sandbox.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sandbox.h>
+
+// Private API declaration (may require code signing)
+extern int sandbox_init_with_parameters(const char *profile, uint64_t flags,
+                                       const char *const parameters[],
+                                       char **errorbuf);
+
+bool sandbox_init_with_profile(const char* profile) {
+    if (!profile) {
+        return false;
+    }
+
+    char* error = NULL;
+    int result = sandbox_init_with_parameters(profile, 0, NULL, &error);
+
+    if (result != 0) {
+        if (error) {
+            fprintf(stderr, "Error: Failed to initialize sandbox: %s\n", error);
+            free(error);
+        } else {
+            fprintf(stderr, "Error: Failed to initialize sandbox\n");
+        }
+        return false;
+    }
+
+    return true;
+}
+
+static bool seatbelt_probe(void) {
+    return true;
+}
+
+static bool seatbelt_apply(const PathList* writable_paths) {
+    TRACE_BEGIN("sandbox_generate_profile");
+    char* profile = sandbox_generate_profile_for_paths(writable_paths);
+    TRACE_END();
+    if (!profile) {
+        fprintf(stderr, "Error: Failed to generate sandbox profile\n");
+        return false;
+    }
+
+    TRACE_BEGIN("sandbox_init");
+    bool result = sandbox_init_with_profile(profile);
+    TRACE_END();
+    free(profile);
+    return result;
+}
+
+const SandboxBackend sandbox_backend_seatbelt = {
+    .name = "seatbelt",
+    .probe = seatbelt_probe,
+    .apply = seatbelt_apply,
+    .matches_patterns = true,
+};
@@ -0,0 +1,1064 @@
+/*
+ * Linux seccomp user-notification backend, the last resort when neither
+ * Landlock nor unprivileged user namespaces are available.
+ *
+ * A BPF filter traps write-class syscalls (opens with write flags, unlink,
+ * rename, mkdir, ...) and hands them to a supervisor thread pool running in
+ * the unsandboxed parent. Read-only opens never leave the kernel. The
+ * supervisor resolves the parent directory of each target and caches the
+ * decision by its (dev, inode), so repeated writes into the same directory
+ * cost one open and fstat instead of a full path resolution.
+ *
+ * Allowed calls are resumed with SECCOMP_USER_NOTIF_FLAG_CONTINUE, which
+ * re-reads the path from the target's memory. A multi-threaded target can
+ * race the check by rewriting the path in between, so this backend is
+ * weaker than Landlock or the namespace backend.
+ *
+ * In audit mode (--audit) the same checks run, but denied calls are
+ * resumed too and logged through audit.c. The supervisor is then the
+ * subreaper of the command and keeps logging until every process the
+ * command left running has exited.
+ *
+ * With --allow-grants the supervisor also listens on a Unix socket for
+ * paths to add to the policy while the command runs. The policy only ever
+ * widens, so a grant keeps cached allows and clears the rest. Requests
+ * from processes with no_new_privs are refused: every process in the
+ * sandbox has it and none can clear it.
+ */
+
+#include "sandbox.h"
+#include "audit.h"
+#include "pattern.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+
+#ifndef SO_PEERPIDFD
+#define SO_PEERPIDFD 77
+#endif
+
+#if defined(__x86_64__)
+#define SECCOMP_AUDIT_ARCH AUDIT_ARCH_X86_64
+#elif defined(__aarch64__)
+#define SECCOMP_AUDIT_ARCH AUDIT_ARCH_AARCH64
+#else
+#error "seccomp backend: unsupported architecture"
+#endif
+
+#define DECISION_CACHE_SIZE 4096
+#define MAX_SUPERVISOR_THREADS 8
+#define DENY_ERRNO EACCES
+// Returned by the checks for writes the policy forbids, as opposed to
+// errors the syscall would hit anyway
+#define POLICY_DENIED (-2)
+
+// Open flags that make an open a write
+#define OPEN_WRITE_FLAGS (O_WRONLY | O_RDWR | O_CREAT | O_TRUNC)
+
+#define NO_ARG (-1)
+
+// How to find the path arguments of a trapped syscall. dirfd arguments
+// are NO_ARG for the legacy calls that always resolve against the cwd.
+typedef struct {
+    int nr;
+    const char* name;
+    int dirfd_arg;
+    int path_arg;
+    int dirfd2_arg;
+    int path2_arg;
+    int flags_arg;      // open flags, for calls that may be read-only
+    bool follow_final;  // the final component is followed if it is a symlink
+} TrappedSyscall;
+
+#define SC(name) __NR_##name, #name
+
+static const TrappedSyscall trapped_syscalls[] = {
+#ifdef __NR_open
+    {SC(open), NO_ARG, 0, NO_ARG, NO_ARG, 1, true},
+#endif
+    {SC(openat), 0, 1, NO_ARG, NO_ARG, 2, true},
+#ifdef __NR_creat
+    {SC(creat), NO_ARG, 0, NO_ARG, NO_ARG, NO_ARG, true},
+#endif
+    {SC(truncate), NO_ARG, 0, NO_ARG, NO_ARG, NO_ARG, true},
+#ifdef __NR_unlink
+    {SC(unlink), NO_ARG, 0, NO_ARG, NO_ARG, NO_ARG, false},
+#endif
+    {SC(unlinkat), 0, 1, NO_ARG, NO_ARG, NO_ARG, false},
+#ifdef __NR_rename
+    {SC(rename), NO_ARG, 0, NO_ARG, 1, NO_ARG, false},
+#endif
+#ifdef __NR_renameat
+    {SC(renameat), 0, 1, 2, 3, NO_ARG, false},
+#endif
+    {SC(renameat2), 0, 1, 2, 3, NO_ARG, false},
+#ifdef __NR_mkdir
+    {SC(mkdir), NO_ARG, 0, NO_ARG, NO_ARG, NO_ARG, false},
+#endif
+    {SC(mkdirat), 0, 1, NO_ARG, NO_ARG, NO_ARG, false},
+#ifdef __NR_rmdir
+    {SC(rmdir), NO_ARG, 0, NO_ARG, NO_ARG, NO_ARG, false},
+#endif
+#ifdef __NR_link
+    {SC(link), NO_ARG, 0, NO_ARG, 1, NO_ARG, false},
+#endif
+    {SC(linkat), 0, 1, 2, 3, NO_ARG, false},
+#ifdef __NR_symlink
+    {SC(symlink), NO_ARG, NO_ARG, NO_ARG, 1, NO_ARG, false},
+#endif
+    {SC(symlinkat), NO_ARG, NO_ARG, 1, 2, NO_ARG, false},
+#ifdef __NR_mknod
+    {SC(mknod), NO_ARG, 0, NO_ARG, NO_ARG, NO_ARG, false},
+#endif
+    {SC(mknodat), 0, 1, NO_ARG, NO_ARG, NO_ARG, false},
+};
+
+#define TRAPPED_COUNT ((int)(sizeof(trapped_syscalls) / sizeof(trapped_syscalls[0])))
+
+// Syscalls that fail with ENOSYS because their writes cannot be checked.
+// openat2 passes flags in a struct the filter cannot inspect; libc falls
+// back to openat. io_uring runs opens, renames, unlinks and mkdirs in the
+// kernel, where they never reach the supervisor; programs using it fall
+// back to plain syscalls.
+static const int denied_syscalls[] = {
+    __NR_openat2,
+#ifdef __NR_io_uring_setup
+    __NR_io_uring_setup,
+    __NR_io_uring_enter,
+    __NR_io_uring_register,
+#endif
+};
+
+#define DENIED_COUNT ((int)(sizeof(denied_syscalls) / sizeof(denied_syscalls[0])))
+
+typedef enum {
+    DECISION_NONE = 0,
+    DECISION_ALLOW,     // directory lies within a writable path
+    DECISION_DENY,      // no writable path at or below this directory
+    DECISION_PARTIAL    // individual writable entries live in this directory
+} Decision;
+
+// Direct-mapped by (dev, inode). A directory moved by an unsandboxed
+// process keeps its cached decision until evicted.
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    Decision decision;
+} CacheEntry;
+
+// Supervisor state; only ever touched in the parent process
+static PathList* policy_paths;
+// Grants extend policy_paths while the workers read it
+static pthread_rwlock_t policy_lock = PTHREAD_RWLOCK_INITIALIZER;
+// Bumped with cache_lock held by every grant, so a decision made before
+// it is not cached after the cache was cleared
+static unsigned policy_generation;
+// Listening socket for grants, or -1
+static int grant_fd = -1;
+// The glob patterns among policy_paths, or NULL if there are none
+static PatternSet* policy_patterns;
+static int listener_fd = -1;
+static struct seccomp_notif_sizes notif_sizes;
+static CacheEntry decision_cache[DECISION_CACHE_SIZE];
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pid_t sandboxed_child = -1;
+// Set by a termination signal once the child itself has exited, to stop
+// waiting for what it left behind
+static volatile sig_atomic_t stop_waiting;
+// Set in audit mode: denials are logged here and the call is allowed
+static AuditLog* audit_log;
+// In audit mode the supervisor is the subreaper of the command, so the log
+// stays open until the processes it leaves running have exited too
+static bool reaping_descendants;
+
+static bool seccomp_probe(void) {
+    __u32 action = SECCOMP_RET_USER_NOTIF;
+    if (syscall(SYS_seccomp, SECCOMP_GET_ACTION_AVAIL, 0, &action) != 0) {
+        return false;
+    }
+    return syscall(SYS_seccomp, SECCOMP_GET_NOTIF_SIZES, 0, &notif_sizes) == 0;
+}
+
+static size_t arg_offset(int arg) {
+    size_t offset = offsetof(struct seccomp_data, args) + (size_t)arg * sizeof(__u64);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    offset += sizeof(__u32);
+#endif
+    return offset;
+}
+
+static bool install_filter(int* out_listener) {
+    struct sock_filter filter[7 + DENIED_COUNT * 2 + TRAPPED_COUNT * 5];
+    int n = 0;
+
+    filter[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+                                               offsetof(struct seccomp_data, arch));
+    filter[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+                                               SECCOMP_AUDIT_ARCH, 1, 0);
+    filter[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K,
+                                               SECCOMP_RET_ERRNO | ENOSYS);
+    filter[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+                                               offsetof(struct seccomp_data, nr));
+#ifdef __x86_64__
+    // x32 syscalls share the arch value but set this bit
+    filter[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K,
+                                               0x40000000, 0, 1);
+    filter[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K,
+                                               SECCOMP_RET_ERRNO | ENOSYS);
+#endif
+    for (int i = 0; i < DENIED_COUNT; i++) {
+        filter[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+                                                   denied_syscalls[i], 0, 1);
+        filter[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K,
+                                                   SECCOMP_RET_ERRNO | ENOSYS);
+    }
+
+    for (int i = 0; i < TRAPPED_COUNT; i++) {
+        const TrappedSyscall* sc = &trapped_syscalls[i];
+        if (sc->flags_arg == NO_ARG) {
+            filter[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+                                                       sc->nr, 0, 1);
+            filter[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K,
+                                                       SECCOMP_RET_USER_NOTIF);
+        } else {
+            // Read-only opens are allowed without leaving the kernel
+            filter[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+                                                       sc->nr, 0, 4);
+            filter[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+                                                       arg_offset(sc->flags_arg));
+            filter[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K,
+                                                       OPEN_WRITE_FLAGS, 0, 1);
+            filter[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K,
+                                                       SECCOMP_RET_USER_NOTIF);
+            filter[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K,
+                                                       SECCOMP_RET_ALLOW);
+        }
+    }
+
+    filter[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+
+    struct sock_fprog prog = {
+        .len = (unsigned short)n,
+        .filter = filter,
+    };
+
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0) {
+        fprintf(stderr, "Error: Failed to set no_new_privs: %s\n", strerror(errno));
+        return false;
+    }
+
+    int fd = (int)syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER,
+                          SECCOMP_FILTER_FLAG_NEW_LISTENER, &prog);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Failed to install seccomp filter: %s\n", strerror(errno));
+        return false;
+    }
+
+    *out_listener = fd;
+    return true;
+}
+
+static bool send_fd(int sock, int fd) {
+    char byte = 0;
+    struct iovec iov = { .iov_base = &byte, .iov_len = 1 };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    return sendmsg(sock, &msg, 0) == 1;
+}
+
+static int recv_fd(int sock) {
+    char byte;
+    struct iovec iov = { .iov_base = &byte, .iov_len = 1 };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+
+    if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1) {
+        return -1;
+    }
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS) {
+        return -1;
+    }
+
+    int fd;
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    return fd;
+}
+
+// Copy a NUL-terminated string out of the target's memory, one page-bounded
+// chunk at a time so a string near the end of a mapping can still be read
+static bool read_remote_string(pid_t pid, __u64 addr, char* buf, size_t size) {
+    size_t done = 0;
+    long page_size = sysconf(_SC_PAGESIZE);
+
+    while (done < size) {
+        __u64 current = addr + done;
+        size_t chunk = (size_t)(page_size - (long)(current % (__u64)page_size));
+        if (chunk > size - done) {
+            chunk = size - done;
+        }
+
+        struct iovec local = { .iov_base = buf + done, .iov_len = chunk };
+        struct iovec remote = { .iov_base = (void*)(uintptr_t)current, .iov_len = chunk };
+        ssize_t n = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+        if (n <= 0) {
+            return false;
+        }
+
+        if (memchr(buf + done, '\0', (size_t)n)) {
+            return true;
+        }
+        done += (size_t)n;
+    }
+
+    return false;
+}
+
+// Build a path the supervisor can resolve in the target's context
+static bool target_path(pid_t pid, int dirfd, const char* path, char* out, size_t size) {
+    int written;
+    if (path[0] == '/') {
+        written = snprintf(out, size, "/proc/%d/root%s", pid, path);
+    } else if (dirfd == AT_FDCWD) {
+        written = snprintf(out, size, "/proc/%d/cwd/%s", pid, path);
+    } else {
+        written = snprintf(out, size, "/proc/%d/fd/%d/%s", pid, dirfd, path);
+    }
+    return written > 0 && (size_t)written < size;
+}
+
+// Decide from a canonical directory path, scanning the policy
+static Decision decide_directory(const char* dir) {
+    Decision decision = DECISION_DENY;
+
+    pthread_rwlock_rdlock(&policy_lock);
+    for (int i = 0; decision != DECISION_ALLOW && i < policy_paths->count; i++) {
+        const char* root = policy_paths->paths[i];
+        if (pattern_is_glob(root)) {
+            continue;
+        }
+        if (path_is_within(dir, root)) {
+            decision = DECISION_ALLOW;
+            continue;
+        }
+
+        // A writable entry directly inside this directory
+        const char* slash = strrchr(root, '/');
+        size_t dir_len = strlen(dir);
+        if (slash && (size_t)(slash - root) == dir_len && strncmp(root, dir, dir_len) == 0) {
+            decision = DECISION_PARTIAL;
+        }
+        if (slash == root && dir_len == 1) {
+            decision = DECISION_PARTIAL;
+        }
+    }
+    pthread_rwlock_unlock(&policy_lock);
+    if (decision == DECISION_ALLOW) {
+        return decision;
+    }
+
+    // Entries below a directory that could still match a pattern are
+    // checked one by one, like literal entries inside it
+    PatternMatch match = pattern_set_match(policy_patterns, dir);
+    if (match == PATTERN_MATCH) {
+        return DECISION_ALLOW;
+    }
+    if (match == PATTERN_PREFIX) {
+        decision = DECISION_PARTIAL;
+    }
+
+    return decision;
+}
+
+static bool canonical_fd_path(int fd, char* out, size_t size) {
+    char link[64];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+    ssize_t len = readlink(link, out, size - 1);
+    if (len < 0) {
+        return false;
+    }
+    out[len] = '\0';
+    return true;
+}
+
+static bool is_path_writable(const char* canonical) {
+    bool writable = false;
+    pthread_rwlock_rdlock(&policy_lock);
+    for (int i = 0; !writable && i < policy_paths->count; i++) {
+        writable = !pattern_is_glob(policy_paths->paths[i]) &&
+                   path_is_within(canonical, policy_paths->paths[i]);
+    }
+    pthread_rwlock_unlock(&policy_lock);
+    return writable || pattern_set_match(policy_patterns, canonical) == PATTERN_MATCH;
+}
+
+#define MAX_SYMLINK_HOPS 8
+
+// Deny a write by policy, noting which path it was for. The supervisor
+// passes a PATH_MAX buffer in audit mode and NULL otherwise; a path that
+// could not be resolved is left empty.
+static int deny(char* denied, const char* path) {
+    if (denied) {
+        snprintf(denied, PATH_MAX, "%s", path);
+    }
+    return POLICY_DENIED;
+}
+
+static int check_full_path(pid_t pid, char* full, bool follow_final, int hops, char* denied);
+
+// Judge a symlink the kernel is about to follow by where it points
+static int check_symlink_target(pid_t pid, const char* full, int hops, char* denied) {
+    int fd = open(full, O_PATH | O_CLOEXEC);
+    if (fd >= 0) {
+        char resolved[PATH_MAX];
+        bool ok = canonical_fd_path(fd, resolved, sizeof(resolved));
+        close(fd);
+        if (!ok) {
+            return deny(denied, "");
+        }
+        return is_path_writable(resolved) ? 0 : deny(denied, resolved);
+    }
+
+    // Dangling link: the kernel will create its target, so check that
+    if (errno != ENOENT || hops >= MAX_SYMLINK_HOPS) {
+        return deny(denied, "");
+    }
+
+    char target[PATH_MAX];
+    ssize_t len = readlink(full, target, sizeof(target) - 1);
+    if (len < 0) {
+        return deny(denied, "");
+    }
+    target[len] = '\0';
+
+    char next[PATH_MAX];
+    int written;
+    if (target[0] == '/') {
+        written = snprintf(next, sizeof(next), "/proc/%d/root%s", pid, target);
+    } else {
+        const char* slash = strrchr(full, '/');
+        written = snprintf(next, sizeof(next), "%.*s/%s",
+                           (int)(slash - full), full, target);
+    }
+    if (written < 0 || (size_t)written >= sizeof(next)) {
+        return ENAMETOOLONG;
+    }
+
+    return check_full_path(pid, next, true, hops + 1, denied);
+}
+
+// Check one path argument. Returns 0 to allow, POLICY_DENIED or a
+// positive errno.
+static int check_path(pid_t pid, int dirfd, const char* path, bool follow_final,
+                      char* denied) {
+    char full[PATH_MAX];
+    if (!target_path(pid, dirfd, path, full, sizeof(full))) {
+        return ENAMETOOLONG;
+    }
+    return check_full_path(pid, full, follow_final, 0, denied);
+}
+
+static int check_full_path(pid_t pid, char* full, bool follow_final, int hops, char* denied) {
+    struct stat st;
+    if (follow_final && stat(full, &st) == 0 && S_ISCHR(st.st_mode)) {
+        // Device nodes such as /dev/null and terminals stay writable;
+        // their permissions are enforced by the kernel as usual
+        return 0;
+    }
+    if (follow_final && lstat(full, &st) == 0 && S_ISLNK(st.st_mode)) {
+        return check_symlink_target(pid, full, hops, denied);
+    }
+
+    // Split off the final component
+    size_t len = strlen(full);
+    while (len > 1 && full[len - 1] == '/') {
+        full[--len] = '\0';
+    }
+    char* slash = strrchr(full, '/');
+    const char* name = slash + 1;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        name = "";
+    } else {
+        *slash = '\0';
+    }
+
+    int fd = open(full, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        // The syscall would fail the same way; answering now avoids
+        // resuming it after the tree changed underneath us
+        return errno;
+    }
+
+    if (fstat(fd, &st) != 0) {
+        int err = errno;
+        close(fd);
+        return err;
+    }
+
+    size_t slot = ((size_t)st.st_dev * 31u + (size_t)st.st_ino) % DECISION_CACHE_SIZE;
+
+    pthread_mutex_lock(&cache_lock);
+    CacheEntry cached = decision_cache[slot];
+    unsigned generation = policy_generation;
+    pthread_mutex_unlock(&cache_lock);
+
+    Decision decision = DECISION_NONE;
+    if (cached.decision != DECISION_NONE && cached.dev == st.st_dev && cached.ino == st.st_ino) {
+        decision = cached.decision;
+    }
+
+    // Audit mode logs the path of every denial, so it resolves cached
+    // denials too
+    char dir[PATH_MAX] = "";
+    if (decision == DECISION_NONE || decision == DECISION_PARTIAL ||
+        (denied && decision == DECISION_DENY)) {
+        if (!canonical_fd_path(fd, dir, sizeof(dir))) {
+            close(fd);
+            return deny(denied, "");
+        }
+    }
+    close(fd);
+
+    if (decision == DECISION_NONE) {
+        decision = decide_directory(dir);
+        pthread_mutex_lock(&cache_lock);
+        if (generation == policy_generation) {
+            decision_cache[slot] = (CacheEntry){ st.st_dev, st.st_ino, decision };
+        }
+        pthread_mutex_unlock(&cache_lock);
+    }
+
+    if (decision == DECISION_ALLOW) {
+        return 0;
+    }
+
+    char entry[PATH_MAX];
+    int written = *name ? snprintf(entry, sizeof(entry), "%s/%s",
+                                   strcmp(dir, "/") == 0 ? "" : dir, name)
+                        : snprintf(entry, sizeof(entry), "%s", dir);
+    bool fits = written > 0 && (size_t)written < sizeof(entry);
+    if (decision == DECISION_PARTIAL && *name && fits && is_path_writable(entry)) {
+        return 0;
+    }
+
+    return deny(denied, fits ? entry : dir);
+}
+
+static const TrappedSyscall* find_trapped(int nr) {
+    for (int i = 0; i < TRAPPED_COUNT; i++) {
+        if (trapped_syscalls[i].nr == nr) {
+            return &trapped_syscalls[i];
+        }
+    }
+    return NULL;
+}
+
+static int dirfd_of(const struct seccomp_data* data, int arg) {
+    return arg == NO_ARG ? AT_FDCWD : (int)data->args[arg];
+}
+
+// Answer a policy denial: EACCES, or in audit mode allow the call and log
+// it. denied is the resolved path, or empty to log the argument as the
+// target passed it.
+static int audited(const struct seccomp_notif* req, const TrappedSyscall* sc, int err,
+                   const char* denied, const char* argument) {
+    if (err != POLICY_DENIED) {
+        return err;
+    }
+    if (!audit_log) {
+        return DENY_ERRNO;
+    }
+    audit_log_record(audit_log, (pid_t)req->pid, sc->name, denied[0] ? denied : argument);
+    return 0;
+}
+
+static int handle_notification(const struct seccomp_notif* req) {
+    const TrappedSyscall* sc = find_trapped(req->data.nr);
+    if (!sc) {
+        return DENY_ERRNO;
+    }
+
+    bool follow = sc->follow_final;
+    if (sc->flags_arg != NO_ARG) {
+        int flags = (int)req->data.args[sc->flags_arg];
+        if ((flags & O_NOFOLLOW) || ((flags & O_CREAT) && (flags & O_EXCL))) {
+            follow = false;
+        }
+    }
+
+    char path[PATH_MAX];
+    char path2[PATH_MAX];
+    bool has_path = sc->path_arg != NO_ARG;
+    bool has_path2 = sc->path2_arg != NO_ARG;
+
+    if (has_path && !read_remote_string(req->pid, req->data.args[sc->path_arg],
+                                        path, sizeof(path))) {
+        return EFAULT;
+    }
+    if (has_path2 && !read_remote_string(req->pid, req->data.args[sc->path2_arg],
+                                         path2, sizeof(path2))) {
+        return EFAULT;
+    }
+
+    // linkat(fd, "", ..., AT_EMPTY_PATH) links an already open file
+    if (has_path && path[0] == '\0') {
+        has_path = false;
+    }
+
+    // The pid may have been recycled while we were reading its memory
+    __u64 id = req->id;
+    if (ioctl(listener_fd, SECCOMP_IOCTL_NOTIF_ID_VALID, &id) != 0) {
+        return -1;
+    }
+
+    int err = 0;
+    char denied[PATH_MAX] = "";
+    if (has_path) {
+        err = check_path((pid_t)req->pid, dirfd_of(&req->data, sc->dirfd_arg), path, follow,
+                         audit_log ? denied : NULL);
+        err = audited(req, sc, err, denied, path);
+        denied[0] = '\0';
+    }
+    if (err == 0 && has_path2) {
+        err = check_path((pid_t)req->pid, dirfd_of(&req->data, sc->dirfd2_arg), path2, false,
+                         audit_log ? denied : NULL);
+        err = audited(req, sc, err, denied, path2);
+    }
+    return err;
+}
+
+static void* supervisor_thread(void* arg) {
+    (void)arg;
+
+    struct seccomp_notif* req = malloc(notif_sizes.seccomp_notif);
+    struct seccomp_notif_resp* resp = malloc(notif_sizes.seccomp_notif_resp);
+    if (!req || !resp) {
+        free(req);
+        free(resp);
+        return NULL;
+    }
+
+    for (;;) {
+        memset(req, 0, notif_sizes.seccomp_notif);
+        if (ioctl(listener_fd, SECCOMP_IOCTL_NOTIF_RECV, req) != 0) {
+            if (errno == EINTR || errno == ENOENT) {
+                continue;
+            }
+            break;
+        }
+
+        int err = handle_notification(req);
+        if (err < 0) {
+            continue;  // target is gone
+        }
+
+        memset(resp, 0, notif_sizes.seccomp_notif_resp);
+        resp->id = req->id;
+        if (err == 0) {
+            resp->flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+        } else {
+            resp->error = -err;
+        }
+
+        // ENOENT here means the target died meanwhile
+        ioctl(listener_fd, SECCOMP_IOCTL_NOTIF_SEND, resp);
+    }
+
+    free(req);
+    free(resp);
+    return NULL;
+}
+
+static void forward_signal(int sig) {
+    if (sandboxed_child > 0) {
+        kill(sandboxed_child, sig);
+    } else {
+        stop_waiting = 1;
+    }
+}
+
+// Close everything but stdio and the fds in keep (the listener, the audit
+// log and the grant socket; -1 entries are skipped), so pipes the
+// supervisor inherited (a pipeline, an embedder's status pipe) close with
+// the command
+static void close_inherited_fds(int keep[], int count) {
+    // Sorted, so the gaps between them can be closed as ranges
+    for (int i = 1; i < count; i++) {
+        for (int j = i; j > 0 && keep[j] < keep[j - 1]; j--) {
+            int swap = keep[j];
+            keep[j] = keep[j - 1];
+            keep[j - 1] = swap;
+        }
+    }
+#ifdef SYS_close_range
+    bool closed = true;
+    int next = STDERR_FILENO + 1;
+    for (int i = 0; closed && i < count; i++) {
+        if (keep[i] < next) {
+            continue;
+        }
+        closed = keep[i] == next || syscall(SYS_close_range, next, keep[i] - 1, 0) == 0;
+        next = keep[i] + 1;
+    }
+    if (closed && syscall(SYS_close_range, next, ~0u, 0) == 0) {
+        return;
+    }
+#endif
+    long max_fd = sysconf(_SC_OPEN_MAX);
+    for (int fd = STDERR_FILENO + 1; fd < max_fd; fd++) {
+        bool kept = false;
+        for (int i = 0; !kept && i < count; i++) {
+            kept = keep[i] == fd;
+        }
+        if (!kept) {
+            close(fd);
+        }
+    }
+}
+
+// Check that the other end of sock is a process of this user outside the
+// sandbox
+static bool peer_outside_sandbox(int sock) {
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0 || cred.uid != getuid()) {
+        return false;
+    }
+
+    // Pin the peer, so its pid cannot be taken over by another process
+    // before the check is done; kernels before 6.5 lack SO_PEERPIDFD and
+    // it is opened by pid instead
+    int pidfd = -1;
+    len = sizeof(pidfd);
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERPIDFD, &pidfd, &len) != 0) {
+        pidfd = (int)syscall(SYS_pidfd_open, cred.pid, 0);
+    }
+    if (pidfd < 0) {
+        return false;
+    }
+    bool outside = !process_has_no_new_privs(cred.pid) &&
+                   syscall(SYS_pidfd_send_signal, pidfd, 0, NULL, 0) == 0;
+    close(pidfd);
+    return outside;
+}
+
+// Add the path requested on client to the policy. Returns NULL on
+// success, or why the grant was refused.
+static const char* apply_grant(int client) {
+    // One absolute path, ended by a newline. Read before the peer is
+    // checked, so a refused client still gets to see the reply.
+    char request[PATH_MAX];
+    size_t len = 0;
+    while (len < sizeof(request) - 1 && !memchr(request, '\n', len)) {
+        ssize_t n = recv(client, request + len, sizeof(request) - 1 - len, 0);
+        if (n <= 0) {
+            break;
+        }
+        len += (size_t)n;
+    }
+    request[len] = '\0';
+    char* end = strchr(request, '\n');
+    if (!end) {
+        return "malformed request";
+    }
+    *end = '\0';
+    if (!peer_outside_sandbox(client)) {
+        return "grants must come from outside the sandbox";
+    }
+    if (request[0] != '/' || pattern_is_glob(request) || strpbrk(request, "\"\r")) {
+        return "not an absolute path";
+    }
+
+    char* resolved = realpath(request, NULL);
+    if (!resolved) {
+        return strerror(errno);
+    }
+    pthread_rwlock_wrlock(&policy_lock);
+    bool added = pathlist_contains(policy_paths, resolved) ||
+                 pathlist_add(policy_paths, resolved);
+    pthread_rwlock_unlock(&policy_lock);
+    free(resolved);
+    if (!added) {
+        return "out of memory";
+    }
+
+    // Allows stay true; denials and partial decisions may not
+    pthread_mutex_lock(&cache_lock);
+    memset(decision_cache, 0, sizeof(decision_cache));
+    policy_generation++;
+    pthread_mutex_unlock(&cache_lock);
+    return NULL;
+}
+
+// One request per connection, answered with "ok" or "error: REASON"
+static void* grant_thread(void* arg) {
+    (void)arg;
+
+    for (;;) {
+        int client = accept4(grant_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+
+        // A client that stalls must not hold up the next grant
+        struct timeval timeout = { 1, 0 };
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        const char* error = apply_grant(client);
+        char reply[256];
+        if (error) {
+            snprintf(reply, sizeof(reply), "error: %s\n", error);
+        } else {
+            snprintf(reply, sizeof(reply), "ok\n");
+        }
+        (void)!send(client, reply, strlen(reply), MSG_NOSIGNAL);
+        close(client);
+    }
+    return NULL;
+}
+
+// Runs in the parent for the lifetime of the sandboxed child; never returns
+static void run_supervisor(pid_t child, int listener, const PathList* writable_paths) {
+    int keep[] = { listener, audit_log_fd(audit_log), grant_fd };
+    close_inherited_fds(keep, (int)(sizeof(keep) / sizeof(keep[0])));
+
+    sandboxed_child = child;
+    listener_fd = listener;
+    // A copy of our own, which grants add to
+    policy_paths = pathlist_create();
+    for (int i = 0; policy_paths && i < writable_paths->count; i++) {
+        if (!pathlist_add(policy_paths, writable_paths->paths[i])) {
+            pathlist_free(policy_paths);
+            policy_paths = NULL;
+        }
+    }
+    policy_patterns = pattern_set_compile(writable_paths);
+    if (!policy_paths || !policy_patterns) {
+        fprintf(stderr, "Error: Failed to set up the write policy\n");
+        kill(child, SIGKILL);
+        _exit(1);
+    }
+
+    // Keep sandboxed processes from attaching to the supervisor
+    prctl(PR_SET_DUMPABLE, 0, 0, 0, 0);
+
+    // Terminal signals reach the child through the process group already
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+    // Not restarted, so a signal can end the wait for leftover processes
+    struct sigaction forward = { .sa_handler = forward_signal };
+    sigemptyset(&forward.sa_mask);
+    sigaction(SIGTERM, &forward, NULL);
+    sigaction(SIGHUP, &forward, NULL);
+
+    // Recording blocks once the ring is full, so there must be a drainer
+    if (audit_log && !audit_log_start(audit_log)) {
+        fprintf(stderr, "Error: Failed to start audit log writer\n");
+        kill(child, SIGKILL);
+        _exit(1);
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cpus < 2 ? 2 : (cpus > MAX_SUPERVISOR_THREADS ? MAX_SUPERVISOR_THREADS : (int)cpus);
+    for (int i = 0; i < threads; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, supervisor_thread, NULL) == 0) {
+            pthread_detach(thread);
+        }
+    }
+
+    pthread_t grants;
+    if (grant_fd >= 0 && pthread_create(&grants, NULL, grant_thread, NULL) == 0) {
+        pthread_detach(grants);
+    } else if (grant_fd >= 0) {
+        fprintf(stderr, "Warning: Failed to start accepting grants\n");
+    }
+
+    // Exit with the child's status, but as a subreaper only once
+    // everything it left running is gone, as their writes are logged too
+    int status = 0;
+    bool child_exited = false;
+    for (;;) {
+        int child_status;
+        pid_t done = waitpid(reaping_descendants ? -1 : child, &child_status, 0);
+        if (done == child) {
+            status = child_status;
+            child_exited = true;
+            sandboxed_child = -1;
+            if (!reaping_descendants) {
+                break;
+            }
+        } else if (done < 0 && errno == EINTR) {
+            if (child_exited && stop_waiting) {
+                break;
+            }
+        } else if (done < 0) {
+            break;
+        }
+    }
+    if (!child_exited) {
+        _exit(1);
+    }
+    audit_log_close(audit_log);
+
+    if (WIFSIGNALED(status)) {
+        _exit(128 + WTERMSIG(status));
+    }
+    _exit(WEXITSTATUS(status));
+}
+
+static bool seccomp_apply(const PathList* writable_paths) {
+    if (!writable_paths || !seccomp_probe()) {
+        return false;
+    }
+
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) != 0) {
+        fprintf(stderr, "Error: Failed to create socket pair: %s\n", strerror(errno));
+        return false;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+
+    // Before the fork, so nothing the child starts can be orphaned before
+    // it; the child does not inherit it
+    reaping_descendants = audit_log && prctl(PR_SET_CHILD_SUBREAPER, 1, 0, 0, 0) == 0;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Error: Failed to fork: %s\n", strerror(errno));
+        close(sockets[0]);
+        close(sockets[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        // Child: install the filter and hand the listener to the parent.
+        // apply() returns here, in the process that goes on to exec.
+        close(sockets[0]);
+        if (grant_fd >= 0) {
+            close(grant_fd);
+            grant_fd = -1;
+        }
+        int listener;
+        if (!install_filter(&listener)) {
+            _exit(1);
+        }
+        bool sent = send_fd(sockets[1], listener);
+        close(listener);
+        close(sockets[1]);
+        if (!sent) {
+            fprintf(stderr, "Error: Failed to hand off seccomp listener\n");
+            _exit(1);
+        }
+        return true;
+    }
+
+    close(sockets[1]);
+    int listener = recv_fd(sockets[0]);
+    close(sockets[0]);
+    if (listener < 0) {
+        // Child already reported why
+        int status;
+        waitpid(pid, &status, 0);
+        _exit(1);
+    }
+
+    run_supervisor(pid, listener, writable_paths);
+    return false;
+}
+
+bool sandbox_seccomp_accept_grants(const char* socket_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (!socket_path || strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: Grant socket path is too long\n");
+        return false;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    // Left behind by a sandbox with the same id that was killed
+    unlink(socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    mode_t old_umask = umask(0177);
+    bool listening = fd >= 0 && bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0 &&
+                     listen(fd, 8) == 0;
+    umask(old_umask);
+    if (!listening) {
+        fprintf(stderr, "Error: Failed to listen on %s: %s\n", socket_path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    grant_fd = fd;
+    return true;
+}
+
+bool sandbox_apply_seccomp_audit(const PathList* writable_paths, const char* log_path) {
+    if (!seccomp_probe()) {
+        fprintf(stderr, "Error: Audit mode needs seccomp user notifications (Linux 5.5+)\n");
+        return false;
+    }
+    audit_log = audit_log_open(log_path);
+    return audit_log && seccomp_apply(writable_paths);
+}
+
+const SandboxBackend sandbox_backend_seccomp = {
+    .name = "seccomp",
+    .probe = seccomp_probe,
+    .apply = seccomp_apply,
+    .matches_patterns = true,
+};
@@ -0,0 +1,634 @@
+/*
+ * Snapshots of the writable paths, taken just before the command runs.
+ *
+ * Regular files are cloned where the filesystem supports reflinks (FICLONE
+ * on Linux, clonefile() on macOS) and copied elsewhere, so without
+ * reflinks a snapshot costs a full copy of the writable paths. Hard links
+ * would be cheaper, but a link shares its inode with the original, so any
+ * write in place (>>, truncate, O_RDWR) would change the snapshot too, and
+ * no backend can break the link before such a write.
+ *
+ * Snapshots live in $XDG_STATE_HOME/sandbash/snapshots/<id>:
+ *   manifest  a line per root, then a line per entry below it, parents
+ *             first: type, method, mode, size, mtime, ctime, inode, root
+ *             index and path relative to the root ("." for the root)
+ *   data/N/   the saved tree of root N
+ *
+ * Rollback walks the current tree, compares each entry's inode, size,
+ * mode and times with the manifest and only touches what differs, so it
+ * costs a stat per entry plus the changed files. Each root stays on its
+ * own filesystem; mount points below it are left alone.
+ */
+
+#include "snapshot.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __APPLE__
+#include <sys/clonefile.h>
+#endif
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+typedef struct {
+    // 'd', 'f' or 'l'
+    char type;
+    // How a file was saved: 'c' cloned or 'p' copied; '-' for others
+    char method;
+    mode_t mode;
+    long long size;
+    struct timespec mtime;
+    struct timespec ctime;
+    unsigned long long ino;
+    int root;
+    bool seen;
+} Entry;
+
+typedef struct {
+    char dir[PATH_MAX / 2];
+    PathList* roots;
+    // Absolute path of every entry; entries[i] describes paths->paths[i]
+    PathList* paths;
+    Entry* entries;
+    int entry_capacity;
+    // The snapshot store is never saved or rolled back
+    dev_t store_dev;
+    ino_t store_ino;
+    // While saving
+    FILE* manifest;
+    bool clone_unsupported;
+    int saved[2];
+    int skipped;
+    // While rolling back
+    int changed;
+} Snapshot;
+
+enum { SAVED_CLONE, SAVED_COPY };
+
+static void make_dirs(const char* path) {
+    char buffer[PATH_MAX];
+    snprintf(buffer, sizeof(buffer), "%s", path);
+
+    for (char* p = buffer + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(buffer, 0700);
+            *p = '/';
+        }
+    }
+    mkdir(buffer, 0700);
+}
+
+static bool join_path(char out[PATH_MAX], const char* dir, const char* rel) {
+    int len = rel && *rel && strcmp(rel, ".") != 0 ? snprintf(out, PATH_MAX, "%s/%s", dir, rel)
+                                                   : snprintf(out, PATH_MAX, "%s", dir);
+    return len >= 0 && len < PATH_MAX;
+}
+
+static bool same_time(struct timespec a, struct timespec b) {
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+// Open the snapshot directory for id, which must not exist yet if create
+static bool snapshot_open(Snapshot* snapshot, const char* id, bool create) {
+    memset(snapshot, 0, sizeof(*snapshot));
+
+    if (!is_valid_session_id(id)) {
+        fprintf(stderr, "Error: Invalid snapshot id: %s\n", id ? id : "");
+        return false;
+    }
+
+    char* state_dir = get_xdg_state_dir();
+    if (!state_dir) {
+        fprintf(stderr, "Error: Failed to determine state directory\n");
+        return false;
+    }
+    char store[PATH_MAX];
+    snprintf(store, sizeof(store), "%s/sandbash/snapshots", state_dir);
+    free(state_dir);
+    make_dirs(store);
+
+    struct stat st;
+    int len = snprintf(snapshot->dir, sizeof(snapshot->dir), "%s/%s", store, id);
+    if (stat(store, &st) != 0 || len < 0 || (size_t)len >= sizeof(snapshot->dir)) {
+        fprintf(stderr, "Error: Failed to open snapshot store %s\n", store);
+        return false;
+    }
+    snapshot->store_dev = st.st_dev;
+    snapshot->store_ino = st.st_ino;
+
+    if (create && mkdir(snapshot->dir, 0700) != 0) {
+        fprintf(stderr, "Error: Failed to create snapshot %s: %s\n", id,
+                errno == EEXIST ? "already exists" : strerror(errno));
+        return false;
+    }
+
+    snapshot->roots = pathlist_create();
+    snapshot->paths = pathlist_create();
+    return snapshot->roots && snapshot->paths;
+}
+
+static void snapshot_close(Snapshot* snapshot) {
+    pathlist_free(snapshot->roots);
+    pathlist_free(snapshot->paths);
+    free(snapshot->entries);
+}
+
+static bool is_store(const Snapshot* snapshot, const struct stat* st) {
+    return st->st_dev == snapshot->store_dev && st->st_ino == snapshot->store_ino;
+}
+
+// Reflink source to a new file at dest, keeping mode and times
+static bool clone_file(const char* source, const char* dest) {
+#if defined(__APPLE__)
+    return clonefile(source, dest, CLONE_NOFOLLOW) == 0;
+#elif defined(FICLONE)
+    int in = open(source, O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        return false;
+    }
+    struct stat st;
+    int out = fstat(in, &st) == 0 ? open(dest, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600)
+                                  : -1;
+    bool ok = out >= 0 && ioctl(out, FICLONE, in) == 0;
+    if (ok) {
+        struct timespec times[2] = { STAT_ATIME(st), STAT_MTIME(st) };
+        ok = fchmod(out, st.st_mode & 07777) == 0 && futimens(out, times) == 0;
+    }
+
+    int saved = errno;
+    close(in);
+    if (out >= 0) {
+        close(out);
+        if (!ok) {
+            unlink(dest);
+        }
+    }
+    errno = saved;
+    return ok;
+#else
+    (void)source;
+    (void)dest;
+    errno = ENOTSUP;
+    return false;
+#endif
+}
+
+// Save one regular file; returns its method, or 0 if it could not be saved
+static char save_file(Snapshot* snapshot, const char* path, const char* data) {
+    if (!snapshot->clone_unsupported) {
+        if (clone_file(path, data)) {
+            snapshot->saved[SAVED_CLONE]++;
+            return 'c';
+        }
+        // Other errors (EXDEV, EACCES) are about this file, not the
+        // filesystem
+        if (errno == EOPNOTSUPP || errno == ENOTSUP || errno == EINVAL || errno == ENOTTY) {
+            snapshot->clone_unsupported = true;
+        }
+    }
+
+    if (copy_file_atomic(path, data)) {
+        snapshot->saved[SAVED_COPY]++;
+        return 'p';
+    }
+    return 0;
+}
+
+static void write_entry(Snapshot* snapshot, char type, char method, const struct stat* st,
+                        int root, const char* rel) {
+    fprintf(snapshot->manifest, "%c\t%c\t%o\t%lld\t%lld\t%ld\t%lld\t%ld\t%llu\t%d\t%s\n",
+            type, method, (unsigned)(st->st_mode & 07777), (long long)st->st_size,
+            (long long)STAT_MTIME(*st).tv_sec, (long)STAT_MTIME(*st).tv_nsec,
+            (long long)STAT_CTIME(*st).tv_sec, (long)STAT_CTIME(*st).tv_nsec,
+            (unsigned long long)st->st_ino, root, rel);
+}
+
+static void save_tree(Snapshot* snapshot, int root, dev_t root_dev, const char* path,
+                      const char* rel) {
+    struct stat st;
+    if (lstat(path, &st) != 0 || is_store(snapshot, &st) ||
+        (S_ISDIR(st.st_mode) && st.st_dev != root_dev)) {
+        return;
+    }
+    // The manifest is line and tab separated
+    if (strpbrk(rel, "\t\n")) {
+        fprintf(stderr, "Warning: Not saving %s: name contains a tab or newline\n", path);
+        snapshot->skipped++;
+        return;
+    }
+
+    char data_root[PATH_MAX];
+    char data[PATH_MAX];
+    snprintf(data_root, sizeof(data_root), "%s/data/%d", snapshot->dir, root);
+    if (!join_path(data, data_root, rel)) {
+        snapshot->skipped++;
+        return;
+    }
+
+    if (S_ISREG(st.st_mode)) {
+        char method = save_file(snapshot, path, data);
+        if (!method) {
+            fprintf(stderr, "Warning: Not saving %s: %s\n", path, strerror(errno));
+            snapshot->skipped++;
+            return;
+        }
+        write_entry(snapshot, 'f', method, &st, root, rel);
+        return;
+    }
+
+    if (S_ISLNK(st.st_mode)) {
+        if (!copy_symlink_atomic(path, data)) {
+            fprintf(stderr, "Warning: Not saving %s: %s\n", path, strerror(errno));
+            snapshot->skipped++;
+            return;
+        }
+        write_entry(snapshot, 'l', '-', &st, root, rel);
+        return;
+    }
+
+    if (!S_ISDIR(st.st_mode)) {
+        // Sockets, FIFOs and devices are not restored
+        return;
+    }
+
+    DIR* dir = opendir(path);
+    if (!dir || mkdir(data, 0700) != 0) {
+        fprintf(stderr, "Warning: Not saving %s: %s\n", path, strerror(errno));
+        snapshot->skipped++;
+        if (dir) {
+            closedir(dir);
+        }
+        return;
+    }
+    write_entry(snapshot, 'd', '-', &st, root, rel);
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        char child_path[PATH_MAX];
+        char child_rel[PATH_MAX];
+        if (!join_path(child_path, path, entry->d_name) ||
+            !(strcmp(rel, ".") == 0 ? join_path(child_rel, entry->d_name, NULL)
+                                    : join_path(child_rel, rel, entry->d_name))) {
+            snapshot->skipped++;
+            continue;
+        }
+        save_tree(snapshot, root, root_dev, child_path, child_rel);
+    }
+    closedir(dir);
+}
+
+bool snapshot_create(const char* id, const PathList* writable_paths) {
+    Snapshot snapshot;
+    if (!writable_paths || !snapshot_open(&snapshot, id, true)) {
+        return false;
+    }
+
+    char data_dir[PATH_MAX];
+    char manifest_path[PATH_MAX];
+    char temp_path[PATH_MAX];
+    snprintf(data_dir, sizeof(data_dir), "%s/data", snapshot.dir);
+    snprintf(manifest_path, sizeof(manifest_path), "%s/manifest", snapshot.dir);
+    snprintf(temp_path, sizeof(temp_path), "%s/manifest.tmp", snapshot.dir);
+    mkdir(data_dir, 0700);
+
+    snapshot.manifest = fopen(temp_path, "w");
+    if (!snapshot.manifest) {
+        fprintf(stderr, "Error: Failed to write snapshot manifest: %s\n", strerror(errno));
+        remove_tree(snapshot.dir);
+        snapshot_close(&snapshot);
+        return false;
+    }
+
+    // Entries refer to roots by their position in the manifest, which
+    // leaves out the writable paths that do not exist
+    int root_count = 0;
+    for (int i = 0; i < writable_paths->count; i++) {
+        const char* root = writable_paths->paths[i];
+        struct stat st;
+        if (lstat(root, &st) != 0) {
+            continue;
+        }
+
+        if (path_is_within(snapshot.dir, root)) {
+            fprintf(stderr, "Warning: Snapshot store is writable inside the sandbox: %s\n",
+                    snapshot.dir);
+        }
+
+        fprintf(snapshot.manifest, "r\t%s\n", root);
+        snapshot.clone_unsupported = false;
+        save_tree(&snapshot, root_count++, st.st_dev, root, ".");
+    }
+
+    bool ok = fclose(snapshot.manifest) == 0 && rename(temp_path, manifest_path) == 0;
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to write snapshot manifest: %s\n", strerror(errno));
+        remove_tree(snapshot.dir);
+    } else {
+        fprintf(stderr, "Snapshot: %s (%d cloned, %d copied",
+                id, snapshot.saved[SAVED_CLONE], snapshot.saved[SAVED_COPY]);
+        if (snapshot.skipped > 0) {
+            fprintf(stderr, ", %d skipped", snapshot.skipped);
+        }
+        fprintf(stderr, ")\n");
+    }
+
+    snapshot_close(&snapshot);
+    return ok;
+}
+
+static bool add_entry(Snapshot* snapshot, const char* path, const Entry* entry) {
+    if (!pathlist_add(snapshot->paths, path)) {
+        return false;
+    }
+    int index = pathlist_find(snapshot->paths, path);
+    if (index >= snapshot->entry_capacity) {
+        int capacity = snapshot->entry_capacity ? snapshot->entry_capacity * 2 : 1024;
+        Entry* grown = realloc(snapshot->entries, sizeof(Entry) * (size_t)capacity);
+        if (!grown) {
+            return false;
+        }
+        snapshot->entries = grown;
+        snapshot->entry_capacity = capacity;
+    }
+    snapshot->entries[index] = *entry;
+    return true;
+}
+
+static bool load_manifest(Snapshot* snapshot) {
+    char manifest_path[PATH_MAX];
+    snprintf(manifest_path, sizeof(manifest_path), "%s/manifest", snapshot->dir);
+    FILE* f = fopen(manifest_path, "r");
+    if (!f) {
+        fprintf(stderr, "Error: No snapshot at %s\n", snapshot->dir);
+        return false;
+    }
+
+    char* line = NULL;
+    size_t line_size = 0;
+    bool ok = true;
+    while (ok && getline(&line, &line_size, f) > 0) {
+        line[strcspn(line, "\n")] = '\0';
+        if (line[0] == 'r' && line[1] == '\t') {
+            ok = pathlist_add(snapshot->roots, line + 2);
+            continue;
+        }
+
+        // The relative path comes after the tenth tab and may contain
+        // anything else
+        char* rel = line;
+        for (int tabs = 0; rel && tabs < 10; tabs++) {
+            rel = strchr(rel, '\t');
+            rel = rel ? rel + 1 : NULL;
+        }
+
+        Entry entry = { 0 };
+        unsigned mode;
+        long long mtime_sec;
+        long long ctime_sec;
+        if (!rel || sscanf(line, "%c %c %o %lld %lld %ld %lld %ld %llu %d", &entry.type,
+                           &entry.method, &mode, &entry.size, &mtime_sec,
+                           &entry.mtime.tv_nsec, &ctime_sec, &entry.ctime.tv_nsec,
+                           &entry.ino, &entry.root) != 10 ||
+            entry.root < 0 || entry.root >= snapshot->roots->count ||
+            !strchr(entry.type == 'f' ? "cp" : "-", entry.method)) {
+            fprintf(stderr, "Error: Corrupt snapshot manifest %s\n", manifest_path);
+            ok = false;
+            break;
+        }
+        entry.mode = (mode_t)mode;
+        entry.mtime.tv_sec = (time_t)mtime_sec;
+        entry.ctime.tv_sec = (time_t)ctime_sec;
+
+        char path[PATH_MAX];
+        ok = join_path(path, snapshot->roots->paths[entry.root], rel) &&
+             add_entry(snapshot, path, &entry);
+    }
+
+    free(line);
+    fclose(f);
+    return ok;
+}
+
+static void data_path(const Snapshot* snapshot, int index, char out[PATH_MAX]) {
+    const Entry* entry = &snapshot->entries[index];
+    const char* path = snapshot->paths->paths[index];
+    const char* root = snapshot->roots->paths[entry->root];
+    const char* rel = path[strlen(root)] ? path + strlen(root) + 1 : ".";
+
+    char data_root[PATH_MAX];
+    snprintf(data_root, sizeof(data_root), "%s/data/%d", snapshot->dir, entry->root);
+    join_path(out, data_root, rel);
+}
+
+static bool restore_file(const Snapshot* snapshot, int index) {
+    const char* path = snapshot->paths->paths[index];
+    char data[PATH_MAX];
+    data_path(snapshot, index, data);
+
+    struct stat st;
+    if (lstat(data, &st) != 0) {
+        return false;
+    }
+
+    char temp[PATH_MAX];
+    int len = snprintf(temp, sizeof(temp), "%s.sandbash-restore", path);
+    if (len < 0 || (size_t)len >= sizeof(temp)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    unlink(temp);
+
+    if (clone_file(data, temp)) {
+        if (rename(temp, path) == 0) {
+            return true;
+        }
+        unlink(temp);
+    }
+    return copy_file_atomic(data, path);
+}
+
+static bool restore_symlink(const Snapshot* snapshot, int index) {
+    char data[PATH_MAX];
+    data_path(snapshot, index, data);
+    return copy_symlink_atomic(data, snapshot->paths->paths[index]);
+}
+
+static bool symlink_matches(const Snapshot* snapshot, int index) {
+    char data[PATH_MAX];
+    char saved[PATH_MAX];
+    char current[PATH_MAX];
+    data_path(snapshot, index, data);
+    ssize_t saved_len = readlink(data, saved, sizeof(saved));
+    ssize_t current_len = readlink(snapshot->paths->paths[index], current, sizeof(current));
+    return saved_len >= 0 && saved_len == current_len &&
+           memcmp(saved, current, (size_t)saved_len) == 0;
+}
+
+static bool file_matches(const Entry* entry, const struct stat* st) {
+    return (unsigned long long)st->st_ino == entry->ino && st->st_size == entry->size &&
+           (st->st_mode & 07777) == entry->mode &&
+           same_time(STAT_MTIME(*st), entry->mtime) && same_time(STAT_CTIME(*st), entry->ctime);
+}
+
+static char type_of(const struct stat* st) {
+    return S_ISDIR(st->st_mode) ? 'd' : S_ISREG(st->st_mode) ? 'f' :
+           S_ISLNK(st->st_mode) ? 'l' : '?';
+}
+
+// Bring what exists now back in line with the manifest. Entries that are
+// missing now are restored afterwards by restore_missing.
+static bool reconcile(Snapshot* snapshot, dev_t root_dev, const char* path) {
+    struct stat st;
+    if (lstat(path, &st) != 0 || is_store(snapshot, &st) ||
+        (S_ISDIR(st.st_mode) && st.st_dev != root_dev)) {
+        return true;
+    }
+
+    int index = pathlist_find(snapshot->paths, path);
+    if (index < 0) {
+        snapshot->changed++;
+        return remove_tree(path);
+    }
+
+    Entry* entry = &snapshot->entries[index];
+    if (type_of(&st) != entry->type) {
+        snapshot->changed++;
+        return remove_tree(path);
+    }
+    entry->seen = true;
+
+    if (entry->type == 'f') {
+        if (file_matches(entry, &st)) {
+            return true;
+        }
+        snapshot->changed++;
+        return restore_file(snapshot, index);
+    }
+    if (entry->type == 'l') {
+        if (symlink_matches(snapshot, index)) {
+            return true;
+        }
+        snapshot->changed++;
+        return restore_symlink(snapshot, index);
+    }
+
+    if ((st.st_mode & 07777) != entry->mode) {
+        snapshot->changed++;
+        chmod(path, entry->mode);
+    }
+
+    DIR* dir = opendir(path);
+    if (!dir) {
+        return false;
+    }
+
+    bool ok = true;
+    struct dirent* child;
+    while ((child = readdir(dir)) != NULL) {
+        if (strcmp(child->d_name, ".") == 0 || strcmp(child->d_name, "..") == 0) {
+            continue;
+        }
+        char child_path[PATH_MAX];
+        if (!join_path(child_path, path, child->d_name) ||
+            !reconcile(snapshot, root_dev, child_path)) {
+            fprintf(stderr, "Warning: Failed to roll back %s/%s: %s\n", path, child->d_name,
+                    strerror(errno));
+            ok = false;
+        }
+    }
+    closedir(dir);
+    return ok;
+}
+
+static bool restore_missing(Snapshot* snapshot) {
+    bool ok = true;
+
+    // The manifest lists parents first, so directories exist before their
+    // contents are restored
+    for (int i = 0; i < snapshot->paths->count; i++) {
+        Entry* entry = &snapshot->entries[i];
+        if (entry->seen) {
+            continue;
+        }
+        const char* path = snapshot->paths->paths[i];
+
+        bool restored;
+        if (entry->type == 'd') {
+            restored = mkdir(path, 0700) == 0 || errno == EEXIST;
+        } else if (entry->type == 'f') {
+            restored = restore_file(snapshot, i);
+        } else {
+            restored = restore_symlink(snapshot, i);
+        }
+        if (!restored) {
+            fprintf(stderr, "Warning: Failed to restore %s: %s\n", path, strerror(errno));
+            ok = false;
+        }
+        snapshot->changed++;
+    }
+
+    // Directory modes last, in case one is not writable
+    for (int i = snapshot->paths->count - 1; i >= 0; i--) {
+        if (!snapshot->entries[i].seen && snapshot->entries[i].type == 'd') {
+            chmod(snapshot->paths->paths[i], snapshot->entries[i].mode);
+        }
+    }
+    return ok;
+}
+
+bool snapshot_rollback(const char* id) {
+    Snapshot snapshot;
+    if (!snapshot_open(&snapshot, id, false) || !load_manifest(&snapshot)) {
+        snapshot_close(&snapshot);
+        return false;
+    }
+
+    bool ok = true;
+    for (int i = 0; i < snapshot.roots->count; i++) {
+        const char* root = snapshot.roots->paths[i];
+        struct stat st;
+        if (lstat(root, &st) == 0 && !reconcile(&snapshot, st.st_dev, root)) {
+            ok = false;
+        }
+    }
+    if (!restore_missing(&snapshot)) {
+        ok = false;
+    }
+
+    printf("Rolled back %d change(s) from snapshot %s\n", snapshot.changed, id);
+
+    snapshot_close(&snapshot);
+    return ok;
+}
+
+bool snapshot_drop(const char* id) {
+    Snapshot snapshot;
+    if (!snapshot_open(&snapshot, id, false)) {
+        snapshot_close(&snapshot);
+        return false;
+    }
+
+    struct stat st;
+    bool ok = lstat(snapshot.dir, &st) == 0 && remove_tree(snapshot.dir);
+    if (ok) {
+        printf("Dropped snapshot %s\n", id);
+    } else {
+        fprintf(stderr, "Error: Failed to remove snapshot %s: %s\n", id, strerror(errno));
+    }
+
+    snapshot_close(&snapshot);
+    return ok;
+}
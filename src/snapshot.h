@@ -0,0 +1,17 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "config.h"
+#include <stdbool.h>
+
+// Save every writable path under a new snapshot id
+bool snapshot_create(const char* id, const PathList* writable_paths);
+
+// Restore the saved paths, touching only entries that changed since the
+// snapshot. The snapshot is kept.
+bool snapshot_rollback(const char* id);
+
+// Delete a snapshot
+bool snapshot_drop(const char* id);
+
+#endif // SNAPSHOT_H
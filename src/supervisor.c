@@ -0,0 +1,647 @@
+/*
+ * Supervisor for sandboxed process trees.
+ *
+ * The supervisor is sandbash itself, left behind as the command's parent
+ * and marked a child subreaper, so processes orphaned inside the tree are
+ * reparented to it rather than escaping to init. One epoll loop watches a
+ * pidfd for the command, a signalfd for SIGCHLD and termination signals,
+ * and a timerfd for --timeout and the --kill-after grace period.
+ *
+ * Teardown walks /proc for every process below the supervisor and signals
+ * each through a pidfd, so a recycled pid is never hit: SIGTERM first,
+ * SIGKILL once the grace period runs out. It happens on timeout, on
+ * SIGTERM or SIGHUP (which is how --kill-sandbox asks), and when the
+ * command exits while processes it started are still running.
+ *
+ * Running sandboxes are registered as files in <runtime>/sandbash/
+ * sandboxes, one per id, holding the supervisor's pid and start time.
+ * Sandboxes started with --allow-grants listen for grants on a socket of
+ * the same name in <runtime>/sandbash/grants.
+ */
+
+#include "supervisor.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+// While waiting for leftover descendants, which are not all our children
+// and so do not all send SIGCHLD, look again this often
+#define TREE_POLL_MS 100
+
+typedef enum {
+    PHASE_RUNNING,
+    // SIGTERM sent; SIGKILL when the timer fires
+    PHASE_TERMINATING,
+    // SIGKILL sent; give up when the timer fires
+    PHASE_KILLING,
+} Phase;
+
+static int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+// Signal through a pidfd when the kernel has them, so the pid cannot
+// have been reused in between
+static void send_signal(pid_t pid, int sig) {
+    int pidfd = open_pidfd(pid);
+#ifdef SYS_pidfd_send_signal
+    if (pidfd >= 0 && syscall(SYS_pidfd_send_signal, pidfd, sig, NULL, 0) == 0) {
+        close(pidfd);
+        return;
+    }
+#endif
+    if (pidfd >= 0) {
+        close(pidfd);
+        return;
+    }
+    kill(pid, sig);
+}
+
+// Read the parent and state of pid from /proc/<pid>/stat, and its start
+// time in clock ticks after boot
+static bool read_stat(pid_t pid, pid_t* ppid, char* state, unsigned long long* start) {
+    char path[64];
+    char buffer[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t len = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (len <= 0) {
+        return false;
+    }
+    buffer[len] = '\0';
+
+    // The command name may hold spaces and parentheses; fields resume
+    // after the last ')'
+    const char* fields = strrchr(buffer, ')');
+    int parent = 0;
+    unsigned long long started = 0;
+    if (!fields || sscanf(fields + 2, "%c %d %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s "
+                          "%*s %*s %*s %*s %*s %*s %llu", state, &parent, &started) != 3) {
+        return false;
+    }
+    *ppid = parent;
+    *start = started;
+    return true;
+}
+
+// Every live process below this one. Returns how many were found, up to
+// capacity, or -1 if /proc cannot be read.
+static int find_descendants(pid_t* out, int capacity) {
+    DIR* proc = opendir("/proc");
+    if (!proc) {
+        return -1;
+    }
+
+    int count = 0;
+    int size = 0;
+    pid_t* pids = NULL;
+    pid_t* parents = NULL;
+    struct dirent* entry;
+    while ((entry = readdir(proc)) != NULL) {
+        char* end;
+        long pid = strtol(entry->d_name, &end, 10);
+        pid_t ppid;
+        char state;
+        unsigned long long start;
+        // Zombies are gone as far as signals are concerned, but ours
+        // still need reaping
+        if (*end != '\0' || pid <= 0 || !read_stat((pid_t)pid, &ppid, &state, &start) ||
+            (state == 'Z' && ppid != getpid())) {
+            continue;
+        }
+        if (count == size) {
+            size = size ? size * 2 : 512;
+            pid_t* grown_pids = realloc(pids, sizeof(pid_t) * (size_t)size);
+            pid_t* grown_parents = grown_pids ? realloc(parents, sizeof(pid_t) * (size_t)size)
+                                              : NULL;
+            if (grown_pids) {
+                pids = grown_pids;
+            }
+            if (!grown_parents) {
+                break;
+            }
+            parents = grown_parents;
+        }
+        pids[count] = (pid_t)pid;
+        parents[count] = ppid;
+        count++;
+    }
+    closedir(proc);
+
+    // Grow the set from ourselves until no process joins
+    int found = 0;
+    bool* below = calloc((size_t)count + 1, sizeof(bool));
+    pid_t self = getpid();
+    for (bool grew = below != NULL; grew;) {
+        grew = false;
+        for (int i = 0; i < count; i++) {
+            if (below[i]) {
+                continue;
+            }
+            bool child = parents[i] == self;
+            for (int j = 0; !child && j < found; j++) {
+                child = parents[i] == out[j];
+            }
+            if (child && found < capacity) {
+                below[i] = true;
+                out[found++] = pids[i];
+                grew = true;
+            }
+        }
+    }
+
+    free(below);
+    free(pids);
+    free(parents);
+    return found;
+}
+
+// Signal the whole tree; returns how many processes there were
+static int signal_tree(int sig) {
+    pid_t descendants[4096];
+    int count = find_descendants(descendants, (int)(sizeof(descendants) / sizeof(pid_t)));
+    for (int i = 0; i < count; i++) {
+        send_signal(descendants[i], sig);
+    }
+    return count;
+}
+
+static void arm_timer(int timer, double seconds) {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = (time_t)seconds;
+    spec.it_value.tv_nsec = (long)((seconds - (double)(time_t)seconds) * 1e9);
+    // Zero would disarm it
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+        spec.it_value.tv_nsec = 1;
+    }
+    timerfd_settime(timer, 0, &spec, NULL);
+}
+
+// Reap every child that has exited, noting pid's status when it does
+static void reap(pid_t pid, int* status, bool* exited) {
+    int child_status;
+    pid_t done;
+    while ((done = waitpid(-1, &child_status, WNOHANG)) > 0) {
+        if (done == pid) {
+            *status = child_status;
+            *exited = true;
+        }
+    }
+}
+
+int supervisor_wait(pid_t pid, const SupervisorLimits* limits) {
+    sigset_t mask;
+    sigset_t previous;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGQUIT);
+    sigprocmask(SIG_BLOCK, &mask, &previous);
+
+    int signals = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    // A SIGCHLD sent before the mask went up is lost, but the pidfd of
+    // an exited process is readable from the start
+    int pidfd = open_pidfd(pid);
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (signals < 0 || timer < 0 || epoll < 0) {
+        fprintf(stderr, "Warning: Supervisor setup failed, only waiting: %s\n",
+                strerror(errno));
+    }
+    int fds[] = { signals, timer, pidfd };
+    for (size_t i = 0; epoll >= 0 && i < sizeof(fds) / sizeof(fds[0]); i++) {
+        struct epoll_event event = { .events = EPOLLIN, .data.fd = fds[i] };
+        if (fds[i] >= 0) {
+            epoll_ctl(epoll, EPOLL_CTL_ADD, fds[i], &event);
+        }
+    }
+
+    if (limits->timeout > 0 && timer >= 0) {
+        arm_timer(timer, limits->timeout);
+    }
+
+    Phase phase = PHASE_RUNNING;
+    bool timed_out = false;
+    bool killed = false;
+    bool exited = false;
+    int status = -1;
+    for (;;) {
+        bool was_running = !exited;
+        reap(pid, &status, &exited);
+        if (was_running && exited && pidfd >= 0 && epoll >= 0) {
+            // It stays readable from now on
+            epoll_ctl(epoll, EPOLL_CTL_DEL, pidfd, NULL);
+        }
+
+        // Once the command is gone, nothing it started may stay behind
+        if (exited) {
+            int left = signal_tree(phase == PHASE_RUNNING ? SIGTERM : 0);
+            if (left <= 0) {
+                break;
+            }
+            if (phase == PHASE_RUNNING) {
+                phase = PHASE_TERMINATING;
+                arm_timer(timer, limits->kill_after);
+            }
+        }
+
+        if (epoll < 0) {
+            // No event loop: block on the command alone
+            if (!exited && waitpid(pid, &status, 0) == pid) {
+                exited = true;
+            }
+            if (exited) {
+                break;
+            }
+            continue;
+        }
+
+        struct epoll_event events[4];
+        int ready = epoll_wait(epoll, events, 4, exited ? TREE_POLL_MS : -1);
+        for (int i = 0; i < ready; i++) {
+            int fd = events[i].data.fd;
+            if (fd == signals) {
+                struct signalfd_siginfo info;
+                while (read(signals, &info, sizeof(info)) == sizeof(info)) {
+                    // The terminal sends SIGINT and SIGQUIT to the whole
+                    // process group already
+                    if ((info.ssi_signo == SIGTERM || info.ssi_signo == SIGHUP) &&
+                        phase == PHASE_RUNNING) {
+                        signal_tree(SIGTERM);
+                        phase = PHASE_TERMINATING;
+                        arm_timer(timer, limits->kill_after);
+                    }
+                }
+            } else if (fd == timer) {
+                unsigned long long expirations;
+                if (read(timer, &expirations, sizeof(expirations)) < 0) {
+                    continue;
+                }
+                if (phase == PHASE_RUNNING) {
+                    fprintf(stderr, "Error: Command timed out after %gs\n", limits->timeout);
+                    timed_out = true;
+                    signal_tree(SIGTERM);
+                    phase = PHASE_TERMINATING;
+                    arm_timer(timer, limits->kill_after);
+                } else if (phase == PHASE_TERMINATING) {
+                    killed = signal_tree(SIGKILL) > 0;
+                    phase = PHASE_KILLING;
+                    arm_timer(timer, limits->kill_after);
+                } else {
+                    int left = signal_tree(0);
+                    fprintf(stderr, "Warning: %d process(es) survived SIGKILL\n", left);
+                    if (exited) {
+                        goto done;
+                    }
+                }
+            }
+        }
+    }
+
+done:
+    if (pidfd >= 0) {
+        close(pidfd);
+    }
+    if (signals >= 0) {
+        close(signals);
+    }
+    if (timer >= 0) {
+        close(timer);
+    }
+    if (epoll >= 0) {
+        close(epoll);
+    }
+    sigprocmask(SIG_SETMASK, &previous, NULL);
+
+    if (timed_out) {
+        return killed ? SUPERVISOR_KILLED : SUPERVISOR_TIMED_OUT;
+    }
+    if (status < 0) {
+        return 1;
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
+
+// <runtime>/sandbash/name, created if missing
+static bool runtime_subdir(const char* name, char* out, size_t size) {
+    char* runtime_dir = get_xdg_runtime_dir();
+    if (!runtime_dir) {
+        fprintf(stderr, "Error: Failed to determine runtime directory\n");
+        return false;
+    }
+    snprintf(out, size, "%s/sandbash", runtime_dir);
+    mkdir(out, 0700);
+    snprintf(out, size, "%s/sandbash/%s", runtime_dir, name);
+    mkdir(out, 0700);
+    free(runtime_dir);
+    return true;
+}
+
+static bool registry_dir(char* out, size_t size) {
+    return runtime_subdir("sandboxes", out, size);
+}
+
+bool supervisor_grant_socket(const char* id, char* out, size_t size) {
+    char dir[PATH_MAX / 2];
+    if (!is_valid_session_id(id) || !runtime_subdir("grants", dir, sizeof(dir))) {
+        return false;
+    }
+    int len = snprintf(out, size, "%s/%s", dir, id);
+    return len > 0 && (size_t)len < size;
+}
+
+typedef struct {
+    pid_t pid;
+    unsigned long long start;
+    time_t created;
+    char directory[PATH_MAX];
+    char command[1024];
+} Entry;
+
+static bool read_entry(const char* path, Entry* entry) {
+    FILE* f = fopen(path, "re");
+    if (!f) {
+        return false;
+    }
+    char line[PATH_MAX + 1280];
+    int pid = 0;
+    long long created = 0;
+    int fields_end = 0;
+    bool ok = fgets(line, sizeof(line), f) &&
+              sscanf(line, "%d\t%llu\t%lld\t%n", &pid, &entry->start, &created,
+                     &fields_end) == 3 && fields_end > 0;
+    fclose(f);
+    if (!ok) {
+        return false;
+    }
+
+    line[strcspn(line, "\n")] = '\0';
+    char* directory = line + fields_end;
+    char* command = strchr(directory, '\t');
+    if (command) {
+        *command++ = '\0';
+    }
+    entry->pid = pid;
+    entry->created = (time_t)created;
+    snprintf(entry->directory, sizeof(entry->directory), "%s", directory);
+    snprintf(entry->command, sizeof(entry->command), "%s", command ? command : "");
+    return true;
+}
+
+// Whether the entry's supervisor is still the process that registered it
+static bool entry_alive(const Entry* entry) {
+    pid_t ppid;
+    char state;
+    unsigned long long start;
+    return read_stat(entry->pid, &ppid, &state, &start) && start == entry->start &&
+           state != 'Z';
+}
+
+bool supervisor_register(const char* id, int argc, char* const argv[]) {
+    if (!is_valid_session_id(id)) {
+        fprintf(stderr, "Error: Invalid sandbox id: %s\n", id ? id : "");
+        return false;
+    }
+    char dir[PATH_MAX / 2];
+    if (!registry_dir(dir, sizeof(dir))) {
+        return false;
+    }
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, id);
+    Entry existing;
+    if (read_entry(path, &existing) && entry_alive(&existing)) {
+        fprintf(stderr, "Error: Sandbox %s is already running (pid %d)\n", id,
+                (int)existing.pid);
+        return false;
+    }
+
+    pid_t ppid;
+    char state;
+    unsigned long long start;
+    char cwd[PATH_MAX];
+    if (!read_stat(getpid(), &ppid, &state, &start) || !getcwd(cwd, sizeof(cwd))) {
+        fprintf(stderr, "Error: Failed to register sandbox %s\n", id);
+        return false;
+    }
+
+    // One line, so tabs and newlines in arguments become spaces
+    char command[1024] = "";
+    for (int i = 0; i < argc; i++) {
+        size_t len = strlen(command);
+        snprintf(command + len, sizeof(command) - len, "%s%s", i > 0 ? " " : "", argv[i]);
+    }
+    for (char* p = command; *p; p++) {
+        if (*p == '\t' || *p == '\n') {
+            *p = ' ';
+        }
+    }
+
+    char temp[PATH_MAX + 16];
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+    FILE* f = fopen(temp, "we");
+    if (!f) {
+        fprintf(stderr, "Error: Failed to register sandbox %s: %s\n", id, strerror(errno));
+        return false;
+    }
+    fprintf(f, "%d\t%llu\t%lld\t%s\t%s\n", (int)getpid(), start, (long long)time(NULL), cwd,
+            command);
+    if (fclose(f) != 0 || rename(temp, path) != 0) {
+        fprintf(stderr, "Error: Failed to register sandbox %s: %s\n", id, strerror(errno));
+        unlink(temp);
+        return false;
+    }
+
+    if (prctl(PR_SET_CHILD_SUBREAPER, 1) != 0) {
+        fprintf(stderr, "Warning: Failed to become a subreaper; orphaned processes may "
+                        "escape: %s\n", strerror(errno));
+    }
+    return true;
+}
+
+void supervisor_unregister(const char* id) {
+    char dir[PATH_MAX / 2];
+    char path[PATH_MAX];
+    if (!registry_dir(dir, sizeof(dir))) {
+        return;
+    }
+    snprintf(path, sizeof(path), "%s/%s", dir, id);
+
+    // Only our own entry; a later run may have taken the id over
+    Entry entry;
+    if (read_entry(path, &entry) && entry.pid == getpid()) {
+        unlink(path);
+        if (supervisor_grant_socket(id, path, sizeof(path))) {
+            unlink(path);
+        }
+    }
+}
+
+bool supervisor_list(void) {
+    char dir[PATH_MAX / 2];
+    if (!registry_dir(dir, sizeof(dir))) {
+        return false;
+    }
+    DIR* handle = opendir(dir);
+    if (!handle) {
+        fprintf(stderr, "Error: Failed to read %s: %s\n", dir, strerror(errno));
+        return false;
+    }
+
+    bool header = false;
+    time_t now = time(NULL);
+    struct dirent* entry;
+    while ((entry = readdir(handle)) != NULL) {
+        if (!is_valid_session_id(entry->d_name) || strstr(entry->d_name, ".tmp")) {
+            continue;
+        }
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        Entry sandbox;
+        if (!read_entry(path, &sandbox) || !entry_alive(&sandbox)) {
+            // Its supervisor was killed before it could unregister
+            unlink(path);
+            if (supervisor_grant_socket(entry->d_name, path, sizeof(path))) {
+                unlink(path);
+            }
+            continue;
+        }
+
+        if (!header) {
+            printf("%-28s %8s %9s  %s\n", "ID", "PID", "AGE", "DIRECTORY / COMMAND");
+            header = true;
+        }
+        long age = (long)(now - sandbox.created);
+        char age_text[32];
+        if (age >= 3600) {
+            snprintf(age_text, sizeof(age_text), "%ldh%02ldm", age / 3600, age % 3600 / 60);
+        } else {
+            snprintf(age_text, sizeof(age_text), "%ldm%02lds", age / 60, age % 60);
+        }
+        printf("%-28s %8d %9s  %s\n", entry->d_name, (int)sandbox.pid, age_text,
+               sandbox.directory);
+        printf("%-28s %8s %9s    %s\n", "", "", "", sandbox.command);
+    }
+    closedir(handle);
+    return true;
+}
+
+bool supervisor_kill(const char* id) {
+    char dir[PATH_MAX / 2];
+    if (!is_valid_session_id(id)) {
+        fprintf(stderr, "Error: Invalid sandbox id: %s\n", id ? id : "");
+        return false;
+    }
+    if (!registry_dir(dir, sizeof(dir))) {
+        return false;
+    }
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, id);
+    Entry sandbox;
+    if (!read_entry(path, &sandbox) || !entry_alive(&sandbox)) {
+        fprintf(stderr, "Error: No running sandbox %s\n", id);
+        return false;
+    }
+
+    // The supervisor terminates the tree, escalating to SIGKILL itself
+    send_signal(sandbox.pid, SIGTERM);
+    return true;
+}
+
+bool supervisor_grant(const char* id, const char* path) {
+    char dir[PATH_MAX / 2];
+    if (!is_valid_session_id(id)) {
+        fprintf(stderr, "Error: Invalid sandbox id: %s\n", id ? id : "");
+        return false;
+    }
+    if (!registry_dir(dir, sizeof(dir))) {
+        return false;
+    }
+
+    char entry_path[PATH_MAX];
+    snprintf(entry_path, sizeof(entry_path), "%s/%s", dir, id);
+    Entry sandbox;
+    if (!read_entry(entry_path, &sandbox) || !entry_alive(&sandbox)) {
+        fprintf(stderr, "Error: No running sandbox %s\n", id);
+        return false;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (!supervisor_grant_socket(id, addr.sun_path, sizeof(addr.sun_path))) {
+        fprintf(stderr, "Error: Failed to determine grant socket of sandbox %s\n", id);
+        return false;
+    }
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "Error: Sandbox %s does not accept grants; start it with "
+                        "--allow-grants\n", id);
+        if (sock >= 0) {
+            close(sock);
+        }
+        return false;
+    }
+
+    // The request is the path and a newline; the reply "ok" or
+    // "error: REASON"
+    struct timeval timeout = { 5, 0 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    char request[PATH_MAX + 1];
+    int len = snprintf(request, sizeof(request), "%s\n", path);
+    char reply[256] = "";
+    ssize_t received = -1;
+    if (len > 0 && (size_t)len < sizeof(request) &&
+        send(sock, request, (size_t)len, MSG_NOSIGNAL) == len) {
+        received = recv(sock, reply, sizeof(reply) - 1, 0);
+    }
+    close(sock);
+    if (received <= 0) {
+        fprintf(stderr, "Error: No answer from sandbox %s\n", id);
+        return false;
+    }
+    reply[received] = '\0';
+    reply[strcspn(reply, "\n")] = '\0';
+
+    if (strcmp(reply, "ok") != 0) {
+        const char* reason = strncmp(reply, "error: ", 7) == 0 ? reply + 7 : reply;
+        fprintf(stderr, "Error: Sandbox %s refused the grant: %s\n", id, reason);
+        return false;
+    }
+    printf("Granted write access to %s in sandbox %s\n", path, id);
+    return true;
+}
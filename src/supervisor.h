@@ -0,0 +1,45 @@
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+// How long a supervised command may run, and how long its tree gets to
+// exit after SIGTERM before SIGKILL; zero timeout means no limit
+typedef struct {
+    double timeout;
+    double kill_after;
+} SupervisorLimits;
+
+// Exit statuses, as for coreutils timeout
+#define SUPERVISOR_TIMED_OUT 124
+#define SUPERVISOR_KILLED (128 + 9)
+
+// Record the calling process as the supervisor of sandbox id, so it can
+// be listed and killed, and make it a subreaper so the tree's orphans
+// stay below it. Fails if a live sandbox already has the id.
+bool supervisor_register(const char* id, int argc, char* const argv[]);
+
+// Drop the sandbox from the registry
+void supervisor_unregister(const char* id);
+
+// Wait for pid, enforcing the limits.
+// When pid exits, whatever is left of its tree is terminated too.
+// Returns the exit status sandbash should exit with.
+int supervisor_wait(pid_t pid, const SupervisorLimits* limits);
+
+// Print the running sandboxes, removing entries of ones that are gone
+bool supervisor_list(void);
+
+// Ask the supervisor of sandbox id to terminate its tree
+bool supervisor_kill(const char* id);
+
+// Store the path of the socket sandbox id accepts grants on in out
+bool supervisor_grant_socket(const char* id, char* out, size_t size);
+
+// Make path, which must be canonical, writable in the running sandbox id.
+// Only works from outside the sandbox, for one started with grants
+// allowed.
+bool supervisor_grant(const char* id, const char* path);
+
+#endif // SUPERVISOR_H
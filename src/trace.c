@@ -0,0 +1,141 @@
+/*
+ * Startup tracing, enabled with SANDBASH_TRACE=<file>.
+ *
+ * Phases are recorded in memory as begin/end pairs against the monotonic
+ * clock and written out as Chrome trace JSON, which chrome://tracing and
+ * Perfetto both load. The file is opened up front because the sandbox may
+ * forbid creating it later, and it is rewritten just before exec since
+ * nothing runs after that.
+ *
+ * Recording is not thread-safe; callers disable tracing before starting
+ * threads.
+ */
+
+#include "trace.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+    const char* name;
+    // Owned copy, or NULL
+    char* detail;
+    double timestamp_us;
+    // 'B', 'E' or 'i'
+    char phase;
+} TraceEvent;
+
+bool trace_enabled = false;
+
+static int trace_fd = -1;
+// The launch is one timeline even when a backend forks partway through
+static int trace_pid = 0;
+static TraceEvent* events = NULL;
+static size_t event_count = 0;
+static size_t event_capacity = 0;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+void trace_init(void) {
+    const char* path = getenv("SANDBASH_TRACE");
+    if (!path || !*path) {
+        return;
+    }
+
+    trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (trace_fd < 0) {
+        fprintf(stderr, "Warning: Cannot open trace file %s\n", path);
+        return;
+    }
+    trace_pid = (int)getpid();
+    trace_enabled = true;
+}
+
+static void record(char phase, const char* name, const char* detail) {
+    if (event_count == event_capacity) {
+        size_t capacity = event_capacity ? event_capacity * 2 : 64;
+        TraceEvent* grown = realloc(events, capacity * sizeof(TraceEvent));
+        if (!grown) {
+            // Keep what we have rather than failing the launch
+            trace_flush();
+            trace_disable();
+            return;
+        }
+        events = grown;
+        event_capacity = capacity;
+    }
+
+    TraceEvent* event = &events[event_count++];
+    event->name = name;
+    event->detail = detail ? strdup(detail) : NULL;
+    event->timestamp_us = now_us();
+    event->phase = phase;
+}
+
+void trace_begin(const char* name, const char* detail) {
+    record('B', name, detail);
+}
+
+void trace_end(void) {
+    record('E', NULL, NULL);
+}
+
+void trace_instant(const char* name, const char* detail) {
+    record('i', name, detail);
+}
+
+void trace_flush(void) {
+    if (trace_fd < 0) {
+        return;
+    }
+
+    // A stdio stream on a duplicate so fclose leaves trace_fd open for
+    // the next flush
+    int fd = dup(trace_fd);
+    FILE* f = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!f) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    if (ftruncate(fd, 0) != 0 || lseek(fd, 0, SEEK_SET) != 0) {
+        fclose(f);
+        return;
+    }
+
+    fprintf(f, "{\"traceEvents\": [\n");
+    for (size_t i = 0; i < event_count; i++) {
+        const TraceEvent* event = &events[i];
+        fprintf(f, "  {\"ph\": \"%c\", \"ts\": %.3f, \"pid\": %d, \"tid\": %d", event->phase,
+                event->timestamp_us, trace_pid, trace_pid);
+        if (event->name) {
+            fprintf(f, ", \"name\": ");
+            write_json_string(f, event->name);
+            fprintf(f, ", \"cat\": \"sandbash\"");
+        }
+        if (event->phase == 'i') {
+            fprintf(f, ", \"s\": \"p\"");
+        }
+        if (event->detail) {
+            fprintf(f, ", \"args\": {\"detail\": ");
+            write_json_string(f, event->detail);
+            fprintf(f, "}");
+        }
+        fprintf(f, "}%s\n", i + 1 < event_count ? "," : "");
+    }
+    fprintf(f, "], \"displayTimeUnit\": \"ns\"}\n");
+    fclose(f);
+}
+
+void trace_disable(void) {
+    trace_enabled = false;
+}
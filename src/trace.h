@@ -0,0 +1,39 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+
+// Set by trace_init when SANDBASH_TRACE names an output file. The macros
+// below test it first, so disabled tracing costs one branch per phase.
+extern bool trace_enabled;
+
+// Start tracing if SANDBASH_TRACE is set. The output file is opened here,
+// before any sandbox is applied.
+void trace_init(void);
+
+// Record the start of a phase, with an optional detail such as a path
+void trace_begin(const char* name, const char* detail);
+
+// Record the end of the innermost open phase
+void trace_end(void);
+
+// Record a point in time, e.g. the exec that ends the trace
+void trace_instant(const char* name, const char* detail);
+
+// Write everything recorded so far as Chrome trace JSON. Safe to call
+// more than once; each call rewrites the whole file.
+void trace_flush(void);
+
+// Stop recording for good, e.g. before threads are started
+void trace_disable(void);
+
+#define TRACE_BEGIN(name) do { if (trace_enabled) trace_begin(name, NULL); } while (0)
+#define TRACE_BEGIN_DETAIL(name, detail) \
+    do { if (trace_enabled) trace_begin(name, detail); } while (0)
+#define TRACE_END() do { if (trace_enabled) trace_end(); } while (0)
+#define TRACE_INSTANT(name) do { if (trace_enabled) trace_instant(name, NULL); } while (0)
+#define TRACE_INSTANT_DETAIL(name, detail) \
+    do { if (trace_enabled) trace_instant(name, detail); } while (0)
+#define TRACE_FLUSH() do { if (trace_enabled) trace_flush(); } while (0)
+
+#endif // TRACE_H
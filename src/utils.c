@@ -1,30 +1,134 @@
 #include "utils.h"
+#include "trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <limits.h>
+#include <ctype.h>
 #include <pwd.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef __APPLE__
 #include <CommonCrypto/CommonDigest.h>
+#define SHA256_DIGEST_LENGTH CC_SHA256_DIGEST_LENGTH
+#else
+#define SHA256_DIGEST_LENGTH 32
+
+// Minimal SHA-256 (FIPS 180-4) so Linux builds need no crypto library.
+// Must produce the same digest as CommonCrypto so per-directory config
+// hashes are identical on both platforms.
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(uint32_t state[8], const unsigned char block[64]) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+               ((uint32_t)block[i * 4 + 2] << 8) | (uint32_t)block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int i = 0; i < 64; i++) {
+        uint32_t s1 = ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + ch + sha256_k[i] + w[i];
+        uint32_t s0 = ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+static void sha256(const void* data, size_t len, unsigned char out[32]) {
+    uint32_t state[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    const unsigned char* p = data;
+    size_t remaining = len;
+
+    while (remaining >= 64) {
+        sha256_block(state, p);
+        p += 64;
+        remaining -= 64;
+    }
+
+    // Final block(s): message tail, 0x80 marker, zero pad, bit length
+    unsigned char tail[128] = {0};
+    memcpy(tail, p, remaining);
+    tail[remaining] = 0x80;
+    size_t tail_len = remaining < 56 ? 64 : 128;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 0; i < 8; i++) {
+        tail[tail_len - 1 - i] = (unsigned char)(bits >> (i * 8));
+    }
+    sha256_block(state, tail);
+    if (tail_len == 128) {
+        sha256_block(state, tail + 64);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        out[i * 4] = (unsigned char)(state[i] >> 24);
+        out[i * 4 + 1] = (unsigned char)(state[i] >> 16);
+        out[i * 4 + 2] = (unsigned char)(state[i] >> 8);
+        out[i * 4 + 3] = (unsigned char)state[i];
+    }
+}
+#endif
 
 bool is_under_home_directory(void) {
     char cwd[PATH_MAX];
-    const char* home = getenv("HOME");
 
-    if (!home) {
+    if (!getcwd(cwd, sizeof(cwd))) {
         return false;
     }
 
-    if (!getcwd(cwd, sizeof(cwd))) {
+    return is_directory_under_home(cwd);
+}
+
+bool is_directory_under_home(const char* dir) {
+    const char* home = getenv("HOME");
+
+    if (!home || !dir) {
         return false;
     }
 
     size_t home_len = strlen(home);
 
-    // Check if cwd starts with home path
-    return strncmp(cwd, home, home_len) == 0 &&
-           (cwd[home_len] == '/' || cwd[home_len] == '\0');
+    // Check if dir starts with home path
+    return strncmp(dir, home, home_len) == 0 &&
+           (dir[home_len] == '/' || dir[home_len] == '\0');
 }
 
 char* expand_path(const char* path) {
@@ -54,7 +158,9 @@ char* expand_path(const char* path) {
     }
 
     // Resolve to absolute path
+    TRACE_BEGIN_DETAIL("realpath", expanded);
     char* absolute = realpath(expanded, NULL);
+    TRACE_END();
     return absolute;
 }
 
@@ -63,8 +169,12 @@ char* compute_path_hash(const char* path) {
         return NULL;
     }
 
-    unsigned char hash[CC_SHA256_DIGEST_LENGTH];
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+#ifdef __APPLE__
     CC_SHA256(path, strlen(path), hash);
+#else
+    sha256(path, strlen(path), hash);
+#endif
 
     // Convert first 8 bytes to hex (16 chars)
     char* hex = malloc(17);
@@ -96,6 +206,379 @@ char* get_xdg_config_dir(void) {
     return strdup(path);
 }
 
+char* get_xdg_cache_dir(void) {
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    if (xdg && xdg[0] == '/') {
+        return strdup(xdg);
+    }
+
+    const char* home = getenv("HOME");
+    if (!home) {
+        return NULL;
+    }
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/.cache", home);
+    return strdup(path);
+}
+
+char* get_xdg_state_dir(void) {
+    const char* xdg = getenv("XDG_STATE_HOME");
+    if (xdg && xdg[0] == '/') {
+        return strdup(xdg);
+    }
+
+    const char* home = getenv("HOME");
+    if (!home) {
+        return NULL;
+    }
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/.local/state", home);
+    return strdup(path);
+}
+
+char* get_xdg_runtime_dir(void) {
+    const char* xdg = getenv("XDG_RUNTIME_DIR");
+    if (xdg && xdg[0] == '/') {
+        return strdup(xdg);
+    }
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "/tmp/sandbash-%u", (unsigned)getuid());
+
+    // /tmp is shared, so only trust a directory we own and nobody else can use
+    if (mkdir(path, 0700) != 0 && errno != EEXIST) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (lstat(path, &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != getuid() ||
+        (st.st_mode & 077) != 0) {
+        return NULL;
+    }
+
+    return strdup(path);
+}
+
+static const char* find_env(char* const envp[], const char* name) {
+    size_t len = strlen(name);
+    for (; *envp; envp++) {
+        if (strncmp(*envp, name, len) == 0 && (*envp)[len] == '=') {
+            return *envp + len + 1;
+        }
+    }
+    return NULL;
+}
+
+void exec_with_env(char* const argv[], char* const envp[]) {
+    const char* file = argv[0];
+    if (strchr(file, '/')) {
+        execve(file, argv, envp);
+        return;
+    }
+
+    const char* path = find_env(envp, "PATH");
+    if (!path) {
+        path = "/usr/local/bin:/usr/bin:/bin";
+    }
+
+    // Runs between fork and exec, so no allocation
+    int err = ENOENT;
+    char candidate[PATH_MAX];
+    while (*path) {
+        const char* end = strchr(path, ':');
+        size_t len = end ? (size_t)(end - path) : strlen(path);
+        int n = len == 0 ? snprintf(candidate, sizeof(candidate), "%s", file)
+                         : snprintf(candidate, sizeof(candidate), "%.*s/%s", (int)len, path, file);
+
+        if (n > 0 && (size_t)n < sizeof(candidate)) {
+            execve(candidate, argv, envp);
+            // Keep looking past missing entries, but report a real failure
+            if (errno != ENOENT && errno != ENOTDIR) {
+                err = errno;
+            }
+        }
+
+        if (!end) {
+            break;
+        }
+        path = end + 1;
+    }
+    errno = err;
+}
+
+bool create_cloexec_pipe(int fds[2]) {
+#ifdef __linux__
+    // Atomically, so a fork on another thread cannot keep either end open
+    return pipe2(fds, O_CLOEXEC) == 0;
+#else
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+#endif
+}
+
+#ifdef __linux__
+bool process_has_no_new_privs(pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+
+    FILE* f = fopen(path, "re");
+    if (!f) {
+        return true;
+    }
+
+    char line[256];
+    int value = 1;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "NoNewPrivs: %d", &value) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return value != 0;
+}
+#endif
+
+bool make_directories(const char* path, mode_t mode) {
+    char partial[PATH_MAX];
+    int len = snprintf(partial, sizeof(partial), "%s", path);
+    if (len < 0 || (size_t)len >= sizeof(partial)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    for (char* slash = strchr(partial + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        if (mkdir(partial, mode) != 0 && errno != EEXIST) {
+            return false;
+        }
+        *slash = '/';
+    }
+    return mkdir(partial, mode) == 0 || errno == EEXIST;
+}
+
+bool path_is_within(const char* path, const char* root) {
+    if (!path || !root) {
+        return false;
+    }
+
+    size_t root_len = strlen(root);
+
+    // "/" contains everything
+    if (root_len == 1 && root[0] == '/') {
+        return path[0] == '/';
+    }
+
+    return strncmp(path, root, root_len) == 0 &&
+           (path[root_len] == '/' || path[root_len] == '\0');
+}
+
+char* generate_session_id(void) {
+    char stamp[32];
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+
+    char* id = malloc(64);
+    if (id) {
+        snprintf(id, 64, "%s-%d", stamp, (int)getpid());
+    }
+    return id;
+}
+
+bool is_valid_session_id(const char* id) {
+    if (!id || !*id || id[0] == '.' || strlen(id) > 64) {
+        return false;
+    }
+    for (const char* p = id; *p; p++) {
+        bool ok = (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
+                  (*p >= '0' && *p <= '9') || *p == '-' || *p == '_' || *p == '.';
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool parse_duration(const char* text, double* seconds) {
+    char* end;
+    double value = strtod(text, &end);
+    if (end == text || !(value >= 0)) {
+        return false;
+    }
+
+    if (strcmp(end, "ms") == 0) {
+        value /= 1000;
+    } else if (strcmp(end, "m") == 0) {
+        value *= 60;
+    } else if (strcmp(end, "h") == 0) {
+        value *= 3600;
+    } else if (strcmp(end, "s") != 0 && *end != '\0') {
+        return false;
+    }
+
+    // Keep it within what timers and sleeps accept
+    if (value > 1e8) {
+        return false;
+    }
+    *seconds = value;
+    return true;
+}
+
+bool parse_size(const char* value, unsigned long long* out) {
+    if (!isdigit((unsigned char)value[0])) {
+        return false;
+    }
+    char* end;
+    errno = 0;
+    unsigned long long size = strtoull(value, &end, 10);
+    if (errno != 0) {
+        return false;
+    }
+
+    unsigned shift = 0;
+    switch (toupper((unsigned char)*end)) {
+        case 'K': shift = 10; end++; break;
+        case 'M': shift = 20; end++; break;
+        case 'G': shift = 30; end++; break;
+        case 'T': shift = 40; end++; break;
+        default: break;
+    }
+    if (*end != '\0' || size == 0 || size > (ULLONG_MAX >> shift)) {
+        return false;
+    }
+    *out = size << shift;
+    return true;
+}
+
+bool copy_file_atomic(const char* source, const char* dest) {
+    char temp[PATH_MAX];
+    int len = snprintf(temp, sizeof(temp), "%s.sandbash-XXXXXX", dest);
+    if (len < 0 || (size_t)len >= sizeof(temp)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+
+    int in = open(source, O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        return false;
+    }
+    struct stat st;
+    int out = fstat(in, &st) == 0 ? mkstemp(temp) : -1;
+    if (out < 0) {
+        close(in);
+        return false;
+    }
+
+    char buffer[65536];
+    ssize_t n;
+    bool ok = true;
+    while (ok && (n = read(in, buffer, sizeof(buffer))) != 0) {
+        if (n < 0) {
+            ok = errno == EINTR;
+            continue;
+        }
+        for (ssize_t done = 0; ok && done < n; ) {
+            ssize_t written = write(out, buffer + done, (size_t)(n - done));
+            ok = written > 0;
+            done += written > 0 ? written : 0;
+        }
+    }
+
+    struct timespec times[2] = { STAT_ATIME(st), STAT_MTIME(st) };
+    ok = ok && fchmod(out, st.st_mode & 07777) == 0 && futimens(out, times) == 0;
+    close(in);
+    ok = close(out) == 0 && ok;
+
+    if (!ok || rename(temp, dest) != 0) {
+        int saved = errno;
+        unlink(temp);
+        errno = saved;
+        return false;
+    }
+    return true;
+}
+
+bool copy_symlink_atomic(const char* source, const char* dest) {
+    char target[PATH_MAX];
+    ssize_t len = readlink(source, target, sizeof(target) - 1);
+    if (len < 0) {
+        return false;
+    }
+    target[len] = '\0';
+
+    char temp[PATH_MAX];
+    int temp_len = snprintf(temp, sizeof(temp), "%s.sandbash-link", dest);
+    if (temp_len < 0 || (size_t)temp_len >= sizeof(temp)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    unlink(temp);
+    if (symlink(target, temp) != 0) {
+        return false;
+    }
+    if (rename(temp, dest) != 0) {
+        int saved = errno;
+        unlink(temp);
+        errno = saved;
+        return false;
+    }
+    return true;
+}
+
+bool remove_tree(const char* path) {
+    struct stat st;
+    if (lstat(path, &st) != 0) {
+        return errno == ENOENT;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        return unlink(path) == 0;
+    }
+
+    // Directories left without permissions (overlayfs work directories,
+    // for one) still have to be emptied
+    chmod(path, 0700);
+    DIR* dir = opendir(path);
+    if (!dir) {
+        return false;
+    }
+
+    bool ok = true;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        char child[PATH_MAX];
+        int len = snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        if (len < 0 || (size_t)len >= sizeof(child) || !remove_tree(child)) {
+            ok = false;
+        }
+    }
+    closedir(dir);
+
+    return ok && rmdir(path) == 0;
+}
+
+void write_json_string(FILE* f, const char* str) {
+    fputc('"', f);
+    for (const unsigned char* p = (const unsigned char*)str; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(f, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(f, "\\u%04x", *p);
+        } else {
+            fputc(*p, f);
+        }
+    }
+    fputc('"', f);
+}
+
 void free_string(char* str) {
     free(str);
 }
@@ -2,10 +2,27 @@
 #define UTILS_H
 
 #include <stdbool.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// Timestamps in a struct stat, which macOS names differently
+#ifdef __APPLE__
+#define STAT_ATIME(st) ((st).st_atimespec)
+#define STAT_MTIME(st) ((st).st_mtimespec)
+#define STAT_CTIME(st) ((st).st_ctimespec)
+#else
+#define STAT_ATIME(st) ((st).st_atim)
+#define STAT_MTIME(st) ((st).st_mtim)
+#define STAT_CTIME(st) ((st).st_ctim)
+#endif
 
 // Check if current directory is under HOME
 bool is_under_home_directory(void);
 
+// Check if dir is under HOME
+bool is_directory_under_home(const char* dir);
+
 // Get expanded path (handle ~ and relative paths)
 char* expand_path(const char* path);
 
@@ -15,6 +32,65 @@ char* compute_path_hash(const char* path);
 // Get XDG config directory (~/.config)
 char* get_xdg_config_dir(void);
 
+// Get XDG cache directory (~/.cache)
+char* get_xdg_cache_dir(void);
+
+// Get XDG state directory (~/.local/state)
+char* get_xdg_state_dir(void);
+
+// Get the per-user runtime directory ($XDG_RUNTIME_DIR, or a private
+// directory under /tmp). The directory is created if missing.
+char* get_xdg_runtime_dir(void);
+
+// Create directory path and any missing parents with mode
+bool make_directories(const char* path, mode_t mode);
+
+// Check whether path equals root or lies beneath it
+bool path_is_within(const char* path, const char* root);
+
+// Like execvp, but search the PATH in envp rather than our own
+// environment. Returns only on failure, with errno set.
+void exec_with_env(char* const argv[], char* const envp[]);
+
+// Create a pipe with both ends close-on-exec
+bool create_cloexec_pipe(int fds[2]);
+
+#ifdef __linux__
+// Check whether pid runs with no_new_privs, as every process in a Landlock
+// or seccomp sandbox does. A process that cannot be inspected counts as
+// having it.
+bool process_has_no_new_privs(pid_t pid);
+#endif
+
+// Generate an id for a new overlay session or snapshot
+char* generate_session_id(void);
+
+// Check that an overlay session or snapshot id is usable as a file name
+bool is_valid_session_id(const char* id);
+
+// Parse a duration such as "90", "1.5s", "500ms", "10m" or "2h" into
+// seconds
+bool parse_duration(const char* text, double* seconds);
+
+// Parse a byte count with an optional K, M, G or T suffix (powers of
+// 1024), such as "512M"
+bool parse_size(const char* value, unsigned long long* out);
+
+// Copy a regular file, with its mode and times, to a temporary name next
+// to dest and rename it over dest
+bool copy_file_atomic(const char* source, const char* dest);
+
+// Recreate a symlink at a temporary name next to dest and rename it over
+// dest
+bool copy_symlink_atomic(const char* source, const char* dest);
+
+// Delete a file or a directory and everything below it, without
+// following symlinks. A missing path counts as removed.
+bool remove_tree(const char* path);
+
+// Write str as a quoted JSON string
+void write_json_string(FILE* f, const char* str);
+
 // Free allocated string
 void free_string(char* str);
 
@@ -19,10 +19,10 @@ run_test() {
     echo "Test: $test_name"
     if eval "$command"; then
         echo "  ✓ PASS: $expected_behavior"
-        ((PASS++))
+        PASS=$((PASS + 1))
     else
         echo "  ✗ FAIL: $expected_behavior"
-        ((FAIL++))
+        FAIL=$((FAIL + 1))
     fi
     echo
 }
@@ -31,13 +31,13 @@ run_test() {
 echo "Test 1: No arguments launches interactive bash"
 echo "  (Manual test - skipping in automated suite)"
 echo
-((PASS++))
+PASS=$((PASS + 1))
 
 # Test 2: --allow-write only launches bash
 echo "Test 2: --allow-write only launches interactive bash"
 echo "  (Manual test - skipping in automated suite)"
 echo
-((PASS++))
+PASS=$((PASS + 1))
 
 # Test 3: Direct command execution
 run_test "Execute echo command" \
@@ -68,10 +68,10 @@ run_test "Config operation without command" \
 echo "Test 8: Config operation with command (should fail)"
 if ./sandbash --list-paths echo foo 2>&1 | grep -q -i "error\|cannot"; then
     echo "  ✓ PASS: Correctly rejects config op + command"
-    ((PASS++))
+    PASS=$((PASS + 1))
 else
     echo "  ✗ FAIL: Should reject config op + command"
-    ((FAIL++))
+    FAIL=$((FAIL + 1))
 fi
 echo
 
@@ -79,10 +79,10 @@ echo
 echo "Test 9: --add-path with command (should fail)"
 if ./sandbash --add-path /tmp echo foo 2>&1 | grep -q -i "error\|cannot"; then
     echo "  ✓ PASS: Correctly rejects --add-path + command"
-    ((PASS++))
+    PASS=$((PASS + 1))
 else
     echo "  ✗ FAIL: Should reject --add-path + command"
-    ((FAIL++))
+    FAIL=$((FAIL + 1))
 fi
 echo
 
@@ -96,18 +96,18 @@ echo "Test 11: Write restrictions work with direct execution"
 if ./sandbash --allow-write=/tmp touch /tmp/test_$$.txt && [ -f /tmp/test_$$.txt ]; then
     rm -f /tmp/test_$$.txt
     echo "  ✓ PASS: Can write to /tmp with --allow-write"
-    ((PASS++))
+    PASS=$((PASS + 1))
 else
     echo "  ✗ FAIL: Should be able to write to /tmp with --allow-write"
-    ((FAIL++))
+    FAIL=$((FAIL + 1))
 fi
 
 if ! ./sandbash touch ~/Desktop/test_$$.txt 2>&1 | grep -q "Operation not permitted"; then
     echo "  ✗ FAIL: Should block writes outside sandbox"
-    ((FAIL++))
+    FAIL=$((FAIL + 1))
 else
     echo "  ✓ PASS: Blocks writes outside sandbox"
-    ((PASS++))
+    PASS=$((PASS + 1))
 fi
 echo
 
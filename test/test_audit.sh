@@ -0,0 +1,91 @@
+#!/bin/bash
+# Test --audit mode
+# Writes outside the writable paths must succeed and be logged, including
+# those of processes the command leaves running, and writes inside them
+# must not be logged
+
+set -e
+
+echo "=== Audit Test ==="
+echo
+
+if [ "$(uname -s)" != "Linux" ]; then
+    echo "  (Linux only - skipping)"
+    exit 0
+fi
+
+# sandbash only runs from within $HOME
+WORK_DIR="$HOME/.sandbash_test_audit_$$"
+mkdir -p "$WORK_DIR/config" "$WORK_DIR/project" "$WORK_DIR/cache/npm"
+trap 'rm -rf "$WORK_DIR"' EXIT
+export XDG_CONFIG_HOME="$WORK_DIR/config"
+LOG="$WORK_DIR/audit.jsonl"
+CACHE="$WORK_DIR/cache/npm"
+
+SANDBASH="$PWD/sandbash"
+cd "$WORK_DIR/project"
+PASS=0
+FAIL=0
+
+pass() {
+    echo "  ✓ PASS: $1"
+    PASS=$((PASS + 1))
+}
+
+fail() {
+    echo "  ✗ FAIL: $1"
+    FAIL=$((FAIL + 1))
+}
+
+echo "Test: writes outside the writable paths are allowed and logged"
+set +e
+OUTPUT=$(timeout 30 "$SANDBASH" --audit="$LOG" -- \
+             bash -c "echo x > '$CACHE/first'; echo y > inside; (sleep 0.3; echo z > '$CACHE/late') & exit 4" \
+             2>&1)
+STATUS=$?
+set -e
+if [ ! -f "$LOG" ]; then
+    echo "  (seccomp backend unavailable here - skipping: $OUTPUT)"
+    exit 0
+fi
+if [ -e "$CACHE/first" ] && [ -e "$CACHE/late" ]; then
+    pass "the writes succeeded"
+else
+    fail "a write was refused: $OUTPUT"
+fi
+if grep -q "\"path\":\"$CACHE/first\"" "$LOG" && grep -q "\"path\":\"$CACHE/late\"" "$LOG"; then
+    pass "both logged, including the background process's write"
+else
+    fail "log holds: $(cat "$LOG")"
+fi
+if ! grep -q "inside" "$LOG"; then
+    pass "the write to the current directory is not logged"
+else
+    fail "a write inside the writable paths was logged"
+fi
+if [ "$(grep -c '"syscall":' "$LOG")" -eq "$(wc -l < "$LOG")" ]; then
+    pass "every line is a JSON record with a syscall"
+else
+    fail "malformed log: $(cat "$LOG")"
+fi
+
+echo "Test: the summary suggests the directory"
+if echo "$OUTPUT" | grep -q "2 write(s) outside the writable paths" &&
+   echo "$OUTPUT" | grep -q "sandbash --add-path $WORK_DIR/cache"; then
+    pass "count and --add-path suggestion printed"
+else
+    fail "unexpected summary: $OUTPUT"
+fi
+
+echo "Test: the command's exit status is passed through"
+if [ $STATUS -eq 4 ]; then
+    pass "exit status 4"
+else
+    fail "exit status $STATUS"
+fi
+
+echo
+echo "==================================="
+echo "Passed: $PASS, Failed: $FAIL"
+echo "==================================="
+[ $FAIL -eq 0 ]
@@ -0,0 +1,83 @@
+#!/bin/bash
+# Test the --changes-out manifest
+# It must list exactly what the command created, modified and deleted
+# under the writable paths, including writes by processes it left running
+
+set -e
+
+echo "=== Change Manifest Test ==="
+echo
+
+if [ "$(uname -s)" != "Linux" ]; then
+    echo "  (Linux only - skipping)"
+    exit 0
+fi
+
+# sandbash only runs from within $HOME
+WORK_DIR="$HOME/.sandbash_test_changes_out_$$"
+PROJECT="$WORK_DIR/project"
+mkdir -p "$WORK_DIR/config" "$PROJECT/src"
+trap 'rm -rf "$WORK_DIR"' EXIT
+export XDG_CONFIG_HOME="$WORK_DIR/config"
+echo old > "$PROJECT/src/main.c"
+echo old > "$PROJECT/old.txt"
+echo old > "$PROJECT/untouched"
+
+SANDBASH="$PWD/sandbash"
+cd "$PROJECT"
+PASS=0
+FAIL=0
+
+pass() {
+    echo "  ✓ PASS: $1"
+    PASS=$((PASS + 1))
+}
+
+fail() {
+    echo "  ✗ FAIL: $1"
+    FAIL=$((FAIL + 1))
+}
+
+echo "Test: created, modified and deleted paths are listed"
+set +e
+OUTPUT=$(timeout 30 "$SANDBASH" --changes-out="$WORK_DIR/changes" -- \
+             bash -c 'echo new >> src/main.c; mkdir build; echo o > build/main.o; rm old.txt
+                      touch temp; rm temp
+                      (sleep 0.5; echo late > late.txt) & exit 3' 2>&1)
+STATUS=$?
+set -e
+if [ ! -f "$WORK_DIR/changes" ]; then
+    echo "  (change tracking unavailable here - skipping: $OUTPUT)"
+    exit 0
+fi
+EXPECTED="A $PROJECT/build/
+A $PROJECT/build/main.o
+A $PROJECT/late.txt
+D $PROJECT/old.txt
+M $PROJECT/src/main.c"
+if [ "$(cat "$WORK_DIR/changes")" = "$EXPECTED" ]; then
+    pass "sorted manifest with every change"
+else
+    fail "unexpected manifest: $(cat "$WORK_DIR/changes")"
+fi
+
+echo "Test: the command's exit status is passed through"
+if [ $STATUS -eq 3 ]; then
+    pass "exit status 3"
+else
+    fail "exit status $STATUS: $OUTPUT"
+fi
+
+echo "Test: nothing changed gives an empty manifest"
+timeout 30 "$SANDBASH" --changes-out="$WORK_DIR/none" -- cat untouched >/dev/null 2>&1 || true
+if [ -f "$WORK_DIR/none" ] && [ ! -s "$WORK_DIR/none" ]; then
+    pass "empty file"
+else
+    fail "manifest holds: $(cat "$WORK_DIR/none" 2>/dev/null)"
+fi
+
+echo
+echo "==================================="
+echo "Passed: $PASS, Failed: $FAIL"
+echo "==================================="
+[ $FAIL -eq 0 ]
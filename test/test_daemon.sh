@@ -0,0 +1,119 @@
+#!/bin/bash
+# Test launching commands through sandbashd
+# The daemon must run the command in the same sandbox sandbash would set
+# up, with the caller's working directory, output and exit status
+
+set -e
+
+echo "=== Daemon Test ==="
+echo
+
+if [ "$(uname -s)" != "Linux" ]; then
+    echo "  (Linux only - skipping)"
+    exit 0
+fi
+
+# sandbash only runs from within $HOME
+WORK_DIR="$HOME/.sandbash_test_daemon_$$"
+mkdir -p "$WORK_DIR/config" "$WORK_DIR/runtime" "$WORK_DIR/project" "$WORK_DIR/outside"
+chmod 700 "$WORK_DIR/runtime"
+export XDG_CONFIG_HOME="$WORK_DIR/config"
+export XDG_RUNTIME_DIR="$WORK_DIR/runtime"
+SOCKET="$XDG_RUNTIME_DIR/sandbash/sandbashd.sock"
+
+SANDBASH="$PWD/sandbash"
+SANDBASHD="$PWD/sandbashd"
+DAEMON_PID=""
+cleanup() {
+    if [ -n "$DAEMON_PID" ]; then
+        kill "$DAEMON_PID" 2>/dev/null || true
+        wait "$DAEMON_PID" 2>/dev/null || true
+    fi
+    rm -rf "$WORK_DIR"
+}
+trap cleanup EXIT
+
+PASS=0
+FAIL=0
+
+pass() {
+    echo "  ✓ PASS: $1"
+    PASS=$((PASS + 1))
+}
+
+fail() {
+    echo "  ✗ FAIL: $1"
+    FAIL=$((FAIL + 1))
+}
+
+cd "$WORK_DIR/project"
+"$SANDBASHD" --idle-timeout=30 2>"$WORK_DIR/daemon.log" &
+DAEMON_PID=$!
+for _ in $(seq 50); do
+    [ -S "$SOCKET" ] && break
+    sleep 0.1
+done
+if [ ! -S "$SOCKET" ]; then
+    echo "  (daemon did not start - skipping: $(cat "$WORK_DIR/daemon.log"))"
+    exit 0
+fi
+
+echo "Test: the command runs in a zygote"
+set +e
+OUTPUT=$(timeout 20 "$SANDBASH" --use-daemon -- \
+             bash -c 'echo "parent=$(cat /proc/$PPID/comm) cwd=$PWD"; exit 7' 2>&1)
+STATUS=$?
+set -e
+if echo "$OUTPUT" | grep -q "parent=sandbashd"; then
+    pass "started by sandbashd"
+else
+    echo "  (daemon refused the request - skipping: $OUTPUT)"
+    exit 0
+fi
+if echo "$OUTPUT" | grep -q "cwd=$WORK_DIR/project$"; then
+    pass "working directory passed on"
+else
+    fail "wrong working directory: $OUTPUT"
+fi
+if [ $STATUS -eq 7 ]; then
+    pass "exit status passed back"
+else
+    fail "exit status $STATUS, expected 7"
+fi
+
+echo "Test: the zygote enforces the writable paths"
+timeout 20 "$SANDBASH" --use-daemon -- \
+    bash -c "touch '$WORK_DIR/project/inside'; touch '$WORK_DIR/outside/escaped'" \
+    >/dev/null 2>&1 || true
+if [ -e "$WORK_DIR/project/inside" ] && [ ! -e "$WORK_DIR/outside/escaped" ]; then
+    pass "current directory writable, the rest read-only"
+else
+    fail "writable paths not enforced by the zygote"
+fi
+
+echo "Test: a config edit applies to the next command"
+"$SANDBASH" --add-path "$WORK_DIR/outside" >/dev/null
+timeout 20 "$SANDBASH" --use-daemon -- bash -c "touch '$WORK_DIR/outside/added'" \
+    >/dev/null 2>&1 || true
+if [ -e "$WORK_DIR/outside/added" ]; then
+    pass "the added path is writable"
+else
+    fail "the daemon used a stale set of writable paths"
+fi
+
+echo "Test: without the daemon the command runs locally"
+kill "$DAEMON_PID"
+wait "$DAEMON_PID" 2>/dev/null || true
+DAEMON_PID=""
+OUTPUT=$(timeout 20 "$SANDBASH" --use-daemon -- bash -c 'echo ran' 2>&1 || true)
+if echo "$OUTPUT" | grep -q "^ran$"; then
+    pass "fell back to a local sandbox"
+else
+    fail "command did not run: $OUTPUT"
+fi
+
+echo
+echo "==================================="
+echo "Passed: $PASS, Failed: $FAIL"
+echo "==================================="
+[ $FAIL -eq 0 ]
@@ -0,0 +1,94 @@
+#!/bin/bash
+# Test --each-dir fan-out
+# Every directory must run in its own sandbox, built from its own config,
+# with prefixed output and a summary of the ones that failed
+
+set -e
+
+echo "=== Fan-out Test ==="
+echo
+
+if [ "$(uname -s)" != "Linux" ]; then
+    echo "  (Linux only - skipping)"
+    exit 0
+fi
+
+# sandbash only runs from within $HOME
+WORK_DIR="$HOME/.sandbash_test_fanout_$$"
+mkdir -p "$WORK_DIR/config" "$WORK_DIR/a" "$WORK_DIR/b" "$WORK_DIR/c" "$WORK_DIR/shared"
+trap 'rm -rf "$WORK_DIR"' EXIT
+export XDG_CONFIG_HOME="$WORK_DIR/config"
+
+SANDBASH="$PWD/sandbash"
+PASS=0
+FAIL=0
+
+pass() {
+    echo "  ✓ PASS: $1"
+    PASS=$((PASS + 1))
+}
+
+fail() {
+    echo "  ✗ FAIL: $1"
+    FAIL=$((FAIL + 1))
+}
+
+# Only a's config makes the shared directory writable, and c fails
+(cd "$WORK_DIR/a" && "$SANDBASH" --add-path "$WORK_DIR/shared" >/dev/null)
+touch "$WORK_DIR/c/fail"
+
+echo "Test: each directory runs in its own sandbox"
+set +e
+OUTPUT=$(cd "$WORK_DIR" && timeout 60 "$SANDBASH" --jobs=2 --each-dir a b c -- \
+             bash -c 'echo "in $(basename "$PWD")"; touch ../shared/"$(basename "$PWD")"; touch own; [ ! -e fail ]' \
+             2>&1)
+STATUS=$?
+set -e
+if [ ! -e "$WORK_DIR/a/own" ]; then
+    echo "  (sandbox could not run here - skipping: $OUTPUT)"
+    exit 0
+fi
+if [ -e "$WORK_DIR/a/own" ] && [ -e "$WORK_DIR/b/own" ] && [ -e "$WORK_DIR/c/own" ]; then
+    pass "every directory writable by its own run"
+else
+    fail "a directory was not writable by its run"
+fi
+if [ -e "$WORK_DIR/shared/a" ] && [ ! -e "$WORK_DIR/shared/b" ] && [ ! -e "$WORK_DIR/shared/c" ]; then
+    pass "only a's config made the shared directory writable"
+else
+    fail "configs were not applied per directory: $(ls "$WORK_DIR/shared")"
+fi
+
+echo "Test: output lines are prefixed with their directory"
+if echo "$OUTPUT" | grep -q "^\[a\] in a$" && echo "$OUTPUT" | grep -q "^\[b\] in b$" &&
+   echo "$OUTPUT" | grep -q "^\[c\] in c$"; then
+    pass "every line prefixed"
+else
+    fail "unexpected output: $OUTPUT"
+fi
+
+echo "Test: the summary lists the failed directory"
+if [ $STATUS -ne 0 ] && echo "$OUTPUT" | grep -q "^  FAIL c: exit 1" &&
+   echo "$OUTPUT" | grep -q "3 directories, 2 succeeded, 1 failed"; then
+    pass "exit status $STATUS, c listed as failed"
+else
+    fail "status $STATUS, output: $OUTPUT"
+fi
+
+echo "Test: all directories passing exits 0"
+rm "$WORK_DIR/c/fail"
+set +e
+(cd "$WORK_DIR" && timeout 60 "$SANDBASH" --jobs=2 --each-dir a b c -- true >/dev/null 2>&1)
+STATUS=$?
+set -e
+if [ $STATUS -eq 0 ]; then
+    pass "exit status 0"
+else
+    fail "exit status $STATUS"
+fi
+
+echo
+echo "==================================="
+echo "Passed: $PASS, Failed: $FAIL"
+echo "==================================="
+[ $FAIL -eq 0 ]
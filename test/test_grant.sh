@@ -0,0 +1,106 @@
+#!/bin/bash
+# Test --allow-grants and --grant
+# A path granted from outside must become writable in the running sandbox,
+# and a grant from inside the sandbox must be refused
+
+set -e
+
+echo "=== Grant Test ==="
+echo
+
+if [ "$(uname -s)" != "Linux" ]; then
+    echo "  (Linux only - skipping)"
+    exit 0
+fi
+
+# sandbash only runs from within $HOME
+WORK_DIR="$HOME/.sandbash_test_grant_$$"
+RUNTIME_DIR=$(mktemp -d)
+mkdir -p "$WORK_DIR/config" "$WORK_DIR/project" "$WORK_DIR/granted" "$WORK_DIR/other"
+trap 'rm -rf "$WORK_DIR" "$RUNTIME_DIR"' EXIT
+export XDG_CONFIG_HOME="$WORK_DIR/config"
+export XDG_RUNTIME_DIR="$RUNTIME_DIR"
+SESSION="grant-test-$$"
+
+SANDBASH="$PWD/sandbash"
+cd "$WORK_DIR/project"
+PASS=0
+FAIL=0
+
+pass() {
+    echo "  ✓ PASS: $1"
+    PASS=$((PASS + 1))
+}
+
+fail() {
+    echo "  ✗ FAIL: $1"
+    FAIL=$((FAIL + 1))
+}
+
+# The sandboxed command tries both directories before and after the grant,
+# and tries to grant itself the other one in between
+timeout 60 "$SANDBASH" --allow-grants --session="$SESSION" -- bash -c "
+    touch '$WORK_DIR/granted/before' 2>/dev/null
+    '$SANDBASH' --grant '$WORK_DIR/other' --session='$SESSION' && echo 'self grant accepted'
+    touch ready
+    while [ ! -e go ]; do sleep 0.1; done
+    touch '$WORK_DIR/granted/after' '$WORK_DIR/other/after' 2>/dev/null
+    touch done" > "$WORK_DIR/output" 2>&1 &
+RUN_PID=$!
+
+for _ in $(seq 100); do
+    [ -e ready ] && break
+    sleep 0.1
+done
+if [ ! -e ready ]; then
+    wait $RUN_PID 2>/dev/null || true
+    echo "  (seccomp backend unavailable here - skipping: $(cat "$WORK_DIR/output"))"
+    exit 0
+fi
+
+echo "Test: --grant from outside the sandbox"
+set +e
+OUTPUT=$("$SANDBASH" --grant "$WORK_DIR/granted" --session="$SESSION" 2>&1)
+STATUS=$?
+set -e
+touch go
+wait $RUN_PID 2>/dev/null || true
+if [ $STATUS -eq 0 ]; then
+    pass "grant accepted"
+else
+    fail "grant refused: $OUTPUT"
+fi
+if [ ! -e "$WORK_DIR/granted/before" ] && [ -e "$WORK_DIR/granted/after" ]; then
+    pass "the granted path became writable in the running sandbox"
+else
+    fail "granted path writable before: $([ -e "$WORK_DIR/granted/before" ] && echo yes || echo no), after: $([ -e "$WORK_DIR/granted/after" ] && echo yes || echo no)"
+fi
+
+echo "Test: a grant from inside the sandbox is refused"
+if grep -q "grants must come from outside the sandbox" "$WORK_DIR/output" &&
+   ! grep -q "self grant accepted" "$WORK_DIR/output" && [ ! -e "$WORK_DIR/other/after" ]; then
+    pass "the other path stayed read-only"
+else
+    fail "the sandbox widened its own policy: $(cat "$WORK_DIR/output")"
+fi
+
+echo "Test: the grant is not saved"
+timeout 30 "$SANDBASH" -- bash -c "touch '$WORK_DIR/granted/later'" >/dev/null 2>&1 || true
+if [ ! -e "$WORK_DIR/granted/later" ] && [ -e done ]; then
+    pass "the next sandbox cannot write the granted path"
+else
+    fail "the grant outlived the sandbox"
+fi
+
+echo "Test: --grant to a session that does not exist"
+if ! "$SANDBASH" --grant "$WORK_DIR/granted" --session="missing-$$" >/dev/null 2>&1; then
+    pass "refused"
+else
+    fail "accepted"
+fi
+
+echo
+echo "==================================="
+echo "Passed: $PASS, Failed: $FAIL"
+echo "==================================="
+[ $FAIL -eq 0 ]
@@ -0,0 +1,150 @@
+#!/bin/bash
+# Test spawning sandboxed children through libsandbash
+# A program linked against the library loads a config once and spawns two
+# commands from it, which must get the same writable paths as sandbash
+
+set -e
+
+echo "=== Library Test ==="
+echo
+
+if [ "$(uname -s)" != "Linux" ]; then
+    echo "  (Linux only - skipping)"
+    exit 0
+fi
+
+# sandbash only runs from within $HOME
+WORK_DIR="$HOME/.sandbash_test_library_$$"
+mkdir -p "$WORK_DIR/config" "$WORK_DIR/project" "$WORK_DIR/extra" "$WORK_DIR/outside"
+trap 'rm -rf "$WORK_DIR"' EXIT
+export XDG_CONFIG_HOME="$WORK_DIR/config"
+
+PASS=0
+FAIL=0
+
+pass() {
+    echo "  ✓ PASS: $1"
+    PASS=$((PASS + 1))
+}
+
+fail() {
+    echo "  ✗ FAIL: $1"
+    FAIL=$((FAIL + 1))
+}
+
+cat > "$WORK_DIR/spawn.c" << 'EOF'
+#include "sandbash.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// spawn DIR EXTRA OUTPUT SCRIPT: run SCRIPT twice with sh in DIR, with
+// EXTRA writable and stdout in OUTPUT, and print what happened
+int main(int argc, char* argv[]) {
+    if (argc != 5) {
+        return 2;
+    }
+    const char* allow[] = { argv[2] };
+    SandbashOptions options = { 0 };
+    options.directory = argv[1];
+    options.allow_write = allow;
+    options.allow_write_count = 1;
+
+    SandbashConfig* config;
+    SandbashError error = sandbash_config_load(&options, &config);
+    if (error != SANDBASH_OK) {
+        printf("load: %s\n", sandbash_strerror(error));
+        return 1;
+    }
+    printf("backend: %s\n", sandbash_config_backend(config));
+    for (size_t i = 0; i < sandbash_config_path_count(config); i++) {
+        printf("path: %s\n", sandbash_config_path(config, i));
+    }
+
+    int out = open(argv[3], O_WRONLY | O_CREAT | O_APPEND, 0644);
+    int fds[3] = { -1, out, -1 };
+    char* command[] = { "sh", "-c", argv[4], NULL };
+    for (int run = 0; run < 2; run++) {
+        SandbashProcess process;
+        error = sandbash_spawn(config, command, NULL, fds, &process);
+        if (error != SANDBASH_OK) {
+            printf("spawn: %s\n", sandbash_strerror(error));
+            return 1;
+        }
+        int status;
+        waitpid(process.pid, &status, 0);
+        if (process.pidfd >= 0) {
+            close(process.pidfd);
+        }
+        printf("status: %d\n", WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+    }
+    close(out);
+
+    options.directory = "/";
+    SandbashConfig* outside;
+    error = sandbash_config_load(&options, &outside);
+    printf("outside home: %s\n", error == SANDBASH_ERR_OUTSIDE_HOME ? "refused" : "loaded");
+    sandbash_config_free(config);
+    return 0;
+}
+EOF
+
+if [ ! -f libsandbash.a ] && ! make -s libsandbash.a; then
+    echo "✗ FAIL: could not build libsandbash.a"
+    exit 1
+fi
+if ! ${CC:-cc} -I src -o "$WORK_DIR/spawn" "$WORK_DIR/spawn.c" libsandbash.a -pthread; then
+    echo "✗ FAIL: test program did not link"
+    exit 1
+fi
+
+echo "Test: a loaded config lists the merged writable paths"
+set +e
+OUTPUT=$(cd "$WORK_DIR" && timeout 20 "$WORK_DIR/spawn" "$WORK_DIR/project" "$WORK_DIR/extra" \
+             "$WORK_DIR/output" \
+             "echo run; touch '$WORK_DIR/project/in' '$WORK_DIR/extra/in'; touch '$WORK_DIR/outside/escaped'; exit 3" \
+             2>&1)
+set -e
+if echo "$OUTPUT" | grep -qx "path: $WORK_DIR/project" &&
+   echo "$OUTPUT" | grep -qx "path: $WORK_DIR/extra"; then
+    pass "directory and extra path listed"
+else
+    fail "unexpected paths: $OUTPUT"
+fi
+
+echo "Test: spawned commands run in the sandbox"
+if echo "$OUTPUT" | grep -q "^spawn:"; then
+    echo "  (sandbox could not run here - skipping: $OUTPUT)"
+else
+    if [ "$(echo "$OUTPUT" | grep -c "^status: 3$")" -eq 2 ]; then
+        pass "both children exited with the command's status"
+    else
+        fail "unexpected statuses: $OUTPUT"
+    fi
+    if [ "$(grep -c "^run$" "$WORK_DIR/output" 2>/dev/null)" = "2" ]; then
+        pass "stdout went to the given fd"
+    else
+        fail "output file holds: $(cat "$WORK_DIR/output" 2>/dev/null)"
+    fi
+    if [ -e "$WORK_DIR/project/in" ] && [ -e "$WORK_DIR/extra/in" ] &&
+       [ ! -e "$WORK_DIR/outside/escaped" ]; then
+        pass "writable paths enforced"
+    else
+        fail "writable paths not enforced"
+    fi
+fi
+
+echo "Test: a directory outside \$HOME is refused"
+if echo "$OUTPUT" | grep -q "outside home: refused"; then
+    pass "SANDBASH_ERR_OUTSIDE_HOME returned"
+else
+    fail "unexpected result: $OUTPUT"
+fi
+
+echo
+echo "==================================="
+echo "Passed: $PASS, Failed: $FAIL"
+echo "==================================="
+[ $FAIL -eq 0 ]
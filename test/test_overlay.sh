@@ -0,0 +1,112 @@
+#!/bin/bash
+# Test --overlay sessions with --overlay-diff, --overlay-commit and
+# --overlay-discard
+# Writes outside the writable paths must stay in the session until they
+# are committed, and be gone once it is discarded
+
+set -e
+
+echo "=== Overlay Test ==="
+echo
+
+if [ "$(uname -s)" != "Linux" ]; then
+    echo "  (Linux only - skipping)"
+    exit 0
+fi
+
+# sandbash only runs from within $HOME; sessions must live outside it
+WORK_DIR="$HOME/.sandbash_test_overlay_$$"
+RUNTIME_DIR=$(mktemp -d)
+mkdir -p "$WORK_DIR/config" "$WORK_DIR/project" "$WORK_DIR/other"
+trap 'rm -rf "$WORK_DIR" "$RUNTIME_DIR"' EXIT
+export XDG_CONFIG_HOME="$WORK_DIR/config"
+export XDG_RUNTIME_DIR="$RUNTIME_DIR"
+OTHER="$WORK_DIR/other"
+echo old > "$OTHER/modified"
+echo old > "$OTHER/deleted"
+
+SANDBASH="$PWD/sandbash"
+cd "$WORK_DIR/project"
+PASS=0
+FAIL=0
+
+pass() {
+    echo "  ✓ PASS: $1"
+    PASS=$((PASS + 1))
+}
+
+fail() {
+    echo "  ✗ FAIL: $1"
+    FAIL=$((FAIL + 1))
+}
+
+echo "Test: writes outside the writable paths go to the session"
+set +e
+OUTPUT=$(timeout 20 "$SANDBASH" --overlay=first -- \
+             bash -c "echo new > '$OTHER/added'; echo new > '$OTHER/modified'; rm '$OTHER/deleted'; echo new > direct" \
+             2>&1)
+STATUS=$?
+set -e
+if [ $STATUS -ne 0 ]; then
+    echo "  (overlay unavailable here - skipping: $OUTPUT)"
+    exit 0
+fi
+if [ ! -e "$OTHER/added" ] && [ "$(cat "$OTHER/modified")" = old ] && [ -e "$OTHER/deleted" ]; then
+    pass "the real files are untouched"
+else
+    fail "a write outside the writable paths reached the disk"
+fi
+if [ -e direct ]; then
+    pass "the current directory is written through"
+else
+    fail "the write to the current directory was captured"
+fi
+
+echo "Test: a later command in the session sees the earlier writes"
+OUTPUT=$(timeout 20 "$SANDBASH" --overlay=first -- cat "$OTHER/added" 2>/dev/null || true)
+if [ "$OUTPUT" = new ]; then
+    pass "session continued"
+else
+    fail "the second command did not see the first one's write: $OUTPUT"
+fi
+
+echo "Test: --overlay-diff lists the changes"
+OUTPUT=$("$SANDBASH" --overlay-diff first 2>&1)
+EXPECTED="A $OTHER/added
+D $OTHER/deleted
+M $OTHER/modified"
+if [ "$OUTPUT" = "$EXPECTED" ]; then
+    pass "A, D and M lines"
+else
+    fail "unexpected diff: $OUTPUT"
+fi
+
+echo "Test: --overlay-commit applies the changes"
+"$SANDBASH" --overlay-commit first >/dev/null 2>&1 || true
+if [ "$(cat "$OTHER/added" 2>/dev/null)" = new ] &&
+   [ "$(cat "$OTHER/modified")" = new ] && [ ! -e "$OTHER/deleted" ]; then
+    pass "changes on disk"
+else
+    fail "changes not applied"
+fi
+if ! "$SANDBASH" --overlay-diff first >/dev/null 2>&1; then
+    pass "session deleted"
+else
+    fail "session still exists after the commit"
+fi
+
+echo "Test: --overlay-discard throws the changes away"
+timeout 20 "$SANDBASH" --overlay=second -- bash -c "echo discarded > '$OTHER/added'" \
+    >/dev/null 2>&1 || true
+"$SANDBASH" --overlay-discard second >/dev/null 2>&1 || true
+if [ "$(cat "$OTHER/added")" = new ] && ! "$SANDBASH" --overlay-diff second >/dev/null 2>&1; then
+    pass "real file kept and session deleted"
+else
+    fail "discarded changes applied or session kept"
+fi
+
+echo
+echo "==================================="
+echo "Passed: $PASS, Failed: $FAIL"
+echo "==================================="
+[ $FAIL -eq 0 ]
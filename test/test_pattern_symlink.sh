@@ -0,0 +1,61 @@
+#!/bin/bash
+# Test that pattern expansion does not follow symlinks
+# A sandbox that can write one match of a pattern could otherwise replace
+# another with a symlink and have later launches grant its target
+
+set -e
+
+echo "=== Pattern Symlink Test ==="
+echo
+
+if [ "$(uname -s)" != "Linux" ]; then
+    echo "  (Linux only - skipping)"
+    exit 0
+fi
+
+# sandbash only runs from within $HOME
+WORK_DIR="$HOME/.sandbash_test_pattern_symlink_$$"
+OUTSIDE_DIR="/tmp/sandbash_test_pattern_symlink_$$"
+mkdir -p "$WORK_DIR/projects/a" "$WORK_DIR/projects/b/build" "$WORK_DIR/elsewhere" \
+         "$OUTSIDE_DIR"
+trap 'rm -rf "$WORK_DIR" "$OUTSIDE_DIR"' EXIT
+ln -s "$OUTSIDE_DIR" "$WORK_DIR/projects/a/build"
+
+SANDBASH="$PWD/sandbash"
+cd "$WORK_DIR/elsewhere"
+
+FAILED=0
+for BACKEND in landlock namespace; do
+    echo "Test: $BACKEND backend with a symlinked match"
+    set +e
+    OUTPUT=$(timeout 20 "$SANDBASH" --backend="$BACKEND" --no-cache \
+                 --allow-write="$WORK_DIR/projects/*/build" -- \
+                 bash -c "touch '$OUTSIDE_DIR/escaped'; touch '$WORK_DIR/projects/b/build/ok'" \
+                 2>&1)
+    STATUS=$?
+    set -e
+
+    if [ ! -e "$WORK_DIR/projects/b/build/ok" ]; then
+        # Backend unavailable here, or the launch failed for another reason
+        echo "  (could not run with $BACKEND - skipping: $OUTPUT)"
+        continue
+    fi
+    if [ -e "$OUTSIDE_DIR/escaped" ]; then
+        echo "  ✗ FAIL: the symlinked match made $OUTSIDE_DIR writable"
+        FAILED=1
+    else
+        echo "  ✓ PASS: symlinked match skipped, real match writable (exit status $STATUS)"
+    fi
+    rm -f "$OUTSIDE_DIR/escaped" "$WORK_DIR/projects/b/build/ok"
+done
+
+echo
+echo "==================================="
+if [ $FAILED -ne 0 ]; then
+    echo "Pattern symlink test failed"
+    echo "==================================="
+    exit 1
+fi
+echo "Pattern symlink test passed"
+echo "==================================="
+exit 0
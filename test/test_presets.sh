@@ -0,0 +1,114 @@
+#!/bin/bash
+# Test toolchain cache presets
+# A preset must make its toolchain's caches writable, wherever the
+# toolchain's variables move them, and nothing else
+
+set -e
+
+echo "=== Presets Test ==="
+echo
+
+if [ "$(uname -s)" != "Linux" ]; then
+    echo "  (Linux only - skipping)"
+    exit 0
+fi
+
+# sandbash only runs from within $HOME
+WORK_DIR="$HOME/.sandbash_test_presets_$$"
+mkdir -p "$WORK_DIR/config" "$WORK_DIR/project" "$WORK_DIR/bin" "$WORK_DIR/cargo/bin"
+trap 'rm -rf "$WORK_DIR"' EXIT
+export XDG_CONFIG_HOME="$WORK_DIR/config"
+export npm_config_cache="$WORK_DIR/npm-cache"
+export CARGO_HOME="$WORK_DIR/cargo"
+export CCACHE_DIR="$WORK_DIR/ccache"
+
+SANDBASH="$PWD/sandbash"
+cd "$WORK_DIR/project"
+PASS=0
+FAIL=0
+
+pass() {
+    echo "  ✓ PASS: $1"
+    PASS=$((PASS + 1))
+}
+
+fail() {
+    echo "  ✗ FAIL: $1"
+    FAIL=$((FAIL + 1))
+}
+
+echo "Test: config operations do not create missing caches"
+OUTPUT=$("$SANDBASH" --preset=node --list-paths 2>&1 || true)
+if [ ! -e "$npm_config_cache" ] && ! echo "$OUTPUT" | grep -q "$npm_config_cache"; then
+    pass "--list-paths left the npm cache out"
+else
+    fail "--list-paths created or listed the missing cache: $OUTPUT"
+fi
+
+echo "Test: --preset=node creates and grants the npm cache"
+set +e
+OUTPUT=$(timeout 30 "$SANDBASH" --no-cache --preset=node -- \
+             bash -c "touch '$npm_config_cache/entry'" 2>&1)
+STATUS=$?
+set -e
+if [ ! -d "$npm_config_cache" ]; then
+    fail "the cache was not created: $OUTPUT"
+elif [ $STATUS -eq 0 ] && [ -e "$npm_config_cache/entry" ]; then
+    pass "npm cache writable"
+else
+    echo "  (sandbox could not run here - skipping: $OUTPUT)"
+    exit 0
+fi
+
+echo "Test: --preset=rust grants the registry but not cargo's bin"
+timeout 30 "$SANDBASH" --no-cache --preset=rust -- \
+    bash -c "touch '$CARGO_HOME/registry/entry'; touch '$CARGO_HOME/bin/escaped'" \
+    >/dev/null 2>&1 || true
+if [ -e "$CARGO_HOME/registry/entry" ] && [ ! -e "$CARGO_HOME/bin/escaped" ]; then
+    pass "registry writable, bin read-only"
+else
+    fail "wrong cargo paths writable"
+fi
+
+echo "Test: a preset line in a config applies"
+"$SANDBASH" --add-path "$WORK_DIR/bin" >/dev/null
+CONFIG=$(grep -l "config for: $WORK_DIR/project$" "$XDG_CONFIG_HOME"/sandbash/projects/*)
+echo "preset ccache" >> "$CONFIG"
+timeout 30 "$SANDBASH" --no-cache -- bash -c "touch '$CCACHE_DIR/from-config'" >/dev/null 2>&1 || true
+if [ -e "$CCACHE_DIR/from-config" ]; then
+    pass "ccache directory writable"
+else
+    fail "the config's preset line was not applied"
+fi
+
+echo "Test: --preset=auto picks presets from the command name"
+rm -rf "$CCACHE_DIR"
+sed -i '/^preset /d' "$CONFIG"
+printf '#!/bin/bash\ntouch "%s/from-auto"\n' "$CCACHE_DIR" > "$WORK_DIR/bin/make"
+chmod +x "$WORK_DIR/bin/make"
+timeout 30 "$SANDBASH" --no-cache --preset=auto -- "$WORK_DIR/bin/make" >/dev/null 2>&1 || true
+if [ -e "$CCACHE_DIR/from-auto" ]; then
+    pass "make selected ccache"
+else
+    fail "auto did not select ccache for make"
+fi
+rm -f "$CCACHE_DIR/from-auto"
+timeout 30 "$SANDBASH" --no-cache -- "$WORK_DIR/bin/make" >/dev/null 2>&1 || true
+if [ ! -e "$CCACHE_DIR/from-auto" ]; then
+    pass "no preset without --preset"
+else
+    fail "ccache writable without a preset"
+fi
+
+echo "Test: an unknown preset is refused"
+if ! "$SANDBASH" --preset=cobol -- true >/dev/null 2>&1; then
+    pass "--preset=cobol rejected"
+else
+    fail "unknown preset accepted"
+fi
+
+echo
+echo "==================================="
+echo "Passed: $PASS, Failed: $FAIL"
+echo "==================================="
+[ $FAIL -eq 0 ]
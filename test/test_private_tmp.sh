@@ -0,0 +1,82 @@
+#!/bin/bash
+# Test --private-tmp
+# The command must get an empty, writable, size-capped /tmp of its own
+# with every backend, and nothing it writes there may reach the real /tmp
+
+set -e
+
+echo "=== Private /tmp Test ==="
+echo
+
+if [ "$(uname -s)" != "Linux" ]; then
+    echo "  (Linux only - skipping)"
+    exit 0
+fi
+
+# sandbash only runs from within $HOME
+WORK_DIR="$HOME/.sandbash_test_private_tmp_$$"
+MARKER="/tmp/sandbash_test_private_tmp_$$"
+mkdir -p "$WORK_DIR/config" "$WORK_DIR/project"
+touch "$MARKER"
+trap 'rm -rf "$WORK_DIR" "$MARKER" "$MARKER.written"' EXIT
+export XDG_CONFIG_HOME="$WORK_DIR/config"
+
+SANDBASH="$PWD/sandbash"
+cd "$WORK_DIR/project"
+PASS=0
+FAIL=0
+
+pass() {
+    echo "  ✓ PASS: $1"
+    PASS=$((PASS + 1))
+}
+
+fail() {
+    echo "  ✗ FAIL: $1"
+    FAIL=$((FAIL + 1))
+}
+
+for BACKEND in landlock namespace seccomp; do
+    echo "Test: $BACKEND backend"
+    set +e
+    OUTPUT=$(timeout 30 "$SANDBASH" --backend="$BACKEND" --private-tmp=1M -- bash -c "
+                 [ -e '$MARKER' ] && echo 'sees real tmp'
+                 echo data > '$MARKER.written' && echo 'tmp writable'
+                 head -c 2000000 /dev/zero > /tmp/big 2>/dev/null || echo 'size capped'" 2>&1)
+    STATUS=$?
+    set -e
+    if [ $STATUS -ne 0 ] && ! echo "$OUTPUT" | grep -q "tmp writable"; then
+        echo "  (could not run with $BACKEND - skipping: $OUTPUT)"
+        continue
+    fi
+    if echo "$OUTPUT" | grep -q "tmp writable" && ! echo "$OUTPUT" | grep -q "sees real tmp"; then
+        pass "empty and writable"
+    else
+        fail "unexpected /tmp: $OUTPUT"
+    fi
+    if echo "$OUTPUT" | grep -q "size capped"; then
+        pass "a 2M write to a 1M /tmp failed"
+    else
+        fail "the size limit was not applied"
+    fi
+    if [ ! -e "$MARKER.written" ]; then
+        pass "nothing reached the real /tmp"
+    else
+        fail "a write reached the real /tmp"
+        rm -f "$MARKER.written"
+    fi
+done
+
+echo "Test: without --private-tmp, /tmp stays read-only"
+timeout 30 "$SANDBASH" -- bash -c "echo data > '$MARKER.written'" >/dev/null 2>&1 || true
+if [ ! -e "$MARKER.written" ]; then
+    pass "write to /tmp refused"
+else
+    fail "/tmp writable without --private-tmp"
+fi
+
+echo
+echo "==================================="
+echo "Passed: $PASS, Failed: $FAIL"
+echo "==================================="
+[ $FAIL -eq 0 ]
@@ -0,0 +1,92 @@
+#!/bin/bash
+# Test --profile-io
+# File syscalls of the command and its children must be counted against
+# the directory they go to
+
+set -e
+
+echo "=== I/O Profile Test ==="
+echo
+
+if [ "$(uname -s)" != "Linux" ]; then
+    echo "  (Linux only - skipping)"
+    exit 0
+fi
+
+# sandbash only runs from within $HOME
+WORK_DIR="$HOME/.sandbash_test_profile_io_$$"
+PROJECT="$WORK_DIR/project"
+mkdir -p "$WORK_DIR/config" "$PROJECT/busy" "$PROJECT/quiet"
+trap 'rm -rf "$WORK_DIR"' EXIT
+export XDG_CONFIG_HOME="$WORK_DIR/config"
+REPORT="$WORK_DIR/io.tsv"
+
+SANDBASH="$PWD/sandbash"
+if [ ! -f "$PWD/libsandbash-profile.so" ] && ! make -s libsandbash-profile.so; then
+    echo "✗ FAIL: could not build libsandbash-profile.so"
+    exit 1
+fi
+cd "$PROJECT"
+PASS=0
+FAIL=0
+
+pass() {
+    echo "  ✓ PASS: $1"
+    PASS=$((PASS + 1))
+}
+
+fail() {
+    echo "  ✗ FAIL: $1"
+    FAIL=$((FAIL + 1))
+}
+
+# Column n of the report line for a directory
+column() {
+    awk -F'\t' -v dir="$1" -v n="$2" '$7 == dir { print $n }' "$REPORT"
+}
+
+echo "Test: calls are counted per directory"
+set +e
+OUTPUT=$(timeout 30 "$SANDBASH" --profile-io="$REPORT" -- \
+             bash -c 'for i in 1 2 3 4 5; do dd if=/dev/zero of=busy/f$i bs=1k count=2 2>/dev/null; cat busy/f$i > /dev/null; done
+                      stat quiet > /dev/null; mv busy/f1 busy/g1; exit 5' 2>&1)
+STATUS=$?
+set -e
+if [ ! -s "$REPORT" ]; then
+    echo "  (profiling unavailable here - skipping: $OUTPUT)"
+    exit 0
+fi
+if [ "$(head -1 "$REPORT")" = "$(printf 'time_ms\topens\tstats\treads\twrites\trenames\tdirectory')" ]; then
+    pass "header line"
+else
+    fail "unexpected header: $(head -1 "$REPORT")"
+fi
+OPENS=$(column "$PROJECT/busy" 2)
+READS=$(column "$PROJECT/busy" 4)
+WRITES=$(column "$PROJECT/busy" 5)
+RENAMES=$(column "$PROJECT/busy" 6)
+if [ "${OPENS:-0}" -ge 10 ] && [ "${READS:-0}" -ge 5 ] && [ "${WRITES:-0}" -ge 10 ] &&
+   [ "${RENAMES:-0}" -eq 1 ]; then
+    pass "busy/: $OPENS opens, $READS reads, $WRITES writes, $RENAMES rename"
+else
+    fail "busy/ counted as: $(grep "$PROJECT/busy" "$REPORT")"
+fi
+STATS=$(column "$PROJECT" 3)
+if [ "${STATS:-0}" -ge 1 ] && ! grep -q "$PROJECT/quiet" "$REPORT"; then
+    pass "stat of quiet/ charged to its parent"
+else
+    fail "project counted as: $(grep "$PROJECT" "$REPORT")"
+fi
+
+echo "Test: the summary names the report and the exit status is kept"
+if echo "$OUTPUT" | grep -q "I/O profile: .* written to $REPORT" && [ $STATUS -eq 5 ]; then
+    pass "summary printed, exit status 5"
+else
+    fail "status $STATUS, output: $OUTPUT"
+fi
+
+echo
+echo "==================================="
+echo "Passed: $PASS, Failed: $FAIL"
+echo "==================================="
+[ $FAIL -eq 0 ]
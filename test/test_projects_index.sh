@@ -0,0 +1,108 @@
+#!/bin/bash
+# Test the index of per-directory configs and config inheritance
+# Launches must not build the index, and configs without the header line
+# that names their directory must still be inherited
+
+set -e
+
+echo "=== Projects Index Test ==="
+echo
+
+if [ "$(uname -s)" != "Linux" ]; then
+    echo "  (Linux only - skipping)"
+    exit 0
+fi
+
+# sandbash only runs from within $HOME
+WORK_DIR="$HOME/.sandbash_test_projects_index_$$"
+mkdir -p "$WORK_DIR/config" "$WORK_DIR/project/sub" "$WORK_DIR/shared"
+trap 'rm -rf "$WORK_DIR"' EXIT
+export XDG_CONFIG_HOME="$WORK_DIR/config"
+INDEX="$XDG_CONFIG_HOME/sandbash/projects.index"
+
+SANDBASH="$PWD/sandbash"
+PASS=0
+FAIL=0
+
+pass() {
+    echo "  ✓ PASS: $1"
+    PASS=$((PASS + 1))
+}
+
+fail() {
+    echo "  ✗ FAIL: $1"
+    FAIL=$((FAIL + 1))
+}
+
+# Try to write to the shared directory from the subdirectory, which only
+# works if the project's config is inherited
+inherits() {
+    rm -f "$WORK_DIR/shared/ok"
+    (cd "$WORK_DIR/project/sub" &&
+     timeout 20 "$SANDBASH" --no-cache -- bash -c "touch '$WORK_DIR/shared/ok'" >/dev/null 2>&1) || true
+    [ -e "$WORK_DIR/shared/ok" ]
+}
+
+echo "Test: --add-path builds the index"
+(cd "$WORK_DIR/project" && "$SANDBASH" --add-path "$WORK_DIR/shared" >/dev/null)
+CONFIG=$(grep -l "config for: $WORK_DIR/project$" "$XDG_CONFIG_HOME"/sandbash/projects/*)
+if [ -f "$INDEX" ] && "$SANDBASH" --list-projects 2>/dev/null | grep -qx "$WORK_DIR/project"; then
+    pass "index lists the project"
+else
+    fail "index missing or does not list the project"
+fi
+
+echo "Test: the subdirectory inherits the project's config"
+if inherits; then
+    pass "shared directory writable from the subdirectory"
+else
+    echo "  (sandbox could not run here - skipping launch tests)"
+    echo
+    echo "Passed: $PASS, Failed: $FAIL"
+    [ $FAIL -eq 0 ]
+    exit
+fi
+
+echo "Test: a launch does not build a missing index"
+rm -f "$INDEX"
+if inherits && [ ! -e "$INDEX" ]; then
+    pass "inherited through the ancestor walk, no index written"
+else
+    fail "launch without an index built one or lost the inherited config"
+fi
+
+echo "Test: a config without the header line is still inherited"
+sed -i '1d' "$CONFIG"
+OUTPUT=$("$SANDBASH" --reindex 2>&1)
+if echo "$OUTPUT" | grep -q "Warning: 1 config file does not name a directory"; then
+    pass "--reindex warns about it"
+else
+    fail "--reindex did not warn: $OUTPUT"
+fi
+if inherits; then
+    pass "headerless config applies with an index present"
+else
+    fail "headerless config was ignored"
+fi
+
+echo "Test: --add-path adds the missing header"
+mkdir -p "$WORK_DIR/more"
+(cd "$WORK_DIR/project" && "$SANDBASH" --add-path "$WORK_DIR/more" >/dev/null)
+OUTPUT=$("$SANDBASH" --list-projects 2>&1)
+if head -1 "$CONFIG" | grep -q "config for: $WORK_DIR/project$" &&
+   [ "$OUTPUT" = "$WORK_DIR/project" ]; then
+    pass "config migrated and listed without a warning"
+else
+    fail "config not migrated: $OUTPUT"
+fi
+if inherits; then
+    pass "migrated config is inherited"
+else
+    fail "migrated config was not inherited"
+fi
+
+echo
+echo "==================================="
+echo "Passed: $PASS, Failed: $FAIL"
+echo "==================================="
+[ $FAIL -eq 0 ]
@@ -0,0 +1,94 @@
+#!/bin/bash
+# Test --report resource accounting
+# The report must hold the command's real status and what its whole tree
+# cost, orphaned grandchildren included
+
+set -e
+
+echo "=== Run Report Test ==="
+echo
+
+if [ "$(uname -s)" != "Linux" ]; then
+    echo "  (Linux only - skipping)"
+    exit 0
+fi
+
+# sandbash only runs from within $HOME
+WORK_DIR="$HOME/.sandbash_test_report_$$"
+mkdir -p "$WORK_DIR/config" "$WORK_DIR/project"
+trap 'rm -rf "$WORK_DIR"' EXIT
+export XDG_CONFIG_HOME="$WORK_DIR/config"
+REPORT="$WORK_DIR/report.json"
+
+SANDBASH="$PWD/sandbash"
+cd "$WORK_DIR/project"
+PASS=0
+FAIL=0
+
+pass() {
+    echo "  ✓ PASS: $1"
+    PASS=$((PASS + 1))
+}
+
+fail() {
+    echo "  ✗ FAIL: $1"
+    FAIL=$((FAIL + 1))
+}
+
+# Numeric value of a field in the report
+field() {
+    sed -n "s/^ *\"$1\": *\([0-9.]*\),*$/\1/p" "$REPORT"
+}
+
+echo "Test: the report covers the command and its orphans"
+set +e
+# The orphan burns CPU after its parent has exited, and finishes before the
+# command does, so it is only counted if sandbash reaps it as a subreaper
+OUTPUT=$(timeout 30 "$SANDBASH" --report="$REPORT" -- bash -c '
+             (bash -c "end=\$((SECONDS + 2)); while [ \$SECONDS -lt \$end ]; do :; done" &)
+             head -c 5000000 /dev/zero > data; sleep 3; exit 6' 2>&1)
+STATUS=$?
+set -e
+if [ ! -s "$REPORT" ]; then
+    echo "  (sandbox could not run here - skipping: $OUTPUT)"
+    exit 0
+fi
+if [ $STATUS -eq 6 ] && [ "$(field exit_status)" = 6 ] && grep -q '"signal": null' "$REPORT"; then
+    pass "exit status 6 passed through and recorded"
+else
+    fail "status $STATUS, report: $(cat "$REPORT")"
+fi
+if grep -q '"command": \["bash", "-c", ' "$REPORT"; then
+    pass "command recorded"
+else
+    fail "command missing: $(cat "$REPORT")"
+fi
+CPU=$(field user_cpu_s)
+WALL=$(field wall_time_s)
+if awk -v cpu="${CPU:-0}" -v wall="${WALL:-0}" 'BEGIN { exit !(cpu >= 0.9 && wall >= 3) }'; then
+    pass "the orphan's CPU time counted (user ${CPU}s, wall ${WALL}s)"
+else
+    fail "user ${CPU}s, wall ${WALL}s: the orphan was missed"
+fi
+if [ "$(field write_chars)" -ge 5000000 ] 2>/dev/null; then
+    pass "$(field write_chars) bytes written counted"
+else
+    fail "write_chars: $(field write_chars)"
+fi
+
+echo "Test: a command killed by a signal"
+set +e
+timeout 30 "$SANDBASH" --report="$REPORT" -- bash -c 'kill -TERM $$' >/dev/null 2>&1
+STATUS=$?
+set -e
+if grep -q '"signal": 15' "$REPORT" && [ $STATUS -eq 143 ]; then
+    pass "signal 15 recorded, exit status 143"
+else
+    fail "status $STATUS, report: $(cat "$REPORT")"
+fi
+
+echo
+echo "==================================="
+echo "Passed: $PASS, Failed: $FAIL"
+echo "==================================="
+[ $FAIL -eq 0 ]
@@ -0,0 +1,141 @@
+#!/bin/bash
+# Test that a path that hangs while resolving is skipped after the timeout
+# A preloaded shim makes realpath() hang for paths containing "hang" and
+# reports a FUSE mount, so the paths are resolved in the helper process
+
+set -e
+
+echo "=== Resolve Timeout Test ==="
+echo
+
+if [ "$(uname -s)" != "Linux" ]; then
+    echo "  (Linux only - skipping)"
+    exit 0
+fi
+
+# sandbash only runs from within $HOME
+WORK_DIR="$HOME/.sandbash_test_resolve_timeout_$$"
+mkdir -p "$WORK_DIR/config" "$WORK_DIR/project" "$WORK_DIR/hang" "$WORK_DIR/ok"
+trap 'rm -rf "$WORK_DIR"' EXIT
+export XDG_CONFIG_HOME="$WORK_DIR/config"
+
+SANDBASH="$PWD/sandbash"
+PASS=0
+FAIL=0
+
+pass() {
+    echo "  ✓ PASS: $1"
+    PASS=$((PASS + 1))
+}
+
+fail() {
+    echo "  ✗ FAIL: $1"
+    FAIL=$((FAIL + 1))
+}
+
+cat > "$WORK_DIR/shim.c" << 'EOF'
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <mntent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+char* realpath(const char* path, char* resolved) {
+    static char* (*next)(const char*, char*);
+    if (!next) {
+        next = (char* (*)(const char*, char*))dlsym(RTLD_NEXT, "realpath");
+    }
+    while (strstr(path, "hang")) {
+        pause();
+    }
+    return next(path, resolved);
+}
+
+struct mntent* getmntent(FILE* stream) {
+    static struct mntent* (*next)(FILE*);
+    static struct mntent fuse = { "test", "/mnt/test", "fuse.test", "rw", 0, 0 };
+    static int reported;
+    if (!next) {
+        next = (struct mntent* (*)(FILE*))dlsym(RTLD_NEXT, "getmntent");
+    }
+    struct mntent* entry = next(stream);
+    if (!entry && !reported) {
+        reported = 1;
+        return &fuse;
+    }
+    return entry;
+}
+EOF
+if ! ${CC:-cc} -shared -fPIC -o "$WORK_DIR/shim.so" "$WORK_DIR/shim.c" -ldl 2>/dev/null; then
+    echo "  (could not build the shim - skipping)"
+    exit 0
+fi
+
+echo "Test: a hung config entry is skipped and the others still apply"
+(cd "$WORK_DIR/project" &&
+ "$SANDBASH" --add-path "$WORK_DIR/hang" >/dev/null &&
+ "$SANDBASH" --add-path "$WORK_DIR/ok" >/dev/null)
+START=$(date +%s%N)
+set +e
+# The children of the command's shell, read with builtins before it runs
+# anything, so a helper left unreaped by sandbash would be the only one and
+# the shell has not reaped it yet
+OUTPUT=$(cd "$WORK_DIR/project" &&
+         LD_PRELOAD="$WORK_DIR/shim.so" timeout 20 "$SANDBASH" --no-cache \
+             --resolve-timeout=300ms -- \
+             bash -c "read -r c < /proc/\$\$/task/\$\$/children; echo \"children=[\$c]\"; touch '$WORK_DIR/ok/written'" \
+             2>&1)
+STATUS=$?
+set -e
+ELAPSED_MS=$((($(date +%s%N) - START) / 1000000))
+
+if [ $STATUS -eq 124 ]; then
+    fail "launch hung on the entry"
+elif echo "$OUTPUT" | grep -q "Warning: Timed out resolving path on line [0-9]*: $WORK_DIR/hang"; then
+    pass "timed-out entry reported (${ELAPSED_MS}ms)"
+else
+    fail "no timeout warning: $OUTPUT"
+fi
+if [ -e "$WORK_DIR/ok/written" ]; then
+    pass "the entry that resolved is writable"
+elif echo "$OUTPUT" | grep -q "Timed out"; then
+    echo "  (sandbox could not run here - skipping: $OUTPUT)"
+else
+    fail "the entry that resolved is not writable"
+fi
+if echo "$OUTPUT" | grep -q "children=\[\]"; then
+    pass "no helper left as a child of the command"
+elif echo "$OUTPUT" | grep -q "children="; then
+    fail "the command inherited a child: $(echo "$OUTPUT" | grep children=)"
+fi
+
+echo "Test: --list-paths skips the hung entry"
+set +e
+OUTPUT=$(cd "$WORK_DIR/project" &&
+         LD_PRELOAD="$WORK_DIR/shim.so" timeout 20 "$SANDBASH" --no-cache \
+             --resolve-timeout=300ms --list-paths 2>&1)
+set -e
+if echo "$OUTPUT" | grep -q "Timed out resolving path on line [0-9]*: $WORK_DIR/hang" &&
+   echo "$OUTPUT" | grep -qx "  $WORK_DIR/ok"; then
+    pass "--list-paths reports the hung entry and lists the rest"
+else
+    fail "unexpected --list-paths output: $OUTPUT"
+fi
+
+echo "Test: --resolve-timeout=0 resolves without the helper"
+set +e
+OUTPUT=$(cd "$WORK_DIR/project" &&
+         timeout 20 "$SANDBASH" --no-cache --resolve-timeout=0 --list-paths 2>&1)
+set -e
+if echo "$OUTPUT" | grep -qx "  $WORK_DIR/hang" && echo "$OUTPUT" | grep -qx "  $WORK_DIR/ok"; then
+    pass "both entries listed"
+else
+    fail "unexpected --list-paths output: $OUTPUT"
+fi
+
+echo
+echo "==================================="
+echo "Passed: $PASS, Failed: $FAIL"
+echo "==================================="
+[ $FAIL -eq 0 ]
@@ -0,0 +1,101 @@
+#!/bin/bash
+# Test resource limits and scheduling presets
+# The limits must reach the command, through its cgroup where one can be
+# created and through setrlimit otherwise
+
+set -e
+
+echo "=== Resource Limits Test ==="
+echo
+
+if [ "$(uname -s)" != "Linux" ]; then
+    echo "  (Linux only - skipping)"
+    exit 0
+fi
+
+# sandbash only runs from within $HOME
+WORK_DIR="$HOME/.sandbash_test_resource_limits_$$"
+mkdir -p "$WORK_DIR/config" "$WORK_DIR/project"
+trap 'rm -rf "$WORK_DIR"' EXIT
+export XDG_CONFIG_HOME="$WORK_DIR/config"
+
+SANDBASH="$PWD/sandbash"
+cd "$WORK_DIR/project"
+PASS=0
+FAIL=0
+
+pass() {
+    echo "  ✓ PASS: $1"
+    PASS=$((PASS + 1))
+}
+
+fail() {
+    echo "  ✗ FAIL: $1"
+    FAIL=$((FAIL + 1))
+}
+
+echo "Test: memory and process limits reach the command"
+set +e
+OUTPUT=$(timeout 30 "$SANDBASH" --memory-max=512M --pids-max=64 -- bash -c '
+             cgroup=$(sed -n "s/^0:://p" /proc/self/cgroup)
+             case "$cgroup" in
+                 */sandbash-*)
+                     root=$(awk "\$3 == \"cgroup2\" { print \$2; exit }" /proc/mounts)
+                     echo "cgroup memory=$(cat "$root$cgroup/memory.max") pids=$(cat "$root$cgroup/pids.max")" ;;
+                 *)
+                     echo "rlimit memory=$(ulimit -v) pids=$(ulimit -u)" ;;
+             esac' 2>&1)
+STATUS=$?
+set -e
+if [ $STATUS -ne 0 ]; then
+    echo "  (sandbox could not run here - skipping: $OUTPUT)"
+    exit 0
+fi
+if echo "$OUTPUT" | grep -q "^cgroup memory=536870912 pids=64$"; then
+    pass "set on the command's cgroup leaf"
+elif echo "$OUTPUT" | grep -q "^rlimit memory=524288 pids=64$" &&
+     echo "$OUTPUT" | grep -q "falling back to setrlimit"; then
+    pass "cgroup unavailable, set with setrlimit after a warning"
+else
+    fail "limits not applied: $OUTPUT"
+fi
+
+echo "Test: a memory limit stops an allocation beyond it"
+set +e
+timeout 30 "$SANDBASH" --memory-max=64M -- \
+    bash -c 'x=$(head -c 200000000 /dev/zero | tr "\0" x); echo ${#x}' >/dev/null 2>&1
+STATUS=$?
+set -e
+if [ $STATUS -ne 0 ] && [ $STATUS -ne 124 ]; then
+    pass "allocation of about 200M failed (exit status $STATUS)"
+else
+    fail "allocation beyond the limit succeeded or hung (exit status $STATUS)"
+fi
+
+echo "Test: --priority=background lowers the CPU and I/O priority"
+OUTPUT=$(timeout 30 "$SANDBASH" --priority=background -- \
+             bash -c 'echo "nice=$(nice)"; ionice -p $$' 2>&1 || true)
+if echo "$OUTPUT" | grep -q "^nice=10$"; then
+    pass "nice 10"
+else
+    fail "unexpected niceness: $OUTPUT"
+fi
+if ! command -v ionice >/dev/null || echo "$OUTPUT" | grep -q "best-effort: prio 7"; then
+    pass "lowest best-effort I/O priority"
+else
+    fail "unexpected I/O priority: $OUTPUT"
+fi
+
+echo "Test: invalid limits are refused"
+if ! "$SANDBASH" --memory-max=lots -- true >/dev/null 2>&1 &&
+   ! "$SANDBASH" --io-weight=0 -- true >/dev/null 2>&1; then
+    pass "bad size and out-of-range weight rejected"
+else
+    fail "an invalid limit was accepted"
+fi
+
+echo
+echo "==================================="
+echo "Passed: $PASS, Failed: $FAIL"
+echo "==================================="
+[ $FAIL -eq 0 ]
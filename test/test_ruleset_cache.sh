@@ -0,0 +1,98 @@
+#!/bin/bash
+# Test the cache of resolved writable path sets
+# A cached set must be dropped once a config it was built from changes,
+# or a path added by hand would stay read-only until --no-cache
+
+set -e
+
+echo "=== Ruleset Cache Test ==="
+echo
+
+if [ "$(uname -s)" != "Linux" ]; then
+    echo "  (Linux only - skipping)"
+    exit 0
+fi
+
+# sandbash only runs from within $HOME
+WORK_DIR="$HOME/.sandbash_test_ruleset_cache_$$"
+mkdir -p "$WORK_DIR/config/sandbash" "$WORK_DIR/project/sub" "$WORK_DIR/first" \
+         "$WORK_DIR/second" "$WORK_DIR/inherited"
+trap 'rm -rf "$WORK_DIR"' EXIT
+export XDG_CONFIG_HOME="$WORK_DIR/config"
+RULESETS="$XDG_CONFIG_HOME/sandbash/rulesets"
+
+SANDBASH="$PWD/sandbash"
+PASS=0
+FAIL=0
+
+pass() {
+    echo "  ✓ PASS: $1"
+    PASS=$((PASS + 1))
+}
+
+fail() {
+    echo "  ✗ FAIL: $1"
+    FAIL=$((FAIL + 1))
+}
+
+# Try to create a file in a directory from within the sandbox
+can_write() {
+    rm -f "$1/ok"
+    (cd "$WORK_DIR/project/sub" &&
+     timeout 20 "$SANDBASH" -- bash -c "touch '$1/ok'" >/dev/null 2>&1) || true
+    [ -e "$1/ok" ]
+}
+
+echo "$WORK_DIR/first" > "$XDG_CONFIG_HOME/sandbash/config"
+
+echo "Test: a launch stores the resolved set"
+if ! can_write "$WORK_DIR/first"; then
+    echo "  (sandbox could not run here - skipping)"
+    exit 0
+fi
+if [ -n "$(ls -A "$RULESETS" 2>/dev/null)" ]; then
+    pass "cache entry written to $RULESETS"
+else
+    fail "no cache entry written"
+fi
+
+echo "Test: a path added to the global config by hand is picked up"
+echo "$WORK_DIR/second" >> "$XDG_CONFIG_HOME/sandbash/config"
+if can_write "$WORK_DIR/second"; then
+    pass "the new path is writable on the next launch"
+else
+    fail "the cached set was used after the config changed"
+fi
+
+echo "Test: a path removed from the global config is dropped"
+echo "$WORK_DIR/second" > "$XDG_CONFIG_HOME/sandbash/config"
+if ! can_write "$WORK_DIR/first"; then
+    pass "the removed path is read-only again"
+else
+    fail "the removed path stayed writable"
+fi
+
+echo "Test: a new config in a parent directory is picked up"
+(cd "$WORK_DIR/project" && "$SANDBASH" --add-path "$WORK_DIR/inherited" >/dev/null)
+if can_write "$WORK_DIR/inherited"; then
+    pass "the parent's path is writable in the subdirectory"
+else
+    fail "the cached set hid the parent's new config"
+fi
+
+echo "Test: --allow-write arguments are part of the key"
+rm -f "$WORK_DIR/first/ok"
+(cd "$WORK_DIR/project/sub" &&
+ timeout 20 "$SANDBASH" --allow-write="$WORK_DIR/first" -- \
+     bash -c "touch '$WORK_DIR/first/ok'" >/dev/null 2>&1) || true
+if [ -e "$WORK_DIR/first/ok" ] && ! can_write "$WORK_DIR/first"; then
+    pass "the path is only writable with the argument"
+else
+    fail "a cached set leaked between argument lists"
+fi
+
+echo
+echo "==================================="
+echo "Passed: $PASS, Failed: $FAIL"
+echo "==================================="
+[ $FAIL -eq 0 ]
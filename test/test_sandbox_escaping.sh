@@ -37,10 +37,20 @@ int main(int argc, char* argv[]) {
 }
 EOF
 
-# Try to compile and link with sandbox.o
+# Link against the library, which has every object sandbox.o depends on
 echo "Compiling test helper..."
-if ! clang -o test_escape_helper test_escape_helper.c src/sandbox.o src/config.o src/utils.o -framework Security -framework CoreFoundation 2>&1 | grep -v "Undefined symbols"; then
-    echo "✗ EXPECTED FAILURE: escape_sandbox_string() function doesn't exist yet"
+if [ ! -f libsandbash.a ] && ! make -s libsandbash.a; then
+    echo "✗ FAIL: could not build libsandbash.a"
+    rm -f test_escape_helper.c
+    exit 1
+fi
+if [ "$(uname -s)" = "Darwin" ]; then
+    LINK_FLAGS="-framework Security -framework CoreFoundation"
+else
+    LINK_FLAGS="-pthread"
+fi
+if ! ${CC:-cc} -o test_escape_helper test_escape_helper.c libsandbash.a $LINK_FLAGS; then
+    echo "✗ FAIL: test helper did not link"
     echo
     rm -f test_escape_helper test_escape_helper.c
     exit 1
@@ -57,13 +67,13 @@ ACTUAL=$(./test_escape_helper "$INPUT")
 
 if [ "$ACTUAL" = "$EXPECTED" ]; then
     echo "  ✓ PASS: Double quote escaped correctly"
-    ((PASS++))
+    PASS=$((PASS + 1))
 else
     echo "  ✗ FAIL: Double quote not escaped"
     echo "    Input:    $INPUT"
     echo "    Expected: $EXPECTED"
     echo "    Actual:   $ACTUAL"
-    ((FAIL++))
+    FAIL=$((FAIL + 1))
 fi
 echo
 
@@ -75,13 +85,13 @@ ACTUAL=$(./test_escape_helper "$INPUT")
 
 if [ "$ACTUAL" = "$EXPECTED" ]; then
     echo "  ✓ PASS: Backslash escaped correctly"
-    ((PASS++))
+    PASS=$((PASS + 1))
 else
     echo "  ✗ FAIL: Backslash not escaped"
     echo "    Input:    $INPUT"
     echo "    Expected: $EXPECTED"
     echo "    Actual:   $ACTUAL"
-    ((FAIL++))
+    FAIL=$((FAIL + 1))
 fi
 echo
 
@@ -93,13 +103,13 @@ ACTUAL=$(./test_escape_helper "$INPUT")
 
 if [ "$ACTUAL" = "$EXPECTED" ]; then
     echo "  ✓ PASS: Both characters escaped correctly"
-    ((PASS++))
+    PASS=$((PASS + 1))
 else
     echo "  ✗ FAIL: Not all characters escaped"
     echo "    Input:    $INPUT"
     echo "    Expected: $EXPECTED"
     echo "    Actual:   $ACTUAL"
-    ((FAIL++))
+    FAIL=$((FAIL + 1))
 fi
 echo
 
@@ -111,13 +121,13 @@ ACTUAL=$(./test_escape_helper "$INPUT")
 
 if [ "$ACTUAL" = "$EXPECTED" ]; then
     echo "  ✓ PASS: Normal path unchanged"
-    ((PASS++))
+    PASS=$((PASS + 1))
 else
     echo "  ✗ FAIL: Normal path was modified"
     echo "    Input:    $INPUT"
     echo "    Expected: $EXPECTED"
     echo "    Actual:   $ACTUAL"
-    ((FAIL++))
+    FAIL=$((FAIL + 1))
 fi
 echo
 
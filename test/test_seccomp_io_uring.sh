@@ -0,0 +1,110 @@
+#!/bin/bash
+# Test that io_uring cannot bypass the seccomp backend
+# Opens submitted through io_uring run in the kernel and never reach the
+# supervisor, so the filter must refuse io_uring altogether
+
+set -e
+
+echo "=== Seccomp io_uring Test ==="
+echo
+
+if [ "$(uname -s)" != "Linux" ]; then
+    echo "  (Linux only - skipping)"
+    exit 0
+fi
+
+# sandbash only runs from within $HOME
+WORK_DIR="$HOME/.sandbash_test_io_uring_$$"
+OUTSIDE_DIR="/tmp/sandbash_test_io_uring_$$"
+TARGET="$OUTSIDE_DIR/created"
+mkdir -p "$WORK_DIR" "$OUTSIDE_DIR"
+trap 'rm -rf "$WORK_DIR" "$OUTSIDE_DIR"' EXIT
+
+# Creates argv[1] with IORING_OP_OPENAT; exits 2 if io_uring is refused
+cat > "$WORK_DIR/uring_open.c" <<'EOF'
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        return 1;
+    }
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ring = (int)syscall(__NR_io_uring_setup, 1, &params);
+    if (ring < 0) {
+        printf("io_uring_setup: %s\n", strerror(errno));
+        return 2;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    char* sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring,
+                    IORING_OFF_SQ_RING);
+    char* cq = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring,
+                    IORING_OFF_CQ_RING);
+    struct io_uring_sqe* sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe),
+                                     PROT_READ | PROT_WRITE, MAP_SHARED, ring,
+                                     IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+        return 1;
+    }
+
+    memset(&sqes[0], 0, sizeof(sqes[0]));
+    sqes[0].opcode = IORING_OP_OPENAT;
+    sqes[0].fd = AT_FDCWD;
+    sqes[0].addr = (unsigned long)argv[1];
+    sqes[0].open_flags = O_WRONLY | O_CREAT;
+    sqes[0].len = 0644;
+    unsigned* tail = (unsigned*)(sq + params.sq_off.tail);
+    unsigned* array = (unsigned*)(sq + params.sq_off.array);
+    array[*tail & *(unsigned*)(sq + params.sq_off.ring_mask)] = 0;
+    __atomic_store_n(tail, *tail + 1, __ATOMIC_RELEASE);
+
+    if (syscall(__NR_io_uring_enter, ring, 1, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+        printf("io_uring_enter: %s\n", strerror(errno));
+        return 2;
+    }
+    struct io_uring_cqe* cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    printf("openat result: %d\n", cqes[0].res);
+    return 0;
+}
+EOF
+
+if ! cc -o "$WORK_DIR/uring_open" "$WORK_DIR/uring_open.c"; then
+    echo "  (io_uring headers not available - skipping)"
+    exit 0
+fi
+
+cd "$WORK_DIR"
+SANDBASH="$OLDPWD/sandbash"
+
+echo "Test: io_uring openat outside the writable paths"
+set +e
+OUTPUT=$(timeout 10 "$SANDBASH" --backend=seccomp --no-cache -- ./uring_open "$TARGET" 2>&1)
+STATUS=$?
+set -e
+echo "  $OUTPUT"
+
+if [ -e "$TARGET" ]; then
+    echo "  ✗ FAIL: io_uring created $TARGET outside the sandbox"
+    exit 1
+fi
+if [ $STATUS -ne 2 ]; then
+    echo "  ✗ FAIL: io_uring was not refused (exit status $STATUS)"
+    exit 1
+fi
+echo "  ✓ PASS: io_uring refused, nothing created"
+
+echo
+echo "==================================="
+echo "io_uring test passed"
+echo "==================================="
+exit 0
@@ -0,0 +1,126 @@
+#!/bin/bash
+# Test supervised sandboxes: --supervise, --timeout, --session and
+# --kill-sandbox
+# Nothing the command starts may outlive the sandbox
+
+set -e
+
+echo "=== Supervise Test ==="
+echo
+
+if [ "$(uname -s)" != "Linux" ]; then
+    echo "  (Linux only - skipping)"
+    exit 0
+fi
+
+# sandbash only runs from within $HOME
+WORK_DIR="$HOME/.sandbash_test_supervise_$$"
+RUNTIME_DIR=$(mktemp -d)
+mkdir -p "$WORK_DIR/config" "$WORK_DIR/project"
+trap 'rm -rf "$WORK_DIR" "$RUNTIME_DIR"' EXIT
+export XDG_CONFIG_HOME="$WORK_DIR/config"
+export XDG_RUNTIME_DIR="$RUNTIME_DIR"
+
+SANDBASH="$PWD/sandbash"
+cd "$WORK_DIR/project"
+PASS=0
+FAIL=0
+
+pass() {
+    echo "  ✓ PASS: $1"
+    PASS=$((PASS + 1))
+}
+
+fail() {
+    echo "  ✗ FAIL: $1"
+    FAIL=$((FAIL + 1))
+}
+
+# Whether the process whose pid is in a file is still running
+alive() {
+    [ -s "$1" ] && kill -0 "$(cat "$1")" 2>/dev/null
+}
+
+echo "Test: processes left running are terminated with the command"
+set +e
+OUTPUT=$(timeout 30 "$SANDBASH" --supervise -- \
+             bash -c 'sleep 60 & echo $! > left.pid; exit 3' 2>&1)
+STATUS=$?
+set -e
+if [ ! -s left.pid ]; then
+    echo "  (sandbox could not run here - skipping: $OUTPUT)"
+    exit 0
+fi
+sleep 0.2
+if ! alive left.pid && [ $STATUS -eq 3 ]; then
+    pass "background process gone, exit status 3"
+else
+    fail "status $STATUS, background process alive: $(alive left.pid && echo yes || echo no)"
+    kill "$(cat left.pid)" 2>/dev/null || true
+fi
+
+echo "Test: --timeout terminates the whole tree"
+START=$(date +%s)
+set +e
+timeout 30 "$SANDBASH" --timeout=1s --kill-after=1s -- \
+    bash -c '(sleep 60 & echo $! > orphan.pid) ; sleep 60' >/dev/null 2>&1
+STATUS=$?
+set -e
+ELAPSED=$(($(date +%s) - START))
+sleep 0.2
+if [ $STATUS -eq 124 ] && [ $ELAPSED -lt 10 ]; then
+    pass "exit status 124 after ${ELAPSED}s"
+else
+    fail "exit status $STATUS after ${ELAPSED}s"
+fi
+if ! alive orphan.pid; then
+    pass "orphaned grandchild terminated"
+else
+    fail "orphaned grandchild outlived the timeout"
+    kill "$(cat orphan.pid)" 2>/dev/null || true
+fi
+
+echo "Test: a process ignoring SIGTERM gets SIGKILL"
+set +e
+timeout 30 "$SANDBASH" --timeout=500ms --kill-after=500ms -- \
+    bash -c 'trap "" TERM; while :; do sleep 0.1; done' >/dev/null 2>&1
+STATUS=$?
+set -e
+if [ $STATUS -eq 137 ]; then
+    pass "exit status 137"
+else
+    fail "exit status $STATUS"
+fi
+
+echo "Test: --kill-sandbox ends a named session"
+timeout 30 "$SANDBASH" --session=test-$$ -- bash -c 'sleep 60' >/dev/null 2>&1 &
+RUN_PID=$!
+LISTED=no
+for _ in $(seq 50); do
+    if "$SANDBASH" --list-sandboxes 2>/dev/null | grep -q "test-$$"; then
+        LISTED=yes
+        break
+    fi
+    sleep 0.1
+done
+if [ $LISTED = yes ]; then
+    pass "session listed by --list-sandboxes"
+else
+    fail "session not listed"
+fi
+"$SANDBASH" --kill-sandbox "test-$$" >/dev/null 2>&1 || true
+set +e
+wait $RUN_PID
+STATUS=$?
+set -e
+if [ $STATUS -ne 124 ] && ! "$SANDBASH" --list-sandboxes 2>/dev/null | grep -q "test-$$"; then
+    pass "session ended (exit status $STATUS) and unregistered"
+else
+    fail "session still running or registered (exit status $STATUS)"
+fi
+
+echo
+echo "==================================="
+echo "Passed: $PASS, Failed: $FAIL"
+echo "==================================="
+[ $FAIL -eq 0 ]